@@ -0,0 +1,403 @@
+// Offline packer: bakes .obj models, their textures and a skybox into one asset bundle
+// that the app loads with --bundle. Run it from the app folder so the asset names match
+// the paths the app uses, e.g.
+//
+//   AssetPacker models/scene.gpsbundle models/base-scene/base_scene.obj models/ghost/ghost.obj
+//       --skybox models/skybox/nightsky models/skybox/nightsky_rt.tga models/skybox/nightsky_lf.tga
+//       models/skybox/nightsky_up.tga models/skybox/nightsky_dn.tga models/skybox/nightsky_bk.tga
+//       models/skybox/nightsky_ft.tga
+//
+// With --dds it instead writes a block compressed <image>.dds next to each image, which the app
+// uploads in place of the image (auto picks BC1 for opaque images and BC3 otherwise), e.g.
+//
+//   AssetPacker --dds auto models/base-scene/wood_dark.jpg models/base-scene/clouds.jpg
+
+#include "AssetBundle.hpp"
+#include "BlockCompressor.hpp"
+#include "DdsFile.hpp"
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+static bool mipmapsEnabled = true;
+
+static float SrgbToLinear(unsigned char value)
+{
+    float c = value / 255.0f;
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static unsigned char LinearToSrgb(float value)
+{
+    float c = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+    c = c < 0.0f ? 0.0f : (c > 1.0f ? 1.0f : c);
+    return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+// Builds levelCount mip levels of one face, level 0 included. Color channels are averaged in linear
+// space like glGenerateMipmap does for GL_SRGB textures, alpha is averaged as is.
+static void BuildMipChain(const unsigned char* pixels, int width, int height, int channels, int levelCount,
+    std::vector<std::vector<unsigned char> >& levels)
+{
+    static float srgbToLinear[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (int i = 0; i < 256; i++) {
+            srgbToLinear[i] = SrgbToLinear((unsigned char)i);
+        }
+        tableReady = true;
+    }
+
+    levels.assign(levelCount, std::vector<unsigned char>());
+    std::vector<float> level((size_t)width * height * channels);
+    for (size_t i = 0; i < level.size(); i++) {
+        level[i] = channels == 4 && i % 4 == 3 ? pixels[i] / 255.0f : srgbToLinear[pixels[i]];
+    }
+
+    for (int l = 0; l < levelCount; l++) {
+        if (l > 0) {
+            // 2x2 box filter, the last row/column is repeated for odd sizes
+            int nextWidth = width > 1 ? width / 2 : 1;
+            int nextHeight = height > 1 ? height / 2 : 1;
+            std::vector<float> next((size_t)nextWidth * nextHeight * channels);
+            for (int y = 0; y < nextHeight; y++) {
+                int y0 = std::min(y * 2, height - 1);
+                int y1 = std::min(y * 2 + 1, height - 1);
+                for (int x = 0; x < nextWidth; x++) {
+                    int x0 = std::min(x * 2, width - 1);
+                    int x1 = std::min(x * 2 + 1, width - 1);
+                    for (int c = 0; c < channels; c++) {
+                        next[((size_t)y * nextWidth + x) * channels + c] = 0.25f * (
+                            level[((size_t)y0 * width + x0) * channels + c] + level[((size_t)y0 * width + x1) * channels + c] +
+                            level[((size_t)y1 * width + x0) * channels + c] + level[((size_t)y1 * width + x1) * channels + c]);
+                    }
+                }
+            }
+            level.swap(next);
+            width = nextWidth;
+            height = nextHeight;
+        }
+
+        levels[l].resize(level.size());
+        for (size_t i = 0; i < level.size(); i++) {
+            levels[l][i] = channels == 4 && i % 4 == 3 ?
+                (unsigned char)(std::min(std::max(level[i], 0.0f), 1.0f) * 255.0f + 0.5f) : LinearToSrgb(level[i]);
+        }
+    }
+}
+
+// Appends the mip chain of one face to payload
+static void AppendMipChain(const unsigned char* pixels, const gps::TextureAssetHeader& texture, std::vector<unsigned char>& payload)
+{
+    std::vector<std::vector<unsigned char> > levels;
+    BuildMipChain(pixels, (int)texture.width, (int)texture.height, (int)texture.channels, (int)texture.levelCount, levels);
+    for (uint32_t l = 0; l < texture.levelCount; l++) {
+        size_t start = payload.size();
+        payload.resize(start + gps::AssetBundle::GetTextureLevelSize(texture, l), 0);
+        memcpy(&payload[start], &levels[l][0], levels[l].size());
+    }
+}
+
+static void InitTextureHeader(gps::TextureAssetHeader& texture, int width, int height, int channels, int faceCount, bool mipmaps)
+{
+    memset(&texture, 0, sizeof(texture));
+    texture.width = (uint32_t)width;
+    texture.height = (uint32_t)height;
+    texture.channels = (uint32_t)channels;
+    texture.faceCount = (uint32_t)faceCount;
+    texture.levelCount = 1;
+    if (mipmaps) {
+        int size = std::max(width, height);
+        while (size > 1) {
+            size /= 2;
+            texture.levelCount++;
+        }
+    }
+}
+
+// Decodes a material texture the way TextureManager::ReadTextureFromFile does: RGBA, flipped vertically
+static unsigned char* LoadTexture(const std::string& path, int& width, int& height)
+{
+    int n;
+    unsigned char* image = stbi_load(path.c_str(), &width, &height, &n, 4);
+    if (!image) {
+        fprintf(stderr, "ERROR: could not load %s\n", path.c_str());
+        return NULL;
+    }
+
+    size_t rowBytes = (size_t)width * 4;
+    std::vector<unsigned char> row(rowBytes);
+    for (int y = 0; y < height / 2; y++) {
+        unsigned char* top = image + y * rowBytes;
+        unsigned char* bottom = image + (height - y - 1) * rowBytes;
+        memcpy(&row[0], top, rowBytes);
+        memcpy(top, bottom, rowBytes);
+        memcpy(bottom, &row[0], rowBytes);
+    }
+    return image;
+}
+
+static bool PackTexture(gps::AssetBundleWriter& writer, const std::string& path)
+{
+    int width, height;
+    unsigned char* image = LoadTexture(path, width, height);
+    if (!image) {
+        return false;
+    }
+
+    gps::TextureAssetHeader texture;
+    InitTextureHeader(texture, width, height, 4, 1, mipmapsEnabled);
+    std::vector<unsigned char> payload((const unsigned char*)&texture, (const unsigned char*)(&texture + 1));
+    AppendMipChain(image, texture, payload);
+    stbi_image_free(image);
+
+    std::cout << "  texture  " << path << " (" << width << "x" << height << ", " << texture.levelCount << " levels)" << std::endl;
+    return writer.Add(path, gps::ASSET_TEXTURE, payload);
+}
+
+// Decodes the six faces the way SkyBox::LoadSkyBoxTextures does: RGB, not flipped
+static bool PackSkyBox(gps::AssetBundleWriter& writer, const std::string& name, const std::vector<std::string>& faces)
+{
+    gps::TextureAssetHeader texture;
+    std::vector<unsigned char> payload;
+    for (size_t i = 0; i < faces.size(); i++) {
+        int width, height, n;
+        unsigned char* image = stbi_load(faces[i].c_str(), &width, &height, &n, 3);
+        if (!image) {
+            fprintf(stderr, "ERROR: could not load %s\n", faces[i].c_str());
+            return false;
+        }
+
+        if (i == 0) {
+            InitTextureHeader(texture, width, height, 3, (int)faces.size(), false);
+            payload.assign((const unsigned char*)&texture, (const unsigned char*)(&texture + 1));
+        }
+        else if ((uint32_t)width != texture.width || (uint32_t)height != texture.height) {
+            fprintf(stderr, "ERROR: skybox face %s is not %ux%u\n", faces[i].c_str(), texture.width, texture.height);
+            stbi_image_free(image);
+            return false;
+        }
+
+        size_t start = payload.size();
+        payload.resize(start + gps::AssetBundle::GetTextureLevelSize(texture, 0), 0);
+        memcpy(&payload[start], image, (size_t)width * height * 3);
+        stbi_image_free(image);
+    }
+
+    std::cout << "  skybox   " << name << " (" << texture.width << "x" << texture.height << ")" << std::endl;
+    return writer.Add(name, gps::ASSET_CUBE_MAP, payload);
+}
+
+static bool PackModel(gps::AssetBundleWriter& writer, const std::string& fileName, std::set<std::string>& packedTextures)
+{
+    std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+
+    std::vector<gps::MeshData> meshData;
+    if (!gps::Model3D::ReadMeshData(fileName, basePath, meshData)) {
+        return false;
+    }
+    gps::Model3D::ProcessMeshData(meshData);
+
+    std::vector<unsigned char> payload;
+    gps::MeshCache::Serialize(meshData, gps::Model3D::GetMeshCacheFlags(), payload);
+    std::cout << "  meshes   " << fileName << " (" << meshData.size() << " meshes, " << payload.size() / 1024 << " KB)" << std::endl;
+    if (!writer.Add(fileName, gps::ASSET_MESHES, payload)) {
+        return false;
+    }
+
+    // same paths as Model3D::LoadMaterialTextures
+    for (size_t s = 0; s < meshData.size(); s++) {
+        const std::string* names[3] = { &meshData[s].ambientTexture, &meshData[s].diffuseTexture, &meshData[s].specularTexture };
+        for (int slot = 0; slot < 3; slot++) {
+            std::string path = basePath + *names[slot];
+            if (names[slot]->empty() || !packedTextures.insert(path).second) {
+                continue;
+            }
+            if (!PackTexture(writer, path)) {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+static double ComputePsnr(const unsigned char* a, const unsigned char* b, size_t size)
+{
+    double error = 0.0;
+    for (size_t i = 0; i < size; i++) {
+        double d = (double)a[i] - (double)b[i];
+        error += d * d;
+    }
+    return error > 0.0 ? 10.0 * std::log10(255.0 * 255.0 * size / error) : 99.0;
+}
+
+// Compresses the image and its mip chain into <image>.dds. rawBytes/compressedBytes are the video
+// memory the texture takes as RGBA8 and block compressed, both with mipmaps.
+static bool CompressTexture(const std::string& path, const std::string& formatName, size_t& rawBytes, size_t& compressedBytes)
+{
+    int width, height;
+    unsigned char* image = LoadTexture(path, width, height);
+    if (!image) {
+        return false;
+    }
+
+    gps::BlockFormat format;
+    if (formatName == "bc1") {
+        format = gps::BLOCK_FORMAT_BC1;
+    }
+    else if (formatName == "bc3") {
+        format = gps::BLOCK_FORMAT_BC3;
+    }
+    else if (formatName == "bc7") {
+        format = gps::BLOCK_FORMAT_BC7;
+    }
+    else {
+        format = gps::BlockCompressor::HasAlpha(image, width, height) ? gps::BLOCK_FORMAT_BC3 : gps::BLOCK_FORMAT_BC1;
+    }
+
+    gps::TextureAssetHeader texture;
+    InitTextureHeader(texture, width, height, 4, 1, mipmapsEnabled);
+    std::vector<std::vector<unsigned char> > levels;
+    BuildMipChain(image, width, height, 4, (int)texture.levelCount, levels);
+    stbi_image_free(image);
+
+    std::vector<std::vector<unsigned char> > blocks(levels.size());
+    size_t levelRawBytes = 0;
+    size_t levelCompressedBytes = 0;
+    for (size_t l = 0; l < levels.size(); l++) {
+        int levelWidth = std::max(width >> l, 1);
+        int levelHeight = std::max(height >> l, 1);
+        gps::BlockCompressor::Compress(&levels[l][0], levelWidth, levelHeight, format, blocks[l]);
+        levelRawBytes += levels[l].size();
+        levelCompressedBytes += blocks[l].size();
+    }
+
+    // BC1 drops alpha, so only the color channels are compared for it
+    std::vector<unsigned char> decoded(levels[0].size());
+    gps::BlockCompressor::Decompress(&blocks[0][0], width, height, format, &decoded[0]);
+    if (format == gps::BLOCK_FORMAT_BC1) {
+        for (size_t i = 3; i < decoded.size(); i += 4) {
+            decoded[i] = levels[0][i];
+        }
+    }
+    double psnr = ComputePsnr(&levels[0][0], &decoded[0], decoded.size());
+
+    std::string ddsPath = gps::DdsFile::GetCompressedPath(path);
+    if (!gps::DdsFile::Write(ddsPath, format, width, height, blocks)) {
+        fprintf(stderr, "ERROR: could not write %s\n", ddsPath.c_str());
+        return false;
+    }
+
+    printf("  %-4s %s (%dx%d): %zu KB -> %zu KB, %.1f dB\n", gps::BlockCompressor::GetFormatName(format), ddsPath.c_str(),
+        width, height, levelRawBytes / 1024, levelCompressedBytes / 1024, psnr);
+    rawBytes += levelRawBytes;
+    compressedBytes += levelCompressedBytes;
+    return true;
+}
+
+static int CompressTextures(int argc, const char* argv[])
+{
+    std::string formatName = argv[2];
+    if (formatName != "bc1" && formatName != "bc3" && formatName != "bc7" && formatName != "auto") {
+        std::cerr << "ERROR: unknown block format " << formatName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    size_t rawBytes = 0;
+    size_t compressedBytes = 0;
+    for (int i = 3; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--no-mipmaps") {
+            mipmapsEnabled = false;
+        }
+        else if (!CompressTexture(option, formatName, rawBytes, compressedBytes)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Texture VRAM: " << rawBytes / 1024 << " KB as RGBA8, " << compressedBytes / 1024
+        << " KB block compressed, in " << elapsed << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, const char* argv[]) {
+
+    if (argc < 3) {
+        std::cerr << "usage: AssetPacker <bundle> <model.obj>... [--skybox <name> <rt> <lf> <up> <dn> <bk> <ft>]" << std::endl;
+        std::cerr << "       [--no-mesh-optimizer] [--compact-vertices] [--no-mesh-lod] [--triangle-bvh] [--no-mipmaps]" << std::endl;
+        std::cerr << "       AssetPacker --dds <bc1|bc3|bc7|auto> [--no-mipmaps] <image>..." << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (std::string(argv[1]) == "--dds") {
+        return CompressTextures(argc, argv);
+    }
+
+    std::string bundleName = argv[1];
+    std::vector<std::string> models;
+    std::string skyBoxName;
+    std::vector<std::string> skyBoxFaces;
+    for (int i = 2; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--no-mesh-optimizer") {
+            gps::Model3D::SetMeshOptimizerEnabled(false);
+        }
+        else if (option == "--compact-vertices") {
+            gps::Model3D::SetCompactVerticesEnabled(true);
+        }
+        else if (option == "--no-mesh-lod") {
+            gps::Model3D::SetMeshLodEnabled(false);
+        }
+        else if (option == "--triangle-bvh") {
+            gps::Model3D::SetTriangleBvhEnabled(true);
+        }
+        else if (option == "--no-mipmaps") {
+            mipmapsEnabled = false;
+        }
+        else if (option == "--skybox" && i + 7 < argc) {
+            skyBoxName = argv[++i];
+            for (int face = 0; face < 6; face++) {
+                skyBoxFaces.push_back(argv[++i]);
+            }
+        }
+        else {
+            models.push_back(option);
+        }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    gps::AssetBundleWriter writer;
+    std::set<std::string> packedTextures;
+    for (size_t i = 0; i < models.size(); i++) {
+        if (!PackModel(writer, models[i], packedTextures)) {
+            std::cerr << "ERROR: could not pack " << models[i] << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    if (!skyBoxName.empty() && !PackSkyBox(writer, skyBoxName, skyBoxFaces)) {
+        std::cerr << "ERROR: could not pack skybox " << skyBoxName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (!writer.Write(bundleName)) {
+        std::cerr << "ERROR: could not write " << bundleName << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "Packed " << bundleName << " in " << elapsed << " s" << std::endl;
+    return EXIT_SUCCESS;
+}
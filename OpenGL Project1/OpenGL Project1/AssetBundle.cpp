@@ -0,0 +1,199 @@
+#include "AssetBundle.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    static const char ASSET_BUNDLE_MAGIC[4] = { 'G', 'P', 'S', 'B' };
+    static const size_t ASSET_ALIGNMENT = 16;
+
+    static size_t AlignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    AssetBundle::AssetBundle() : header(NULL), entries(NULL)
+    {
+    }
+
+    bool AssetBundle::Open(const std::string& fileName)
+    {
+        Close();
+
+        if (!file.Open(fileName)) {
+            return false;
+        }
+
+        const unsigned char* data = file.GetData();
+        size_t size = file.GetSize();
+        if (size < sizeof(AssetBundleHeader)) {
+            Close();
+            return false;
+        }
+
+        const AssetBundleHeader* fileHeader = (const AssetBundleHeader*)data;
+        if (memcmp(fileHeader->magic, ASSET_BUNDLE_MAGIC, sizeof(fileHeader->magic)) != 0 ||
+            fileHeader->version != ASSET_BUNDLE_VERSION ||
+            fileHeader->tocOffset + (uint64_t)fileHeader->assetCount * sizeof(AssetBundleEntry) > size) {
+            Close();
+            return false;
+        }
+
+        const AssetBundleEntry* fileEntries = (const AssetBundleEntry*)(data + fileHeader->tocOffset);
+        for (uint32_t i = 0; i < fileHeader->assetCount; i++) {
+            if (fileEntries[i].offset + fileEntries[i].size > size ||
+                memchr(fileEntries[i].name, 0, sizeof(fileEntries[i].name)) == NULL) {
+                Close();
+                return false;
+            }
+        }
+
+        header = fileHeader;
+        entries = fileEntries;
+        return true;
+    }
+
+    void AssetBundle::Close()
+    {
+        file.Close();
+        header = NULL;
+        entries = NULL;
+    }
+
+    bool AssetBundle::IsOpen() const
+    {
+        return header != NULL;
+    }
+
+    const AssetBundleEntry* AssetBundle::Find(const std::string& name, AssetType type) const
+    {
+        if (!header) {
+            return NULL;
+        }
+
+        // bundles hold a few dozen assets, a linear scan is enough
+        for (uint32_t i = 0; i < header->assetCount; i++) {
+            if (entries[i].type == (uint32_t)type && name == entries[i].name) {
+                return &entries[i];
+            }
+        }
+        return NULL;
+    }
+
+    const unsigned char* AssetBundle::GetData(const AssetBundleEntry& entry) const
+    {
+        return file.GetData() + entry.offset;
+    }
+
+    const TextureAssetHeader* AssetBundle::GetTexture(const AssetBundleEntry& entry) const
+    {
+        if (entry.size < sizeof(TextureAssetHeader)) {
+            return NULL;
+        }
+
+        const TextureAssetHeader* texture = (const TextureAssetHeader*)GetData(entry);
+        if (texture->width == 0 || texture->height == 0 || (texture->channels != 3 && texture->channels != 4) ||
+            texture->levelCount == 0 || texture->levelCount > 32 || texture->faceCount == 0 || texture->faceCount > 6 ||
+            GetTexturePayloadSize(*texture) > entry.size) {
+            return NULL;
+        }
+        return texture;
+    }
+
+    const unsigned char* AssetBundle::GetTextureLevel(const TextureAssetHeader& texture, uint32_t face, uint32_t level) const
+    {
+        return (const unsigned char*)&texture + GetTextureLevelOffset(texture, face, level);
+    }
+
+    size_t AssetBundle::GetTextureLevelSize(const TextureAssetHeader& texture, uint32_t level)
+    {
+        size_t width = texture.width >> level ? texture.width >> level : 1;
+        size_t height = texture.height >> level ? texture.height >> level : 1;
+        return AlignUp(width * height * texture.channels, 4);
+    }
+
+    size_t AssetBundle::GetTextureLevelOffset(const TextureAssetHeader& texture, uint32_t face, uint32_t level)
+    {
+        size_t faceSize = 0;
+        for (uint32_t l = 0; l < texture.levelCount; l++) {
+            faceSize += GetTextureLevelSize(texture, l);
+        }
+
+        size_t offset = sizeof(TextureAssetHeader) + face * faceSize;
+        for (uint32_t l = 0; l < level; l++) {
+            offset += GetTextureLevelSize(texture, l);
+        }
+        return offset;
+    }
+
+    size_t AssetBundle::GetTexturePayloadSize(const TextureAssetHeader& texture)
+    {
+        return GetTextureLevelOffset(texture, texture.faceCount, 0);
+    }
+
+    bool AssetBundleWriter::Add(const std::string& name, AssetType type, const std::vector<unsigned char>& payload)
+    {
+        AssetBundleEntry entry;
+        memset(&entry, 0, sizeof(entry));
+        if (name.size() >= sizeof(entry.name)) {
+            return false;
+        }
+        memcpy(entry.name, name.c_str(), name.size());
+        entry.type = (uint32_t)type;
+        entry.size = payload.size();
+
+        entries.push_back(entry);
+        payloads.push_back(payload);
+        return true;
+    }
+
+    bool AssetBundleWriter::Write(const std::string& fileName) const
+    {
+        // header | payloads | table of contents
+        std::vector<AssetBundleEntry> toc(entries);
+        size_t offset = AlignUp(sizeof(AssetBundleHeader), ASSET_ALIGNMENT);
+        for (size_t i = 0; i < toc.size(); i++) {
+            toc[i].offset = offset;
+            offset = AlignUp(offset + toc[i].size, ASSET_ALIGNMENT);
+        }
+
+        AssetBundleHeader fileHeader;
+        memset(&fileHeader, 0, sizeof(fileHeader));
+        memcpy(fileHeader.magic, ASSET_BUNDLE_MAGIC, sizeof(fileHeader.magic));
+        fileHeader.version = ASSET_BUNDLE_VERSION;
+        fileHeader.assetCount = (uint32_t)toc.size();
+        fileHeader.tocOffset = offset;
+
+        std::string tempPath = fileName + ".tmp";
+        std::ofstream bundleFile(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!bundleFile) {
+            return false;
+        }
+
+        static const char padding[ASSET_ALIGNMENT] = {};
+        bundleFile.write((const char*)&fileHeader, sizeof(fileHeader));
+        size_t written = sizeof(fileHeader);
+        for (size_t i = 0; i < toc.size(); i++) {
+            bundleFile.write(padding, toc[i].offset - written);
+            if (!payloads[i].empty()) {
+                bundleFile.write((const char*)&payloads[i][0], payloads[i].size());
+            }
+            written = toc[i].offset + toc[i].size;
+        }
+        bundleFile.write(padding, fileHeader.tocOffset - written);
+        if (!toc.empty()) {
+            bundleFile.write((const char*)&toc[0], toc.size() * sizeof(AssetBundleEntry));
+        }
+
+        bundleFile.close();
+        if (!bundleFile) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(fileName.c_str());
+        return std::rename(tempPath.c_str(), fileName.c_str()) == 0;
+    }
+}
@@ -0,0 +1,101 @@
+#ifndef AssetBundle_hpp
+#define AssetBundle_hpp
+
+#include "MappedFile.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the layout below changes, mesh payloads carry their own MESH_CACHE_VERSION
+    const uint32_t ASSET_BUNDLE_VERSION = 1;
+
+    enum AssetType
+    {
+        // a serialized MeshCache, named after the .obj it was built from
+        ASSET_MESHES = 1,
+        // TextureAssetHeader with one face, named after the image path the materials use
+        ASSET_TEXTURE = 2,
+        // TextureAssetHeader with the six cube map faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order
+        ASSET_CUBE_MAP = 3
+    };
+
+    struct AssetBundleHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t assetCount;
+        uint32_t reserved;
+        uint64_t tocOffset;
+    };
+
+    // Table of contents entry, offsets are from the start of the file and 16 byte aligned
+    struct AssetBundleEntry
+    {
+        char name[112];
+        uint32_t type;
+        uint32_t reserved;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    // Followed by every face's mip chain, face major, each level tightly packed and 4 byte aligned.
+    // Pixels are stored exactly as glTexImage2D expects them, already flipped for OpenGL.
+    struct TextureAssetHeader
+    {
+        uint32_t width;
+        uint32_t height;
+        // 3 (RGB) or 4 (RGBA), 8 bits each
+        uint32_t channels;
+        uint32_t levelCount;
+        uint32_t faceCount;
+        uint32_t reserved;
+    };
+
+    // Single file holding the preprocessed meshes and decoded textures of a scene, read with one mapping.
+    // Built offline by the AssetPacker tool.
+    class AssetBundle
+    {
+    public:
+        AssetBundle();
+
+        bool Open(const std::string& fileName);
+        void Close();
+        bool IsOpen() const;
+
+        // NULL if the bundle has no asset of that name and type
+        const AssetBundleEntry* Find(const std::string& name, AssetType type) const;
+        const unsigned char* GetData(const AssetBundleEntry& entry) const;
+
+        // Texture payload accessors, NULL if the entry is not a valid texture
+        const TextureAssetHeader* GetTexture(const AssetBundleEntry& entry) const;
+        const unsigned char* GetTextureLevel(const TextureAssetHeader& texture, uint32_t face, uint32_t level) const;
+
+        // Layout of a texture payload, shared with the packer
+        static size_t GetTextureLevelSize(const TextureAssetHeader& texture, uint32_t level);
+        static size_t GetTextureLevelOffset(const TextureAssetHeader& texture, uint32_t face, uint32_t level);
+        static size_t GetTexturePayloadSize(const TextureAssetHeader& texture);
+
+    private:
+        MappedFile file;
+        const AssetBundleHeader* header;
+        const AssetBundleEntry* entries;
+    };
+
+    // Collects assets in memory and writes them as a bundle
+    class AssetBundleWriter
+    {
+    public:
+        // Names longer than AssetBundleEntry::name are rejected
+        bool Add(const std::string& name, AssetType type, const std::vector<unsigned char>& payload);
+        bool Write(const std::string& fileName) const;
+
+    private:
+        std::vector<AssetBundleEntry> entries;
+        std::vector<std::vector<unsigned char> > payloads;
+    };
+}
+
+#endif /* AssetBundle_hpp */
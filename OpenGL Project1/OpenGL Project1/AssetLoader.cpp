@@ -0,0 +1,266 @@
+#include "AssetLoader.hpp"
+#include "GLStateCache.hpp"
+#include "MappedFile.hpp"
+#include "TextureManager.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+namespace gps {
+
+    AssetLoader::AssetLoader() :
+        placeholderTexture(0), placeholderCubeMap(0),
+        pendingCount(0), uploadCount(0), uploadTime(0.0), maxFrameUploadTime(0.0)
+    {
+    }
+
+    AssetLoader::~AssetLoader()
+    {
+        Stop();
+    }
+
+    void AssetLoader::Start(unsigned int threadCount)
+    {
+        if (pool) {
+            return;
+        }
+        pool.reset(new ThreadPool(threadCount));
+
+        // mid grey in sRGB, close to the average albedo of the scene
+        const unsigned char grey[4] = { 128, 128, 128, 255 };
+        glGenTextures(1, &placeholderTexture);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, placeholderTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+
+        const unsigned char black[4] = { 0, 0, 0, 0 };
+        glGenTextures(1, &placeholderCubeMap);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, placeholderCubeMap);
+        for (GLuint i = 0; i < 6; i++) {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, black);
+        }
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+    }
+
+    void AssetLoader::Stop()
+    {
+        if (!pool) {
+            return;
+        }
+        pool.reset();
+
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        for (size_t i = 0; i < decoded.size(); i++) {
+            FreeImage(decoded[i]);
+        }
+        decoded.clear();
+        pendingCount = 0;
+        // the placeholders may still be bound by models that never finished loading, they go with the context
+    }
+
+    bool AssetLoader::IsStarted() const
+    {
+        return pool != NULL;
+    }
+
+    TextureHandle AssetLoader::LoadTexture(const std::string& path)
+    {
+        TextureHandle handle = std::make_shared<TextureLoad>();
+        handle->id = placeholderTexture;
+        handle->ready = false;
+        handle->path = path;
+        handle->bytes = 0;
+        handle->layer = -1;
+        handle->cancelled = false;
+        handle->contentHash = 0;
+        pendingCount++;
+
+        pool->Submit([this, handle]() {
+            DecodedImage image;
+            image.handle = handle;
+            image.target = GL_TEXTURE_2D;
+            image.contentHash = 0;
+            // the file is read once, for the content hash TextureManager shares textures by and for decoding
+            MappedFile file;
+            unsigned char* pixels = NULL;
+            if (file.Open(handle->path)) {
+                image.contentHash = TextureManager::HashContent(file.GetData(), file.GetSize());
+                int n;
+                pixels = stbi_load_from_memory(file.GetData(), (int)file.GetSize(), &image.width, &image.height, &n, 4);
+            }
+            if (pixels) {
+                // flip the rows for OpenGL, as TextureManager::ReadTextureFromFile does
+                size_t rowBytes = (size_t)image.width * 4;
+                std::vector<unsigned char> row(rowBytes);
+                for (int y = 0; y < image.height / 2; y++) {
+                    unsigned char* top = pixels + y * rowBytes;
+                    unsigned char* bottom = pixels + (image.height - y - 1) * rowBytes;
+                    memcpy(&row[0], top, rowBytes);
+                    memcpy(top, bottom, rowBytes);
+                    memcpy(bottom, &row[0], rowBytes);
+                }
+                image.faces.push_back(pixels);
+            }
+            else {
+                fprintf(stderr, "ERROR: could not load %s\n", handle->path.c_str());
+            }
+            PushDecoded(image);
+        });
+        return handle;
+    }
+
+    TextureHandle AssetLoader::LoadCubeMap(const std::vector<std::string>& faces)
+    {
+        TextureHandle handle = std::make_shared<TextureLoad>();
+        handle->id = placeholderCubeMap;
+        handle->ready = false;
+        handle->path = faces.empty() ? std::string() : faces[0];
+        handle->bytes = 0;
+        handle->layer = -1;
+        handle->cancelled = false;
+        handle->contentHash = 0;
+        pendingCount++;
+
+        pool->Submit([this, handle, faces]() {
+            DecodedImage image;
+            image.handle = handle;
+            image.target = GL_TEXTURE_CUBE_MAP;
+            image.contentHash = 0;
+            for (size_t i = 0; i < faces.size(); i++) {
+                int width, height, n;
+                unsigned char* pixels = stbi_load(faces[i].c_str(), &width, &height, &n, 3);
+                if (!pixels) {
+                    fprintf(stderr, "ERROR: could not load %s\n", faces[i].c_str());
+                    FreeImage(image);
+                    break;
+                }
+                image.width = width;
+                image.height = height;
+                image.faces.push_back(pixels);
+            }
+            PushDecoded(image);
+        });
+        return handle;
+    }
+
+    int AssetLoader::ProcessUploads(double budgetMs)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        int uploaded = 0;
+        double elapsed = 0.0;
+
+        while (uploaded == 0 || elapsed < budgetMs) {
+            DecodedImage image;
+            {
+                std::lock_guard<std::mutex> lock(decodedMutex);
+                if (decoded.empty()) {
+                    break;
+                }
+                image = decoded.front();
+                decoded.pop_front();
+            }
+
+            Upload(image);
+            FreeImage(image);
+            pendingCount--;
+            uploaded++;
+            elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        }
+
+        if (uploaded > 0) {
+            uploadCount += uploaded;
+            uploadTime += elapsed;
+            maxFrameUploadTime = std::max(maxFrameUploadTime, elapsed);
+        }
+        return uploaded;
+    }
+
+    int AssetLoader::GetPendingCount() const
+    {
+        return pendingCount;
+    }
+
+    unsigned int AssetLoader::GetThreadCount() const
+    {
+        return pool ? pool->GetThreadCount() : 0;
+    }
+
+    int AssetLoader::GetUploadCount() const
+    {
+        return uploadCount;
+    }
+
+    double AssetLoader::GetUploadTime() const
+    {
+        return uploadTime;
+    }
+
+    double AssetLoader::GetMaxFrameUploadTime() const
+    {
+        return maxFrameUploadTime;
+    }
+
+    void AssetLoader::PushDecoded(const DecodedImage& image)
+    {
+        std::lock_guard<std::mutex> lock(decodedMutex);
+        decoded.push_back(image);
+    }
+
+    void AssetLoader::Upload(DecodedImage& image)
+    {
+        TextureLoad& texture = *image.handle;
+        texture.ready = true;
+        texture.contentHash = image.contentHash;
+        size_t expectedFaces = image.target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        if (texture.cancelled || image.faces.size() != expectedFaces) {
+            texture.id = 0;
+            return;
+        }
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        GLStateCache::Get().BindTexture(0, image.target, textureID);
+        if (image.target == GL_TEXTURE_2D) {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_SRGB, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.faces[0]);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            // the mip chain adds a third
+            texture.bytes = (size_t)image.width * image.height * 4 * 4 / 3;
+        }
+        else {
+            for (GLuint i = 0; i < 6; i++) {
+                glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, image.width, image.height, 0,
+                    GL_RGB, GL_UNSIGNED_BYTE, image.faces[i]);
+            }
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+            texture.bytes = (size_t)image.width * image.height * 3 * 6;
+        }
+        GLStateCache::Get().BindTexture(0, image.target, 0);
+
+        texture.id = textureID;
+    }
+
+    void AssetLoader::FreeImage(DecodedImage& image)
+    {
+        for (size_t i = 0; i < image.faces.size(); i++) {
+            stbi_image_free(image.faces[i]);
+        }
+        image.faces.clear();
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef AssetLoader_hpp
+#define AssetLoader_hpp
+
+#include <GL/glew.h>
+
+#include "ThreadPool.hpp"
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // One texture request, shared between the loader and whoever draws with it. Only touched on the GL thread.
+    struct TextureLoad
+    {
+        // the placeholder until ready, then the real texture (0 if the image could not be read)
+        GLuint id;
+        bool ready;
+        std::string path;
+        // video memory taken once uploaded, mip chain included
+        size_t bytes;
+        // -1, or the layer once TextureManager::PackTextureArrays moved the image into the GL_TEXTURE_2D_ARRAY id
+        int layer;
+        // set when every owner let go before the upload, the loader then skips it
+        bool cancelled;
+        // TextureManager::HashContent of the image file, set on upload by LoadTexture; 0 if it was not read
+        uint64_t contentHash;
+    };
+
+    typedef std::shared_ptr<TextureLoad> TextureHandle;
+
+    // Decodes images (and runs any other CPU work submitted to it) on a thread pool, then uploads the
+    // results on the GL thread a few at a time so loading never stalls a frame for long.
+    class AssetLoader
+    {
+    public:
+        AssetLoader();
+        ~AssetLoader();
+
+        // Starts the workers and creates the placeholder textures, needs the GL context.
+        // threadCount 0 keeps one hardware thread free for the GL thread.
+        void Start(unsigned int threadCount = 0);
+        // Drops whatever has not been decoded yet and joins the workers
+        void Stop();
+        bool IsStarted() const;
+
+        // Decoded like TextureManager::ReadTextureFromFile (RGBA, flipped, sRGB with mipmaps), drawn as a 1x1 grey
+        // texture until it is uploaded
+        TextureHandle LoadTexture(const std::string& path);
+        // Decoded like SkyBox::LoadSkyBoxTextures (RGB, 6 faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order),
+        // drawn as a black cube map until it is uploaded
+        TextureHandle LoadCubeMap(const std::vector<std::string>& faces);
+
+        // Runs CPU work on the pool, e.g. .obj parsing. The job must not make GL calls.
+        template <typename Job>
+        std::future<typename std::result_of<Job()>::type> Submit(Job job)
+        {
+            return pool->Submit(job);
+        }
+
+        // Uploads decoded images until budgetMs has passed, at least one per call so loading always
+        // progresses. Call once per frame on the GL thread. Returns the number of textures uploaded.
+        int ProcessUploads(double budgetMs);
+
+        // Textures requested but not uploaded yet
+        int GetPendingCount() const;
+
+        unsigned int GetThreadCount() const;
+        int GetUploadCount() const;
+        // Time spent in glTexImage2D/glGenerateMipmap, in total and in the slowest frame
+        double GetUploadTime() const;
+        double GetMaxFrameUploadTime() const;
+
+    private:
+        // Output of a decode job, faces are stbi_load allocations
+        struct DecodedImage
+        {
+            TextureHandle handle;
+            GLenum target;
+            int width;
+            int height;
+            std::vector<unsigned char*> faces;
+            uint64_t contentHash;
+        };
+
+        std::unique_ptr<ThreadPool> pool;
+        GLuint placeholderTexture;
+        GLuint placeholderCubeMap;
+
+        std::mutex decodedMutex;
+        std::deque<DecodedImage> decoded;
+
+        int pendingCount;
+        int uploadCount;
+        double uploadTime;
+        double maxFrameUploadTime;
+
+        void PushDecoded(const DecodedImage& image);
+        void Upload(DecodedImage& image);
+        static void FreeImage(DecodedImage& image);
+
+        AssetLoader(const AssetLoader&);
+        AssetLoader& operator=(const AssetLoader&);
+    };
+}
+
+#endif /* AssetLoader_hpp */
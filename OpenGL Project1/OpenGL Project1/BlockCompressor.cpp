@@ -0,0 +1,562 @@
+#include "BlockCompressor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdint.h>
+
+namespace gps {
+
+    // BC7 4 bit index interpolation weights, out of 64
+    static const int BC7_WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+    static int Clamp(int value, int low, int high)
+    {
+        return value < low ? low : (value > high ? high : value);
+    }
+
+    // Line through the block colors along their principal axis, clamped to the extremes of the pixels.
+    // channels is 3 (RGB) or 4 (RGBA).
+    static void FitPrincipalAxis(const float pixels[16][4], int channels, float low[4], float high[4])
+    {
+        float mean[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++) {
+            for (int c = 0; c < channels; c++) {
+                mean[c] += pixels[i][c] / 16.0f;
+            }
+        }
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++) {
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++) {
+                    covariance[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+                }
+            }
+        }
+
+        // power iteration, a fixed number of steps keeps the result deterministic
+        float axis[4] = { 1.0f, 1.0f, 1.0f, channels == 4 ? 1.0f : 0.0f };
+        for (int iteration = 0; iteration < 8; iteration++) {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            float length = 0.0f;
+            for (int a = 0; a < channels; a++) {
+                for (int b = 0; b < channels; b++) {
+                    next[a] += covariance[a][b] * axis[b];
+                }
+                length += next[a] * next[a];
+            }
+            if (length < 1e-12f) {
+                break;
+            }
+            length = std::sqrt(length);
+            for (int c = 0; c < channels; c++) {
+                axis[c] = next[c] / length;
+            }
+        }
+
+        float minT = 0.0f;
+        float maxT = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++) {
+                t += (pixels[i][c] - mean[c]) * axis[c];
+            }
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int c = 0; c < 4; c++) {
+            low[c] = c < channels ? std::min(std::max(mean[c] + minT * axis[c], 0.0f), 255.0f) : 255.0f;
+            high[c] = c < channels ? std::min(std::max(mean[c] + maxT * axis[c], 0.0f), 255.0f) : 255.0f;
+        }
+    }
+
+    // Endpoints minimizing the squared error of pixels = (1 - t) * low + t * high for fixed t per pixel.
+    // Returns false when every pixel has the same t.
+    static bool SolveEndpoints(const float pixels[16][4], const float t[16], int channels, float low[4], float high[4])
+    {
+        float alpha2 = 0.0f, beta2 = 0.0f, alphaBeta = 0.0f;
+        float alphaX[4] = {}, betaX[4] = {};
+        for (int i = 0; i < 16; i++) {
+            float a = 1.0f - t[i];
+            float b = t[i];
+            alpha2 += a * a;
+            beta2 += b * b;
+            alphaBeta += a * b;
+            for (int c = 0; c < channels; c++) {
+                alphaX[c] += a * pixels[i][c];
+                betaX[c] += b * pixels[i][c];
+            }
+        }
+
+        float determinant = alpha2 * beta2 - alphaBeta * alphaBeta;
+        if (std::fabs(determinant) < 1e-6f) {
+            return false;
+        }
+        for (int c = 0; c < channels; c++) {
+            low[c] = std::min(std::max((alphaX[c] * beta2 - betaX[c] * alphaBeta) / determinant, 0.0f), 255.0f);
+            high[c] = std::min(std::max((betaX[c] * alpha2 - alphaX[c] * alphaBeta) / determinant, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    static uint16_t PackRgb565(const float color[4])
+    {
+        int r = Clamp((int)(color[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+        int g = Clamp((int)(color[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+        int b = Clamp((int)(color[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void UnpackRgb565(uint16_t packed, int color[3])
+    {
+        int r = (packed >> 11) & 31;
+        int g = (packed >> 5) & 63;
+        int b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+    }
+
+    // BC1 palette, 3 colors plus transparent black when color0 <= color1 unless forceFourColors (BC3)
+    static void BuildColorPalette(uint16_t color0, uint16_t color1, bool forceFourColors, int palette[4][4])
+    {
+        int a[3], b[3];
+        UnpackRgb565(color0, a);
+        UnpackRgb565(color1, b);
+        bool fourColors = forceFourColors || color0 > color1;
+        for (int c = 0; c < 3; c++) {
+            palette[0][c] = a[c];
+            palette[1][c] = b[c];
+            palette[2][c] = fourColors ? (2 * a[c] + b[c]) / 3 : (a[c] + b[c]) / 2;
+            palette[3][c] = fourColors ? (a[c] + 2 * b[c]) / 3 : 0;
+        }
+        palette[0][3] = palette[1][3] = palette[2][3] = 255;
+        palette[3][3] = fourColors ? 255 : 0;
+    }
+
+    // Orders the endpoints for four color mode and picks the nearest palette entry per pixel
+    static float EvaluateColorBlock(const float pixels[16][4], uint16_t& color0, uint16_t& color1, int indices[16])
+    {
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+
+        int palette[4][4];
+        BuildColorPalette(color0, color1, true, palette);
+        int paletteSize = color0 == color1 ? 1 : 4;
+
+        float error = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float best = 1e30f;
+            indices[i] = 0;
+            for (int p = 0; p < paletteSize; p++) {
+                float distance = 0.0f;
+                for (int c = 0; c < 3; c++) {
+                    float d = pixels[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < best) {
+                    best = distance;
+                    indices[i] = p;
+                }
+            }
+            error += best;
+        }
+        return error;
+    }
+
+    static void EncodeColorBlock(const float pixels[16][4], unsigned char* block)
+    {
+        float low[4], high[4];
+        FitPrincipalAxis(pixels, 3, low, high);
+
+        uint16_t color0 = PackRgb565(high);
+        uint16_t color1 = PackRgb565(low);
+        int indices[16];
+        float error = EvaluateColorBlock(pixels, color0, color1, indices);
+
+        // one least squares pass over the chosen palette positions
+        static const float PALETTE_T[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+        float t[16];
+        for (int i = 0; i < 16; i++) {
+            t[i] = PALETTE_T[indices[i]];
+        }
+        float endpoint0[4], endpoint1[4];
+        if (color0 != color1 && SolveEndpoints(pixels, t, 3, endpoint0, endpoint1)) {
+            uint16_t refined0 = PackRgb565(endpoint0);
+            uint16_t refined1 = PackRgb565(endpoint1);
+            int refinedIndices[16];
+            float refinedError = EvaluateColorBlock(pixels, refined0, refined1, refinedIndices);
+            if (refinedError < error) {
+                color0 = refined0;
+                color1 = refined1;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        uint32_t bits = 0;
+        for (int i = 0; i < 16; i++) {
+            bits |= (uint32_t)indices[i] << (2 * i);
+        }
+        block[0] = (unsigned char)(color0 & 0xFF);
+        block[1] = (unsigned char)(color0 >> 8);
+        block[2] = (unsigned char)(color1 & 0xFF);
+        block[3] = (unsigned char)(color1 >> 8);
+        for (int i = 0; i < 4; i++) {
+            block[4 + i] = (unsigned char)(bits >> (8 * i));
+        }
+    }
+
+    static void DecodeColorBlock(const unsigned char* block, bool forceFourColors, unsigned char pixels[16][4])
+    {
+        uint16_t color0 = (uint16_t)(block[0] | (block[1] << 8));
+        uint16_t color1 = (uint16_t)(block[2] | (block[3] << 8));
+        uint32_t bits = (uint32_t)block[4] | ((uint32_t)block[5] << 8) | ((uint32_t)block[6] << 16) | ((uint32_t)block[7] << 24);
+
+        int palette[4][4];
+        BuildColorPalette(color0, color1, forceFourColors, palette);
+        for (int i = 0; i < 16; i++) {
+            int index = (bits >> (2 * i)) & 3;
+            for (int c = 0; c < 4; c++) {
+                pixels[i][c] = (unsigned char)palette[index][c];
+            }
+        }
+    }
+
+    // BC3 alpha palette, 8 values when alpha0 > alpha1, else 6 values plus 0 and 255
+    static void BuildAlphaPalette(int alpha0, int alpha1, int palette[8])
+    {
+        palette[0] = alpha0;
+        palette[1] = alpha1;
+        if (alpha0 > alpha1) {
+            for (int i = 1; i < 7; i++) {
+                palette[i + 1] = ((7 - i) * alpha0 + i * alpha1) / 7;
+            }
+        }
+        else {
+            for (int i = 1; i < 5; i++) {
+                palette[i + 1] = ((5 - i) * alpha0 + i * alpha1) / 5;
+            }
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+    }
+
+    static void EncodeAlphaBlock(const float pixels[16][4], unsigned char* block)
+    {
+        int alpha0 = 0;
+        int alpha1 = 255;
+        for (int i = 0; i < 16; i++) {
+            int alpha = (int)pixels[i][3];
+            alpha0 = std::max(alpha0, alpha);
+            alpha1 = std::min(alpha1, alpha);
+        }
+
+        int palette[8];
+        BuildAlphaPalette(alpha0, alpha1, palette);
+        int paletteSize = alpha0 == alpha1 ? 1 : 8;
+
+        uint64_t bits = 0;
+        for (int i = 0; i < 16; i++) {
+            int alpha = (int)pixels[i][3];
+            int bestIndex = 0;
+            int best = 256;
+            for (int p = 0; p < paletteSize; p++) {
+                int distance = std::abs(alpha - palette[p]);
+                if (distance < best) {
+                    best = distance;
+                    bestIndex = p;
+                }
+            }
+            bits |= (uint64_t)bestIndex << (3 * i);
+        }
+
+        block[0] = (unsigned char)alpha0;
+        block[1] = (unsigned char)alpha1;
+        for (int i = 0; i < 6; i++) {
+            block[2 + i] = (unsigned char)(bits >> (8 * i));
+        }
+    }
+
+    static void DecodeAlphaBlock(const unsigned char* block, unsigned char pixels[16][4])
+    {
+        int palette[8];
+        BuildAlphaPalette(block[0], block[1], palette);
+        uint64_t bits = 0;
+        for (int i = 0; i < 6; i++) {
+            bits |= (uint64_t)block[2 + i] << (8 * i);
+        }
+        for (int i = 0; i < 16; i++) {
+            pixels[i][3] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+        }
+    }
+
+    // Little endian bit stream over a 16 byte BC7 block
+    struct BlockBits
+    {
+        unsigned char* block;
+        const unsigned char* readBlock;
+        int position;
+
+        void Write(uint32_t value, int count)
+        {
+            for (int i = 0; i < count; i++, position++) {
+                if (value & (1u << i)) {
+                    block[position >> 3] |= (unsigned char)(1 << (position & 7));
+                }
+            }
+        }
+
+        uint32_t Read(int count)
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < count; i++, position++) {
+                value |= (uint32_t)((readBlock[position >> 3] >> (position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    // Quantized mode 6 endpoints: 7 bits per channel plus one shared p-bit per endpoint
+    struct Bc7Endpoints
+    {
+        int quantized[2][4];
+        int pBit[2];
+    };
+
+    static float EvaluateBc7Block(const float pixels[16][4], const Bc7Endpoints& endpoints, int indices[16])
+    {
+        int colors[2][4];
+        for (int e = 0; e < 2; e++) {
+            for (int c = 0; c < 4; c++) {
+                colors[e][c] = (endpoints.quantized[e][c] << 1) | endpoints.pBit[e];
+            }
+        }
+
+        int palette[16][4];
+        for (int p = 0; p < 16; p++) {
+            for (int c = 0; c < 4; c++) {
+                palette[p][c] = ((64 - BC7_WEIGHTS[p]) * colors[0][c] + BC7_WEIGHTS[p] * colors[1][c] + 32) >> 6;
+            }
+        }
+
+        float error = 0.0f;
+        for (int i = 0; i < 16; i++) {
+            float best = 1e30f;
+            indices[i] = 0;
+            for (int p = 0; p < 16; p++) {
+                float distance = 0.0f;
+                for (int c = 0; c < 4; c++) {
+                    float d = pixels[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < best) {
+                    best = distance;
+                    indices[i] = p;
+                }
+            }
+            error += best;
+        }
+        return error;
+    }
+
+    // Tries the four p-bit combinations for the endpoint pair and keeps the best
+    static float QuantizeBc7Endpoints(const float pixels[16][4], const float low[4], const float high[4],
+        Bc7Endpoints& best, int bestIndices[16])
+    {
+        float bestError = 1e30f;
+        for (int p = 0; p < 4; p++) {
+            Bc7Endpoints candidate;
+            candidate.pBit[0] = p & 1;
+            candidate.pBit[1] = p >> 1;
+            for (int c = 0; c < 4; c++) {
+                candidate.quantized[0][c] = Clamp((int)((low[c] - candidate.pBit[0]) / 2.0f + 0.5f), 0, 127);
+                candidate.quantized[1][c] = Clamp((int)((high[c] - candidate.pBit[1]) / 2.0f + 0.5f), 0, 127);
+            }
+
+            int indices[16];
+            float error = EvaluateBc7Block(pixels, candidate, indices);
+            if (error < bestError) {
+                bestError = error;
+                best = candidate;
+                memcpy(bestIndices, indices, sizeof(indices));
+            }
+        }
+        return bestError;
+    }
+
+    static void EncodeBc7Block(const float pixels[16][4], unsigned char* block)
+    {
+        float low[4], high[4];
+        FitPrincipalAxis(pixels, 4, low, high);
+
+        Bc7Endpoints endpoints;
+        int indices[16];
+        float error = QuantizeBc7Endpoints(pixels, low, high, endpoints, indices);
+
+        float t[16];
+        for (int i = 0; i < 16; i++) {
+            t[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+        }
+        if (SolveEndpoints(pixels, t, 4, low, high)) {
+            Bc7Endpoints refined;
+            int refinedIndices[16];
+            if (QuantizeBc7Endpoints(pixels, low, high, refined, refinedIndices) < error) {
+                endpoints = refined;
+                memcpy(indices, refinedIndices, sizeof(indices));
+            }
+        }
+
+        // the anchor (first) index is stored without its top bit, which must be 0
+        if (indices[0] & 8) {
+            std::swap(endpoints.quantized[0], endpoints.quantized[1]);
+            std::swap(endpoints.pBit[0], endpoints.pBit[1]);
+            for (int i = 0; i < 16; i++) {
+                indices[i] = 15 - indices[i];
+            }
+        }
+
+        memset(block, 0, 16);
+        BlockBits bits = { block, NULL, 0 };
+        bits.Write(1 << 6, 7);
+        for (int c = 0; c < 4; c++) {
+            bits.Write(endpoints.quantized[0][c], 7);
+            bits.Write(endpoints.quantized[1][c], 7);
+        }
+        bits.Write(endpoints.pBit[0], 1);
+        bits.Write(endpoints.pBit[1], 1);
+        bits.Write(indices[0], 3);
+        for (int i = 1; i < 16; i++) {
+            bits.Write(indices[i], 4);
+        }
+    }
+
+    static void DecodeBc7Block(const unsigned char* block, unsigned char pixels[16][4])
+    {
+        // mode 6 is six 0 bits and a 1, the eighth bit already belongs to the red endpoint
+        if ((block[0] & 0x7F) != 1 << 6) {
+            memset(pixels, 0, 16 * 4);
+            for (int i = 0; i < 16; i++) {
+                pixels[i][3] = 255;
+            }
+            return;
+        }
+
+        BlockBits bits = { NULL, block, 7 };
+        int colors[2][4];
+        for (int c = 0; c < 4; c++) {
+            colors[0][c] = bits.Read(7) << 1;
+            colors[1][c] = bits.Read(7) << 1;
+        }
+        int pBit0 = bits.Read(1);
+        int pBit1 = bits.Read(1);
+        for (int c = 0; c < 4; c++) {
+            colors[0][c] |= pBit0;
+            colors[1][c] |= pBit1;
+        }
+
+        for (int i = 0; i < 16; i++) {
+            int weight = BC7_WEIGHTS[bits.Read(i == 0 ? 3 : 4)];
+            for (int c = 0; c < 4; c++) {
+                pixels[i][c] = (unsigned char)(((64 - weight) * colors[0][c] + weight * colors[1][c] + 32) >> 6);
+            }
+        }
+    }
+
+    size_t BlockCompressor::GetBlockBytes(BlockFormat format)
+    {
+        return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+    }
+
+    size_t BlockCompressor::GetLevelSize(BlockFormat format, int width, int height)
+    {
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * GetBlockBytes(format);
+    }
+
+    const char* BlockCompressor::GetFormatName(BlockFormat format)
+    {
+        switch (format) {
+        case BLOCK_FORMAT_BC1:
+            return "BC1";
+        case BLOCK_FORMAT_BC3:
+            return "BC3";
+        default:
+            return "BC7";
+        }
+    }
+
+    void BlockCompressor::Compress(const unsigned char* rgba, int width, int height, BlockFormat format, std::vector<unsigned char>& blocks)
+    {
+        size_t blockBytes = GetBlockBytes(format);
+        blocks.assign(GetLevelSize(format, width, height), 0);
+        unsigned char* block = blocks.empty() ? NULL : &blocks[0];
+
+        for (int blockY = 0; blockY < height; blockY += 4) {
+            for (int blockX = 0; blockX < width; blockX += 4) {
+                float pixels[16][4];
+                for (int i = 0; i < 16; i++) {
+                    int x = std::min(blockX + (i & 3), width - 1);
+                    int y = std::min(blockY + (i >> 2), height - 1);
+                    const unsigned char* pixel = rgba + ((size_t)y * width + x) * 4;
+                    for (int c = 0; c < 4; c++) {
+                        pixels[i][c] = pixel[c];
+                    }
+                }
+
+                if (format == BLOCK_FORMAT_BC1) {
+                    EncodeColorBlock(pixels, block);
+                }
+                else if (format == BLOCK_FORMAT_BC3) {
+                    EncodeAlphaBlock(pixels, block);
+                    EncodeColorBlock(pixels, block + 8);
+                }
+                else {
+                    EncodeBc7Block(pixels, block);
+                }
+                block += blockBytes;
+            }
+        }
+    }
+
+    void BlockCompressor::Decompress(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba)
+    {
+        size_t blockBytes = GetBlockBytes(format);
+        for (int blockY = 0; blockY < height; blockY += 4) {
+            for (int blockX = 0; blockX < width; blockX += 4) {
+                unsigned char pixels[16][4];
+                if (format == BLOCK_FORMAT_BC1) {
+                    DecodeColorBlock(blocks, false, pixels);
+                }
+                else if (format == BLOCK_FORMAT_BC3) {
+                    DecodeColorBlock(blocks + 8, true, pixels);
+                    DecodeAlphaBlock(blocks, pixels);
+                }
+                else {
+                    DecodeBc7Block(blocks, pixels);
+                }
+                blocks += blockBytes;
+
+                for (int i = 0; i < 16; i++) {
+                    int x = blockX + (i & 3);
+                    int y = blockY + (i >> 2);
+                    if (x < width && y < height) {
+                        memcpy(rgba + ((size_t)y * width + x) * 4, pixels[i], 4);
+                    }
+                }
+            }
+        }
+    }
+
+    bool BlockCompressor::HasAlpha(const unsigned char* rgba, int width, int height)
+    {
+        size_t pixelCount = (size_t)width * height;
+        for (size_t i = 0; i < pixelCount; i++) {
+            if (rgba[i * 4 + 3] != 255) {
+                return true;
+            }
+        }
+        return false;
+    }
+}
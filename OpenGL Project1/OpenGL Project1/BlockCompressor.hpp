@@ -0,0 +1,42 @@
+#ifndef BlockCompressor_hpp
+#define BlockCompressor_hpp
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    enum BlockFormat
+    {
+        // opaque RGB, 4 bits per pixel
+        BLOCK_FORMAT_BC1,
+        // RGB as BC1 plus interpolated alpha, 8 bits per pixel
+        BLOCK_FORMAT_BC3,
+        // RGBA, 8 bits per pixel, higher quality than BC1/BC3
+        BLOCK_FORMAT_BC7
+    };
+
+    // Deterministic CPU encoders for the GPU block compression formats, for offline use. Every format
+    // works on 4x4 blocks of RGBA8 pixels (BC1 ignores alpha). Endpoints come from the principal axis
+    // of the block colors and are refined once by least squares. BC7 is always written in mode 6
+    // (one subset, RGBA endpoints with 4 bit indices).
+    class BlockCompressor
+    {
+    public:
+        static size_t GetBlockBytes(BlockFormat format);
+        // Bytes of one mip level, partial blocks at the edges count as whole blocks
+        static size_t GetLevelSize(BlockFormat format, int width, int height);
+        static const char* GetFormatName(BlockFormat format);
+
+        // Encodes width x height RGBA8 pixels, edge blocks repeat the last row/column
+        static void Compress(const unsigned char* rgba, int width, int height, BlockFormat format, std::vector<unsigned char>& blocks);
+
+        // Decodes blocks back to RGBA8. Only handles what Compress writes: BC7 blocks in other modes decode as black.
+        static void Decompress(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba);
+
+        // True if any pixel is not fully opaque
+        static bool HasAlpha(const unsigned char* rgba, int width, int height);
+    };
+}
+
+#endif /* BlockCompressor_hpp */
@@ -0,0 +1,675 @@
+#include "Bvh.hpp"
+#include "Model3D.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <atomic>
+#include <cfloat>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <thread>
+
+namespace gps {
+
+    static const int SAH_BINS = 16;
+    // cost of visiting a node relative to testing one primitive
+    static const float TRAVERSAL_COST = 1.0f;
+    // smallest subtree handed to another thread during a parallel build
+    static const uint32_t MIN_PARALLEL_PRIMITIVES = 1024;
+
+    struct BvhBin
+    {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        uint32_t count;
+    };
+
+    // Subtree left for the worker threads by the top of a parallel build
+    struct BvhSubtree
+    {
+        uint32_t node;
+        uint32_t first;
+        uint32_t count;
+        int depth;
+        std::vector<BvhNode> nodes;
+    };
+
+    struct BvhBuilder
+    {
+        const std::vector<BvhPrimitive>* primitives;
+        std::vector<glm::vec3> centroids;
+        uint32_t* indices;
+        uint32_t maxLeafSize;
+        // subtrees of at most this many primitives are deferred when subtrees is set
+        uint32_t deferCount;
+        std::vector<BvhSubtree>* subtrees;
+    };
+
+    static float SurfaceArea(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+    {
+        glm::vec3 extent = glm::max(boundsMax - boundsMin, glm::vec3(0.0f));
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+
+    static float SurfaceArea(const BvhNode& node)
+    {
+        return SurfaceArea(glm::vec3(node.boundsMin[0], node.boundsMin[1], node.boundsMin[2]),
+            glm::vec3(node.boundsMax[0], node.boundsMax[1], node.boundsMax[2]));
+    }
+
+    static int GetBin(float centroid, float centroidMin, float binScale, int binCount)
+    {
+        return std::min((int)((centroid - centroidMin) * binScale), binCount - 1);
+    }
+
+    static void BuildNode(const BvhBuilder& builder, std::vector<BvhNode>& nodes, uint32_t nodeIndex, uint32_t first, uint32_t count, int depth)
+    {
+        const std::vector<BvhPrimitive>& primitives = *builder.primitives;
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        glm::vec3 centroidMin(FLT_MAX);
+        glm::vec3 centroidMax(-FLT_MAX);
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t primitive = builder.indices[i];
+            boundsMin = glm::min(boundsMin, primitives[primitive].boundsMin);
+            boundsMax = glm::max(boundsMax, primitives[primitive].boundsMax);
+            centroidMin = glm::min(centroidMin, builder.centroids[primitive]);
+            centroidMax = glm::max(centroidMax, builder.centroids[primitive]);
+        }
+
+        BvhNode& node = nodes[nodeIndex];
+        for (int c = 0; c < 3; c++) {
+            node.boundsMin[c] = boundsMin[c];
+            node.boundsMax[c] = boundsMax[c];
+        }
+        node.first = first;
+        node.count = count;
+        if (count <= 1 || depth >= BVH_MAX_DEPTH - 1) {
+            return;
+        }
+
+        if (builder.subtrees && count <= builder.deferCount) {
+            BvhSubtree subtree;
+            subtree.node = nodeIndex;
+            subtree.first = first;
+            subtree.count = count;
+            subtree.depth = depth;
+            builder.subtrees->push_back(subtree);
+            return;
+        }
+
+        // cheapest of the planes between the bins on every axis, all three are binned in one pass.
+        // Small ranges get fewer bins, most nodes are near the leaves and the sweeps would dominate.
+        float bestCost = FLT_MAX;
+        int bestAxis = -1;
+        int bestSplit = 0;
+        int binCount = (int)std::min(count, (uint32_t)SAH_BINS);
+        glm::vec3 centroidExtent = centroidMax - centroidMin;
+        glm::vec3 binScale;
+        BvhBin bins[3][SAH_BINS];
+        for (int axis = 0; axis < 3; axis++) {
+            binScale[axis] = centroidExtent[axis] > 0.0f ? binCount / centroidExtent[axis] : 0.0f;
+            for (int b = 0; b < binCount; b++) {
+                bins[axis][b].boundsMin = glm::vec3(FLT_MAX);
+                bins[axis][b].boundsMax = glm::vec3(-FLT_MAX);
+                bins[axis][b].count = 0;
+            }
+        }
+        for (uint32_t i = first; i < first + count; i++) {
+            uint32_t primitive = builder.indices[i];
+            const BvhPrimitive& bounds = primitives[primitive];
+            for (int axis = 0; axis < 3; axis++) {
+                BvhBin& bin = bins[axis][GetBin(builder.centroids[primitive][axis], centroidMin[axis], binScale[axis], binCount)];
+                bin.boundsMin = glm::min(bin.boundsMin, bounds.boundsMin);
+                bin.boundsMax = glm::max(bin.boundsMax, bounds.boundsMax);
+                bin.count++;
+            }
+        }
+
+        for (int axis = 0; axis < 3; axis++) {
+            if (centroidExtent[axis] <= 0.0f) {
+                continue;
+            }
+
+            // areas and counts left of each plane in one sweep, right of it in the other
+            float leftCost[SAH_BINS - 1];
+            glm::vec3 sweepMin(FLT_MAX);
+            glm::vec3 sweepMax(-FLT_MAX);
+            uint32_t sweepCount = 0;
+            for (int b = 0; b < binCount - 1; b++) {
+                sweepMin = glm::min(sweepMin, bins[axis][b].boundsMin);
+                sweepMax = glm::max(sweepMax, bins[axis][b].boundsMax);
+                sweepCount += bins[axis][b].count;
+                leftCost[b] = sweepCount > 0 ? SurfaceArea(sweepMin, sweepMax) * sweepCount : 0.0f;
+            }
+            sweepMin = glm::vec3(FLT_MAX);
+            sweepMax = glm::vec3(-FLT_MAX);
+            sweepCount = 0;
+            for (int b = binCount - 1; b > 0; b--) {
+                sweepMin = glm::min(sweepMin, bins[axis][b].boundsMin);
+                sweepMax = glm::max(sweepMax, bins[axis][b].boundsMax);
+                sweepCount += bins[axis][b].count;
+                float cost = leftCost[b - 1] + (sweepCount > 0 ? SurfaceArea(sweepMin, sweepMax) * sweepCount : 0.0f);
+                if (sweepCount > 0 && sweepCount < count && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = b;
+                }
+            }
+        }
+
+        float parentArea = std::max(SurfaceArea(boundsMin, boundsMax), FLT_MIN);
+        bestCost = TRAVERSAL_COST + bestCost / parentArea;
+        if (bestAxis < 0 || bestCost >= (float)count) {
+            if (count <= builder.maxLeafSize) {
+                return;
+            }
+        }
+
+        uint32_t middle;
+        if (bestAxis >= 0) {
+            float axisScale = binScale[bestAxis];
+            float axisMin = centroidMin[bestAxis];
+            const std::vector<glm::vec3>& centroids = builder.centroids;
+            middle = (uint32_t)(std::partition(builder.indices + first, builder.indices + first + count,
+                [&](uint32_t primitive) { return GetBin(centroids[primitive][bestAxis], axisMin, axisScale, binCount) < bestSplit; }) - builder.indices);
+        }
+        else {
+            // every centroid in one point, any halves are as good
+            middle = first + count / 2;
+        }
+
+        uint32_t left = (uint32_t)nodes.size();
+        nodes.resize(nodes.size() + 2);
+        nodes[nodeIndex].first = left;
+        nodes[nodeIndex].count = 0;
+        BuildNode(builder, nodes, left, first, middle - first, depth + 1);
+        BuildNode(builder, nodes, left + 1, middle, first + count - middle, depth + 1);
+    }
+
+    Bvh::Bvh()
+    {
+    }
+
+    void Bvh::Build(const std::vector<BvhPrimitive>& primitives, uint32_t maxLeafSize, unsigned int threadCount)
+    {
+        Clear();
+        if (primitives.empty()) {
+            return;
+        }
+        // hardware_concurrency may report 0
+        threadCount = std::max(threadCount, 1u);
+
+        primitiveIndices.resize(primitives.size());
+        BvhBuilder builder;
+        builder.primitives = &primitives;
+        builder.centroids.resize(primitives.size());
+        for (size_t i = 0; i < primitives.size(); i++) {
+            primitiveIndices[i] = (uint32_t)i;
+            builder.centroids[i] = (primitives[i].boundsMin + primitives[i].boundsMax) * 0.5f;
+        }
+        builder.indices = &primitiveIndices[0];
+        builder.maxLeafSize = maxLeafSize;
+
+        // the top splits run here until the ranges are small enough to give every thread a few of them
+        std::vector<BvhSubtree> subtrees;
+        uint32_t primitiveCount = (uint32_t)primitives.size();
+        bool parallel = threadCount > 1 && primitiveCount >= 2 * MIN_PARALLEL_PRIMITIVES;
+        builder.deferCount = std::max(primitiveCount / (threadCount * 4), MIN_PARALLEL_PRIMITIVES);
+        builder.subtrees = parallel ? &subtrees : NULL;
+
+        nodes.reserve(primitives.size() * 2);
+        nodes.resize(1);
+        BuildNode(builder, nodes, 0, 0, primitiveCount, 0);
+        if (subtrees.empty()) {
+            return;
+        }
+
+        // subtrees cover disjoint ranges of primitiveIndices, so the workers only share the job counter
+        builder.subtrees = NULL;
+        const BvhBuilder& sharedBuilder = builder;
+        std::atomic<size_t> nextSubtree(0);
+        std::vector<std::thread> workers;
+        for (unsigned int t = 0; t < std::min((size_t)threadCount, subtrees.size()); t++) {
+            workers.push_back(std::thread([&]() {
+                for (size_t s = nextSubtree++; s < subtrees.size(); s = nextSubtree++) {
+                    BvhSubtree& subtree = subtrees[s];
+                    subtree.nodes.reserve(subtree.count * 2);
+                    subtree.nodes.resize(1);
+                    BuildNode(sharedBuilder, subtree.nodes, 0, subtree.first, subtree.count, subtree.depth);
+                }
+            }));
+        }
+        for (size_t t = 0; t < workers.size(); t++) {
+            workers[t].join();
+        }
+
+        // each subtree root replaces its placeholder, the rest is appended with the child links moved
+        for (size_t s = 0; s < subtrees.size(); s++) {
+            const std::vector<BvhNode>& subtreeNodes = subtrees[s].nodes;
+            uint32_t offset = (uint32_t)nodes.size() - 1;
+            nodes[subtrees[s].node] = subtreeNodes[0];
+            if (subtreeNodes[0].count == 0) {
+                nodes[subtrees[s].node].first += offset;
+            }
+            for (size_t n = 1; n < subtreeNodes.size(); n++) {
+                nodes.push_back(subtreeNodes[n]);
+                if (nodes.back().count == 0) {
+                    nodes.back().first += offset;
+                }
+            }
+        }
+    }
+
+    bool Bvh::Load(const BvhNode* nodes, size_t nodeCount, const uint32_t* primitiveIndices, size_t primitiveCount)
+    {
+        Clear();
+        if (nodeCount == 0) {
+            return true;
+        }
+
+        // children always come after their parent, so every walk ends; the depth bounds the traversal stacks
+        std::vector<int> depths(nodeCount, 0);
+        for (size_t n = 0; n < nodeCount; n++) {
+            const BvhNode& node = nodes[n];
+            if (node.count > 0) {
+                if ((uint64_t)node.first + node.count > primitiveCount) {
+                    return false;
+                }
+            }
+            else if (node.first <= n || (uint64_t)node.first + 1 >= nodeCount || depths[n] + 1 >= BVH_MAX_DEPTH) {
+                return false;
+            }
+            else {
+                depths[node.first] = depths[n] + 1;
+                depths[node.first + 1] = depths[n] + 1;
+            }
+        }
+        for (size_t i = 0; i < primitiveCount; i++) {
+            if (primitiveIndices[i] >= primitiveCount) {
+                return false;
+            }
+        }
+
+        this->nodes.assign(nodes, nodes + nodeCount);
+        this->primitiveIndices.assign(primitiveIndices, primitiveIndices + primitiveCount);
+        return true;
+    }
+
+    void Bvh::Clear()
+    {
+        nodes.clear();
+        primitiveIndices.clear();
+    }
+
+    bool Bvh::IsEmpty() const
+    {
+        return nodes.empty();
+    }
+
+    const std::vector<BvhNode>& Bvh::GetNodes() const
+    {
+        return nodes;
+    }
+
+    const std::vector<uint32_t>& Bvh::GetPrimitiveIndices() const
+    {
+        return primitiveIndices;
+    }
+
+    float Bvh::GetSahCost() const
+    {
+        if (nodes.empty()) {
+            return 0.0f;
+        }
+
+        float rootArea = std::max(SurfaceArea(nodes[0]), FLT_MIN);
+        float cost = 0.0f;
+        for (size_t n = 0; n < nodes.size(); n++) {
+            float probability = SurfaceArea(nodes[n]) / rootArea;
+            cost += probability * (nodes[n].count > 0 ? (float)nodes[n].count : TRAVERSAL_COST);
+        }
+        return cost;
+    }
+
+    int Bvh::GetDepth() const
+    {
+        std::vector<int> depths(nodes.size(), 1);
+        int depth = nodes.empty() ? 0 : 1;
+        for (size_t n = 0; n < nodes.size(); n++) {
+            if (nodes[n].count == 0) {
+                depths[nodes[n].first] = depths[n] + 1;
+                depths[nodes[n].first + 1] = depths[n] + 1;
+                depth = std::max(depth, depths[n] + 1);
+            }
+        }
+        return depth;
+    }
+
+    void Bvh::QueryFrustum(const gps::Frustum& frustum, std::vector<uint32_t>& results) const
+    {
+        if (nodes.empty()) {
+            return;
+        }
+
+        // planes a node is entirely inside of are not tested again below it
+        const int ALL_PLANES = (1 << FRUSTUM_PLANE_COUNT) - 1;
+        uint32_t stack[BVH_MAX_DEPTH * 2];
+        int masks[BVH_MAX_DEPTH * 2];
+        int stackSize = 1;
+        stack[0] = 0;
+        masks[0] = ALL_PLANES;
+
+        while (stackSize > 0) {
+            stackSize--;
+            const BvhNode& node = nodes[stack[stackSize]];
+            int mask = masks[stackSize];
+
+            bool outside = false;
+            for (int p = 0; p < FRUSTUM_PLANE_COUNT && mask != 0 && !outside; p++) {
+                if (!(mask & (1 << p))) {
+                    continue;
+                }
+                const glm::vec4& plane = frustum.GetPlane((FrustumPlane)p);
+                float farthest = plane.w;
+                float nearest = plane.w;
+                for (int c = 0; c < 3; c++) {
+                    farthest += plane[c] * (plane[c] >= 0.0f ? node.boundsMax[c] : node.boundsMin[c]);
+                    nearest += plane[c] * (plane[c] >= 0.0f ? node.boundsMin[c] : node.boundsMax[c]);
+                }
+                outside = farthest < 0.0f;
+                if (nearest >= 0.0f) {
+                    mask &= ~(1 << p);
+                }
+            }
+            if (outside) {
+                continue;
+            }
+
+            if (node.count > 0) {
+                results.insert(results.end(), primitiveIndices.begin() + node.first, primitiveIndices.begin() + node.first + node.count);
+            }
+            else {
+                stack[stackSize] = node.first + 1;
+                masks[stackSize++] = mask;
+                stack[stackSize] = node.first;
+                masks[stackSize++] = mask;
+            }
+        }
+    }
+
+    void Bvh::QueryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<uint32_t>& results) const
+    {
+        if (nodes.empty()) {
+            return;
+        }
+
+        uint32_t stack[BVH_MAX_DEPTH * 2];
+        int stackSize = 1;
+        stack[0] = 0;
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+            bool overlaps = true;
+            for (int c = 0; c < 3; c++) {
+                overlaps = overlaps && node.boundsMin[c] <= boxMax[c] && node.boundsMax[c] >= boxMin[c];
+            }
+            if (!overlaps) {
+                continue;
+            }
+
+            if (node.count > 0) {
+                results.insert(results.end(), primitiveIndices.begin() + node.first, primitiveIndices.begin() + node.first + node.count);
+            }
+            else {
+                stack[stackSize++] = node.first + 1;
+                stack[stackSize++] = node.first;
+            }
+        }
+    }
+
+    void Bvh::QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& results) const
+    {
+        if (nodes.empty()) {
+            return;
+        }
+
+        glm::vec3 inverseDirection = GetInverseDirection(direction);
+        uint32_t stack[BVH_MAX_DEPTH * 2];
+        int stackSize = 1;
+        stack[0] = 0;
+        while (stackSize > 0) {
+            const BvhNode& node = nodes[stack[--stackSize]];
+            if (IntersectRay(node, origin, inverseDirection, maxDistance) >= maxDistance) {
+                continue;
+            }
+
+            if (node.count > 0) {
+                results.insert(results.end(), primitiveIndices.begin() + node.first, primitiveIndices.begin() + node.first + node.count);
+            }
+            else {
+                stack[stackSize++] = node.first + 1;
+                stack[stackSize++] = node.first;
+            }
+        }
+    }
+
+    float Bvh::IntersectRay(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance)
+    {
+        // slabs, the ray starts at distance 0
+        float entry = 0.0f;
+        float exit = maxDistance;
+        for (int c = 0; c < 3; c++) {
+            float t0 = (node.boundsMin[c] - origin[c]) * inverseDirection[c];
+            float t1 = (node.boundsMax[c] - origin[c]) * inverseDirection[c];
+            entry = std::max(entry, std::min(t0, t1));
+            exit = std::min(exit, std::max(t0, t1));
+        }
+        return entry <= exit ? entry : FLT_MAX;
+    }
+
+    glm::vec3 Bvh::GetInverseDirection(const glm::vec3& direction)
+    {
+        // a zero component gets a huge finite inverse, an infinite one would give NaN on the slab planes
+        glm::vec3 inverse;
+        for (int c = 0; c < 3; c++) {
+            float component = std::abs(direction[c]) > 1e-20f ? direction[c] : (direction[c] < 0.0f ? -1e-20f : 1e-20f);
+            inverse[c] = 1.0f / component;
+        }
+        return inverse;
+    }
+
+    bool Bvh::IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+        const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& distance)
+    {
+        glm::vec3 edge1 = b - a;
+        glm::vec3 edge2 = c - a;
+        glm::vec3 p = glm::cross(direction, edge2);
+        float determinant = glm::dot(edge1, p);
+        if (std::abs(determinant) < 1e-12f) {
+            return false;
+        }
+
+        float inverseDeterminant = 1.0f / determinant;
+        glm::vec3 s = origin - a;
+        float u = glm::dot(s, p) * inverseDeterminant;
+        if (u < 0.0f || u > 1.0f) {
+            return false;
+        }
+        glm::vec3 q = glm::cross(s, edge1);
+        float v = glm::dot(direction, q) * inverseDeterminant;
+        if (v < 0.0f || u + v > 1.0f) {
+            return false;
+        }
+
+        float t = glm::dot(edge2, q) * inverseDeterminant;
+        if (t <= 0.0f || t >= distance) {
+            return false;
+        }
+        distance = t;
+        return true;
+    }
+
+    // Closest hit of a ray against every triangle, the reference for the benchmark
+    static float RaycastBruteForce(const std::vector<MeshData>& meshData, const glm::vec3& origin, const glm::vec3& direction, float distance)
+    {
+        for (size_t s = 0; s < meshData.size(); s++) {
+            const MeshData& mesh = meshData[s];
+            size_t indexCount = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+            for (size_t i = 0; i + 2 < indexCount; i += 3) {
+                Bvh::IntersectTriangle(origin, direction, mesh.vertices[mesh.indices[i]].Position,
+                    mesh.vertices[mesh.indices[i + 1]].Position, mesh.vertices[mesh.indices[i + 2]].Position, distance);
+            }
+        }
+        return distance;
+    }
+
+    void Bvh::Benchmark(std::string fileName, int runs)
+    {
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+        std::vector<MeshData> meshData;
+        if (!Model3D::ReadMeshData(fileName, basePath, meshData) || meshData.empty()) {
+            return;
+        }
+
+        size_t triangleCount = 0;
+        glm::vec3 sceneMin(FLT_MAX);
+        glm::vec3 sceneMax(-FLT_MAX);
+        for (size_t s = 0; s < meshData.size(); s++) {
+            MeshData& mesh = meshData[s];
+            mesh.boundsMin = glm::vec3(FLT_MAX);
+            mesh.boundsMax = glm::vec3(-FLT_MAX);
+            for (size_t v = 0; v < mesh.vertices.size(); v++) {
+                mesh.boundsMin = glm::min(mesh.boundsMin, mesh.vertices[v].Position);
+                mesh.boundsMax = glm::max(mesh.boundsMax, mesh.vertices[v].Position);
+            }
+            sceneMin = glm::min(sceneMin, mesh.boundsMin);
+            sceneMax = glm::max(sceneMax, mesh.boundsMax);
+            triangleCount += mesh.indices.size() / 3;
+        }
+
+        // build times, the triangle hierarchies once on one thread and once on every hardware thread
+        unsigned int threadCount = std::max(std::thread::hardware_concurrency(), 1u);
+        Bvh meshBvh;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++) {
+            MeshCache::BuildMeshBvh(meshData, meshBvh);
+        }
+        double meshBuildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+        double triangleBuildTime[2];
+        unsigned int buildThreads[2] = { 1, threadCount };
+        for (int mode = 0; mode < 2; mode++) {
+            start = std::chrono::steady_clock::now();
+            for (int run = 0; run < runs; run++) {
+                for (size_t s = 0; s < meshData.size(); s++) {
+                    Model3D::BuildTriangleBvh(meshData[s], buildThreads[mode]);
+                }
+            }
+            triangleBuildTime[mode] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+        }
+
+        size_t triangleNodes = 0;
+        int triangleDepth = 0;
+        float triangleCost = 0.0f;
+        for (size_t s = 0; s < meshData.size(); s++) {
+            triangleNodes += meshData[s].triangleBvh.GetNodes().size();
+            triangleDepth = std::max(triangleDepth, meshData[s].triangleBvh.GetDepth());
+            triangleCost = std::max(triangleCost, meshData[s].triangleBvh.GetSahCost());
+        }
+
+        // closest hits through both levels: mesh boxes, then the triangles of the meshes they lead to
+        const int RAY_COUNT = 100000;
+        const int CHECKED_RAYS = 100;
+        std::mt19937 random(1234);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        std::vector<glm::vec3> origins(RAY_COUNT);
+        std::vector<glm::vec3> directions(RAY_COUNT);
+        for (int r = 0; r < RAY_COUNT; r++) {
+            origins[r] = sceneMin + (sceneMax - sceneMin) * glm::vec3(unit(random), unit(random), unit(random));
+            float z = unit(random) * 2.0f - 1.0f;
+            float angle = unit(random) * 6.2831853f;
+            float radius = std::sqrt(1.0f - z * z);
+            directions[r] = glm::vec3(radius * std::cos(angle), radius * std::sin(angle), z);
+        }
+
+        float rayLength = glm::length(sceneMax - sceneMin);
+        std::vector<float> hitDistances(RAY_COUNT);
+        size_t hitCount = 0;
+        start = std::chrono::steady_clock::now();
+        for (int r = 0; r < RAY_COUNT; r++) {
+            const glm::vec3& origin = origins[r];
+            const glm::vec3& direction = directions[r];
+            float distance = rayLength;
+            bool hit = meshBvh.Raycast(origin, direction, distance, [&](uint32_t mesh, float& meshDistance) {
+                const MeshData& data = meshData[mesh];
+                return data.triangleBvh.Raycast(origin, direction, meshDistance, [&](uint32_t triangle, float& triangleDistance) {
+                    return IntersectTriangle(origin, direction, data.vertices[data.indices[3 * triangle]].Position,
+                        data.vertices[data.indices[3 * triangle + 1]].Position, data.vertices[data.indices[3 * triangle + 2]].Position,
+                        triangleDistance);
+                });
+            });
+            hitDistances[r] = distance;
+            hitCount += hit ? 1 : 0;
+        }
+        double rayTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        int rayMismatches = 0;
+        for (int r = 0; r < CHECKED_RAYS; r++) {
+            float expected = RaycastBruteForce(meshData, origins[r], directions[r], rayLength);
+            rayMismatches += std::abs(expected - hitDistances[r]) > 1e-4f * std::max(expected, 1.0f) ? 1 : 0;
+        }
+
+        // frustum and box queries over the meshes against testing every mesh box
+        const int QUERY_COUNT = 10000;
+        glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 20.0f);
+        std::vector<Frustum> frustums(QUERY_COUNT);
+        for (int q = 0; q < QUERY_COUNT; q++) {
+            glm::mat4 view = glm::lookAt(origins[q], origins[q] + directions[q], std::abs(directions[q].y) < 0.99f ?
+                glm::vec3(0.0f, 1.0f, 0.0f) : glm::vec3(1.0f, 0.0f, 0.0f));
+            frustums[q].Extract(projection * view);
+        }
+
+        std::vector<uint32_t> results;
+        size_t bvhResults = 0;
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < QUERY_COUNT; q++) {
+            results.clear();
+            meshBvh.QueryFrustum(frustums[q], results);
+            bvhResults += results.size();
+        }
+        double frustumTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        size_t linearResults = 0;
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < QUERY_COUNT; q++) {
+            for (size_t s = 0; s < meshData.size(); s++) {
+                linearResults += frustums[q].IntersectsBox(meshData[s].boundsMin, meshData[s].boundsMax) ? 1 : 0;
+            }
+        }
+        double linearFrustumTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        glm::vec3 boxExtent = (sceneMax - sceneMin) * 0.05f;
+        size_t boxResults = 0;
+        start = std::chrono::steady_clock::now();
+        for (int q = 0; q < QUERY_COUNT; q++) {
+            results.clear();
+            meshBvh.QueryBox(origins[q] - boxExtent, origins[q] + boxExtent, results);
+            boxResults += results.size();
+        }
+        double boxTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        std::cout << "BVH benchmark: " << fileName << " (" << meshData.size() << " meshes, " << triangleCount << " triangles, "
+            << runs << " runs)" << std::endl;
+        std::cout << "  mesh BVH build     : " << meshBuildTime << " ms, " << meshBvh.GetNodes().size() << " nodes, depth "
+            << meshBvh.GetDepth() << ", SAH cost " << meshBvh.GetSahCost() << std::endl;
+        std::cout << "  triangle BVH build : " << triangleBuildTime[0] << " ms on 1 thread, " << triangleBuildTime[1] << " ms on "
+            << threadCount << ", " << triangleNodes << " nodes, max depth " << triangleDepth << ", max SAH cost " << triangleCost << std::endl;
+        std::cout << "  rays               : " << RAY_COUNT / rayTime / 1000.0 << " Mrays/s, " << hitCount << " of " << RAY_COUNT
+            << " hit, " << rayMismatches << " of " << CHECKED_RAYS << " differ from brute force" << std::endl;
+        std::cout << "  frustum queries    : " << frustumTime * 1000.0 / QUERY_COUNT << " us (" << linearFrustumTime * 1000.0 / QUERY_COUNT
+            << " us testing every mesh), " << bvhResults << " / " << linearResults << " meshes found" << std::endl;
+        std::cout << "  box queries        : " << boxTime * 1000.0 / QUERY_COUNT << " us, " << boxResults / QUERY_COUNT
+            << " meshes per query" << std::endl;
+    }
+}
@@ -0,0 +1,139 @@
+#ifndef Bvh_hpp
+#define Bvh_hpp
+
+#include "Frustum.hpp"
+
+#include "glm/glm.hpp"
+
+#include <stdint.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Nodes this deep are always leaves, which bounds every traversal stack
+    const int BVH_MAX_DEPTH = 64;
+
+    // 32 bytes, two to a cache line. Interior nodes have count 0 and their children at first and
+    // first + 1, leaves cover primitive indices [first, first + count).
+    struct BvhNode
+    {
+        float boundsMin[3];
+        uint32_t first;
+        float boundsMax[3];
+        uint32_t count;
+    };
+
+    struct BvhPrimitive
+    {
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+    };
+
+    // Bounding volume hierarchy over axis aligned boxes, built with the binned surface area heuristic.
+    // Nodes live in one array in depth first order with siblings next to each other, primitives are
+    // referred to by their index in the array given to Build.
+    class Bvh
+    {
+    public:
+        Bvh();
+
+        // Leaves hold at most maxLeafSize primitives, fewer when splitting them is cheaper. threadCount > 1
+        // builds the subtrees below the first few splits on that many threads.
+        void Build(const std::vector<BvhPrimitive>& primitives, uint32_t maxLeafSize, unsigned int threadCount = 1);
+
+        // Takes a hierarchy serialized from GetNodes/GetPrimitiveIndices, returns false if it is malformed
+        bool Load(const BvhNode* nodes, size_t nodeCount, const uint32_t* primitiveIndices, size_t primitiveCount);
+
+        void Clear();
+        bool IsEmpty() const;
+        const std::vector<BvhNode>& GetNodes() const;
+        const std::vector<uint32_t>& GetPrimitiveIndices() const;
+
+        // Expected cost of a ray query relative to testing one primitive, lower is better
+        float GetSahCost() const;
+        int GetDepth() const;
+
+        // Queries append every primitive of the leaves they reach, which are exact per primitive only
+        // with a maxLeafSize of 1
+
+        // Appends every primitive whose box is not entirely outside one of the planes
+        void QueryFrustum(const gps::Frustum& frustum, std::vector<uint32_t>& results) const;
+
+        // Appends every primitive whose box overlaps [boxMin, boxMax]
+        void QueryBox(const glm::vec3& boxMin, const glm::vec3& boxMax, std::vector<uint32_t>& results) const;
+
+        // Appends every primitive whose box the ray enters before maxDistance
+        void QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, std::vector<uint32_t>& results) const;
+
+        // Closest hit along the ray. hit(primitive, distance) tests one primitive and, if it is hit closer
+        // than distance, lowers distance and returns true. Nodes are visited near to far and skipped once
+        // they start past distance. Returns true if anything was hit, distance holds the closest hit.
+        template <typename HitFunction>
+        bool Raycast(const glm::vec3& origin, const glm::vec3& direction, float& distance, HitFunction hit) const
+        {
+            if (nodes.empty()) {
+                return false;
+            }
+
+            glm::vec3 inverseDirection = GetInverseDirection(direction);
+            bool found = false;
+            uint32_t stack[BVH_MAX_DEPTH];
+            int stackSize = 0;
+            uint32_t node = 0;
+            if (IntersectRay(nodes[0], origin, inverseDirection, distance) >= distance) {
+                return false;
+            }
+
+            while (true) {
+                const BvhNode& current = nodes[node];
+                if (current.count > 0) {
+                    for (uint32_t i = 0; i < current.count; i++) {
+                        found = hit(primitiveIndices[current.first + i], distance) || found;
+                    }
+                }
+                else {
+                    uint32_t nearChild = current.first;
+                    uint32_t farChild = current.first + 1;
+                    float nearDistance = IntersectRay(nodes[nearChild], origin, inverseDirection, distance);
+                    float farDistance = IntersectRay(nodes[farChild], origin, inverseDirection, distance);
+                    if (farDistance < nearDistance) {
+                        std::swap(nearChild, farChild);
+                        std::swap(nearDistance, farDistance);
+                    }
+                    if (nearDistance < distance) {
+                        if (farDistance < distance) {
+                            stack[stackSize++] = farChild;
+                        }
+                        node = nearChild;
+                        continue;
+                    }
+                }
+
+                if (stackSize == 0) {
+                    break;
+                }
+                node = stack[--stackSize];
+            }
+            return found;
+        }
+
+        // Moller-Trumbore, returns true and lowers distance if the triangle is hit closer than distance
+        static bool IntersectTriangle(const glm::vec3& origin, const glm::vec3& direction,
+            const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, float& distance);
+
+        // Builds mesh and triangle hierarchies for the .obj file and times queries against them, CPU work only
+        static void Benchmark(std::string fileName, int runs);
+
+    private:
+        std::vector<BvhNode> nodes;
+        std::vector<uint32_t> primitiveIndices;
+
+        // Entry distance of the ray into the node box, or a value >= maxDistance if it misses
+        static float IntersectRay(const BvhNode& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance);
+        static glm::vec3 GetInverseDirection(const glm::vec3& direction);
+    };
+}
+
+#endif /* Bvh_hpp */
@@ -21,6 +21,13 @@ namespace gps {
         return glm::lookAt(cameraPosition, cameraTarget, cameraUpDirection);
     }
 
+    //return the world space frustum planes of projection * view
+    gps::Frustum Camera::getFrustum(const glm::mat4& projection) {
+        gps::Frustum frustum;
+        frustum.Extract(projection * getViewMatrix());
+        return frustum;
+    }
+
     void Camera::displayCameraParameters() {
         //printf("\n");
          //printf("Camera position: %f %f %f\n", cameraPosition.x, cameraPosition.y, cameraPosition.z);
@@ -0,0 +1,243 @@
+#include "DdsFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    struct DdsPixelFormat
+    {
+        uint32_t size;
+        uint32_t flags;
+        char fourCC[4];
+        uint32_t rgbBitCount;
+        uint32_t bitMasks[4];
+    };
+
+    struct DdsHeader
+    {
+        uint32_t size;
+        uint32_t flags;
+        uint32_t height;
+        uint32_t width;
+        uint32_t pitchOrLinearSize;
+        uint32_t depth;
+        uint32_t mipMapCount;
+        uint32_t reserved1[11];
+        DdsPixelFormat pixelFormat;
+        uint32_t caps;
+        uint32_t caps2;
+        uint32_t caps3;
+        uint32_t caps4;
+        uint32_t reserved2;
+    };
+
+    struct DdsHeaderDx10
+    {
+        uint32_t dxgiFormat;
+        uint32_t resourceDimension;
+        uint32_t miscFlag;
+        uint32_t arraySize;
+        uint32_t miscFlags2;
+    };
+
+    static const char DDS_MAGIC[4] = { 'D', 'D', 'S', ' ' };
+
+    static const uint32_t DDSD_CAPS = 0x1;
+    static const uint32_t DDSD_HEIGHT = 0x2;
+    static const uint32_t DDSD_WIDTH = 0x4;
+    static const uint32_t DDSD_PIXELFORMAT = 0x1000;
+    static const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    static const uint32_t DDSD_LINEARSIZE = 0x80000;
+    static const uint32_t DDPF_FOURCC = 0x4;
+    static const uint32_t DDSCAPS_COMPLEX = 0x8;
+    static const uint32_t DDSCAPS_TEXTURE = 0x1000;
+    static const uint32_t DDSCAPS_MIPMAP = 0x400000;
+    static const uint32_t DDS_DIMENSION_TEXTURE2D = 3;
+
+    // DXGI_FORMAT values, the plain UNORM variants are accepted too
+    static const uint32_t DXGI_FORMAT_BC1_UNORM = 71;
+    static const uint32_t DXGI_FORMAT_BC1_UNORM_SRGB = 72;
+    static const uint32_t DXGI_FORMAT_BC3_UNORM = 77;
+    static const uint32_t DXGI_FORMAT_BC3_UNORM_SRGB = 78;
+    static const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+    static const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+    DdsFile::DdsFile() : format(BLOCK_FORMAT_BC1), width(0), height(0), levelCount(0), dataOffset(0)
+    {
+    }
+
+    bool DdsFile::Open(const std::string& fileName)
+    {
+        Close();
+        if (!file.Open(fileName)) {
+            return false;
+        }
+
+        const unsigned char* data = file.GetData();
+        size_t size = file.GetSize();
+        if (size < sizeof(DDS_MAGIC) + sizeof(DdsHeader) || memcmp(data, DDS_MAGIC, sizeof(DDS_MAGIC)) != 0) {
+            Close();
+            return false;
+        }
+
+        const DdsHeader* header = (const DdsHeader*)(data + sizeof(DDS_MAGIC));
+        dataOffset = sizeof(DDS_MAGIC) + sizeof(DdsHeader);
+        if (header->size != sizeof(DdsHeader) || !(header->pixelFormat.flags & DDPF_FOURCC) ||
+            header->width == 0 || header->height == 0 || header->width > 16384 || header->height > 16384) {
+            Close();
+            return false;
+        }
+
+        const char* fourCC = header->pixelFormat.fourCC;
+        if (memcmp(fourCC, "DXT1", 4) == 0) {
+            format = BLOCK_FORMAT_BC1;
+        }
+        else if (memcmp(fourCC, "DXT5", 4) == 0) {
+            format = BLOCK_FORMAT_BC3;
+        }
+        else if (memcmp(fourCC, "DX10", 4) == 0 && size >= dataOffset + sizeof(DdsHeaderDx10)) {
+            const DdsHeaderDx10* dx10 = (const DdsHeaderDx10*)(data + dataOffset);
+            dataOffset += sizeof(DdsHeaderDx10);
+            if (dx10->resourceDimension != DDS_DIMENSION_TEXTURE2D || dx10->arraySize > 1) {
+                Close();
+                return false;
+            }
+
+            switch (dx10->dxgiFormat) {
+            case DXGI_FORMAT_BC1_UNORM:
+            case DXGI_FORMAT_BC1_UNORM_SRGB:
+                format = BLOCK_FORMAT_BC1;
+                break;
+            case DXGI_FORMAT_BC3_UNORM:
+            case DXGI_FORMAT_BC3_UNORM_SRGB:
+                format = BLOCK_FORMAT_BC3;
+                break;
+            case DXGI_FORMAT_BC7_UNORM:
+            case DXGI_FORMAT_BC7_UNORM_SRGB:
+                format = BLOCK_FORMAT_BC7;
+                break;
+            default:
+                Close();
+                return false;
+            }
+        }
+        else {
+            Close();
+            return false;
+        }
+
+        width = (int)header->width;
+        height = (int)header->height;
+        levelCount = (header->flags & DDSD_MIPMAPCOUNT) && header->mipMapCount > 0 ? (int)header->mipMapCount : 1;
+        levelCount = std::min(levelCount, 32);
+
+        size_t total = dataOffset;
+        for (int level = 0; level < levelCount; level++) {
+            total += GetLevelSize(level);
+        }
+        if (total > size) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    void DdsFile::Close()
+    {
+        file.Close();
+        width = 0;
+        height = 0;
+        levelCount = 0;
+        dataOffset = 0;
+    }
+
+    BlockFormat DdsFile::GetFormat() const
+    {
+        return format;
+    }
+
+    int DdsFile::GetWidth() const
+    {
+        return width;
+    }
+
+    int DdsFile::GetHeight() const
+    {
+        return height;
+    }
+
+    int DdsFile::GetLevelCount() const
+    {
+        return levelCount;
+    }
+
+    const unsigned char* DdsFile::GetLevelData(int level) const
+    {
+        size_t offset = dataOffset;
+        for (int l = 0; l < level; l++) {
+            offset += GetLevelSize(l);
+        }
+        return file.GetData() + offset;
+    }
+
+    size_t DdsFile::GetLevelSize(int level) const
+    {
+        return BlockCompressor::GetLevelSize(format, std::max(width >> level, 1), std::max(height >> level, 1));
+    }
+
+    bool DdsFile::Write(const std::string& fileName, BlockFormat format, int width, int height,
+        const std::vector<std::vector<unsigned char> >& levels)
+    {
+        DdsHeader header;
+        memset(&header, 0, sizeof(header));
+        header.size = sizeof(DdsHeader);
+        header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_MIPMAPCOUNT | DDSD_LINEARSIZE;
+        header.height = (uint32_t)height;
+        header.width = (uint32_t)width;
+        header.pitchOrLinearSize = (uint32_t)BlockCompressor::GetLevelSize(format, width, height);
+        header.mipMapCount = (uint32_t)levels.size();
+        header.pixelFormat.size = sizeof(DdsPixelFormat);
+        header.pixelFormat.flags = DDPF_FOURCC;
+        memcpy(header.pixelFormat.fourCC, "DX10", 4);
+        header.caps = DDSCAPS_TEXTURE | (levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+
+        DdsHeaderDx10 dx10;
+        memset(&dx10, 0, sizeof(dx10));
+        dx10.dxgiFormat = format == BLOCK_FORMAT_BC1 ? DXGI_FORMAT_BC1_UNORM_SRGB :
+            (format == BLOCK_FORMAT_BC3 ? DXGI_FORMAT_BC3_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM_SRGB);
+        dx10.resourceDimension = DDS_DIMENSION_TEXTURE2D;
+        dx10.arraySize = 1;
+
+        std::string tempPath = fileName + ".tmp";
+        std::ofstream ddsFile(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!ddsFile) {
+            return false;
+        }
+        ddsFile.write(DDS_MAGIC, sizeof(DDS_MAGIC));
+        ddsFile.write((const char*)&header, sizeof(header));
+        ddsFile.write((const char*)&dx10, sizeof(dx10));
+        for (size_t level = 0; level < levels.size(); level++) {
+            if (!levels[level].empty()) {
+                ddsFile.write((const char*)&levels[level][0], levels[level].size());
+            }
+        }
+
+        ddsFile.close();
+        if (!ddsFile) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(fileName.c_str());
+        return std::rename(tempPath.c_str(), fileName.c_str()) == 0;
+    }
+
+    std::string DdsFile::GetCompressedPath(const std::string& imagePath)
+    {
+        // the extension is kept, base-scene has both podea.jpg and podea.jfif
+        return imagePath + ".dds";
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef DdsFile_hpp
+#define DdsFile_hpp
+
+#include "BlockCompressor.hpp"
+#include "MappedFile.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Block compressed 2D texture with its mip chain in a .dds file. Only BC1, BC3 and BC7 are read, every
+    // one is treated as sRGB like the other material textures. Files written here store the bottom row
+    // first, already flipped for OpenGL like the asset bundle textures.
+    class DdsFile
+    {
+    public:
+        DdsFile();
+
+        // Maps fileName and validates the header and the level sizes
+        bool Open(const std::string& fileName);
+        void Close();
+
+        BlockFormat GetFormat() const;
+        int GetWidth() const;
+        int GetHeight() const;
+        int GetLevelCount() const;
+        const unsigned char* GetLevelData(int level) const;
+        size_t GetLevelSize(int level) const;
+
+        // Writes levels (each BlockCompressor::GetLevelSize bytes, halving down from width x height)
+        // with a DX10 header naming the sRGB format. Returns false on I/O errors.
+        static bool Write(const std::string& fileName, BlockFormat format, int width, int height,
+            const std::vector<std::vector<unsigned char> >& levels);
+
+        // The .dds next to an image, e.g. wood_dark.jpg -> wood_dark.jpg.dds
+        static std::string GetCompressedPath(const std::string& imagePath);
+
+    private:
+        MappedFile file;
+        BlockFormat format;
+        int width;
+        int height;
+        int levelCount;
+        size_t dataOffset;
+
+        DdsFile(const DdsFile&);
+        DdsFile& operator=(const DdsFile&);
+    };
+}
+
+#endif /* DdsFile_hpp */
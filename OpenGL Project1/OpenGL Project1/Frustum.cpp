@@ -0,0 +1,148 @@
+#include "Frustum.hpp"
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace gps {
+
+    static glm::vec4 NormalizePlane(const glm::vec4& plane)
+    {
+        float length = glm::length(glm::vec3(plane));
+        return length > 0.0f ? plane / length : plane;
+    }
+
+    Frustum::Frustum()
+    {
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            planes[p] = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+        }
+    }
+
+    void Frustum::Extract(const glm::mat4& clipMatrix)
+    {
+        // glm matrices are column major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+        glm::vec4 rows[4];
+        for (int i = 0; i < 4; i++) {
+            rows[i] = glm::vec4(clipMatrix[0][i], clipMatrix[1][i], clipMatrix[2][i], clipMatrix[3][i]);
+        }
+
+        // -w <= x, y, z <= w
+        planes[FRUSTUM_PLANE_LEFT] = NormalizePlane(rows[3] + rows[0]);
+        planes[FRUSTUM_PLANE_RIGHT] = NormalizePlane(rows[3] - rows[0]);
+        planes[FRUSTUM_PLANE_BOTTOM] = NormalizePlane(rows[3] + rows[1]);
+        planes[FRUSTUM_PLANE_TOP] = NormalizePlane(rows[3] - rows[1]);
+        planes[FRUSTUM_PLANE_NEAR] = NormalizePlane(rows[3] + rows[2]);
+        planes[FRUSTUM_PLANE_FAR] = NormalizePlane(rows[3] - rows[2]);
+    }
+
+    Frustum Frustum::Transform(const glm::mat4& model) const
+    {
+        // a point p is on the object space plane when model * p is on the original one
+        glm::mat4 transposed = glm::transpose(model);
+        Frustum frustum;
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            frustum.planes[p] = NormalizePlane(transposed * planes[p]);
+        }
+        return frustum;
+    }
+
+    const glm::vec4& Frustum::GetPlane(FrustumPlane plane) const
+    {
+        return planes[plane];
+    }
+
+    bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+    {
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            if (glm::dot(glm::vec3(planes[p]), center) + planes[p].w < -radius) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool Frustum::IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const
+    {
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+            glm::vec3 normal = glm::vec3(planes[p]);
+            glm::vec3 corner(normal.x >= 0.0f ? boxMax.x : boxMin.x,
+                normal.y >= 0.0f ? boxMax.y : boxMin.y,
+                normal.z >= 0.0f ? boxMax.z : boxMin.z);
+            if (glm::dot(normal, corner) + planes[p].w < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void Frustum::CullSpheres(const glm::vec4* spheres, size_t count, unsigned char* visible) const
+    {
+        size_t i = 0;
+#ifdef FRUSTUM_SSE
+        // four spheres transposed to x, y, z, radius lanes, each plane broadcast across them
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(&spheres[i].x);
+            __m128 y = _mm_loadu_ps(&spheres[i + 1].x);
+            __m128 z = _mm_loadu_ps(&spheres[i + 2].x);
+            __m128 radius = _mm_loadu_ps(&spheres[i + 3].x);
+            _MM_TRANSPOSE4_PS(x, y, z, radius);
+            __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), radius);
+
+            __m128 outside = _mm_setzero_ps();
+            for (int p = 0; p < FRUSTUM_PLANE_COUNT; p++) {
+                __m128 distance = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(planes[p].x)), _mm_set1_ps(planes[p].w));
+                distance = _mm_add_ps(distance, _mm_mul_ps(y, _mm_set1_ps(planes[p].y)));
+                distance = _mm_add_ps(distance, _mm_mul_ps(z, _mm_set1_ps(planes[p].z)));
+                outside = _mm_or_ps(outside, _mm_cmplt_ps(distance, negativeRadius));
+            }
+
+            int outsideMask = _mm_movemask_ps(outside);
+            for (int lane = 0; lane < 4; lane++) {
+                visible[i + lane] = (outsideMask >> lane) & 1 ? 0 : 1;
+            }
+        }
+#endif
+        for (; i < count; i++) {
+            visible[i] = IntersectsSphere(glm::vec3(spheres[i]), spheres[i].w) ? 1 : 0;
+        }
+    }
+
+    bool Frustum::ClipTriangle(const glm::mat4& clipMatrix, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        // Sutherland-Hodgman in homogeneous clip space, a convex polygon gains at most one vertex per plane
+        glm::vec4 polygon[3 + FRUSTUM_PLANE_COUNT];
+        glm::vec4 clipped[3 + FRUSTUM_PLANE_COUNT];
+        int vertexCount = 3;
+        polygon[0] = clipMatrix * glm::vec4(a, 1.0f);
+        polygon[1] = clipMatrix * glm::vec4(b, 1.0f);
+        polygon[2] = clipMatrix * glm::vec4(c, 1.0f);
+
+        for (int p = 0; p < FRUSTUM_PLANE_COUNT && vertexCount > 0; p++) {
+            int axis = p / 2;
+            float sign = p % 2 == 0 ? 1.0f : -1.0f;
+            int clippedCount = 0;
+            for (int v = 0; v < vertexCount; v++) {
+                const glm::vec4& current = polygon[v];
+                const glm::vec4& next = polygon[(v + 1) % vertexCount];
+                float currentDistance = current.w + sign * current[axis];
+                float nextDistance = next.w + sign * next[axis];
+
+                if (currentDistance >= 0.0f) {
+                    clipped[clippedCount++] = current;
+                }
+                if ((currentDistance >= 0.0f) != (nextDistance >= 0.0f)) {
+                    float t = currentDistance / (currentDistance - nextDistance);
+                    clipped[clippedCount++] = current + (next - current) * t;
+                }
+            }
+
+            vertexCount = clippedCount;
+            for (int v = 0; v < vertexCount; v++) {
+                polygon[v] = clipped[v];
+            }
+        }
+        return vertexCount > 0;
+    }
+}
@@ -0,0 +1,64 @@
+#ifndef Frustum_hpp
+#define Frustum_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    enum FrustumPlane
+    {
+        FRUSTUM_PLANE_LEFT = 0,
+        FRUSTUM_PLANE_RIGHT,
+        FRUSTUM_PLANE_BOTTOM,
+        FRUSTUM_PLANE_TOP,
+        FRUSTUM_PLANE_NEAR,
+        FRUSTUM_PLANE_FAR,
+        FRUSTUM_PLANE_COUNT
+    };
+
+    // Meshes tested in one frame: kept, outside the frustum, and inside it but hidden behind occluders
+    struct CullStats
+    {
+        unsigned int visible;
+        unsigned int culled;
+        unsigned int occluded;
+    };
+
+    // The six clip planes of a projection, pointing inwards. Planes extracted from projection * view are
+    // in world space, from projection * view * model in that model's object space. Every test is
+    // conservative: an object is only rejected when it is entirely outside one plane.
+    class Frustum
+    {
+    public:
+        // Everything is inside until Extract is called
+        Frustum();
+
+        // Reads the planes from the rows of a clip matrix (Gribb and Hartmann), normalized
+        void Extract(const glm::mat4& clipMatrix);
+
+        // The same planes expressed in the space model transforms from
+        Frustum Transform(const glm::mat4& model) const;
+
+        const glm::vec4& GetPlane(FrustumPlane plane) const;
+
+        bool IntersectsSphere(const glm::vec3& center, float radius) const;
+
+        // Axis aligned box, tested with the corner farthest along each plane normal
+        bool IntersectsBox(const glm::vec3& boxMin, const glm::vec3& boxMax) const;
+
+        // Sets visible[i] to 1 if spheres[i] (center in xyz, radius in w) may be visible, 0 if not.
+        // Four spheres are tested per step with SSE where it is available.
+        void CullSpheres(const glm::vec4* spheres, size_t count, unsigned char* visible) const;
+
+        // Reference test: clips the triangle against the clip space volume of clipMatrix and returns
+        // true if any part of it is left
+        static bool ClipTriangle(const glm::mat4& clipMatrix, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c);
+
+    private:
+        glm::vec4 planes[FRUSTUM_PLANE_COUNT];
+    };
+}
+
+#endif /* Frustum_hpp */
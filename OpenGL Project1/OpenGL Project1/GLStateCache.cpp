@@ -0,0 +1,234 @@
+#include "GLStateCache.hpp"
+
+namespace gps {
+
+    // never a valid name or enum, compares unequal to anything set
+    static const GLuint UNKNOWN = 0xFFFFFFFFu;
+
+    bool GLStateCache::enabled = true;
+
+    GLStateCache::GLStateCache()
+    {
+        frameStats.issued = 0;
+        frameStats.elided = 0;
+        frameStats.textureBinds = 0;
+        lastFrameStats = frameStats;
+        totalStats = frameStats;
+        Invalidate();
+    }
+
+    GLStateCache& GLStateCache::Get()
+    {
+        // never destroyed, like TextureManager, so objects released during static destruction can use it
+        static GLStateCache* instance = new GLStateCache();
+        return *instance;
+    }
+
+    bool GLStateCache::Changed(bool differs)
+    {
+        if (differs || !enabled) {
+            frameStats.issued++;
+            return true;
+        }
+        frameStats.elided++;
+        return false;
+    }
+
+    void GLStateCache::UseProgram(GLuint program)
+    {
+        if (Changed(this->program != program)) {
+            glUseProgram(program);
+            this->program = program;
+        }
+    }
+
+    void GLStateCache::BindVertexArray(GLuint vertexArray)
+    {
+        if (Changed(this->vertexArray != vertexArray)) {
+            glBindVertexArray(vertexArray);
+            this->vertexArray = vertexArray;
+        }
+    }
+
+    void GLStateCache::ActiveTexture(GLuint unit)
+    {
+        if (Changed(activeUnit != unit)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeUnit = unit;
+        }
+    }
+
+    void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        int targetIndex = GetTargetIndex(target);
+        if (unit >= MAX_TEXTURE_UNITS || targetIndex < 0) {
+            // not tracked, send as is and forget the unit selection
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glBindTexture(target, texture);
+            activeUnit = unit;
+            frameStats.issued += 2;
+            frameStats.textureBinds++;
+            return;
+        }
+
+        if (textures[unit][targetIndex] == texture && enabled) {
+            frameStats.elided++;
+            return;
+        }
+        ActiveTexture(unit);
+        Changed(true);
+        glBindTexture(target, texture);
+        frameStats.textureBinds++;
+        textures[unit][targetIndex] = texture;
+    }
+
+    void GLStateCache::SetCapability(GLenum capability, bool enable)
+    {
+        int index = GetCapabilityIndex(capability);
+        if (index < 0 || Changed(capabilities[index] != (int)enable)) {
+            if (enable) {
+                glEnable(capability);
+            }
+            else {
+                glDisable(capability);
+            }
+            if (index >= 0) {
+                capabilities[index] = enable;
+            }
+        }
+    }
+
+    void GLStateCache::SetBlendFunc(GLenum source, GLenum destination)
+    {
+        if (Changed(blendSource != source || blendDestination != destination)) {
+            glBlendFunc(source, destination);
+            blendSource = source;
+            blendDestination = destination;
+        }
+    }
+
+    void GLStateCache::SetDepthFunc(GLenum func)
+    {
+        if (Changed(depthFunc != func)) {
+            glDepthFunc(func);
+            depthFunc = func;
+        }
+    }
+
+    void GLStateCache::SetDepthMask(bool enable)
+    {
+        if (Changed(depthMask != (int)enable)) {
+            glDepthMask(enable ? GL_TRUE : GL_FALSE);
+            depthMask = enable;
+        }
+    }
+
+    void GLStateCache::SetPolygonMode(GLenum mode)
+    {
+        if (Changed(polygonMode != mode)) {
+            glPolygonMode(GL_FRONT_AND_BACK, mode);
+            polygonMode = mode;
+        }
+    }
+
+    void GLStateCache::ForgetTexture(GLuint texture)
+    {
+        for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            for (int target = 0; target < TEXTURE_TARGET_COUNT; target++) {
+                if (textures[unit][target] == texture) {
+                    textures[unit][target] = UNKNOWN;
+                }
+            }
+        }
+    }
+
+    void GLStateCache::ForgetVertexArray(GLuint vertexArray)
+    {
+        if (this->vertexArray == vertexArray) {
+            this->vertexArray = UNKNOWN;
+        }
+    }
+
+    void GLStateCache::ForgetProgram(GLuint program)
+    {
+        if (this->program == program) {
+            this->program = UNKNOWN;
+        }
+    }
+
+    void GLStateCache::Invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int unit = 0; unit < MAX_TEXTURE_UNITS; unit++) {
+            for (int target = 0; target < TEXTURE_TARGET_COUNT; target++) {
+                textures[unit][target] = UNKNOWN;
+            }
+        }
+        for (int i = 0; i < CAPABILITY_COUNT; i++) {
+            capabilities[i] = -1;
+        }
+        blendSource = UNKNOWN;
+        blendDestination = UNKNOWN;
+        depthFunc = UNKNOWN;
+        depthMask = -1;
+        polygonMode = UNKNOWN;
+    }
+
+    void GLStateCache::EndFrame()
+    {
+        lastFrameStats = frameStats;
+        totalStats.issued += frameStats.issued;
+        totalStats.elided += frameStats.elided;
+        totalStats.textureBinds += frameStats.textureBinds;
+        frameStats.issued = 0;
+        frameStats.elided = 0;
+        frameStats.textureBinds = 0;
+    }
+
+    GLStateStats GLStateCache::GetFrameStats() const
+    {
+        return lastFrameStats;
+    }
+
+    GLStateStats GLStateCache::GetTotalStats() const
+    {
+        return totalStats;
+    }
+
+    void GLStateCache::SetEnabled(bool enabled)
+    {
+        GLStateCache::enabled = enabled;
+    }
+
+    int GLStateCache::GetTargetIndex(GLenum target)
+    {
+        switch (target) {
+        case GL_TEXTURE_2D:
+            return 0;
+        case GL_TEXTURE_CUBE_MAP:
+            return 1;
+        case GL_TEXTURE_2D_ARRAY:
+            return 2;
+        default:
+            return -1;
+        }
+    }
+
+    int GLStateCache::GetCapabilityIndex(GLenum capability)
+    {
+        switch (capability) {
+        case GL_BLEND:
+            return 0;
+        case GL_DEPTH_TEST:
+            return 1;
+        case GL_CULL_FACE:
+            return 2;
+        case GL_FRAMEBUFFER_SRGB:
+            return 3;
+        default:
+            return -1;
+        }
+    }
+}
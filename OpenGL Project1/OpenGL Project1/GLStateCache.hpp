@@ -0,0 +1,89 @@
+#ifndef GLStateCache_hpp
+#define GLStateCache_hpp
+
+#include <GL/glew.h>
+
+namespace gps {
+
+    struct GLStateStats
+    {
+        // state changes sent to GL and the ones skipped because GL already had that state
+        unsigned int issued;
+        unsigned int elided;
+        // glBindTexture calls among the issued ones
+        unsigned int textureBinds;
+    };
+
+    // Shadow copy of the GL state the draw path changes: program, vertex array, texture bindings,
+    // capabilities, blend/depth functions and polygon mode. Setting a value GL already has is skipped.
+    // Every change of this state must go through here, else the shadow copy is stale; Invalidate()
+    // forgets it after code that cannot. Only used from the GL thread.
+    class GLStateCache
+    {
+    public:
+        static const int MAX_TEXTURE_UNITS = 16;
+
+        static GLStateCache& Get();
+
+        void UseProgram(GLuint program);
+        void BindVertexArray(GLuint vertexArray);
+        // Binds texture to GL_TEXTURE_2D, GL_TEXTURE_CUBE_MAP or GL_TEXTURE_2D_ARRAY of unit
+        void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+        // GL_BLEND, GL_DEPTH_TEST, GL_CULL_FACE or GL_FRAMEBUFFER_SRGB
+        void SetCapability(GLenum capability, bool enable);
+        void SetBlendFunc(GLenum source, GLenum destination);
+        void SetDepthFunc(GLenum func);
+        void SetDepthMask(bool enable);
+        void SetPolygonMode(GLenum mode);
+
+        // GL unbinds deleted objects, and may hand the same name out again
+        void ForgetTexture(GLuint texture);
+        void ForgetVertexArray(GLuint vertexArray);
+        void ForgetProgram(GLuint program);
+
+        // Marks every value unknown, the next call for each is sent to GL
+        void Invalidate();
+
+        // Closes the frame counters, GetFrameStats returns the frame just finished
+        void EndFrame();
+        GLStateStats GetFrameStats() const;
+        GLStateStats GetTotalStats() const;
+
+        // Skipping is on by default, off sends every call to GL to compare the issued counts
+        static void SetEnabled(bool enabled);
+
+    private:
+        static const int TEXTURE_TARGET_COUNT = 3;
+        static const int CAPABILITY_COUNT = 4;
+
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        GLuint textures[MAX_TEXTURE_UNITS][TEXTURE_TARGET_COUNT];
+        int capabilities[CAPABILITY_COUNT];
+        GLenum blendSource;
+        GLenum blendDestination;
+        GLenum depthFunc;
+        int depthMask;
+        GLenum polygonMode;
+
+        GLStateStats frameStats;
+        GLStateStats lastFrameStats;
+        GLStateStats totalStats;
+
+        static bool enabled;
+
+        GLStateCache();
+        GLStateCache(const GLStateCache&);
+        GLStateCache& operator=(const GLStateCache&);
+
+        // True if the change has to be sent to GL, counting it either way
+        bool Changed(bool differs);
+        void ActiveTexture(GLuint unit);
+        static int GetTargetIndex(GLenum target);
+        static int GetCapabilityIndex(GLenum capability);
+    };
+}
+
+#endif /* GLStateCache_hpp */
@@ -0,0 +1,34 @@
+#ifndef Hash_hpp
+#define Hash_hpp
+
+#include <cstring>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace gps {
+
+    const uint64_t HASH_SEED = 14695981039346656037ULL;
+
+    // FNV-1a over 8 byte words, the tail is hashed byte by byte. Not a cryptographic hash; the result can be
+    // passed back in as hash to continue over another buffer. Values are stored in the mesh and program
+    // binary caches, so changing it means bumping their versions.
+    inline uint64_t HashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED)
+    {
+        const unsigned char* bytes = (const unsigned char*)data;
+        const uint64_t prime = 1099511628211ULL;
+
+        size_t i = 0;
+        for (; i + 8 <= size; i += 8) {
+            uint64_t word;
+            memcpy(&word, bytes + i, sizeof(word));
+            hash = (hash ^ word) * prime;
+        }
+        for (; i < size; i++) {
+            hash = (hash ^ bytes[i]) * prime;
+        }
+
+        return hash;
+    }
+}
+
+#endif /* Hash_hpp */
@@ -0,0 +1,39 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        // Maps fileName into memory, returns false if it cannot be opened or is empty
+        bool Open(const std::string& fileName);
+        void Close();
+
+        bool IsOpen() const;
+        const unsigned char* GetData() const;
+        size_t GetSize() const;
+
+    private:
+        const unsigned char* data;
+        size_t size;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
+}
+
+#endif /* MappedFile_hpp */
@@ -0,0 +1,93 @@
+#include "MaterialTable.hpp"
+
+#include <cstring>
+#include <iostream>
+
+namespace gps {
+
+    MaterialTable& MaterialTable::Get()
+    {
+        // never destroyed, like the texture manager
+        static MaterialTable* instance = new MaterialTable();
+        return *instance;
+    }
+
+    MaterialTable::MaterialTable() : created(false), dirty(true), indexBuffer(0)
+    {
+        MaterialUniforms white;
+        white.ambient = glm::vec4(1.0f);
+        white.diffuse = glm::vec4(1.0f);
+        white.specular = glm::vec4(1.0f);
+        white.textureLayers = glm::vec4(-1.0f);
+        materials.push_back(white);
+    }
+
+    uint32_t MaterialTable::Add(const gps::Material& material, bool diffuseTexture, bool specularTexture)
+    {
+        MaterialUniforms entry;
+        entry.ambient = glm::vec4(material.ambient, 1.0f);
+        entry.diffuse = glm::vec4(material.diffuse, diffuseTexture ? 1.0f : 0.0f);
+        entry.specular = glm::vec4(material.specular, specularTexture ? 1.0f : 0.0f);
+        entry.textureLayers = glm::vec4(-1.0f);
+        return Find(entry);
+    }
+
+    uint32_t MaterialTable::SetTextureLayers(uint32_t material, int diffuseLayer, int specularLayer)
+    {
+        MaterialUniforms entry = materials[material];
+        entry.textureLayers = glm::vec4((float)diffuseLayer, (float)specularLayer, -1.0f, -1.0f);
+        return Find(entry);
+    }
+
+    uint32_t MaterialTable::Find(const gps::MaterialUniforms& entry)
+    {
+        for (size_t i = 0; i < materials.size(); i++) {
+            if (memcmp(&materials[i], &entry, sizeof(MaterialUniforms)) == 0) {
+                return (uint32_t)i;
+            }
+        }
+        if (materials.size() == MAX_MATERIALS) {
+            std::cerr << "WARNING: more than " << MAX_MATERIALS << " materials, drawing the rest with the default one" << std::endl;
+            return 0;
+        }
+        materials.push_back(entry);
+        dirty = true;
+        return (uint32_t)(materials.size() - 1);
+    }
+
+    size_t MaterialTable::GetCount() const
+    {
+        return materials.size();
+    }
+
+    void MaterialTable::Upload()
+    {
+        if (!dirty) {
+            return;
+        }
+        // the whole array is bound even when part of it is filled, the shader only reads the used entries
+        if (!created) {
+            buffer.Create(UNIFORM_BINDING_MATERIALS, sizeof(MaterialUniforms) * MAX_MATERIALS);
+            created = true;
+        }
+        std::vector<MaterialUniforms> block(MAX_MATERIALS, materials[0]);
+        std::copy(materials.begin(), materials.end(), block.begin());
+        // as a plain pointer, the template overload would copy the pointer itself
+        buffer.Update((const void*)&block[0]);
+        dirty = false;
+    }
+
+    GLuint MaterialTable::GetIndexBuffer()
+    {
+        if (indexBuffer == 0) {
+            std::vector<GLuint> indices(MAX_MATERIALS);
+            for (GLuint i = 0; i < indices.size(); i++) {
+                indices[i] = i;
+            }
+            glGenBuffers(1, &indexBuffer);
+            glBindBuffer(GL_ARRAY_BUFFER, indexBuffer);
+            glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), &indices[0], GL_STATIC_DRAW);
+        }
+        return indexBuffer;
+    }
+}
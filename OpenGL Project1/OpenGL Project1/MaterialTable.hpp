@@ -0,0 +1,57 @@
+#ifndef MaterialTable_hpp
+#define MaterialTable_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "Mesh.hpp"
+#include "UniformBuffer.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace gps {
+
+    // Length of the MaterialBlock array in basic.frag, at 64 bytes each it fills the 16 KB every GL 4.1
+    // driver allows for a uniform block
+    const int MAX_MATERIALS = 256;
+
+    // Scene-wide table of the .mtl colors, uploaded as one uniform block array so a draw only needs the
+    // index of its material. Equal materials share an entry. Entry 0 is white and samples both textures,
+    // it is what draws without a material index get. Only used from the GL thread.
+    class MaterialTable
+    {
+    public:
+        static MaterialTable& Get();
+
+        // Index of the material, added if the table has no equal one. Returns 0 once the table is full.
+        uint32_t Add(const gps::Material& material, bool diffuseTexture, bool specularTexture);
+        // Index of a copy of entry material sampling the given texture array layers, -1 for a 2D texture
+        uint32_t SetTextureLayers(uint32_t material, int diffuseLayer, int specularLayer);
+        size_t GetCount() const;
+
+        // Copies the table to the uniform buffer if something was added since the last call
+        void Upload();
+
+        // 0, 1, 2 ... MAX_MATERIALS - 1, read as a per instance attribute an indirect draw's baseInstance
+        // turns into its material index
+        GLuint GetIndexBuffer();
+
+    private:
+        std::vector<gps::MaterialUniforms> materials;
+        gps::UniformBuffer buffer;
+        bool created;
+        bool dirty;
+        GLuint indexBuffer;
+
+        MaterialTable();
+
+        // Index of an equal entry, the entry is added if there is none
+        uint32_t Find(const gps::MaterialUniforms& entry);
+
+        MaterialTable(const MaterialTable&);
+        MaterialTable& operator=(const MaterialTable&);
+    };
+}
+
+#endif /* MaterialTable_hpp */
@@ -7,65 +7,297 @@ namespace gps {
 		this->vertices = vertices;
 		this->indices = indices;
 		this->textures = textures;
+		this->format = VERTEX_FORMAT_FLOAT;
+		this->quantization.positionOffset = glm::vec3(0.0f);
+		this->quantization.positionScale = glm::vec3(1.0f);
 
-		this->setupMesh();
+		this->setupMesh(&this->vertices[0], (GLsizei)this->vertices.size(), &this->indices[0], (GLsizei)this->indices.size());
+	}
+
+	Mesh::Mesh(const void* vertexData, GLsizei vertexCount, VertexFormat format, const VertexQuantization& quantization,
+		const GLuint* indices, GLsizei indexCount, std::vector<Texture> textures)
+	{
+		this->textures = textures;
+		this->format = format;
+		this->quantization = quantization;
+
+		this->setupMesh(vertexData, vertexCount, indices, indexCount);
 	}
 
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	void Mesh::setLods(const std::vector<MeshLod>& lods) {
+		if (!lods.empty()) {
+			this->lods = lods;
+			this->currentLod = 0;
+		}
+	}
+
+	int Mesh::getLodCount() const {
+		return (int)this->lods.size();
+	}
+
+	const MeshLod& Mesh::getLod(int lod) const {
+		return this->lods[lod];
+	}
+
+	void Mesh::setMaterial(uint32_t materialIndex) {
+		this->materialIndex = materialIndex;
+	}
+
+	uint32_t Mesh::getMaterial() const {
+		return this->materialIndex;
+	}
+
+	VertexFormat Mesh::getFormat() const {
+		return this->format;
+	}
+
+	GLsizei Mesh::getVertexCount() const {
+		return this->vertexCount;
+	}
+
+	GLsizei Mesh::getIndexCount() const {
+		return this->indexCount;
+	}
+
+	GLuint Mesh::getFirstVertex() const {
+		return this->firstVertex;
+	}
+
+	void Mesh::moveToSharedBuffers(GLuint vertexBuffer, GLuint firstVertex, GLuint indexBuffer, GLuint firstIndex) {
+		GLsizeiptr vertexSize = this->format == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+		glBindBuffer(GL_COPY_READ_BUFFER, this->buffers.VBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, firstVertex * vertexSize, this->vertexCount * vertexSize);
+		glBindBuffer(GL_COPY_READ_BUFFER, this->buffers.EBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, indexBuffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, firstIndex * sizeof(GLuint), this->indexCount * sizeof(GLuint));
+
+		// the indices stay relative to the mesh, the attributes start at its first vertex instead
+		GLStateCache::Get().BindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+		setVertexAttributes(this->format, firstVertex * vertexSize);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+		GLStateCache::Get().BindVertexArray(0);
+
+		glDeleteBuffers(1, &this->buffers.VBO);
+		glDeleteBuffers(1, &this->buffers.EBO);
+		// owned by the model now
+		this->buffers.VBO = 0;
+		this->buffers.EBO = 0;
+
+		this->firstVertex = firstVertex;
+		for (size_t i = 0; i < this->lods.size(); i++) {
+			this->lods[i].indexOffset += firstIndex;
+		}
+	}
+
+	void Mesh::setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax) {
+		this->boundsMin = boundsMin;
+		this->boundsMax = boundsMax;
+		this->boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		this->boundsRadius = glm::length(boundsMax - boundsMin) * 0.5f;
+	}
+
+	glm::vec3 Mesh::getBoundsCenter() const {
+		return this->boundsCenter;
+	}
+
+	float Mesh::getBoundsRadius() const {
+		return this->boundsRadius;
+	}
+
+	glm::vec3 Mesh::getBoundsMin() const {
+		return this->boundsMin;
+	}
+
+	glm::vec3 Mesh::getBoundsMax() const {
+		return this->boundsMax;
+	}
+
+	int Mesh::selectLod(float screenSize, float hysteresis) {
+		this->currentLod = SelectLod(screenSize, this->currentLod, (int)this->lods.size(), hysteresis);
+		return this->currentLod;
+	}
+
+	int Mesh::SelectLod(float screenSize, int currentLod, int lodCount, float hysteresis) {
+		// coarsest level whose threshold is passed, with the thresholds pushed away from the current level
+		int coarser = 0;
+		int finer = 0;
+		for (int lod = 1; lod < lodCount; lod++) {
+			if (screenSize < LOD_SCREEN_SIZE[lod] * (1.0f - hysteresis)) {
+				coarser = lod;
+			}
+			if (screenSize < LOD_SCREEN_SIZE[lod] * (1.0f + hysteresis)) {
+				finer = lod;
+			}
+		}
+
+		if (coarser > currentLod) {
+			return coarser;
+		}
+		if (finer < currentLod) {
+			return finer;
+		}
+		return currentLod < lodCount ? currentLod : lodCount - 1;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(const gps::Shader& shader)
+	{
+		this->Draw(shader, 0);
+	}
+
+	void Mesh::Draw(const gps::Shader& shader, int lod)
+	{
+		this->bindMaterial(shader, false);
+		GLStateCache::Get().BindVertexArray(this->buffers.VAO);
+		const MeshLod& range = this->lods[lod];
+		glDrawElements(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.indexOffset * sizeof(GLuint)));
+	}
+
+	void Mesh::DrawInstanced(const gps::Shader& shader, int lod, GLsizei instanceCount)
+	{
+		this->bindMaterial(shader, true);
+		GLStateCache::Get().BindVertexArray(this->buffers.VAO);
+		const MeshLod& range = this->lods[lod];
+		glDrawElementsInstanced(GL_TRIANGLES, range.indexCount, GL_UNSIGNED_INT, (GLvoid*)(range.indexOffset * sizeof(GLuint)),
+			instanceCount);
+	}
+
+	void Mesh::setInstanceBuffer(GLuint buffer)
 	{
+		GLStateCache::Get().BindVertexArray(this->buffers.VAO);
+		glBindBuffer(GL_ARRAY_BUFFER, buffer);
+		// a matrix attribute takes one location per column, each advanced once per instance
+		for (GLuint i = 0; i < 4; i++) {
+			GLuint location = INSTANCE_MODEL_LOCATION + i;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLvoid*)(offsetof(InstanceData, model) + i * sizeof(glm::vec4)));
+			glVertexAttribDivisor(location, 1);
+		}
+		for (GLuint i = 0; i < 3; i++) {
+			GLuint location = INSTANCE_NORMAL_MATRIX_LOCATION + i;
+			glEnableVertexAttribArray(location);
+			glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, sizeof(InstanceData),
+				(GLvoid*)(offsetof(InstanceData, normalMatrix) + i * sizeof(glm::vec3)));
+			glVertexAttribDivisor(location, 1);
+		}
+	}
+
+	void Mesh::bindMaterial(const gps::Shader& shader, bool instanced)
+	{
+		GLStateCache& state = GLStateCache::Get();
 		shader.useShaderProgram();
+		if (this->uniformProgram != shader.shaderProgram || this->textureUniforms.size() != this->textures.size()) {
+			resolveUniforms(shader);
+		}
 
-		//set textures
+		//set textures, they stay bound after the draw so the next mesh with the same ones skips the binds
 		for (GLuint i = 0; i < textures.size(); i++)
 		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+			if (this->textures[i].layer >= 0) {
+				// the layer itself comes from the material
+				this->textureUniforms[i].set(TEXTURE_ARRAY_UNIT + i);
+				state.BindTexture(TEXTURE_ARRAY_UNIT + i, GL_TEXTURE_2D_ARRAY, this->textures[i].id);
+				continue;
+			}
+			this->textureUniforms[i].set(i);
+			state.BindTexture(i, GL_TEXTURE_2D, this->textures[i].id);
 		}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
-
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+		//vertex dequantization
+		this->positionOffsetUniform.set(this->quantization.positionOffset);
+		this->positionScaleUniform.set(this->quantization.positionScale);
+		this->octahedralNormalsUniform.set(this->format == VERTEX_FORMAT_COMPACT);
+		this->instancedUniform.set(instanced);
 
+		// current vertex attribute, read by vertex arrays without a material index array
+		glVertexAttribI1ui(MATERIAL_INDEX_LOCATION, this->materialIndex);
     }
 
+	void Mesh::resolveUniforms(const gps::Shader& shader)
+	{
+		this->uniformProgram = shader.shaderProgram;
+		this->textureUniforms.clear();
+		for (size_t i = 0; i < this->textures.size(); i++) {
+			const std::string& type = this->textures[i].type;
+			this->textureUniforms.push_back(shader.getUniform<GLint>(this->textures[i].layer >= 0 ? type + "Array" : type));
+		}
+		this->positionOffsetUniform = shader.getUniform<glm::vec3>("positionOffset");
+		this->positionScaleUniform = shader.getUniform<glm::vec3>("positionScale");
+		this->octahedralNormalsUniform = shader.getUniform<bool>("octahedralNormals");
+		this->instancedUniform = shader.getUniform<bool>("instanced");
+	}
+
+	void Mesh::setTexture(size_t i, GLuint id, int layer)
+	{
+		if (this->textures[i].layer != layer) {
+			// the sampler uniform changes with the layer
+			this->uniformProgram = 0;
+		}
+		this->textures[i].id = id;
+		this->textures[i].layer = layer;
+	}
+
 	// Initializes all the buffer objects/arrays
-	void Mesh::setupMesh(){
+	void Mesh::setupMesh(const void* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount){
+		MeshLod fullMesh = { 0, (GLuint)indexCount, 0.0f };
+		this->lods.assign(1, fullMesh);
+		this->currentLod = 0;
+		this->boundsCenter = glm::vec3(0.0f);
+		this->boundsRadius = 0.0f;
+		this->uniformProgram = 0;
+		this->vertexCount = vertexCount;
+		this->indexCount = indexCount;
+		this->firstVertex = 0;
+		this->materialIndex = 0;
+
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
 		glGenBuffers(1, &this->buffers.VBO);
 		glGenBuffers(1, &this->buffers.EBO);
 
-		glBindVertexArray(this->buffers.VAO);
+		GLStateCache::Get().BindVertexArray(this->buffers.VAO);
 		// Load data into vertex buffers
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		size_t vertexSize = this->format == VERTEX_FORMAT_COMPACT ? sizeof(CompactVertex) : sizeof(Vertex);
+		glBufferData(GL_ARRAY_BUFFER, vertexCount * vertexSize, vertexData, GL_STATIC_DRAW);
 
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
-
-		// Set the vertex attribute pointers
-		// Vertex Positions
-		glEnableVertexAttribArray(0);
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)0);
-		// Vertex Normals
-		glEnableVertexAttribArray(1);
-		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Normal));
-		// Vertex Texture Coords
-		glEnableVertexAttribArray(2);
-		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
-
-		glBindVertexArray(0);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(GLuint), indexData, GL_STATIC_DRAW);
+
+		setVertexAttributes(this->format, 0);
+
+		GLStateCache::Get().BindVertexArray(0);
+	}
+
+	void Mesh::setVertexAttributes(VertexFormat format, GLintptr vertexOffset) {
+		if (format == VERTEX_FORMAT_COMPACT) {
+			// Vertex Positions, dequantized in the vertex shader
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)(vertexOffset + offsetof(CompactVertex, Position)));
+			// Vertex Normals, octahedral decoded in the vertex shader
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(CompactVertex), (GLvoid*)(vertexOffset + offsetof(CompactVertex, Normal)));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(CompactVertex), (GLvoid*)(vertexOffset + offsetof(CompactVertex, TexCoords)));
+		}
+		else {
+			// Vertex Positions
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)vertexOffset);
+			// Vertex Normals
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(vertexOffset + offsetof(Vertex, Normal)));
+			// Vertex Texture Coords
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)(vertexOffset + offsetof(Vertex, TexCoords)));
+		}
 	}
 }
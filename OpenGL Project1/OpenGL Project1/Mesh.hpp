@@ -3,8 +3,11 @@
 
 #include <GL/glew.h>
 #include "glm/glm.hpp"
+#include "glm/gtc/type_ptr.hpp"
 
+#include "Bvh.hpp"
 #include "Shader.hpp"
+#include "GLStateCache.hpp"
 
 #include <string>
 #include <vector>
@@ -19,14 +22,55 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// 16 byte vertex selected with VERTEX_FORMAT_COMPACT
+struct CompactVertex
+{
+    // 16 bit unorm inside the mesh bounds, the 4th component is padding
+    GLushort Position[4];
+    // octahedral encoded unit normal, 16 bit snorm
+    GLshort Normal[2];
+    // half floats
+    GLushort TexCoords[2];
+};
+
+enum VertexFormat { VERTEX_FORMAT_FLOAT, VERTEX_FORMAT_COMPACT };
+
+// Object space position = positionOffset + stored position * positionScale
+struct VertexQuantization
+{
+    glm::vec3 positionOffset;
+    glm::vec3 positionScale;
+};
+
+// Level of detail 0 is the full mesh, every level after it is a simplified index buffer over the same vertices
+const int MAX_MESH_LODS = 4;
+
+// A level is drawn once the bounding sphere covers less than this fraction of the screen height
+const float LOD_SCREEN_SIZE[MAX_MESH_LODS] = { 1.0f, 0.25f, 0.1f, 0.04f };
+
+// Range of a level of detail inside the mesh index buffer
+struct MeshLod
+{
+    GLuint indexOffset;
+    GLuint indexCount;
+    // largest object space deviation from the full mesh
+    float error;
+};
+
 struct Texture
 {
     GLuint id;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
     std::string path;
+    // -1 for a GL_TEXTURE_2D, else the layer of the GL_TEXTURE_2D_ARRAY id, sampled through type + "Array"
+    int layer;
 };
 
+// Texture i of a mesh is bound to unit i, or to TEXTURE_ARRAY_UNIT + i when it is an array layer, so a
+// sampler2D and a sampler2DArray never share a unit
+const GLuint TEXTURE_ARRAY_UNIT = 3;
+
 struct Material
     {
         glm::vec3 ambient;
@@ -34,6 +78,42 @@ struct Material
         glm::vec3 specular;
     };
 
+// CPU-side mesh produced by the .obj parser, before it is uploaded
+struct MeshData
+{
+    std::vector<Vertex> vertices;
+    std::vector<GLuint> indices;
+    Material material;
+    // texture file names relative to the model folder, empty if the material has none
+    std::string ambientTexture;
+    std::string diffuseTexture;
+    std::string specularTexture;
+    // filled only when the compact vertex format is selected
+    std::vector<CompactVertex> compactVertices;
+    VertexQuantization quantization;
+    // every level of detail, indices holds them back to back; empty means indices is a single level
+    std::vector<MeshLod> lods;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // over the triangles of the full mesh (primitive i is indices[3i..3i+2]), empty unless enabled
+    Bvh triangleBvh;
+};
+
+// Per instance attributes of DrawInstanced, read by basic.vert at locations 3-6 (model) and 7-9 (normal
+// matrix, without the view rotation the shader adds)
+struct InstanceData
+{
+    glm::mat4 model;
+    glm::mat3 normalMatrix;
+};
+
+const GLuint INSTANCE_MODEL_LOCATION = 3;
+const GLuint INSTANCE_NORMAL_MATRIX_LOCATION = 7;
+
+// Index into the MaterialBlock array of basic.frag. A constant attribute set by bindMaterial for draws of a
+// single mesh, a per instance one for the indirect draws of merged geometry, which put it in baseInstance.
+const GLuint MATERIAL_INDEX_LOCATION = 10;
+
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
@@ -49,16 +129,94 @@ public:
 
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
+	// Uploads straight from caller owned memory (e.g. a mapped mesh cache), no CPU copy is kept.
+	// vertexData holds Vertex or CompactVertex elements depending on format.
+	Mesh(const void* vertexData, GLsizei vertexCount, VertexFormat format, const VertexQuantization& quantization,
+		const GLuint* indices, GLsizei indexCount, std::vector<Texture> textures);
+
 	Buffers getBuffers();
 
-	void Draw(gps::Shader shader);
+	// Ranges of the index buffer drawn per level of detail, by default one level covering all of it
+	void setLods(const std::vector<MeshLod>& lods);
+	int getLodCount() const;
+
+	const MeshLod& getLod(int lod) const;
+
+	// Points texture i at id, a GL_TEXTURE_2D when layer is -1, else a GL_TEXTURE_2D_ARRAY and its layer
+	void setTexture(size_t i, GLuint id, int layer);
+
+	// Entry of the MaterialTable holding the mesh colors, 0 by default
+	void setMaterial(uint32_t materialIndex);
+	uint32_t getMaterial() const;
+
+	VertexFormat getFormat() const;
+	GLsizei getVertexCount() const;
+	GLsizei getIndexCount() const;
+
+	// Copies the vertices and indices into buffers shared with other meshes, at firstVertex and firstIndex, and
+	// deletes the mesh's own. The vertex array reads from the shared buffers afterwards and the level of detail
+	// ranges point into the shared index buffer, so every draw works as before.
+	void moveToSharedBuffers(GLuint vertexBuffer, GLuint firstVertex, GLuint indexBuffer, GLuint firstIndex);
+	// Where the vertices start in the vertex buffer, the base vertex of indirect draws
+	GLuint getFirstVertex() const;
+
+	void setBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+	glm::vec3 getBoundsCenter() const;
+	float getBoundsRadius() const;
+	glm::vec3 getBoundsMin() const;
+	glm::vec3 getBoundsMax() const;
+
+	// Picks the level of detail for a bounding sphere covering screenSize of the screen height.
+	// Levels only change once the size is past the threshold by hysteresis (relative), which stops flickering.
+	int selectLod(float screenSize, float hysteresis);
+
+	void Draw(const gps::Shader& shader);
+
+	void Draw(const gps::Shader& shader, int lod);
+
+	// Points the instance attributes of the vertex array at buffer, which holds InstanceData elements
+	void setInstanceBuffer(GLuint buffer);
+
+	// One draw of instanceCount copies, each with the transform of its element in the instance buffer
+	void DrawInstanced(const gps::Shader& shader, int lod, GLsizei instanceCount);
+
+	// Binds the textures, sets the vertex format uniforms and the material index, for draws the caller issues
+	// with another vertex array
+	void bindMaterial(const gps::Shader& shader, bool instanced);
+
+	// Attribute pointers of format into the bound GL_ARRAY_BUFFER, with the first vertex at vertexOffset bytes
+	static void setVertexAttributes(VertexFormat format, GLintptr vertexOffset);
+
+	// Level for screenSize starting from currentLod, without any GL state so it can be checked on the CPU
+	static int SelectLod(float screenSize, int currentLod, int lodCount, float hysteresis);
 
 private:
     /*  Render data  */
     Buffers buffers;
+    VertexFormat format;
+    GLsizei vertexCount;
+    GLsizei indexCount;
+    GLuint firstVertex;
+    uint32_t materialIndex;
+    VertexQuantization quantization;
+    std::vector<MeshLod> lods;
+    int currentLod;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
+    // uniform handles of the program drawn with last, resolved again only when the program changes
+    GLuint uniformProgram;
+    std::vector<Uniform<GLint> > textureUniforms;
+    Uniform<glm::vec3> positionOffsetUniform;
+    Uniform<glm::vec3> positionScaleUniform;
+    Uniform<bool> octahedralNormalsUniform;
+    Uniform<bool> instancedUniform;
 
 	// Initializes all the buffer objects/arrays
-	void setupMesh();
+	void setupMesh(const void* vertexData, GLsizei vertexCount, const GLuint* indexData, GLsizei indexCount);
+
+	void resolveUniforms(const gps::Shader& shader);
 
 };
 
@@ -0,0 +1,347 @@
+#include "MeshCache.hpp"
+#include "Hash.hpp"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+namespace gps {
+
+    static const char MESH_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+
+    MeshCache::MeshCache() : data(NULL), header(NULL), entries(NULL)
+    {
+    }
+
+    std::string MeshCache::GetCachePath(const std::string& objFileName)
+    {
+        return objFileName.substr(0, objFileName.find_last_of('.')) + ".meshcache";
+    }
+
+    // The .mtl is expected next to the .obj with the same name, like our exported scenes
+    std::string MeshCache::GetMtlPath(const std::string& objFileName)
+    {
+        return objFileName.substr(0, objFileName.find_last_of('.')) + ".mtl";
+    }
+
+    bool MeshCache::GetFileStamp(const std::string& fileName, FileStamp& stamp)
+    {
+        struct stat fileInfo;
+        if (stat(fileName.c_str(), &fileInfo) != 0) {
+            // a missing file gets a stamp of its own so that creating it invalidates the cache
+            stamp.size = 0;
+            stamp.modifiedTime = -1;
+            return false;
+        }
+
+        stamp.size = (uint64_t)fileInfo.st_size;
+        stamp.modifiedTime = (int64_t)fileInfo.st_mtime;
+        return true;
+    }
+
+    size_t MeshCache::GetVertexStride(uint32_t flags)
+    {
+        return (flags & MESH_CACHE_COMPACT_VERTICES) ? sizeof(CompactVertex) : sizeof(Vertex);
+    }
+
+    size_t MeshCache::GetBvhSize(const Bvh& bvh)
+    {
+        return bvh.GetNodes().size() * sizeof(BvhNode) + bvh.GetPrimitiveIndices().size() * sizeof(uint32_t);
+    }
+
+    void MeshCache::WriteBvh(const Bvh& bvh, unsigned char* destination)
+    {
+        if (!bvh.IsEmpty()) {
+            size_t nodeBytes = bvh.GetNodes().size() * sizeof(BvhNode);
+            memcpy(destination, &bvh.GetNodes()[0], nodeBytes);
+            memcpy(destination + nodeBytes, &bvh.GetPrimitiveIndices()[0], bvh.GetPrimitiveIndices().size() * sizeof(uint32_t));
+        }
+    }
+
+    bool MeshCache::CheckBvhRange(uint64_t offset, uint32_t nodeCount, uint32_t primitiveCount, size_t size)
+    {
+        // nodes are read in place, so they keep the 4 byte alignment of their floats
+        return nodeCount == 0 || (offset % sizeof(uint32_t) == 0 &&
+            offset + (uint64_t)nodeCount * sizeof(BvhNode) + (uint64_t)primitiveCount * sizeof(uint32_t) <= size);
+    }
+
+    void MeshCache::BuildMeshBvh(const std::vector<MeshData>& meshes, Bvh& bvh)
+    {
+        std::vector<BvhPrimitive> primitives(meshes.size());
+        for (size_t i = 0; i < meshes.size(); i++) {
+            primitives[i].boundsMin = meshes[i].boundsMin;
+            primitives[i].boundsMax = meshes[i].boundsMax;
+        }
+        // one mesh per leaf, so culling through the hierarchy is as exact as testing every mesh box
+        bvh.Build(primitives, 1);
+    }
+
+    void MeshCache::Serialize(const std::vector<MeshData>& meshes, uint32_t flags, std::vector<unsigned char>& buffer)
+    {
+        MeshCacheHeader fileHeader;
+        memset(&fileHeader, 0, sizeof(fileHeader));
+        memcpy(fileHeader.magic, MESH_CACHE_MAGIC, sizeof(fileHeader.magic));
+        fileHeader.version = MESH_CACHE_VERSION;
+        fileHeader.meshCount = (uint32_t)meshes.size();
+        fileHeader.flags = flags;
+
+        // lay out the sections
+        bool compact = (flags & MESH_CACHE_COMPACT_VERTICES) != 0;
+        size_t stride = GetVertexStride(flags);
+        bool triangleBvh = (flags & MESH_CACHE_TRIANGLE_BVH) != 0;
+        Bvh meshBvh;
+        BuildMeshBvh(meshes, meshBvh);
+        size_t vertexBytes = 0;
+        size_t indexBytes = 0;
+        size_t bvhBytes = GetBvhSize(meshBvh);
+        std::string names;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            vertexBytes += meshes[i].vertices.size() * stride;
+            indexBytes += meshes[i].indices.size() * sizeof(GLuint);
+            bvhBytes += triangleBvh ? GetBvhSize(meshes[i].triangleBvh) : 0;
+            names += meshes[i].ambientTexture + meshes[i].diffuseTexture + meshes[i].specularTexture;
+        }
+
+        size_t entriesStart = sizeof(MeshCacheHeader);
+        size_t vertexStart = entriesStart + meshes.size() * sizeof(MeshCacheEntry);
+        size_t indexStart = vertexStart + vertexBytes;
+        size_t bvhStart = indexStart + indexBytes;
+        size_t namesStart = bvhStart + bvhBytes;
+
+        buffer.assign(namesStart + names.size(), 0);
+        unsigned char* data = &buffer[0];
+
+        fileHeader.bvhOffset = bvhStart;
+        fileHeader.bvhNodeCount = (uint32_t)meshBvh.GetNodes().size();
+        fileHeader.bvhPrimitiveCount = (uint32_t)meshBvh.GetPrimitiveIndices().size();
+        WriteBvh(meshBvh, data + bvhStart);
+
+        size_t vertexOffset = vertexStart;
+        size_t indexOffset = indexStart;
+        size_t bvhOffset = bvhStart + GetBvhSize(meshBvh);
+        size_t nameOffset = namesStart;
+        for (size_t i = 0; i < meshes.size(); i++) {
+            const MeshData& mesh = meshes[i];
+
+            MeshCacheEntry entry;
+            memset(&entry, 0, sizeof(entry));
+            entry.vertexOffset = vertexOffset;
+            entry.indexOffset = indexOffset;
+            entry.vertexCount = (uint32_t)mesh.vertices.size();
+            entry.indexCount = (uint32_t)mesh.indices.size();
+            if (triangleBvh) {
+                entry.bvhOffset = bvhOffset;
+                entry.bvhNodeCount = (uint32_t)mesh.triangleBvh.GetNodes().size();
+                entry.bvhPrimitiveCount = (uint32_t)mesh.triangleBvh.GetPrimitiveIndices().size();
+                WriteBvh(mesh.triangleBvh, data + bvhOffset);
+                bvhOffset += GetBvhSize(mesh.triangleBvh);
+            }
+            for (int c = 0; c < 3; c++) {
+                entry.ambient[c] = mesh.material.ambient[c];
+                entry.diffuse[c] = mesh.material.diffuse[c];
+                entry.specular[c] = mesh.material.specular[c];
+                entry.positionOffset[c] = mesh.quantization.positionOffset[c];
+                entry.positionScale[c] = mesh.quantization.positionScale[c];
+                entry.boundsMin[c] = mesh.boundsMin[c];
+                entry.boundsMax[c] = mesh.boundsMax[c];
+            }
+
+            entry.lodCount = (uint32_t)std::min(mesh.lods.size(), (size_t)MAX_MESH_LODS);
+            for (uint32_t lod = 0; lod < entry.lodCount; lod++) {
+                entry.lodIndexOffset[lod] = mesh.lods[lod].indexOffset;
+                entry.lodIndexCount[lod] = mesh.lods[lod].indexCount;
+                entry.lodError[lod] = mesh.lods[lod].error;
+            }
+
+            const std::string* textureNames[3] = { &mesh.ambientTexture, &mesh.diffuseTexture, &mesh.specularTexture };
+            for (int slot = 0; slot < 3; slot++) {
+                entry.textureOffset[slot] = (uint32_t)nameOffset;
+                entry.textureLength[slot] = (uint32_t)textureNames[slot]->size();
+                if (!textureNames[slot]->empty()) {
+                    memcpy(data + nameOffset, textureNames[slot]->data(), textureNames[slot]->size());
+                }
+                nameOffset += textureNames[slot]->size();
+            }
+
+            if (compact && !mesh.compactVertices.empty()) {
+                memcpy(data + vertexOffset, &mesh.compactVertices[0], mesh.compactVertices.size() * stride);
+            }
+            else if (!compact && !mesh.vertices.empty()) {
+                memcpy(data + vertexOffset, &mesh.vertices[0], mesh.vertices.size() * stride);
+            }
+            if (!mesh.indices.empty()) {
+                memcpy(data + indexOffset, &mesh.indices[0], mesh.indices.size() * sizeof(GLuint));
+            }
+            vertexOffset += mesh.vertices.size() * stride;
+            indexOffset += mesh.indices.size() * sizeof(GLuint);
+
+            memcpy(data + entriesStart + i * sizeof(MeshCacheEntry), &entry, sizeof(entry));
+        }
+
+        fileHeader.checksum = HashBytes(data + sizeof(MeshCacheHeader), buffer.size() - sizeof(MeshCacheHeader));
+        memcpy(data, &fileHeader, sizeof(fileHeader));
+    }
+
+    bool MeshCache::Write(const std::string& objFileName, const std::vector<MeshData>& meshes, uint32_t flags)
+    {
+        std::vector<unsigned char> buffer;
+        Serialize(meshes, flags, buffer);
+
+        // the stamps are outside the checksummed range, they only exist in cache files
+        MeshCacheHeader* fileHeader = (MeshCacheHeader*)&buffer[0];
+        if (!GetFileStamp(objFileName, fileHeader->objStamp)) {
+            return false;
+        }
+        GetFileStamp(GetMtlPath(objFileName), fileHeader->mtlStamp);
+
+        // write to a temporary file first so an interrupted run never leaves a truncated cache
+        std::string cachePath = GetCachePath(objFileName);
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream cacheFile(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!cacheFile) {
+            return false;
+        }
+        cacheFile.write((const char*)&buffer[0], buffer.size());
+        cacheFile.close();
+        if (!cacheFile) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(cachePath.c_str());
+        return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+    bool MeshCache::Open(const std::string& objFileName, uint32_t flags)
+    {
+        Close();
+
+        if (!file.Open(GetCachePath(objFileName))) {
+            return false;
+        }
+
+        if (file.GetSize() < sizeof(MeshCacheHeader)) {
+            Close();
+            return false;
+        }
+        const MeshCacheHeader* fileHeader = (const MeshCacheHeader*)file.GetData();
+        if (fileHeader->flags != flags) {
+            Close();
+            return false;
+        }
+
+        // staleness check against the sources
+        FileStamp objStamp;
+        FileStamp mtlStamp;
+        GetFileStamp(objFileName, objStamp);
+        GetFileStamp(GetMtlPath(objFileName), mtlStamp);
+        if (objStamp.size != fileHeader->objStamp.size || objStamp.modifiedTime != fileHeader->objStamp.modifiedTime ||
+            mtlStamp.size != fileHeader->mtlStamp.size || mtlStamp.modifiedTime != fileHeader->mtlStamp.modifiedTime) {
+            Close();
+            return false;
+        }
+
+        if (!Open(file.GetData(), file.GetSize())) {
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    bool MeshCache::Open(const unsigned char* cacheData, size_t size)
+    {
+        if (size < sizeof(MeshCacheHeader)) {
+            return false;
+        }
+        const MeshCacheHeader* fileHeader = (const MeshCacheHeader*)cacheData;
+        if (memcmp(fileHeader->magic, MESH_CACHE_MAGIC, sizeof(fileHeader->magic)) != 0 ||
+            fileHeader->version != MESH_CACHE_VERSION) {
+            return false;
+        }
+
+        size_t entriesEnd = sizeof(MeshCacheHeader) + (size_t)fileHeader->meshCount * sizeof(MeshCacheEntry);
+        if (entriesEnd > size ||
+            HashBytes(cacheData + sizeof(MeshCacheHeader), size - sizeof(MeshCacheHeader)) != fileHeader->checksum ||
+            !CheckBvhRange(fileHeader->bvhOffset, fileHeader->bvhNodeCount, fileHeader->bvhPrimitiveCount, size)) {
+            return false;
+        }
+
+        const MeshCacheEntry* fileEntries = (const MeshCacheEntry*)(cacheData + sizeof(MeshCacheHeader));
+        for (uint32_t i = 0; i < fileHeader->meshCount; i++) {
+            const MeshCacheEntry& entry = fileEntries[i];
+            bool inBounds = entry.vertexOffset + (uint64_t)entry.vertexCount * GetVertexStride(fileHeader->flags) <= size &&
+                entry.indexOffset + (uint64_t)entry.indexCount * sizeof(GLuint) <= size;
+            for (int slot = 0; slot < 3; slot++) {
+                inBounds = inBounds && (uint64_t)entry.textureOffset[slot] + entry.textureLength[slot] <= size;
+            }
+            inBounds = inBounds && entry.lodCount <= MAX_MESH_LODS &&
+                CheckBvhRange(entry.bvhOffset, entry.bvhNodeCount, entry.bvhPrimitiveCount, size);
+            for (uint32_t lod = 0; lod < entry.lodCount && inBounds; lod++) {
+                inBounds = (uint64_t)entry.lodIndexOffset[lod] + entry.lodIndexCount[lod] <= entry.indexCount;
+            }
+            if (!inBounds) {
+                return false;
+            }
+        }
+
+        data = cacheData;
+        header = fileHeader;
+        entries = fileEntries;
+        return true;
+    }
+
+    void MeshCache::Close()
+    {
+        file.Close();
+        data = NULL;
+        header = NULL;
+        entries = NULL;
+    }
+
+    size_t MeshCache::GetMeshCount() const
+    {
+        return header ? header->meshCount : 0;
+    }
+
+    uint32_t MeshCache::GetFlags() const
+    {
+        return header ? header->flags : 0;
+    }
+
+    const MeshCacheEntry& MeshCache::GetEntry(size_t mesh) const
+    {
+        return entries[mesh];
+    }
+
+    const void* MeshCache::GetVertexData(size_t mesh) const
+    {
+        return data + entries[mesh].vertexOffset;
+    }
+
+    const GLuint* MeshCache::GetIndices(size_t mesh) const
+    {
+        return (const GLuint*)(data + entries[mesh].indexOffset);
+    }
+
+    std::string MeshCache::GetTextureName(size_t mesh, int slot) const
+    {
+        return std::string((const char*)data + entries[mesh].textureOffset[slot], entries[mesh].textureLength[slot]);
+    }
+
+    bool MeshCache::GetMeshBvh(Bvh& bvh) const
+    {
+        const unsigned char* nodes = data + header->bvhOffset;
+        return bvh.Load((const BvhNode*)nodes, header->bvhNodeCount,
+            (const uint32_t*)(nodes + header->bvhNodeCount * sizeof(BvhNode)), header->bvhPrimitiveCount);
+    }
+
+    bool MeshCache::GetTriangleBvh(size_t mesh, Bvh& bvh) const
+    {
+        const unsigned char* nodes = data + entries[mesh].bvhOffset;
+        return bvh.Load((const BvhNode*)nodes, entries[mesh].bvhNodeCount,
+            (const uint32_t*)(nodes + entries[mesh].bvhNodeCount * sizeof(BvhNode)), entries[mesh].bvhPrimitiveCount);
+    }
+}
@@ -0,0 +1,133 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+#include "MappedFile.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the layout below or the content produced by the .obj parser changes
+    const uint32_t MESH_CACHE_VERSION = 6;
+
+    // MeshCacheHeader::flags, a cache is only reused when they match the current load options
+    const uint32_t MESH_CACHE_OPTIMIZED = 1u << 0;
+    // vertices are stored as CompactVertex instead of Vertex
+    const uint32_t MESH_CACHE_COMPACT_VERTICES = 1u << 1;
+    // index buffers hold the levels of detail after the full mesh
+    const uint32_t MESH_CACHE_LODS = 1u << 2;
+    // every mesh stores a hierarchy over its triangles
+    const uint32_t MESH_CACHE_TRIANGLE_BVH = 1u << 3;
+
+    // Size and modification time of a source file, used to detect stale caches
+    struct FileStamp
+    {
+        uint64_t size;
+        int64_t modifiedTime;
+    };
+
+    struct MeshCacheHeader
+    {
+        char magic[4];
+        uint32_t version;
+        // hash of every byte that follows the header
+        uint64_t checksum;
+        FileStamp objStamp;
+        FileStamp mtlStamp;
+        uint32_t meshCount;
+        uint32_t flags;
+        // hierarchy over the mesh bounds: BvhNode array followed by the primitive indices
+        uint64_t bvhOffset;
+        uint32_t bvhNodeCount;
+        uint32_t bvhPrimitiveCount;
+    };
+
+    // One entry per mesh, offsets are from the start of the file
+    struct MeshCacheEntry
+    {
+        uint64_t vertexOffset;
+        uint64_t indexOffset;
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        // hierarchy over the triangles laid out like the mesh one, no nodes without MESH_CACHE_TRIANGLE_BVH
+        uint64_t bvhOffset;
+        uint32_t bvhNodeCount;
+        uint32_t bvhPrimitiveCount;
+        float ambient[3];
+        float diffuse[3];
+        float specular[3];
+        // ambient, diffuse, specular texture names in the string table
+        uint32_t textureOffset[3];
+        uint32_t textureLength[3];
+        uint32_t lodCount;
+        // dequantization of compact positions, see VertexQuantization
+        float positionOffset[3];
+        float positionScale[3];
+        float boundsMin[3];
+        float boundsMax[3];
+        // see MeshLod, offsets are in indices from the start of the mesh index buffer
+        uint32_t lodIndexOffset[MAX_MESH_LODS];
+        uint32_t lodIndexCount[MAX_MESH_LODS];
+        float lodError[MAX_MESH_LODS];
+    };
+
+    // Binary cache of parsed .obj meshes, stored next to the .obj file:
+    // header | entries | interleaved vertices | indices | hierarchies | texture names
+    class MeshCache
+    {
+    public:
+        MeshCache();
+
+        static std::string GetCachePath(const std::string& objFileName);
+
+        // Serializes the meshes into buffer, the source file stamps are left zero
+        static void Serialize(const std::vector<MeshData>& meshes, uint32_t flags, std::vector<unsigned char>& buffer);
+
+        // Serializes the meshes parsed from objFileName, returns false on I/O errors
+        static bool Write(const std::string& objFileName, const std::vector<MeshData>& meshes, uint32_t flags);
+
+        // Maps the cache of objFileName, fails if it is missing, stale, corrupt or built with other flags
+        bool Open(const std::string& objFileName, uint32_t flags);
+
+        // Reads a serialized cache owned by the caller (e.g. inside an asset bundle), with any flags and
+        // no staleness check. The memory must outlive the MeshCache.
+        bool Open(const unsigned char* cacheData, size_t size);
+        void Close();
+
+        size_t GetMeshCount() const;
+        // MESH_CACHE_* flags the meshes were processed with
+        uint32_t GetFlags() const;
+        const MeshCacheEntry& GetEntry(size_t mesh) const;
+        // Vertex or CompactVertex data depending on the flags the cache was opened with
+        const void* GetVertexData(size_t mesh) const;
+        const GLuint* GetIndices(size_t mesh) const;
+        // slot: 0 ambient, 1 diffuse, 2 specular
+        std::string GetTextureName(size_t mesh, int slot) const;
+
+        // Copies the hierarchy over the mesh bounds, built when the cache was written
+        bool GetMeshBvh(Bvh& bvh) const;
+        // Copies the triangle hierarchy of a mesh, empty without MESH_CACHE_TRIANGLE_BVH
+        bool GetTriangleBvh(size_t mesh, Bvh& bvh) const;
+
+        // Hierarchy over the bounds of every mesh, primitive i is meshes[i]
+        static void BuildMeshBvh(const std::vector<MeshData>& meshes, Bvh& bvh);
+
+    private:
+        MappedFile file;
+        const unsigned char* data;
+        const MeshCacheHeader* header;
+        const MeshCacheEntry* entries;
+
+        static bool GetFileStamp(const std::string& fileName, FileStamp& stamp);
+        static std::string GetMtlPath(const std::string& objFileName);
+        static size_t GetVertexStride(uint32_t flags);
+        static size_t GetBvhSize(const Bvh& bvh);
+        static void WriteBvh(const Bvh& bvh, unsigned char* destination);
+        static bool CheckBvhRange(uint64_t offset, uint32_t nodeCount, uint32_t primitiveCount, size_t size);
+    };
+}
+
+#endif /* MeshCache_hpp */
@@ -0,0 +1,283 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    struct MeshCluster
+    {
+        size_t start;
+        size_t end;
+        float sortKey;
+    };
+
+    static bool CompareClusters(const MeshCluster& a, const MeshCluster& b)
+    {
+        return a.sortKey > b.sortKey;
+    }
+
+    void MeshOptimizer::Optimize(MeshData& mesh, VertexCacheStats& before, VertexCacheStats& after)
+    {
+        before = AnalyzeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+
+        std::vector<size_t> clusters = OptimizeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+        OptimizeOverdraw(mesh.indices, mesh.vertices, clusters, VERTEX_CACHE_SIZE, 1.05f);
+        OptimizeVertexFetch(mesh.vertices, mesh.indices);
+
+        after = AnalyzeVertexCache(mesh.indices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+    }
+
+    std::vector<size_t> MeshOptimizer::OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+    {
+        std::vector<size_t> clusters;
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0) {
+            return clusters;
+        }
+
+        // vertex -> triangle adjacency
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            liveTriangles[indices[i]]++;
+        }
+        std::vector<size_t> adjacencyStart(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++) {
+            adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+        }
+        std::vector<size_t> adjacencyFill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+        std::vector<GLuint> adjacency(triangleCount * 3);
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            adjacency[adjacencyFill[indices[i]]++] = (GLuint)(i / 3);
+        }
+
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<char> emitted(triangleCount, 0);
+        std::vector<GLuint> deadEnd;
+        std::vector<GLuint> candidates;
+        std::vector<GLuint> output;
+        output.reserve(triangleCount * 3);
+
+        unsigned int timeStamp = cacheSize + 1;
+        size_t cursor = 0;
+        while (cursor < vertexCount && liveTriangles[cursor] == 0) cursor++;
+        long long fanning = (long long)cursor;
+        clusters.push_back(0);
+
+        while (fanning >= 0) {
+            // emit every remaining triangle around the fanning vertex
+            candidates.clear();
+            for (size_t a = adjacencyStart[fanning]; a < adjacencyStart[fanning + 1]; a++) {
+                GLuint triangle = adjacency[a];
+                if (emitted[triangle]) {
+                    continue;
+                }
+                for (int c = 0; c < 3; c++) {
+                    GLuint v = indices[triangle * 3 + c];
+                    output.push_back(v);
+                    deadEnd.push_back(v);
+                    candidates.push_back(v);
+                    liveTriangles[v]--;
+                    if (timeStamp - cacheTime[v] > cacheSize) {
+                        cacheTime[v] = timeStamp++;
+                    }
+                }
+                emitted[triangle] = 1;
+            }
+
+            // next fanning vertex: the oldest candidate that will still be cached after its fan is emitted
+            long long next = -1;
+            long long bestPriority = -1;
+            for (size_t c = 0; c < candidates.size(); c++) {
+                GLuint v = candidates[c];
+                if (liveTriangles[v] == 0) {
+                    continue;
+                }
+                long long priority = 0;
+                if (timeStamp - cacheTime[v] + 2 * liveTriangles[v] <= cacheSize) {
+                    priority = timeStamp - cacheTime[v];
+                }
+                if (priority > bestPriority) {
+                    bestPriority = priority;
+                    next = v;
+                }
+            }
+
+            if (next == -1) {
+                // dead end: recently used vertices first, then the next unfinished one in index order
+                while (!deadEnd.empty() && next == -1) {
+                    GLuint v = deadEnd.back();
+                    deadEnd.pop_back();
+                    if (liveTriangles[v] > 0) {
+                        next = v;
+                    }
+                }
+                while (next == -1 && cursor < vertexCount) {
+                    if (liveTriangles[cursor] > 0) {
+                        next = (long long)cursor;
+                    }
+                    else {
+                        cursor++;
+                    }
+                }
+
+                if (next != -1 && output.size() / 3 > clusters.back()) {
+                    clusters.push_back(output.size() / 3);
+                }
+            }
+
+            fanning = next;
+        }
+
+        indices.swap(output);
+        return clusters;
+    }
+
+    void MeshOptimizer::OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+        const std::vector<size_t>& clusters, unsigned int cacheSize, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || clusters.empty()) {
+            return;
+        }
+
+        // split the hard clusters wherever the ACMR so far stays within threshold of the whole cluster's
+        std::vector<MeshCluster> softClusters;
+        std::vector<unsigned int> cacheTime(vertices.size(), 0);
+        unsigned int timeStamp = cacheSize + 1;
+        for (size_t c = 0; c < clusters.size(); c++) {
+            size_t start = clusters[c];
+            size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+
+            timeStamp += cacheSize + 1;
+            size_t clusterMisses = 0;
+            for (size_t i = start * 3; i < end * 3; i++) {
+                if (timeStamp - cacheTime[indices[i]] > cacheSize) {
+                    cacheTime[indices[i]] = timeStamp++;
+                    clusterMisses++;
+                }
+            }
+            float clusterThreshold = threshold * clusterMisses / (end - start);
+
+            timeStamp += cacheSize + 1;
+            size_t misses = 0;
+            MeshCluster cluster;
+            cluster.start = start;
+            for (size_t t = start; t < end; t++) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint v = indices[t * 3 + k];
+                    if (timeStamp - cacheTime[v] > cacheSize) {
+                        cacheTime[v] = timeStamp++;
+                        misses++;
+                    }
+                }
+
+                if (t + 1 < end && (float)misses / (t + 1 - cluster.start) <= clusterThreshold) {
+                    cluster.end = t + 1;
+                    softClusters.push_back(cluster);
+                    cluster.start = t + 1;
+                    timeStamp += cacheSize + 1;
+                    misses = 0;
+                }
+            }
+            cluster.end = end;
+            softClusters.push_back(cluster);
+        }
+
+        // area weighted centroid of the whole mesh
+        glm::vec3 meshCentroid(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++) {
+            const glm::vec3& a = vertices[indices[t * 3 + 0]].Position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].Position;
+            float area = glm::length(glm::cross(b - a, c - a));
+            meshCentroid += (a + b + c) * (area / 3.0f);
+            meshArea += area;
+        }
+        if (meshArea > 0.0f) {
+            meshCentroid /= meshArea;
+        }
+
+        // clusters far out along their own facing direction are likely occluders, draw them first
+        for (size_t c = 0; c < softClusters.size(); c++) {
+            MeshCluster& cluster = softClusters[c];
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = cluster.start; t < cluster.end; t++) {
+                const glm::vec3& a = vertices[indices[t * 3 + 0]].Position;
+                const glm::vec3& b = vertices[indices[t * 3 + 1]].Position;
+                const glm::vec3& c2 = vertices[indices[t * 3 + 2]].Position;
+                glm::vec3 faceNormal = glm::cross(b - a, c2 - a);
+                float faceArea = glm::length(faceNormal);
+                centroid += (a + b + c2) * (faceArea / 3.0f);
+                normal += faceNormal;
+                area += faceArea;
+            }
+
+            float normalLength = glm::length(normal);
+            if (area > 0.0f && normalLength > 0.0f) {
+                cluster.sortKey = glm::dot(centroid / area - meshCentroid, normal / normalLength);
+            }
+            else {
+                cluster.sortKey = 0.0f;
+            }
+        }
+
+        std::stable_sort(softClusters.begin(), softClusters.end(), CompareClusters);
+
+        std::vector<GLuint> output;
+        output.reserve(indices.size());
+        for (size_t c = 0; c < softClusters.size(); c++) {
+            output.insert(output.end(), indices.begin() + softClusters[c].start * 3, indices.begin() + softClusters[c].end * 3);
+        }
+        indices.swap(output);
+    }
+
+    void MeshOptimizer::OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices)
+    {
+        const GLuint unused = ~0u;
+        std::vector<GLuint> remap(vertices.size(), unused);
+        std::vector<Vertex> output;
+        output.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& newIndex = remap[indices[i]];
+            if (newIndex == unused) {
+                newIndex = (GLuint)output.size();
+                output.push_back(vertices[indices[i]]);
+            }
+            indices[i] = newIndex;
+        }
+
+        vertices.swap(output);
+    }
+
+    VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+    {
+        VertexCacheStats stats;
+        stats.triangles = indices.size() / 3;
+        stats.vertices = 0;
+        stats.misses = 0;
+
+        // a vertex is cached if it was one of the last cacheSize vertices pushed into the FIFO
+        std::vector<unsigned int> cacheTime(vertexCount, 0);
+        std::vector<char> referenced(vertexCount, 0);
+        unsigned int timeStamp = cacheSize + 1;
+        for (size_t i = 0; i < stats.triangles * 3; i++) {
+            GLuint v = indices[i];
+            if (timeStamp - cacheTime[v] > cacheSize) {
+                cacheTime[v] = timeStamp++;
+                stats.misses++;
+            }
+            if (!referenced[v]) {
+                referenced[v] = 1;
+                stats.vertices++;
+            }
+        }
+
+        stats.acmr = stats.triangles ? (float)stats.misses / stats.triangles : 0.0f;
+        stats.atvr = stats.vertices ? (float)stats.misses / stats.vertices : 0.0f;
+        return stats;
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <vector>
+
+namespace gps {
+
+    // Cache size used both by the optimizer and by the FIFO simulation that reports on it
+    const unsigned int VERTEX_CACHE_SIZE = 16;
+
+    struct VertexCacheStats
+    {
+        size_t triangles;
+        // distinct vertices referenced by the index buffer
+        size_t vertices;
+        size_t misses;
+        // average cache miss ratio: misses per triangle, 0.5 is ideal and 3 is the worst case
+        float acmr;
+        // average transform to vertex ratio: misses per vertex, 1 is ideal
+        float atvr;
+    };
+
+    // Load time reordering of indexed triangle lists, run before the mesh is uploaded
+    class MeshOptimizer
+    {
+    public:
+        // Runs the three passes below in order, stats are filled for the mesh before and after
+        static void Optimize(MeshData& mesh, VertexCacheStats& before, VertexCacheStats& after);
+
+        // Tipsify (Sander et al. 2007) triangle reordering for the post-transform vertex cache.
+        // Returns the first triangle of every cluster that starts after a cache flush.
+        static std::vector<size_t> OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize);
+
+        // Sorts the clusters from OptimizeVertexCache so that outward facing ones come first,
+        // splitting them further where that keeps the ACMR within threshold of the cache-optimal order
+        static void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<Vertex>& vertices,
+            const std::vector<size_t>& clusters, unsigned int cacheSize, float threshold);
+
+        // Renumbers vertices in the order the index buffer first uses them, unused vertices are dropped
+        static void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<GLuint>& indices);
+
+        // Simulates a FIFO post-transform cache over the index buffer
+        static VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize);
+    };
+}
+
+#endif /* MeshOptimizer_hpp */
@@ -0,0 +1,584 @@
+#include "MeshSimplifier.hpp"
+#include "MeshOptimizer.hpp"
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace gps {
+
+    enum VertexKind
+    {
+        // interior vertex with a single set of attributes, can collapse onto any neighbour
+        VERTEX_MANIFOLD,
+        // on an open edge, can only collapse along that edge
+        VERTEX_BORDER,
+        // shared by several vertices with different attributes, never moves
+        VERTEX_LOCKED
+    };
+
+    // Symmetric 4x4 quadric, error(p) = p'Ap + 2b'p + c, weight is the area it was built from
+    struct Quadric
+    {
+        double a00, a01, a02, a11, a12, a22;
+        double b0, b1, b2;
+        double c;
+        double weight;
+    };
+
+    struct EdgeCollapse
+    {
+        GLuint from;
+        GLuint to;
+        double cost;
+    };
+
+    struct PositionHash
+    {
+        size_t operator()(const glm::vec3& position) const
+        {
+            uint32_t words[3];
+            memcpy(words, &position, sizeof(words));
+            return (size_t)(((uint64_t)words[0] * 73856093u) ^ ((uint64_t)words[1] * 19349663u) ^ ((uint64_t)words[2] * 83492791u));
+        }
+    };
+
+    struct PositionEqual
+    {
+        bool operator()(const glm::vec3& a, const glm::vec3& b) const
+        {
+            return memcmp(&a, &b, sizeof(glm::vec3)) == 0;
+        }
+    };
+
+    // Border edges are weighted heavily so that open boundaries keep their silhouette
+    static const double BORDER_WEIGHT = 10.0;
+
+    // Vertices per level Check measures the deviation from
+    static const size_t LOD_CHECK_SAMPLES = 2048;
+
+    static bool CompareCollapses(const EdgeCollapse& a, const EdgeCollapse& b)
+    {
+        return a.cost < b.cost;
+    }
+
+    static uint64_t EdgeKey(GLuint from, GLuint to)
+    {
+        return ((uint64_t)from << 32) | to;
+    }
+
+    static void QuadricAddPlane(Quadric& q, const glm::vec3& normal, float distance, double weight)
+    {
+        double nx = normal.x;
+        double ny = normal.y;
+        double nz = normal.z;
+        double d = distance;
+
+        q.a00 += weight * nx * nx;
+        q.a01 += weight * nx * ny;
+        q.a02 += weight * nx * nz;
+        q.a11 += weight * ny * ny;
+        q.a12 += weight * ny * nz;
+        q.a22 += weight * nz * nz;
+        q.b0 += weight * nx * d;
+        q.b1 += weight * ny * d;
+        q.b2 += weight * nz * d;
+        q.c += weight * d * d;
+        q.weight += weight;
+    }
+
+    static void QuadricAdd(Quadric& q, const Quadric& r)
+    {
+        q.a00 += r.a00;
+        q.a01 += r.a01;
+        q.a02 += r.a02;
+        q.a11 += r.a11;
+        q.a12 += r.a12;
+        q.a22 += r.a22;
+        q.b0 += r.b0;
+        q.b1 += r.b1;
+        q.b2 += r.b2;
+        q.c += r.c;
+        q.weight += r.weight;
+    }
+
+    // Weighted mean squared distance from p to the planes of the quadric
+    static double QuadricError(const Quadric& q, const glm::vec3& p)
+    {
+        double x = p.x;
+        double y = p.y;
+        double z = p.z;
+
+        double error = q.a00 * x * x + q.a11 * y * y + q.a22 * z * z +
+            2.0 * (q.a01 * x * y + q.a02 * x * z + q.a12 * y * z) +
+            2.0 * (q.b0 * x + q.b1 * y + q.b2 * z) + q.c;
+
+        return q.weight > 0.0 ? std::fabs(error) / q.weight : 0.0;
+    }
+
+    float MeshSimplifier::Simplify(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+        size_t targetIndexCount, float targetError)
+    {
+        // vertices that only differ by their attributes share a position
+        std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual> positionIds;
+        std::vector<GLuint> positionId(vertices.size());
+        std::vector<glm::vec3> positions;
+        std::vector<unsigned int> attributeSets;
+        for (size_t v = 0; v < vertices.size(); v++) {
+            std::pair<std::unordered_map<glm::vec3, GLuint, PositionHash, PositionEqual>::iterator, bool> inserted =
+                positionIds.insert(std::make_pair(vertices[v].Position, (GLuint)positions.size()));
+            if (inserted.second) {
+                positions.push_back(vertices[v].Position);
+                attributeSets.push_back(0);
+            }
+            positionId[v] = inserted.first->second;
+            attributeSets[positionId[v]]++;
+        }
+        size_t positionCount = positions.size();
+
+        std::unordered_set<uint64_t> edges;
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            for (int k = 0; k < 3; k++) {
+                edges.insert(EdgeKey(positionId[indices[i + k]], positionId[indices[i + (k + 1) % 3]]));
+            }
+        }
+
+        std::vector<char> kind(positionCount, VERTEX_MANIFOLD);
+        Quadric zero;
+        memset(&zero, 0, sizeof(zero));
+        std::vector<Quadric> quadrics(positionCount, zero);
+        for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+            GLuint corners[3] = { positionId[indices[i]], positionId[indices[i + 1]], positionId[indices[i + 2]] };
+            glm::vec3 normal = glm::cross(positions[corners[1]] - positions[corners[0]], positions[corners[2]] - positions[corners[0]]);
+            float area = glm::length(normal);
+            if (area == 0.0f) {
+                continue;
+            }
+            normal /= area;
+
+            for (int k = 0; k < 3; k++) {
+                QuadricAddPlane(quadrics[corners[k]], normal, -glm::dot(normal, positions[corners[0]]), area * 0.5);
+            }
+
+            for (int k = 0; k < 3; k++) {
+                GLuint a = corners[k];
+                GLuint b = corners[(k + 1) % 3];
+                if (edges.count(EdgeKey(b, a))) {
+                    continue;
+                }
+
+                // plane through the border edge, perpendicular to the triangle
+                glm::vec3 edge = positions[b] - positions[a];
+                glm::vec3 borderNormal = glm::cross(edge, normal);
+                float length = glm::length(borderNormal);
+                if (length > 0.0f) {
+                    borderNormal /= length;
+                    double weight = BORDER_WEIGHT * glm::dot(edge, edge);
+                    QuadricAddPlane(quadrics[a], borderNormal, -glm::dot(borderNormal, positions[a]), weight);
+                    QuadricAddPlane(quadrics[b], borderNormal, -glm::dot(borderNormal, positions[a]), weight);
+                }
+                kind[a] = VERTEX_BORDER;
+                kind[b] = VERTEX_BORDER;
+            }
+        }
+        for (size_t p = 0; p < positionCount; p++) {
+            if (attributeSets[p] > 1) {
+                kind[p] = VERTEX_LOCKED;
+            }
+        }
+
+        std::vector<size_t> adjacencyStart(positionCount + 1);
+        std::vector<size_t> adjacencyFill;
+        std::vector<GLuint> adjacency;
+        std::vector<EdgeCollapse> collapses;
+        std::vector<char> locked(positionCount);
+        std::vector<GLuint> collapsedTo(positionCount);
+        std::vector<GLuint> collapsedVertex(positionCount);
+        const GLuint notCollapsed = ~0u;
+
+        double maxCost = 0.0;
+        double costLimit = (double)targetError * targetError;
+
+        while (indices.size() > targetIndexCount) {
+            size_t triangleCount = indices.size() / 3;
+
+            // position -> triangle adjacency of the current index buffer
+            std::fill(adjacencyStart.begin(), adjacencyStart.end(), 0);
+            for (size_t i = 0; i < triangleCount * 3; i++) {
+                adjacencyStart[positionId[indices[i]] + 1]++;
+            }
+            for (size_t p = 0; p < positionCount; p++) {
+                adjacencyStart[p + 1] += adjacencyStart[p];
+            }
+            adjacencyFill.assign(adjacencyStart.begin(), adjacencyStart.end() - 1);
+            adjacency.resize(triangleCount * 3);
+            for (size_t i = 0; i < triangleCount * 3; i++) {
+                adjacency[adjacencyFill[positionId[indices[i]]]++] = (GLuint)(i / 3);
+            }
+
+            edges.clear();
+            for (size_t i = 0; i < triangleCount * 3; i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    edges.insert(EdgeKey(positionId[indices[i + k]], positionId[indices[i + (k + 1) % 3]]));
+                }
+            }
+
+            // cheapest allowed direction of every edge
+            collapses.clear();
+            for (size_t i = 0; i < triangleCount * 3; i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    GLuint a = positionId[indices[i + k]];
+                    GLuint b = positionId[indices[i + (k + 1) % 3]];
+                    bool border = edges.count(EdgeKey(b, a)) == 0;
+                    if (a == b || (!border && a > b)) {
+                        // interior edges are seen from both triangles, keep one
+                        continue;
+                    }
+
+                    bool aToB = kind[a] == VERTEX_MANIFOLD || (kind[a] == VERTEX_BORDER && border && kind[b] != VERTEX_MANIFOLD);
+                    bool bToA = kind[b] == VERTEX_MANIFOLD || (kind[b] == VERTEX_BORDER && border && kind[a] != VERTEX_MANIFOLD);
+                    double costAToB = aToB ? QuadricError(quadrics[a], positions[b]) : 0.0;
+                    double costBToA = bToA ? QuadricError(quadrics[b], positions[a]) : 0.0;
+
+                    EdgeCollapse collapse;
+                    if (aToB && (!bToA || costAToB <= costBToA)) {
+                        collapse.from = a;
+                        collapse.to = b;
+                        collapse.cost = costAToB;
+                        collapses.push_back(collapse);
+                    }
+                    else if (bToA) {
+                        collapse.from = b;
+                        collapse.to = a;
+                        collapse.cost = costBToA;
+                        collapses.push_back(collapse);
+                    }
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), CompareCollapses);
+
+            // a collapse removes about two triangles, stop the pass before overshooting the target
+            size_t collapseGoal = std::max((indices.size() - targetIndexCount) / 6, (size_t)1);
+            size_t performed = 0;
+            std::fill(locked.begin(), locked.end(), 0);
+            std::fill(collapsedTo.begin(), collapsedTo.end(), notCollapsed);
+
+            for (size_t c = 0; c < collapses.size() && performed < collapseGoal; c++) {
+                const EdgeCollapse& collapse = collapses[c];
+                if (collapse.cost > costLimit) {
+                    break;
+                }
+                if (locked[collapse.from] || locked[collapse.to]) {
+                    continue;
+                }
+
+                // the triangles around the moved vertex must not flip, and the triangles on the edge
+                // tell which vertex of the target position continues the same attributes
+                bool valid = true;
+                GLuint targetVertex = notCollapsed;
+                for (size_t a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1] && valid; a++) {
+                    const GLuint* triangle = &indices[adjacency[a] * 3];
+                    glm::vec3 before[3];
+                    glm::vec3 after[3];
+                    bool onEdge = false;
+                    for (int k = 0; k < 3; k++) {
+                        GLuint p = positionId[triangle[k]];
+                        if (p == collapse.to) {
+                            targetVertex = triangle[k];
+                            onEdge = true;
+                        }
+                        before[k] = positions[p];
+                        after[k] = p == collapse.from ? positions[collapse.to] : positions[p];
+                    }
+                    if (onEdge) {
+                        continue;
+                    }
+
+                    glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+                    glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+                    float dot = glm::dot(normalBefore, normalAfter);
+                    valid = dot > 0.25f * glm::length(normalBefore) * glm::length(normalAfter);
+                }
+                if (!valid || targetVertex == notCollapsed) {
+                    continue;
+                }
+
+                // freeze the neighbourhood so the flip test above stays true for the rest of the pass
+                for (size_t a = adjacencyStart[collapse.from]; a < adjacencyStart[collapse.from + 1]; a++) {
+                    for (int k = 0; k < 3; k++) {
+                        locked[positionId[indices[adjacency[a] * 3 + k]]] = 1;
+                    }
+                }
+
+                collapsedTo[collapse.from] = collapse.to;
+                collapsedVertex[collapse.from] = targetVertex;
+                QuadricAdd(quadrics[collapse.to], quadrics[collapse.from]);
+                maxCost = std::max(maxCost, collapse.cost);
+                performed++;
+            }
+
+            if (performed == 0) {
+                break;
+            }
+
+            // moved vertices have a single set of attributes, so every reference to them is rewritten
+            size_t write = 0;
+            for (size_t i = 0; i < triangleCount * 3; i += 3) {
+                GLuint triangle[3];
+                for (int k = 0; k < 3; k++) {
+                    GLuint v = indices[i + k];
+                    triangle[k] = collapsedTo[positionId[v]] != notCollapsed ? collapsedVertex[positionId[v]] : v;
+                }
+
+                GLuint p0 = positionId[triangle[0]];
+                GLuint p1 = positionId[triangle[1]];
+                GLuint p2 = positionId[triangle[2]];
+                if (p0 != p1 && p1 != p2 && p0 != p2) {
+                    indices[write++] = triangle[0];
+                    indices[write++] = triangle[1];
+                    indices[write++] = triangle[2];
+                }
+            }
+            indices.resize(write);
+        }
+
+        return (float)std::sqrt(maxCost);
+    }
+
+    void MeshSimplifier::GenerateLods(MeshData& mesh)
+    {
+        mesh.lods.clear();
+        MeshLod fullMesh = { 0, (GLuint)mesh.indices.size(), 0.0f };
+        mesh.lods.push_back(fullMesh);
+        if (mesh.vertices.empty() || mesh.indices.empty()) {
+            return;
+        }
+
+        glm::vec3 boundsMin = mesh.vertices[0].Position;
+        glm::vec3 boundsMax = mesh.vertices[0].Position;
+        for (size_t v = 1; v < mesh.vertices.size(); v++) {
+            boundsMin = glm::min(boundsMin, mesh.vertices[v].Position);
+            boundsMax = glm::max(boundsMax, mesh.vertices[v].Position);
+        }
+        float diagonal = glm::length(boundsMax - boundsMin);
+
+        std::vector<GLuint> lodIndices(mesh.indices);
+        for (int lod = 1; lod < MAX_MESH_LODS; lod++) {
+            size_t previousCount = lodIndices.size();
+            size_t targetCount = (fullMesh.indexCount >> lod) / 3 * 3;
+
+            float error = Simplify(mesh.vertices, lodIndices, targetCount, diagonal * LOD_MAX_ERROR[lod]);
+            if (lodIndices.empty() || lodIndices.size() > previousCount * 9 / 10) {
+                // not worth a draw call of its own
+                break;
+            }
+
+            MeshOptimizer::OptimizeVertexCache(lodIndices, mesh.vertices.size(), VERTEX_CACHE_SIZE);
+
+            MeshLod level;
+            level.indexOffset = (GLuint)mesh.indices.size();
+            level.indexCount = (GLuint)lodIndices.size();
+            level.error = std::max(error, mesh.lods.back().error);
+            mesh.lods.push_back(level);
+            mesh.indices.insert(mesh.indices.end(), lodIndices.begin(), lodIndices.end());
+        }
+    }
+
+    // Distance from p to the closest point of triangle abc (Ericson, Real-Time Collision Detection 5.1.5)
+    static float PointTriangleDistance(const glm::vec3& p, const glm::vec3& a, const glm::vec3& b, const glm::vec3& c)
+    {
+        glm::vec3 ab = b - a;
+        glm::vec3 ac = c - a;
+        glm::vec3 ap = p - a;
+        float d1 = glm::dot(ab, ap);
+        float d2 = glm::dot(ac, ap);
+        if (d1 <= 0.0f && d2 <= 0.0f) {
+            return glm::length(ap);
+        }
+
+        glm::vec3 bp = p - b;
+        float d3 = glm::dot(ab, bp);
+        float d4 = glm::dot(ac, bp);
+        if (d3 >= 0.0f && d4 <= d3) {
+            return glm::length(bp);
+        }
+
+        float vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+            return glm::length(p - (a + ab * (d1 / (d1 - d3))));
+        }
+
+        glm::vec3 cp = p - c;
+        float d5 = glm::dot(ab, cp);
+        float d6 = glm::dot(ac, cp);
+        if (d6 >= 0.0f && d5 <= d6) {
+            return glm::length(cp);
+        }
+
+        float vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+            return glm::length(p - (a + ac * (d2 / (d2 - d6))));
+        }
+
+        float va = d3 * d6 - d5 * d4;
+        if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+            return glm::length(p - (b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6)))));
+        }
+
+        float denominator = 1.0f / (va + vb + vc);
+        return glm::length(p - (a + ab * (vb * denominator) + ac * (vc * denominator)));
+    }
+
+    bool MeshSimplifier::Check(std::string fileName)
+    {
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+        std::vector<gps::MeshData> meshData;
+        if (!Model3D::ReadMeshData(fileName, basePath, meshData) || meshData.empty()) {
+            std::cout << "Mesh LOD check: could not read " << fileName << std::endl;
+            return false;
+        }
+
+        size_t levels = 0;
+        size_t failures = 0;
+        float worstRatio = 0.0f;
+        for (size_t s = 0; s < meshData.size(); s++) {
+            MeshData& mesh = meshData[s];
+            size_t fullIndexCount = mesh.indices.size();
+            GenerateLods(mesh);
+
+            glm::vec3 boundsMin = mesh.vertices.empty() ? glm::vec3(0.0f) : mesh.vertices[0].Position;
+            glm::vec3 boundsMax = boundsMin;
+            for (size_t v = 1; v < mesh.vertices.size(); v++) {
+                boundsMin = glm::min(boundsMin, mesh.vertices[v].Position);
+                boundsMax = glm::max(boundsMax, mesh.vertices[v].Position);
+            }
+            float diagonal = glm::length(boundsMax - boundsMin);
+
+            const std::vector<MeshLod>& lods = mesh.lods;
+            if (lods.empty() || lods[0].indexOffset != 0 || lods[0].indexCount != fullIndexCount || lods.size() > MAX_MESH_LODS) {
+                std::cout << "  mesh " << s << ": " << lods.size() << " levels, the first one is not the full mesh" << std::endl;
+                failures++;
+                continue;
+            }
+
+            // levels only reference vertices of the full mesh, so the deviation is measured from those; at most
+            // LOD_CHECK_SAMPLES of them, every triangle is tested for each
+            std::vector<unsigned char> used(mesh.vertices.size(), 0);
+            for (size_t i = 0; i < fullIndexCount; i++) {
+                if (mesh.indices[i] < mesh.vertices.size()) {
+                    used[mesh.indices[i]] = 1;
+                }
+            }
+            std::vector<GLuint> samples;
+            for (size_t v = 0; v < mesh.vertices.size(); v++) {
+                if (used[v]) {
+                    samples.push_back((GLuint)v);
+                }
+            }
+            size_t sampleStride = samples.size() / LOD_CHECK_SAMPLES + 1;
+
+            for (size_t lod = 0; lod < lods.size(); lod++) {
+                const MeshLod& level = lods[lod];
+                std::string problem;
+                if ((size_t)level.indexOffset + level.indexCount > mesh.indices.size() || level.indexCount % 3 != 0) {
+                    problem = "index range outside the index buffer";
+                }
+                else if (lod > 0 && (level.indexCount == 0 || level.indexCount >= lods[lod - 1].indexCount)) {
+                    problem = "does not have fewer indices than the level before";
+                }
+                else if (lod > 0 && level.error < lods[lod - 1].error) {
+                    problem = "reports less error than the level before";
+                }
+                else if (level.error > diagonal * LOD_MAX_ERROR[lod] * 1.001f) {
+                    problem = "reports more error than LOD_MAX_ERROR allows";
+                }
+                for (size_t i = 0; problem.empty() && i < level.indexCount; i++) {
+                    if (mesh.indices[level.indexOffset + i] >= mesh.vertices.size()) {
+                        problem = "references a vertex out of range";
+                    }
+                }
+                if (!problem.empty()) {
+                    std::cout << "  mesh " << s << " level " << lod << ": " << problem << std::endl;
+                    failures++;
+                    break;
+                }
+                levels++;
+                if (lod == 0) {
+                    continue;
+                }
+
+                float deviation = 0.0f;
+                const GLuint* indices = &mesh.indices[level.indexOffset];
+                for (size_t v = 0; v < samples.size(); v += sampleStride) {
+                    const glm::vec3& p = mesh.vertices[samples[v]].Position;
+                    float closest = std::numeric_limits<float>::max();
+                    for (size_t i = 0; i < level.indexCount && closest > 0.0f; i += 3) {
+                        closest = std::min(closest, PointTriangleDistance(p, mesh.vertices[indices[i]].Position,
+                            mesh.vertices[indices[i + 1]].Position, mesh.vertices[indices[i + 2]].Position));
+                    }
+                    deviation = std::max(deviation, closest);
+                }
+                float bound = diagonal * LOD_MAX_ERROR[lod];
+                worstRatio = std::max(worstRatio, bound > 0.0f ? deviation / bound : 0.0f);
+                std::cout << "  mesh " << s << " level " << lod << ": " << level.indexCount / 3 << " triangles, error "
+                    << level.error << " reported, " << deviation << " measured, bound " << bound << std::endl;
+                if (deviation > bound * 1.001f) {
+                    std::cout << "  mesh " << s << " level " << lod << ": measured error is over the bound" << std::endl;
+                    failures++;
+                    break;
+                }
+            }
+        }
+
+        std::cout << "Mesh LOD check: " << fileName << " (" << meshData.size() << " meshes, " << levels << " levels, worst measured error "
+            << worstRatio << " of the bound) " << (failures == 0 ? "passed" : "FAILED") << std::endl;
+        return failures == 0;
+    }
+
+    void MeshSimplifier::Benchmark(std::string fileName, int runs)
+    {
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+
+        std::vector<gps::MeshData> meshData;
+        if (!Model3D::ReadMeshData(fileName, basePath, meshData)) {
+            return;
+        }
+
+        std::vector<gps::MeshData> simplified;
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++) {
+            simplified = meshData;
+            for (size_t s = 0; s < simplified.size(); s++) {
+                GenerateLods(simplified[s]);
+            }
+        }
+        double lodTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+        std::cout << "Mesh LOD benchmark: " << fileName << " (" << runs << " runs, " << lodTime << " ms)" << std::endl;
+        size_t levelTriangles[MAX_MESH_LODS] = {};
+        for (size_t s = 0; s < simplified.size(); s++) {
+            const std::vector<MeshLod>& lods = simplified[s].lods;
+            std::cout << "  mesh " << s << " :";
+            for (size_t lod = 0; lod < lods.size(); lod++) {
+                std::cout << " " << lods[lod].indexCount / 3 << " (" << lods[lod].error << ")";
+            }
+            std::cout << std::endl;
+
+            // meshes with fewer levels draw their coarsest one further out
+            for (int lod = 0; lod < MAX_MESH_LODS; lod++) {
+                levelTriangles[lod] += lods[std::min((size_t)lod, lods.size() - 1)].indexCount / 3;
+            }
+        }
+        std::cout << "  triangles per level :";
+        for (int lod = 0; lod < MAX_MESH_LODS; lod++) {
+            std::cout << " " << levelTriangles[lod];
+        }
+        std::cout << std::endl;
+    }
+}
@@ -0,0 +1,42 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Largest simplification error accepted per level of detail, relative to the mesh bounds diagonal
+    const float LOD_MAX_ERROR[MAX_MESH_LODS] = { 0.0f, 0.005f, 0.02f, 0.05f };
+
+    // Quadric error metric (Garland and Heckbert 1997) edge collapse simplification.
+    // Vertices are only ever collapsed onto other existing vertices, so every level of detail
+    // is an index buffer over the original vertex buffer. No GL calls are made.
+    class MeshSimplifier
+    {
+    public:
+        // Collapses edges until indices has at most targetIndexCount entries or the next collapse would
+        // move the surface further than targetError (object space). Returns the largest error introduced.
+        // Vertices sharing a position with other vertices (normal/uv seams) are never moved, border
+        // vertices only slide along the border.
+        static float Simplify(const std::vector<Vertex>& vertices, std::vector<GLuint>& indices,
+            size_t targetIndexCount, float targetError);
+
+        // Appends up to MAX_MESH_LODS - 1 levels, each with half the triangles of the previous one, to
+        // mesh.indices and describes them in mesh.lods. Stops early when a level barely simplifies.
+        static void GenerateLods(MeshData& mesh);
+
+        // Generates the levels of every mesh in fileName and prints their triangle counts, errors and timing
+        static void Benchmark(std::string fileName, int runs);
+
+        // Generates the levels of every mesh in fileName and checks them, CPU work only: each level has fewer
+        // indices than the one before, every index is in range, and the error stays within LOD_MAX_ERROR of
+        // the bounds diagonal, both as reported and as measured from the full mesh vertices to the level's
+        // triangles. Returns false if a check fails.
+        static bool Check(std::string fileName);
+    };
+}
+
+#endif /* MeshSimplifier_hpp */
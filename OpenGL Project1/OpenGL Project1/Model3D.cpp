@@ -1,28 +1,1154 @@
 #include "Model3D.hpp"
+#include "Hash.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+#include "glm/gtc/matrix_inverse.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <thread>
+#include <unordered_map>
 
 namespace gps {
 
+	// Bitwise hash/equality over a whole vertex, used to weld identical face corners
+	struct VertexHash
+	{
+		size_t operator()(const gps::Vertex& vertex) const
+		{
+			return (size_t)HashBytes(&vertex, sizeof(gps::Vertex));
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const gps::Vertex& a, const gps::Vertex& b) const
+		{
+			return memcmp(&a, &b, sizeof(gps::Vertex)) == 0;
+		}
+	};
+
+	// CPU side of a LoadModel(loader, ...) call, filled by a worker and consumed by Update
+	struct Model3D::PendingModel
+	{
+		std::string fileName;
+		std::string basePath;
+		std::chrono::steady_clock::time_point start;
+		bool loaded;
+		bool fromCache;
+		MeshCache cache;
+		std::vector<gps::MeshData> meshData;
+	};
+
+	bool Model3D::meshCacheEnabled = true;
+	bool Model3D::meshOptimizerEnabled = true;
+	bool Model3D::compactVerticesEnabled = false;
+	bool Model3D::meshLodEnabled = true;
+	float Model3D::lodHysteresis = 0.1f;
+	bool Model3D::lodDebugEnabled = false;
+	bool Model3D::frustumCullingEnabled = true;
+	bool Model3D::occlusionCullingEnabled = true;
+	bool Model3D::triangleBvhEnabled = false;
+	bool Model3D::mergedGeometryEnabled = false;
+	bool Model3D::indirectDrawsEnabled = true;
+
+	// below this many meshes testing every one with SSE beats walking the hierarchy
+	static const size_t BVH_CULL_MIN_MESHES = 32;
+
+	// meshes with more triangles are too expensive to rasterize as occluders every frame
+	static const size_t MAX_OCCLUDER_TRIANGLES = 4096;
+	// occluder triangles kept per model, the largest meshes are picked first
+	static const size_t MAX_MODEL_OCCLUDER_TRIANGLES = 65536;
+	// the second longest side of an occluder box is at least this fraction of the model diagonal
+	static const float OCCLUDER_MIN_EXTENT = 0.02f;
+
+	// green, yellow, orange, red from the full mesh to the coarsest level
+	static const glm::vec3 LOD_DEBUG_COLORS[MAX_MESH_LODS] = {
+		glm::vec3(0.0f, 1.0f, 0.0f),
+		glm::vec3(1.0f, 1.0f, 0.0f),
+		glm::vec3(1.0f, 0.5f, 0.0f),
+		glm::vec3(1.0f, 0.0f, 0.0f)
+	};
+
+	static glm::vec3 GetBoundsMin(const gps::Mesh& mesh)
+	{
+		return mesh.getBoundsMin();
+	}
+
+	static glm::vec3 GetBoundsMax(const gps::Mesh& mesh)
+	{
+		return mesh.getBoundsMax();
+	}
+
+	static glm::vec3 GetBoundsMin(const gps::MeshData& mesh)
+	{
+		return mesh.boundsMin;
+	}
+
+	static glm::vec3 GetBoundsMax(const gps::MeshData& mesh)
+	{
+		return mesh.boundsMax;
+	}
+
+	// Tests the bounding spheres in world space first, four at a time, then the boxes of the meshes left
+	// against the planes moved to object space, where the box is still axis aligned
+	template <typename MeshType>
+	static unsigned int CullBounds(const std::vector<MeshType>& meshes, const gps::Frustum& frustum, const glm::mat4& model,
+		float scale, std::vector<glm::vec4>& spheres, std::vector<unsigned char>& visible)
+	{
+		spheres.resize(meshes.size());
+		visible.resize(meshes.size());
+		if (meshes.empty()) {
+			return 0;
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			glm::vec3 boundsMin = GetBoundsMin(meshes[i]);
+			glm::vec3 boundsMax = GetBoundsMax(meshes[i]);
+			glm::vec3 center = glm::vec3(model * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+			spheres[i] = glm::vec4(center, glm::length(boundsMax - boundsMin) * 0.5f * scale);
+		}
+		frustum.CullSpheres(&spheres[0], meshes.size(), &visible[0]);
+
+		gps::Frustum objectFrustum = frustum.Transform(model);
+		unsigned int visibleCount = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (visible[i] && !objectFrustum.IntersectsBox(GetBoundsMin(meshes[i]), GetBoundsMax(meshes[i]))) {
+				visible[i] = 0;
+			}
+			visibleCount += visible[i];
+		}
+		return visibleCount;
+	}
+
+	// Walls, floors and the like: meshes whose boxes are wide in at least two directions hide what is behind
+	// them. Returns their indices largest first, cut off at the triangle budget of a model.
+	template <typename MeshType>
+	static std::vector<size_t> SelectOccluders(const std::vector<MeshType>& meshes, const std::vector<size_t>& triangleCounts)
+	{
+		std::vector<size_t> occluders;
+		if (meshes.empty()) {
+			return occluders;
+		}
+
+		glm::vec3 modelMin = GetBoundsMin(meshes[0]);
+		glm::vec3 modelMax = GetBoundsMax(meshes[0]);
+		for (size_t i = 1; i < meshes.size(); i++) {
+			modelMin = glm::min(modelMin, GetBoundsMin(meshes[i]));
+			modelMax = glm::max(modelMax, GetBoundsMax(meshes[i]));
+		}
+		float diagonal = glm::length(modelMax - modelMin);
+
+		std::vector<std::pair<float, size_t> > candidates;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			glm::vec3 extent = GetBoundsMax(meshes[i]) - GetBoundsMin(meshes[i]);
+			float longest = std::max(extent.x, std::max(extent.y, extent.z));
+			float middle = extent.x + extent.y + extent.z - longest - std::min(extent.x, std::min(extent.y, extent.z));
+			if (triangleCounts[i] > 0 && triangleCounts[i] <= MAX_OCCLUDER_TRIANGLES && middle >= OCCLUDER_MIN_EXTENT * diagonal) {
+				candidates.push_back(std::make_pair(longest * middle, i));
+			}
+		}
+		std::sort(candidates.begin(), candidates.end(),
+			[](const std::pair<float, size_t>& a, const std::pair<float, size_t>& b) { return a.first > b.first; });
+
+		size_t triangles = 0;
+		for (size_t c = 0; c < candidates.size(); c++) {
+			size_t mesh = candidates[c].second;
+			if (triangles + triangleCounts[mesh] <= MAX_MODEL_OCCLUDER_TRIANGLES) {
+				triangles += triangleCounts[mesh];
+				occluders.push_back(mesh);
+			}
+		}
+		return occluders;
+	}
+
+	// Appends a mesh to merged occluder triangles, indices are into positions
+	static void AppendOccluder(std::vector<glm::vec3>& occluderPositions, std::vector<uint32_t>& occluderIndices,
+		const std::vector<glm::vec3>& positions, const GLuint* indices, size_t indexCount)
+	{
+		uint32_t first = (uint32_t)occluderPositions.size();
+		occluderPositions.insert(occluderPositions.end(), positions.begin(), positions.end());
+		for (size_t i = 0; i < indexCount; i++) {
+			occluderIndices.push_back(first + indices[i]);
+		}
+	}
+
+	// Occluders of freshly parsed meshes, at full detail
+	static void CollectOccluders(const std::vector<gps::MeshData>& meshData, std::vector<glm::vec3>& occluderPositions,
+		std::vector<uint32_t>& occluderIndices)
+	{
+		std::vector<size_t> triangleCounts(meshData.size());
+		for (size_t s = 0; s < meshData.size(); s++) {
+			triangleCounts[s] = (meshData[s].lods.empty() ? meshData[s].indices.size() : meshData[s].lods[0].indexCount) / 3;
+		}
+
+		std::vector<size_t> occluders = SelectOccluders(meshData, triangleCounts);
+		std::vector<glm::vec3> positions;
+		for (size_t o = 0; o < occluders.size(); o++) {
+			const gps::MeshData& mesh = meshData[occluders[o]];
+			positions.resize(mesh.vertices.size());
+			for (size_t v = 0; v < mesh.vertices.size(); v++) {
+				positions[v] = mesh.vertices[v].Position;
+			}
+			AppendOccluder(occluderPositions, occluderIndices, positions, &mesh.indices[0], triangleCounts[occluders[o]] * 3);
+		}
+	}
+
+	// Queue key of a draw, the texture set stands for the material and the first texture is the one bound most often
+	static uint64_t MakeMaterialKey(const gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram,
+		const std::vector<gps::Texture>& textures, float distance)
+	{
+		uint32_t materialHash = 2166136261u;
+		for (size_t t = 0; t < textures.size(); t++) {
+			materialHash = (materialHash ^ textures[t].id) * 16777619u;
+		}
+		GLuint firstTexture = textures.empty() ? 0 : textures[0].id;
+		return queue.MakeKey(pass, shaderProgram.shaderProgram, firstTexture, materialHash, distance);
+	}
+
+	static bool HasSpecularMap(const gps::Mesh& mesh)
+	{
+		for (size_t t = 0; t < mesh.textures.size(); t++) {
+			if (mesh.textures[t].type == "specularTexture") {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// bounding spheres scale with the largest axis of the model matrix
+	static float GetMaxScale(const glm::mat4& model)
+	{
+		return std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+	}
+
+	Model3D::Model3D() : loader(NULL), uniformProgram(0), instanceBuffer(0), instanceBufferSize(0), instancedMeshes(0),
+		mergedVAO(0), mergedVBO(0), mergedEBO(0), indirectBuffer(0), indirectDraws(false), indirectCommandsDirty(false)
+	{
+	}
+
 	void Model3D::LoadModel(std::string fileName)
 	{
         std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModel(fileName, basePath);
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
-		ReadOBJ(fileName, basePath);
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		bool fromCache = meshCacheEnabled && ReadMeshCache(fileName, basePath);
+		if (!fromCache) {
+			ReadOBJ(fileName, basePath);
+		}
+
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Loaded " << fileName << (fromCache ? " from mesh cache" : " from .obj") << " in " << elapsed << " ms" << std::endl;
+	}
+
+	bool Model3D::LoadModel(const gps::AssetBundle& bundle, std::string fileName)
+	{
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+		const AssetBundleEntry* entry = bundle.Find(fileName, ASSET_MESHES);
+		MeshCache cache;
+		if (!entry || !cache.Open(bundle.GetData(*entry), (size_t)entry->size)) {
+			return false;
+		}
+
+		std::cout << "Loading : " << fileName << " (asset bundle)" << std::endl;
+		CreateMeshes(cache, fileName.substr(0, fileName.find_last_of('/')) + "/", &bundle);
+
+		double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::cout << "Loaded " << fileName << " from asset bundle in " << elapsed << " ms" << std::endl;
+		return true;
+	}
+
+	void Model3D::LoadModel(gps::AssetLoader& loader, std::string fileName)
+	{
+		this->loader = &loader;
+
+		std::shared_ptr<PendingModel> pending = std::make_shared<PendingModel>();
+		pending->fileName = fileName;
+		pending->basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		pending->start = std::chrono::steady_clock::now();
+		pending->loaded = false;
+		pending->fromCache = false;
+		pendingModel = pending;
+
+		pendingModelDone = loader.Submit([pending]() {
+			// same as ReadMeshCache/ReadOBJ without the uploads
+			pending->fromCache = meshCacheEnabled && pending->cache.Open(pending->fileName, GetMeshCacheFlags());
+			if (pending->fromCache) {
+				pending->loaded = true;
+				return;
+			}
+
+			pending->loaded = ReadMeshData(pending->fileName, pending->basePath, pending->meshData);
+			if (!pending->loaded) {
+				return;
+			}
+			ProcessMeshData(pending->meshData);
+			if (meshCacheEnabled && !MeshCache::Write(pending->fileName, pending->meshData, GetMeshCacheFlags())) {
+				std::cerr << "WARNING: could not write mesh cache for " << pending->fileName << std::endl;
+			}
+		});
+	}
+
+	void Model3D::Update()
+	{
+		if (pendingModel && pendingModelDone.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+			pendingModelDone.get();
+			PendingModel& pending = *pendingModel;
+			if (!pending.loaded) {
+				exit(1);
+			}
+
+			if (pending.fromCache) {
+				CreateMeshes(pending.cache, pending.basePath, NULL);
+			}
+			else {
+				CreateMeshes(pending.meshData, pending.basePath);
+			}
+
+			double elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pending.start).count();
+			std::cout << "Loaded " << pending.fileName << (pending.fromCache ? " from mesh cache" : " from .obj")
+				<< " in " << elapsed << " ms (background)" << std::endl;
+			pendingModel.reset();
+		}
+
+		// swap the placeholders for the textures that have been uploaded since the last frame
+		for (size_t t = 0; t < pendingTextures.size(); ) {
+			const std::string& path = pendingTextures[t].first;
+			const TextureLoad& texture = *pendingTextures[t].second;
+			if (!texture.ready) {
+				t++;
+				continue;
+			}
+
+			for (size_t i = 0; i < loadedTextures.size(); i++) {
+				if (loadedTextures[i].path == path) {
+					loadedTextures[i].id = texture.id;
+				}
+			}
+			for (size_t m = 0; m < meshes.size(); m++) {
+				for (size_t i = 0; i < meshes[m].textures.size(); i++) {
+					if (meshes[m].textures[i].path == path) {
+						meshes[m].textures[i].id = texture.id;
+					}
+				}
+			}
+			pendingTextures.erase(pendingTextures.begin() + t);
+		}
+	}
+
+	bool Model3D::IsLoading() const
+	{
+		return pendingModel != NULL || !pendingTextures.empty();
+	}
+
+	void Model3D::UpdateTextureArrays()
+	{
+		bool changed = false;
+		for (size_t i = 0; i < loadedTextures.size(); i++) {
+			TextureHandle handle = TextureManager::Get().Find(loadedTextures[i].path);
+			if (handle) {
+				loadedTextures[i].id = handle->id;
+				loadedTextures[i].layer = handle->layer;
+			}
+		}
+		for (size_t m = 0; m < meshes.size(); m++) {
+			int diffuseLayer = -1;
+			int specularLayer = -1;
+			for (size_t i = 0; i < meshes[m].textures.size(); i++) {
+				const gps::Texture& texture = meshes[m].textures[i];
+				TextureHandle handle = TextureManager::Get().Find(texture.path);
+				if (!handle || !handle->ready) {
+					continue;
+				}
+				changed = changed || texture.layer != handle->layer;
+				meshes[m].setTexture(i, handle->id, handle->layer);
+				if (texture.type == "diffuseTexture") {
+					diffuseLayer = handle->layer;
+				}
+				else if (texture.type == "specularTexture") {
+					specularLayer = handle->layer;
+				}
+			}
+			meshes[m].setMaterial(MaterialTable::Get().SetTextureLayers(meshes[m].getMaterial(), diffuseLayer, specularLayer));
+		}
+		if (!changed) {
+			return;
+		}
+		MaterialTable::Get().Upload();
+		if (mergedVAO != 0) {
+			BuildBatches();
+		}
+	}
+
+	void Model3D::SetMeshCacheEnabled(bool enabled)
+	{
+		meshCacheEnabled = enabled;
+	}
+
+	void Model3D::SetMeshOptimizerEnabled(bool enabled)
+	{
+		meshOptimizerEnabled = enabled;
+	}
+
+	void Model3D::SetCompactVerticesEnabled(bool enabled)
+	{
+		compactVerticesEnabled = enabled;
+	}
+
+	void Model3D::SetMeshLodEnabled(bool enabled)
+	{
+		meshLodEnabled = enabled;
+	}
+
+	void Model3D::SetLodHysteresis(float hysteresis)
+	{
+		lodHysteresis = hysteresis;
+	}
+
+	void Model3D::SetFrustumCullingEnabled(bool enabled)
+	{
+		frustumCullingEnabled = enabled;
+	}
+
+	void Model3D::SetOcclusionCullingEnabled(bool enabled)
+	{
+		occlusionCullingEnabled = enabled;
+	}
+
+	void Model3D::SetTriangleBvhEnabled(bool enabled)
+	{
+		triangleBvhEnabled = enabled;
+	}
+
+	void Model3D::SetMergedGeometryEnabled(bool enabled)
+	{
+		mergedGeometryEnabled = enabled;
+	}
+
+	void Model3D::SetIndirectDrawsEnabled(bool enabled)
+	{
+		indirectDrawsEnabled = enabled;
+	}
+
+	void Model3D::SetLodDebugEnabled(bool enabled)
+	{
+		lodDebugEnabled = enabled;
+	}
+
+	bool Model3D::IsLodDebugEnabled()
+	{
+		return lodDebugEnabled;
+	}
+
+	uint32_t Model3D::GetMeshCacheFlags()
+	{
+		uint32_t flags = 0;
+		if (meshOptimizerEnabled) {
+			flags |= MESH_CACHE_OPTIMIZED;
+		}
+		if (compactVerticesEnabled) {
+			flags |= MESH_CACHE_COMPACT_VERTICES;
+		}
+		if (meshLodEnabled) {
+			flags |= MESH_CACHE_LODS;
+		}
+		if (triangleBvhEnabled) {
+			flags |= MESH_CACHE_TRIANGLE_BVH;
+		}
+		return flags;
 	}
 
 	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::Draw(const gps::Shader& shaderProgram)
 	{
+		shaderProgram.useShaderProgram();
+		ResolveUniforms(shaderProgram);
+		lodDebugUniform.set(false);
+
 		for (int i = 0; i < meshes.size(); i++)
 			meshes[i].Draw(shaderProgram);
 	}
 
+	void Model3D::Draw(const gps::Shader& shaderProgram, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection)
+	{
+		shaderProgram.useShaderProgram();
+		ResolveUniforms(shaderProgram);
+		lodDebugUniform.set(lodDebugEnabled);
+
+		float scale = GetMaxScale(model);
+		glm::mat4 modelView = view * model;
+		gps::Frustum frustum;
+		frustum.Extract(projection * view);
+		CullMeshes(frustum, model, scale);
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (!meshVisible[i]) {
+				continue;
+			}
+			float distance;
+			int lod = SelectMeshLod(i, modelView, scale, projection, distance);
+
+			if (lodDebugEnabled) {
+				lodColorUniform.set(LOD_DEBUG_COLORS[lod]);
+			}
+			meshes[i].Draw(shaderProgram, lod);
+		}
+	}
+
+	void Model3D::Submit(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram, int objectSlot,
+		const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection)
+	{
+		const gps::Shader* shaders[2] = { &shaderProgram, &shaderProgram };
+		SubmitMeshes(queue, pass, shaders, NULL, 0, objectSlot, model, view, projection);
+	}
+
+	void Model3D::Submit(gps::RenderQueue& queue, gps::RenderPass pass, gps::ShaderPermutations& shaders, uint32_t features,
+		int objectSlot, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection)
+	{
+		// selected by SubmitMeshes once a mesh needs them, culled models compile and count nothing
+		const gps::Shader* variants[2] = { NULL, NULL };
+		SubmitMeshes(queue, pass, variants, &shaders, features, objectSlot, model, view, projection);
+	}
+
+	void Model3D::SubmitMeshes(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader* shaders[2],
+		gps::ShaderPermutations* permutations, uint32_t features, int objectSlot,
+		const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection)
+	{
+		auto shaderFor = [&](const gps::Mesh& mesh) -> const gps::Shader& {
+			int variant = HasSpecularMap(mesh) ? 1 : 0;
+			if (!shaders[variant]) {
+				shaders[variant] = &permutations->Select(variant ? features | SHADER_FEATURE_SPECULAR_MAP
+					: features & ~SHADER_FEATURE_SPECULAR_MAP);
+			}
+			return *shaders[variant];
+		};
+
+		float scale = GetMaxScale(model);
+		glm::mat4 modelView = view * model;
+		CullStats stats;
+		stats.visible = CullMeshes(queue.GetFrustum(), model, scale);
+		stats.culled = (unsigned int)meshes.size() - stats.visible;
+		stats.occluded = 0;
+		if (occlusionCullingEnabled && queue.GetOcclusionCuller()) {
+			stats.occluded = OccludeMeshes(*queue.GetOcclusionCuller(), model);
+			stats.visible -= stats.occluded;
+		}
+		queue.AddCullStats(stats);
+
+		gps::OcclusionQueries* occlusionQueries = queue.GetOcclusionQueries();
+		glm::vec4 nearPlane;
+		if (occlusionQueries) {
+			nearPlane = queue.GetFrustum().Transform(model).GetPlane(FRUSTUM_PLANE_NEAR);
+			occlusionQuerySlots.resize(meshes.size(), -1);
+		}
+
+		for (size_t b = 0; b < mergedBatches.size(); b++) {
+			mergedBatches[b].commands.clear();
+			mergedBatches[b].distance = std::numeric_limits<float>::max();
+		}
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (!meshVisible[i]) {
+				continue;
+			}
+			float distance;
+			int lod = SelectMeshLod(i, modelView, scale, projection, distance);
+
+			int query = -1;
+			if (occlusionQueries) {
+				if (occlusionQuerySlots[i] < 0) {
+					occlusionQuerySlots[i] = occlusionQueries->Allocate();
+				}
+				query = occlusionQuerySlots[i];
+				occlusionQueries->AddBox(query, objectSlot, meshes[i].getBoundsMin(), meshes[i].getBoundsMax(), nearPlane);
+			}
+
+			if (mergedVAO != 0) {
+				// a multi-draw cannot be rendered conditionally per mesh, only meshes known to be hidden are left out
+				if (query >= 0 && occlusionQueries->IsHidden(query)) {
+					continue;
+				}
+				MergedBatch& batch = mergedBatches[meshBatches[i]];
+				const MeshLod& range = meshes[i].getLod(lod);
+				DrawElementsIndirectCommand command = { range.indexCount, 1, range.indexOffset,
+					(GLint)meshes[i].getFirstVertex(), meshes[i].getMaterial() };
+				batch.commands.push_back(command);
+				batch.distance = std::min(batch.distance, distance);
+				continue;
+			}
+
+			const gps::Shader& shaderProgram = shaderFor(meshes[i]);
+			DrawItem item;
+			item.key = MakeMaterialKey(queue, pass, shaderProgram, meshes[i].textures, distance);
+			item.shader = &shaderProgram;
+			item.model = this;
+			item.mesh = (uint32_t)i;
+			item.lod = lod;
+			item.objectSlot = objectSlot;
+			item.occlusionQuery = query;
+			item.batch = -1;
+			queue.Add(item);
+		}
+
+		for (size_t b = 0; b < mergedBatches.size(); b++) {
+			if (mergedBatches[b].commands.empty()) {
+				continue;
+			}
+			// the meshes of a batch share their textures, specular map included
+			const gps::Mesh& first = meshes[mergedBatches[b].firstMesh];
+			const gps::Shader& shaderProgram = shaderFor(first);
+			DrawItem item;
+			item.key = MakeMaterialKey(queue, pass, shaderProgram, first.textures, mergedBatches[b].distance);
+			item.shader = &shaderProgram;
+			item.model = this;
+			item.mesh = (uint32_t)mergedBatches[b].firstMesh;
+			item.lod = 0;
+			item.objectSlot = objectSlot;
+			item.occlusionQuery = -1;
+			item.batch = (int)b;
+			queue.Add(item);
+			indirectCommandsDirty = true;
+		}
+	}
+
+	void Model3D::DrawBatch(const gps::Shader& shaderProgram, int batch)
+	{
+		if (indirectCommandsDirty) {
+			// every batch of the frame in one upload
+			indirectCommands.clear();
+			for (size_t b = 0; b < mergedBatches.size(); b++) {
+				mergedBatches[b].indirectOffset = (GLintptr)(indirectCommands.size() * sizeof(DrawElementsIndirectCommand));
+				indirectCommands.insert(indirectCommands.end(), mergedBatches[b].commands.begin(), mergedBatches[b].commands.end());
+			}
+			if (indirectDraws && !indirectCommands.empty()) {
+				glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+				glBufferData(GL_DRAW_INDIRECT_BUFFER, indirectCommands.size() * sizeof(DrawElementsIndirectCommand),
+					&indirectCommands[0], GL_STREAM_DRAW);
+			}
+			indirectCommandsDirty = false;
+		}
+
+		const MergedBatch& drawn = mergedBatches[batch];
+		shaderProgram.useShaderProgram();
+		ResolveUniforms(shaderProgram);
+		// the meshes of a batch may be at different levels, the tint would need a draw each
+		lodDebugUniform.set(false);
+		meshes[drawn.firstMesh].bindMaterial(shaderProgram, false);
+		GLStateCache::Get().BindVertexArray(mergedVAO);
+
+		if (indirectDraws) {
+			glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+			glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (const GLvoid*)drawn.indirectOffset,
+				(GLsizei)drawn.commands.size(), 0);
+			return;
+		}
+		drawCounts.resize(drawn.commands.size());
+		drawOffsets.resize(drawn.commands.size());
+		drawBaseVertices.resize(drawn.commands.size());
+		for (size_t c = 0; c < drawn.commands.size(); c++) {
+			drawCounts[c] = (GLsizei)drawn.commands[c].count;
+			drawOffsets[c] = (const GLvoid*)(drawn.commands[c].firstIndex * sizeof(GLuint));
+			drawBaseVertices[c] = drawn.commands[c].baseVertex;
+		}
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &drawCounts[0], GL_UNSIGNED_INT, &drawOffsets[0],
+			(GLsizei)drawn.commands.size(), &drawBaseVertices[0]);
+	}
+
+	void Model3D::DrawMesh(const gps::Shader& shaderProgram, size_t mesh, int lod)
+	{
+		shaderProgram.useShaderProgram();
+		ResolveUniforms(shaderProgram);
+		lodDebugUniform.set(lodDebugEnabled);
+		if (lodDebugEnabled) {
+			lodColorUniform.set(LOD_DEBUG_COLORS[lod]);
+		}
+		meshes[mesh].Draw(shaderProgram, lod);
+	}
+
+	void Model3D::SetInstances(const glm::mat4* transforms, size_t count)
+	{
+		instances.resize(count);
+		for (size_t i = 0; i < count; i++) {
+			instances[i].model = transforms[i];
+			instances[i].normalMatrix = glm::inverseTranspose(glm::mat3(transforms[i]));
+		}
+
+		if (instanceBuffer == 0) {
+			glGenBuffers(1, &instanceBuffer);
+		}
+		GLsizeiptr size = (GLsizeiptr)(count * sizeof(gps::InstanceData));
+		glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		if (size > instanceBufferSize) {
+			glBufferData(GL_ARRAY_BUFFER, size, instances.empty() ? NULL : &instances[0], GL_DYNAMIC_DRAW);
+			instanceBufferSize = size;
+		}
+		else if (size > 0) {
+			// orphaned so a draw still reading the old instances does not stall the copy
+			glBufferData(GL_ARRAY_BUFFER, instanceBufferSize, NULL, GL_DYNAMIC_DRAW);
+			glBufferSubData(GL_ARRAY_BUFFER, 0, size, &instances[0]);
+		}
+	}
+
+	size_t Model3D::GetMeshCount() const
+	{
+		return meshes.size();
+	}
+
+	size_t Model3D::GetInstanceCount() const
+	{
+		return instances.size();
+	}
+
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram)
+	{
+		if (instances.empty()) {
+			return;
+		}
+		shaderProgram.useShaderProgram();
+		ResolveUniforms(shaderProgram);
+		lodDebugUniform.set(false);
+
+		// meshes created since the last draw, e.g. by a background load, get the instance attributes first
+		for (; instancedMeshes < meshes.size(); instancedMeshes++) {
+			meshes[instancedMeshes].setInstanceBuffer(instanceBuffer);
+		}
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshes[i].DrawInstanced(shaderProgram, 0, (GLsizei)instances.size());
+		}
+	}
+
+	void Model3D::DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count)
+	{
+		SetInstances(transforms, count);
+		DrawInstanced(shaderProgram);
+	}
+
+	unsigned int Model3D::CullMeshes(const gps::Frustum& frustum, const glm::mat4& model, float scale)
+	{
+		if (!frustumCullingEnabled) {
+			meshVisible.assign(meshes.size(), 1);
+			return (unsigned int)meshes.size();
+		}
+		if (meshes.size() < BVH_CULL_MIN_MESHES || meshBvh.IsEmpty()) {
+			return CullBounds(meshes, frustum, model, scale, cullSpheres, meshVisible);
+		}
+
+		// the hierarchy is in object space, the planes are moved there instead
+		visibleMeshes.clear();
+		meshBvh.QueryFrustum(frustum.Transform(model), visibleMeshes);
+		meshVisible.assign(meshes.size(), 0);
+		for (size_t i = 0; i < visibleMeshes.size(); i++) {
+			meshVisible[visibleMeshes[i]] = 1;
+		}
+		return (unsigned int)visibleMeshes.size();
+	}
+
+	unsigned int Model3D::OccludeMeshes(const gps::OcclusionCuller& culler, const glm::mat4& model)
+	{
+		unsigned int occluded = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshVisible[i] && !culler.IsBoxVisible(meshes[i].getBoundsMin(), meshes[i].getBoundsMax(), model)) {
+				meshVisible[i] = 0;
+				occluded++;
+			}
+		}
+		return occluded;
+	}
+
+	void Model3D::RasterizeOccluders(gps::OcclusionCuller& culler, const glm::mat4& model) const
+	{
+		if (!occluderIndices.empty()) {
+			culler.RasterizeOccluder(&occluderPositions[0], occluderPositions.size(), &occluderIndices[0], occluderIndices.size(), model);
+		}
+	}
+
+	size_t Model3D::GetOccluderTriangleCount() const
+	{
+		return occluderIndices.size() / 3;
+	}
+
+	const gps::Bvh& Model3D::GetMeshBvh() const
+	{
+		return meshBvh;
+	}
+
+	const gps::Bvh& Model3D::GetTriangleBvh(size_t mesh) const
+	{
+		return triangleBvhs[mesh];
+	}
+
+	int Model3D::SelectMeshLod(size_t mesh, const glm::mat4& modelView, float scale, const glm::mat4& projection, float& distance)
+	{
+		glm::vec3 center = glm::vec3(modelView * glm::vec4(meshes[mesh].getBoundsCenter(), 1.0f));
+		float radius = meshes[mesh].getBoundsRadius() * scale;
+		distance = glm::length(center);
+
+		// fraction of the screen height covered by the sphere, the camera inside it gets the full mesh
+		float screenSize = distance > radius ? radius * projection[1][1] / distance : 1.0f;
+		return meshes[mesh].selectLod(screenSize, lodHysteresis);
+	}
+
+	void Model3D::ResolveUniforms(const gps::Shader& shaderProgram)
+	{
+		if (uniformProgram != shaderProgram.shaderProgram) {
+			uniformProgram = shaderProgram.shaderProgram;
+			lodDebugUniform = shaderProgram.getUniform<bool>("lodDebug");
+			lodColorUniform = shaderProgram.getUniform<glm::vec3>("lodColor");
+		}
+	}
+
+	static void ComputeBounds(gps::MeshData& mesh)
+	{
+		mesh.boundsMin = glm::vec3(0.0f);
+		mesh.boundsMax = glm::vec3(0.0f);
+		if (!mesh.vertices.empty()) {
+			mesh.boundsMin = mesh.vertices[0].Position;
+			mesh.boundsMax = mesh.vertices[0].Position;
+		}
+		for (size_t v = 1; v < mesh.vertices.size(); v++) {
+			mesh.boundsMin = glm::min(mesh.boundsMin, mesh.vertices[v].Position);
+			mesh.boundsMax = glm::max(mesh.boundsMax, mesh.vertices[v].Position);
+		}
+	}
+
+	// Applies the load options recorded in the mesh cache flags
+	void Model3D::ProcessMeshData(std::vector<gps::MeshData>& meshData)
+	{
+		if (meshOptimizerEnabled) {
+			VertexCacheStats totalBefore = {};
+			VertexCacheStats totalAfter = {};
+			for (size_t s = 0; s < meshData.size(); s++) {
+				VertexCacheStats before;
+				VertexCacheStats after;
+				MeshOptimizer::Optimize(meshData[s], before, after);
+
+				totalBefore.triangles += before.triangles;
+				totalBefore.vertices += before.vertices;
+				totalBefore.misses += before.misses;
+				totalAfter.triangles += after.triangles;
+				totalAfter.vertices += after.vertices;
+				totalAfter.misses += after.misses;
+			}
+
+			if (totalBefore.triangles > 0 && totalBefore.vertices > 0) {
+				std::cout << "ACMR           : " << (float)totalBefore.misses / totalBefore.triangles << " -> "
+					<< (float)totalAfter.misses / totalAfter.triangles << std::endl;
+				std::cout << "ATVR           : " << (float)totalBefore.misses / totalBefore.vertices << " -> "
+					<< (float)totalAfter.misses / totalAfter.vertices << std::endl;
+			}
+		}
+
+		for (size_t s = 0; s < meshData.size(); s++) {
+			ComputeBounds(meshData[s]);
+		}
+
+		if (meshLodEnabled) {
+			size_t levelTriangles[MAX_MESH_LODS] = {};
+			for (size_t s = 0; s < meshData.size(); s++) {
+				MeshSimplifier::GenerateLods(meshData[s]);
+
+				const std::vector<MeshLod>& lods = meshData[s].lods;
+				for (int lod = 0; lod < MAX_MESH_LODS; lod++) {
+					levelTriangles[lod] += lods[std::min((size_t)lod, lods.size() - 1)].indexCount / 3;
+				}
+			}
+
+			std::cout << "LOD triangles  : " << levelTriangles[0];
+			for (int lod = 1; lod < MAX_MESH_LODS; lod++) {
+				std::cout << " -> " << levelTriangles[lod];
+			}
+			std::cout << std::endl;
+		}
+
+		if (triangleBvhEnabled) {
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			size_t nodeCount = 0;
+			for (size_t s = 0; s < meshData.size(); s++) {
+				BuildTriangleBvh(meshData[s], std::thread::hardware_concurrency());
+				nodeCount += meshData[s].triangleBvh.GetNodes().size();
+			}
+			std::cout << "Triangle BVH   : " << nodeCount << " nodes in "
+				<< std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() << " ms" << std::endl;
+		}
+
+		if (compactVerticesEnabled) {
+			size_t floatBytes = 0;
+			size_t compactBytes = 0;
+			for (size_t s = 0; s < meshData.size(); s++) {
+				VertexCompressionError error = VertexCompressor::Compress(meshData[s]);
+				std::cout << "Compact mesh " << s << "  : max error " << error.position << " units, "
+					<< error.normal << " deg normal, " << error.texCoords << " uv" << std::endl;
+
+				floatBytes += meshData[s].vertices.size() * sizeof(gps::Vertex);
+				compactBytes += meshData[s].compactVertices.size() * sizeof(gps::CompactVertex);
+			}
+			std::cout << "VBO bytes      : " << floatBytes << " float, " << compactBytes << " compact" << std::endl;
+		}
+	}
+
+	void Model3D::BuildTriangleBvh(gps::MeshData& mesh, unsigned int threadCount)
+	{
+		// the levels of detail after the full mesh reuse its vertices, they are not included
+		size_t indexCount = mesh.lods.empty() ? mesh.indices.size() : mesh.lods[0].indexCount;
+		std::vector<BvhPrimitive> triangles(indexCount / 3);
+		for (size_t t = 0; t < triangles.size(); t++) {
+			const glm::vec3& a = mesh.vertices[mesh.indices[3 * t]].Position;
+			const glm::vec3& b = mesh.vertices[mesh.indices[3 * t + 1]].Position;
+			const glm::vec3& c = mesh.vertices[mesh.indices[3 * t + 2]].Position;
+			triangles[t].boundsMin = glm::min(a, glm::min(b, c));
+			triangles[t].boundsMax = glm::max(a, glm::max(b, c));
+		}
+		mesh.triangleBvh.Build(triangles, 4, threadCount);
+	}
+
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
+		std::vector<gps::MeshData> meshData;
+		if (!ReadMeshData(fileName, basePath, meshData)) {
+			exit(1);
+		}
+
+		ProcessMeshData(meshData);
+
+		if (meshCacheEnabled && !MeshCache::Write(fileName, meshData, GetMeshCacheFlags())) {
+			std::cerr << "WARNING: could not write mesh cache for " << fileName << std::endl;
+		}
+
+		CreateMeshes(meshData, basePath);
+	}
+
+	void Model3D::CreateMeshes(const std::vector<gps::MeshData>& meshData, std::string basePath)
+	{
+		for (size_t s = 0; s < meshData.size(); s++) {
+			std::vector<gps::Texture> textures = LoadMaterialTextures(basePath,
+				meshData[s].ambientTexture, meshData[s].diffuseTexture, meshData[s].specularTexture);
+
+			if (compactVerticesEnabled && !meshData[s].compactVertices.empty() && !meshData[s].indices.empty()) {
+				meshes.push_back(gps::Mesh(&meshData[s].compactVertices[0], (GLsizei)meshData[s].compactVertices.size(),
+					VERTEX_FORMAT_COMPACT, meshData[s].quantization,
+					&meshData[s].indices[0], (GLsizei)meshData[s].indices.size(), textures));
+			}
+			else {
+				meshes.push_back(gps::Mesh(meshData[s].vertices, meshData[s].indices, textures));
+			}
+			meshes.back().setLods(meshData[s].lods);
+			meshes.back().setBounds(meshData[s].boundsMin, meshData[s].boundsMax);
+			meshes.back().setMaterial(MaterialTable::Get().Add(meshData[s].material,
+				!meshData[s].diffuseTexture.empty(), !meshData[s].specularTexture.empty()));
+			triangleBvhs.push_back(meshData[s].triangleBvh);
+		}
+		// textures shared with models created earlier may already be array layers
+		UpdateTextureArrays();
+		MaterialTable::Get().Upload();
+		MeshCache::BuildMeshBvh(meshData, meshBvh);
+		MergeMeshes();
+
+		if (occlusionCullingEnabled) {
+			CollectOccluders(meshData, occluderPositions, occluderIndices);
+		}
+	}
+
+	void Model3D::MergeMeshes()
+	{
+		if (!mergedGeometryEnabled || meshes.empty() || mergedVAO != 0) {
+			return;
+		}
+		// compact vertices are dequantized with uniforms of their own mesh, which one multi-draw cannot change
+		GLsizeiptr vertexCount = 0;
+		GLsizeiptr indexCount = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			if (meshes[i].getFormat() != VERTEX_FORMAT_FLOAT) {
+				std::cerr << "WARNING: merged geometry needs float vertices, drawing the meshes one by one" << std::endl;
+				return;
+			}
+			vertexCount += meshes[i].getVertexCount();
+			indexCount += meshes[i].getIndexCount();
+		}
+
+		glGenBuffers(1, &mergedVBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mergedVBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, vertexCount * sizeof(gps::Vertex), NULL, GL_STATIC_DRAW);
+		glGenBuffers(1, &mergedEBO);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, mergedEBO);
+		glBufferData(GL_COPY_WRITE_BUFFER, indexCount * sizeof(GLuint), NULL, GL_STATIC_DRAW);
+
+		GLuint firstVertex = 0;
+		GLuint firstIndex = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			meshes[i].moveToSharedBuffers(mergedVBO, firstVertex, mergedEBO, firstIndex);
+			firstVertex += (GLuint)meshes[i].getVertexCount();
+			firstIndex += (GLuint)meshes[i].getIndexCount();
+		}
+
+		glGenVertexArrays(1, &mergedVAO);
+		GLStateCache::Get().BindVertexArray(mergedVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, mergedVBO);
+		gps::Mesh::setVertexAttributes(VERTEX_FORMAT_FLOAT, 0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mergedEBO);
+		indirectDraws = indirectDrawsEnabled && (GLEW_VERSION_4_3 || GLEW_ARB_multi_draw_indirect);
+		if (indirectDraws) {
+			// baseInstance + 0 picks the material index of each draw out of 0, 1, 2 ...
+			glBindBuffer(GL_ARRAY_BUFFER, MaterialTable::Get().GetIndexBuffer());
+			glEnableVertexAttribArray(MATERIAL_INDEX_LOCATION);
+			glVertexAttribIPointer(MATERIAL_INDEX_LOCATION, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+			glVertexAttribDivisor(MATERIAL_INDEX_LOCATION, 1);
+			glGenBuffers(1, &indirectBuffer);
+		}
+		GLStateCache::Get().BindVertexArray(0);
+
+		BuildBatches();
+	}
+
+	void Model3D::BuildBatches()
+	{
+		// one batch per texture set, by path since the ids change when placeholders are replaced, or by array
+		// since the layer travels in the material. The material colors travel with each draw, except in
+		// multi-draws without baseInstance where they split batches too.
+		std::unordered_map<std::string, uint32_t> batchByState;
+		std::unordered_map<std::string, uint32_t> stateBuckets;
+		mergedBatches.clear();
+		meshBatches.resize(meshes.size());
+		for (size_t i = 0; i < meshes.size(); i++) {
+			std::string textureSet;
+			for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+				const gps::Texture& texture = meshes[i].textures[t];
+				textureSet += texture.type + (texture.layer >= 0 ? " array " + std::to_string(texture.id) : ":" + texture.path) + "\n";
+			}
+			std::string textureSetAndMaterial = textureSet + std::to_string(meshes[i].getMaterial());
+			stateBuckets[textureSetAndMaterial] = 0;
+
+			const std::string& state = indirectDraws ? textureSet : textureSetAndMaterial;
+			std::unordered_map<std::string, uint32_t>::iterator found = batchByState.find(state);
+			if (found == batchByState.end()) {
+				found = batchByState.insert(std::make_pair(state, (uint32_t)mergedBatches.size())).first;
+				MergedBatch batch;
+				batch.firstMesh = i;
+				batch.distance = 0.0f;
+				batch.indirectOffset = 0;
+				mergedBatches.push_back(batch);
+			}
+			meshBatches[i] = found->second;
+		}
+
+		std::cout << "Merged " << meshes.size() << " meshes into one vertex and index buffer, " << stateBuckets.size()
+			<< " texture set and material pairs in " << mergedBatches.size() << " batches, "
+			<< (indirectDraws ? "indirect multi-draws" : "multi-draws") << std::endl;
+	}
+
+	bool Model3D::ReadMeshCache(std::string fileName, std::string basePath)
+	{
+		MeshCache cache;
+		if (!cache.Open(fileName, GetMeshCacheFlags())) {
+			return false;
+		}
+
+		std::cout << "Loading : " << fileName << " (mesh cache)" << std::endl;
+		CreateMeshes(cache, basePath, NULL);
+		return true;
+	}
+
+	void Model3D::CreateMeshes(const gps::MeshCache& cache, std::string basePath, const gps::AssetBundle* bundle)
+	{
+		// bundles keep the options they were packed with, so the format comes from the cache itself
+		bool compact = (cache.GetFlags() & MESH_CACHE_COMPACT_VERTICES) != 0;
+
+		for (size_t s = 0; s < cache.GetMeshCount(); s++) {
+			const MeshCacheEntry& entry = cache.GetEntry(s);
+			std::vector<gps::Texture> textures = LoadMaterialTextures(basePath,
+				cache.GetTextureName(s, 0), cache.GetTextureName(s, 1), cache.GetTextureName(s, 2), bundle);
+
+			VertexQuantization quantization;
+			quantization.positionOffset = glm::vec3(entry.positionOffset[0], entry.positionOffset[1], entry.positionOffset[2]);
+			quantization.positionScale = glm::vec3(entry.positionScale[0], entry.positionScale[1], entry.positionScale[2]);
+			if (!compact) {
+				quantization.positionOffset = glm::vec3(0.0f);
+				quantization.positionScale = glm::vec3(1.0f);
+			}
+
+			// vertices and indices go to the GPU straight from the mapping
+			meshes.push_back(gps::Mesh(cache.GetVertexData(s), (GLsizei)entry.vertexCount,
+				compact ? VERTEX_FORMAT_COMPACT : VERTEX_FORMAT_FLOAT, quantization,
+				cache.GetIndices(s), (GLsizei)entry.indexCount, textures));
+
+			std::vector<MeshLod> lods(entry.lodCount);
+			for (uint32_t lod = 0; lod < entry.lodCount; lod++) {
+				lods[lod].indexOffset = entry.lodIndexOffset[lod];
+				lods[lod].indexCount = entry.lodIndexCount[lod];
+				lods[lod].error = entry.lodError[lod];
+			}
+			meshes.back().setLods(lods);
+			meshes.back().setBounds(glm::vec3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]),
+				glm::vec3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]));
+
+			gps::Material material;
+			material.ambient = glm::vec3(entry.ambient[0], entry.ambient[1], entry.ambient[2]);
+			material.diffuse = glm::vec3(entry.diffuse[0], entry.diffuse[1], entry.diffuse[2]);
+			material.specular = glm::vec3(entry.specular[0], entry.specular[1], entry.specular[2]);
+			meshes.back().setMaterial(MaterialTable::Get().Add(material,
+				!cache.GetTextureName(s, 1).empty(), !cache.GetTextureName(s, 2).empty()));
+
+			triangleBvhs.push_back(gps::Bvh());
+			if (!cache.GetTriangleBvh(s, triangleBvhs.back())) {
+				std::cerr << "WARNING: malformed triangle BVH for mesh " << s << " in the mesh cache" << std::endl;
+			}
+		}
+
+		UpdateTextureArrays();
+		MaterialTable::Get().Upload();
+
+		// built from the mesh bounds when the cache was written
+		if (!cache.GetMeshBvh(meshBvh)) {
+			std::cerr << "WARNING: malformed mesh BVH in the mesh cache, culling every mesh separately" << std::endl;
+		}
+		MergeMeshes();
+
+		if (!occlusionCullingEnabled) {
+			return;
+		}
+		std::vector<size_t> triangleCounts(cache.GetMeshCount());
+		for (size_t s = 0; s < cache.GetMeshCount(); s++) {
+			const MeshCacheEntry& entry = cache.GetEntry(s);
+			triangleCounts[s] = (entry.lodCount > 0 ? entry.lodIndexCount[0] : entry.indexCount) / 3;
+		}
+		std::vector<size_t> occluders = SelectOccluders(meshes, triangleCounts);
+		std::vector<glm::vec3> positions;
+		for (size_t o = 0; o < occluders.size(); o++) {
+			size_t s = occluders[o];
+			const MeshCacheEntry& entry = cache.GetEntry(s);
+			positions.resize(entry.vertexCount);
+			if (compact) {
+				// the decoding the vertex shader does
+				const gps::CompactVertex* vertices = (const gps::CompactVertex*)cache.GetVertexData(s);
+				glm::vec3 offset(entry.positionOffset[0], entry.positionOffset[1], entry.positionOffset[2]);
+				glm::vec3 scale(entry.positionScale[0], entry.positionScale[1], entry.positionScale[2]);
+				for (size_t v = 0; v < positions.size(); v++) {
+					glm::vec3 stored(vertices[v].Position[0], vertices[v].Position[1], vertices[v].Position[2]);
+					positions[v] = offset + stored / 65535.0f * scale;
+				}
+			}
+			else {
+				const gps::Vertex* vertices = (const gps::Vertex*)cache.GetVertexData(s);
+				for (size_t v = 0; v < positions.size(); v++) {
+					positions[v] = vertices[v].Position;
+				}
+			}
+			AppendOccluder(occluderPositions, occluderIndices, positions, cache.GetIndices(s), triangleCounts[s] * 3);
+		}
+	}
+
+	bool Model3D::ReadMeshData(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData){
+
         std::cout << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
@@ -30,33 +1156,37 @@ namespace gps {
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		bool ret = ObjParser::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
 
 		if (!err.empty()) { // `err` may contain warning message.
 			std::cerr << err << std::endl;
 		}
 
 		if (!ret) {
-			exit(1);
+			return false;
 		}
 
 		std::cout << "# of shapes    : " << shapes.size() << std::endl;
 		std::cout << "# of materials : " << materials.size() << std::endl;
 
+		size_t cornerCount = 0;
+		size_t weldedCount = 0;
+
 		// Loop over shapes
+		meshData.resize(shapes.size());
 		for (size_t s = 0; s < shapes.size(); s++) {
-			std::vector<gps::Vertex> vertices;
-			std::vector<GLuint> indices;
-			std::vector<gps::Texture> textures;
+			std::vector<gps::Vertex>& vertices = meshData[s].vertices;
+			std::vector<GLuint>& indices = meshData[s].indices;
+
+			// identical (position, normal, texcoord) corners share one vertex
+			std::unordered_map<gps::Vertex, GLuint, VertexHash, VertexEqual> uniqueVertices;
+			uniqueVertices.reserve(shapes[s].mesh.indices.size());
 
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
 			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
 				int fv = shapes[s].mesh.num_face_vertices[f];
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
-
 				// Loop over vertices in the face.
 				for (size_t v = 0; v < fv; v++) {
 					// access to vertex
@@ -84,141 +1214,321 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
-					vertices.push_back(currentVertex);
+					std::pair<std::unordered_map<gps::Vertex, GLuint, VertexHash, VertexEqual>::iterator, bool> welded =
+						uniqueVertices.insert(std::make_pair(currentVertex, (GLuint)vertices.size()));
+					if (welded.second) {
+						vertices.push_back(currentVertex);
+					}
 
-					indices.push_back(index_offset + v);
+					indices.push_back(welded.first->second);
 				}
 
 				index_offset += fv;
 			}
 
+			cornerCount += indices.size();
+			weldedCount += vertices.size();
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
+			meshData[s].material.ambient = glm::vec3(0.0f);
+			meshData[s].material.diffuse = glm::vec3(0.0f);
+			meshData[s].material.specular = glm::vec3(0.0f);
 			int a = shapes[s].mesh.material_ids.size();
 			if (a > 0 && materials.size()>0) {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
-					gps::Material currentMaterial;
+					gps::Material& currentMaterial = meshData[s].material;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
 
-					//ambient texture
-					std::string ambientTexturePath = materials[materialId].ambient_texname;
-					if (!ambientTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + ambientTexturePath, "ambientTexture");
-						textures.push_back(currentTexture);
-					}
+					meshData[s].ambientTexture = materials[materialId].ambient_texname;
+					meshData[s].diffuseTexture = materials[materialId].diffuse_texname;
+					meshData[s].specularTexture = materials[materialId].specular_texname;
+				}
+			}
+		}
 
-					//diffuse texture
-					std::string diffuseTexturePath = materials[materialId].diffuse_texname;
-					if (!diffuseTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + diffuseTexturePath, "diffuseTexture");
-						textures.push_back(currentTexture);
-					}
+		std::cout << "VBO bytes      : " << cornerCount * sizeof(gps::Vertex) << " unwelded, "
+			<< weldedCount * sizeof(gps::Vertex) << " welded" << std::endl;
 
-					//specular texture
-					std::string specularTexturePath = materials[materialId].specular_texname;
-					if (!specularTexturePath.empty())
-					{
-						gps::Texture currentTexture;
-						currentTexture = LoadTexture(basePath + specularTexturePath, "specularTexture");
-						textures.push_back(currentTexture);
+		return true;
+	}
+
+	std::vector<gps::Texture> Model3D::LoadMaterialTextures(std::string basePath, const std::string& ambientTexture,
+		const std::string& diffuseTexture, const std::string& specularTexture, const gps::AssetBundle* bundle)
+	{
+		std::vector<gps::Texture> textures;
+
+		//ambient texture
+		if (!ambientTexture.empty())
+		{
+			textures.push_back(LoadTexture(basePath + ambientTexture, "ambientTexture", bundle));
+		}
+
+		//diffuse texture
+		if (!diffuseTexture.empty())
+		{
+			textures.push_back(LoadTexture(basePath + diffuseTexture, "diffuseTexture", bundle));
+		}
+
+		//specular texture
+		if (!specularTexture.empty())
+		{
+			textures.push_back(LoadTexture(basePath + specularTexture, "specularTexture", bundle));
+		}
+
+		return textures;
+	}
+
+	void Model3D::BenchmarkMeshCache(std::string fileName, int runs)
+	{
+		std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+
+		// uncached path: tinyobj parse and per-vertex rebuild
+		std::vector<gps::MeshData> meshData;
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		for (int run = 0; run < runs; run++) {
+			meshData.clear();
+			if (!ReadMeshData(fileName, basePath, meshData)) {
+				return;
+			}
+		}
+		double objTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+		MeshCache cache;
+		if (!cache.Open(fileName, GetMeshCacheFlags())) {
+			ProcessMeshData(meshData);
+			MeshCache::Write(fileName, meshData, GetMeshCacheFlags());
+		}
+		cache.Close();
+
+		// cached path: map, validate and touch every mesh, as ReadMeshCache does before the upload
+		size_t cachedBytes = 0;
+		start = std::chrono::steady_clock::now();
+		for (int run = 0; run < runs; run++) {
+			if (!cache.Open(fileName, GetMeshCacheFlags())) {
+				std::cerr << "ERROR: could not open mesh cache for " << fileName << std::endl;
+				return;
+			}
+			cachedBytes = 0;
+			for (size_t s = 0; s < cache.GetMeshCount(); s++) {
+				size_t vertexSize = compactVerticesEnabled ? sizeof(gps::CompactVertex) : sizeof(gps::Vertex);
+				cachedBytes += cache.GetEntry(s).vertexCount * vertexSize + cache.GetEntry(s).indexCount * sizeof(GLuint);
+			}
+			cache.Close();
+		}
+		double cacheTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / runs;
+
+		std::cout << "Mesh cache benchmark: " << fileName << " (" << runs << " runs, " << cachedBytes / 1024 << " KB of geometry)" << std::endl;
+		std::cout << "  .obj parse : " << objTime << " ms" << std::endl;
+		std::cout << "  mesh cache : " << cacheTime << " ms" << std::endl;
+		std::cout << "  speedup    : " << objTime / cacheTime << "x" << std::endl;
+	}
+
+	bool Model3D::CheckFrustumCulling(std::string fileName, int cameraCount)
+	{
+		std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		std::vector<gps::MeshData> meshData;
+		if (!ReadMeshData(fileName, basePath, meshData) || meshData.empty()) {
+			return false;
+		}
+
+		glm::vec3 sceneMin = meshData[0].vertices.empty() ? glm::vec3(0.0f) : meshData[0].vertices[0].Position;
+		glm::vec3 sceneMax = sceneMin;
+		for (size_t s = 0; s < meshData.size(); s++) {
+			ComputeBounds(meshData[s]);
+			sceneMin = glm::min(sceneMin, meshData[s].boundsMin);
+			sceneMax = glm::max(sceneMax, meshData[s].boundsMax);
+		}
+
+		// the projection main uses, cameras anywhere in the scene looking anywhere, models rotated and scaled
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 20.0f);
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		// the hierarchy walk has to agree with testing every box
+		gps::Bvh meshBvh;
+		MeshCache::BuildMeshBvh(meshData, meshBvh);
+		std::vector<uint32_t> bvhResults;
+		std::vector<unsigned char> bvhVisible;
+		size_t bvhMismatches = 0;
+
+		std::vector<glm::vec4> spheres;
+		std::vector<unsigned char> visible;
+		size_t tests = 0;
+		size_t visibleByTriangles = 0;
+		size_t visibleByBounds = 0;
+		size_t wronglyCulled = 0;
+		double cullTime = 0.0;
+		for (int camera = 0; camera < cameraCount; camera++) {
+			float scale = 0.5f + unit(random) * 1.5f;
+			glm::mat4 model = glm::rotate(glm::mat4(1.0f), unit(random) * 6.2831853f, glm::vec3(0.0f, 1.0f, 0.0f));
+			model = glm::scale(model, glm::vec3(scale));
+
+			glm::vec3 position = sceneMin + (sceneMax - sceneMin) * glm::vec3(unit(random), unit(random), unit(random));
+			position = glm::vec3(model * glm::vec4(position, 1.0f));
+			float yaw = unit(random) * 6.2831853f;
+			float pitch = (unit(random) - 0.5f) * 2.0f;
+			glm::vec3 front(cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw));
+			glm::mat4 view = glm::lookAt(position, position + front, glm::vec3(0.0f, 1.0f, 0.0f));
+
+			gps::Frustum frustum;
+			frustum.Extract(projection * view);
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			visibleByBounds += CullBounds(meshData, frustum, model, scale, spheres, visible);
+			cullTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+			gps::Frustum objectFrustum = frustum.Transform(model);
+			bvhResults.clear();
+			meshBvh.QueryFrustum(objectFrustum, bvhResults);
+			bvhVisible.assign(meshData.size(), 0);
+			for (size_t i = 0; i < bvhResults.size(); i++) {
+				bvhVisible[bvhResults[i]]++;
+			}
+			for (size_t s = 0; s < meshData.size(); s++) {
+				unsigned char boxVisible = objectFrustum.IntersectsBox(meshData[s].boundsMin, meshData[s].boundsMax) ? 1 : 0;
+				bvhMismatches += bvhVisible[s] != boxVisible ? 1 : 0;
+			}
+
+			glm::mat4 clipMatrix = projection * view * model;
+			for (size_t s = 0; s < meshData.size(); s++) {
+				const gps::MeshData& mesh = meshData[s];
+				bool triangleVisible = false;
+				for (size_t i = 0; i + 2 < mesh.indices.size() && !triangleVisible; i += 3) {
+					triangleVisible = Frustum::ClipTriangle(clipMatrix, mesh.vertices[mesh.indices[i]].Position,
+						mesh.vertices[mesh.indices[i + 1]].Position, mesh.vertices[mesh.indices[i + 2]].Position);
+				}
+				if (triangleVisible) {
+					visibleByTriangles++;
+					if (!visible[s]) {
+						wronglyCulled++;
 					}
 				}
+				tests++;
 			}
-
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
 		}
+
+		std::cout << "Frustum culling check: " << fileName << " (" << cameraCount << " cameras, " << meshData.size() << " meshes)" << std::endl;
+		std::cout << "  visible by triangles : " << visibleByTriangles << " of " << tests << std::endl;
+		std::cout << "  visible by bounds    : " << visibleByBounds << " of " << tests << std::endl;
+		std::cout << "  wrongly culled       : " << wronglyCulled << std::endl;
+		std::cout << "  BVH mismatches       : " << bvhMismatches << std::endl;
+		std::cout << "  cull time            : " << cullTime / std::max(cameraCount, 1) << " ms per camera" << std::endl;
+		return wronglyCulled == 0 && bvhMismatches == 0;
 	}
 
-	// Retrieves a texture associated with the object - by its name and type
-	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
+	void Model3D::BenchmarkOcclusionCulling(std::string fileName, int cameraCount, std::string depthImageName)
+	{
+		std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		std::vector<gps::MeshData> meshData;
+		if (!ReadMeshData(fileName, basePath, meshData) || meshData.empty()) {
+			return;
+		}
+
+		glm::vec3 sceneMin = meshData[0].vertices.empty() ? glm::vec3(0.0f) : meshData[0].vertices[0].Position;
+		glm::vec3 sceneMax = sceneMin;
+		for (size_t s = 0; s < meshData.size(); s++) {
+			ComputeBounds(meshData[s]);
+			sceneMin = glm::min(sceneMin, meshData[s].boundsMin);
+			sceneMax = glm::max(sceneMax, meshData[s].boundsMax);
+		}
+
+		std::vector<glm::vec3> occluderPositions;
+		std::vector<uint32_t> occluderIndices;
+		CollectOccluders(meshData, occluderPositions, occluderIndices);
+		if (occluderIndices.empty()) {
+			std::cout << "Occlusion culling benchmark: " << fileName << " has no meshes suitable as occluders" << std::endl;
+			return;
+		}
 
-			for (int i = 0; i < loadedTextures.size(); i++) {
-				if (loadedTextures[i].path == path)
-				{
-					//already loaded texture
-					return loadedTextures[i];
+		// the projection main uses, cameras anywhere in the lower half of the scene looking roughly level
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, 20.0f);
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+		glm::mat4 identity(1.0f);
+
+		gps::OcclusionCuller culler;
+		std::vector<glm::vec4> spheres;
+		std::vector<unsigned char> visible;
+		size_t inFrustum = 0;
+		size_t occluded = 0;
+		size_t mostOccluded = 0;
+		glm::mat4 mostOccludedView(1.0f);
+		double rasterizeTime = 0.0;
+		double testTime = 0.0;
+		for (int camera = 0; camera < cameraCount; camera++) {
+			glm::vec3 position = sceneMin + (sceneMax - sceneMin) * glm::vec3(unit(random), unit(random) * 0.5f, unit(random));
+			float yaw = unit(random) * 6.2831853f;
+			float pitch = (unit(random) - 0.5f) * 0.5f;
+			glm::vec3 front(cos(pitch) * sin(yaw), sin(pitch), cos(pitch) * cos(yaw));
+			glm::mat4 view = glm::lookAt(position, position + front, glm::vec3(0.0f, 1.0f, 0.0f));
+
+			gps::Frustum frustum;
+			frustum.Extract(projection * view);
+			inFrustum += CullBounds(meshData, frustum, identity, 1.0f, spheres, visible);
+
+			std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			culler.Begin(projection * view);
+			culler.RasterizeOccluder(&occluderPositions[0], occluderPositions.size(), &occluderIndices[0], occluderIndices.size(), identity);
+			std::chrono::steady_clock::time_point rasterized = std::chrono::steady_clock::now();
+			size_t cameraOccluded = 0;
+			for (size_t s = 0; s < meshData.size(); s++) {
+				if (visible[s] && !culler.IsBoxVisible(meshData[s].boundsMin, meshData[s].boundsMax, identity)) {
+					cameraOccluded++;
 				}
 			}
+			std::chrono::steady_clock::time_point tested = std::chrono::steady_clock::now();
+			rasterizeTime += std::chrono::duration<double, std::milli>(rasterized - start).count();
+			testTime += std::chrono::duration<double, std::milli>(tested - rasterized).count();
 
-			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
-			currentTexture.type = std::string(type);
-			currentTexture.path = path;
+			occluded += cameraOccluded;
+			if (cameraOccluded >= mostOccluded) {
+				mostOccluded = cameraOccluded;
+				mostOccludedView = view;
+			}
+		}
 
-			loadedTextures.push_back(currentTexture);
+		culler.Begin(projection * mostOccludedView);
+		culler.RasterizeOccluder(&occluderPositions[0], occluderPositions.size(), &occluderIndices[0], occluderIndices.size(), identity);
+		bool imageWritten = culler.WriteDepthImage(depthImageName);
 
-			return currentTexture;
+		std::cout << "Occlusion culling benchmark: " << fileName << " (" << cameraCount << " cameras, " << meshData.size() << " meshes, "
+			<< occluderIndices.size() / 3 << " occluder triangles, " << culler.GetWidth() << "x" << culler.GetHeight() << " buffer)" << std::endl;
+		std::cout << "  rasterize   : " << rasterizeTime / std::max(cameraCount, 1) << " ms per camera" << std::endl;
+		std::cout << "  box tests   : " << testTime / std::max(cameraCount, 1) << " ms per camera" << std::endl;
+		std::cout << "  in frustum  : " << inFrustum << " of " << meshData.size() * cameraCount << std::endl;
+		std::cout << "  occluded    : " << occluded << " (" << 100.0 * occluded / std::max(inFrustum, (size_t)1) << "% of those)" << std::endl;
+		if (imageWritten) {
+			std::cout << "  depth image : " << depthImageName << " (" << mostOccluded << " meshes hidden)" << std::endl;
 		}
+	}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
-		int x, y, n;
-		int force_channels = 4;
-		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
-		if (!image_data) {
-			fprintf(stderr, "ERROR: could not load %s\n", file_name);
-			return false;
+	// Retrieves a texture associated with the object - by its name and type
+	gps::Texture Model3D::LoadTexture(std::string path, std::string type, const gps::AssetBundle* bundle) {
+
+		// shared with every other model using the same image, loaded on first use
+		TextureHandle handle = TextureManager::Get().Acquire(path, bundle, loader);
+		if (!handle->ready) {
+			pendingTextures.push_back(std::make_pair(path, handle));
 		}
-		// NPOT check
-		if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
-			fprintf(
-				stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
-			);
-		}
-
-		int width_in_bytes = x * 4;
-		unsigned char *top = NULL;
-		unsigned char *bottom = NULL;
-		unsigned char temp = 0;
-		int half_height = y / 2;
-
-		for (int row = 0; row < half_height; row++) {
-			top = image_data + row * width_in_bytes;
-			bottom = image_data + (y - row - 1) * width_in_bytes;
-			for (int col = 0; col < width_in_bytes; col++) {
-				temp = *top;
-				*top = *bottom;
-				*bottom = temp;
-				top++;
-				bottom++;
-			}
-		}
-
-		GLuint textureID;
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(
-			GL_TEXTURE_2D,
-			0,
-			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
-			0,
-			GL_RGBA,
-			GL_UNSIGNED_BYTE,
-			image_data
-		);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
-
-		return textureID;
+
+		gps::Texture currentTexture;
+		currentTexture.id = handle->id;
+		currentTexture.type = std::string(type);
+		currentTexture.path = path;
+		currentTexture.layer = handle->layer;
+
+		loadedTextures.push_back(currentTexture);
+
+		return currentTexture;
 	}
 
 	Model3D::~Model3D() {
+        // the last model using a texture deletes it
         for (size_t i = 0; i < loadedTextures.size(); i++) {
-            glDeleteTextures(1, &loadedTextures.at(i).id);
+            TextureManager::Get().Release(loadedTextures.at(i).path);
         }
 
         for (size_t i = 0; i < meshes.size(); i++) {
@@ -228,6 +1538,17 @@ namespace gps {
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
+            GLStateCache::Get().ForgetVertexArray(VAO);
         }
+		if (instanceBuffer != 0) {
+			glDeleteBuffers(1, &instanceBuffer);
+		}
+		if (mergedVAO != 0) {
+			glDeleteBuffers(1, &mergedVBO);
+			glDeleteBuffers(1, &mergedEBO);
+			glDeleteBuffers(1, &indirectBuffer);
+			glDeleteVertexArrays(1, &mergedVAO);
+			GLStateCache::Get().ForgetVertexArray(mergedVAO);
+		}
 	}
 }
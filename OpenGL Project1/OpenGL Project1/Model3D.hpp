@@ -1,12 +1,27 @@
 #ifndef Model3D_hpp
 #define Model3D_hpp
 
+#include "AssetBundle.hpp"
+#include "AssetLoader.hpp"
 #include "Mesh.hpp"
+#include "MeshCache.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+#include "VertexCompressor.hpp"
+#include "ObjParser.hpp"
+#include "Frustum.hpp"
+#include "MaterialTable.hpp"
+#include "OcclusionCuller.hpp"
+#include "RenderQueue.hpp"
+#include "ShaderPermutations.hpp"
+#include "TextureManager.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
 
+#include <future>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -16,28 +31,271 @@ namespace gps {
     {
 
     public:
+        Model3D();
         ~Model3D();
 
 		void LoadModel(std::string fileName);
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// Builds the model packed under fileName in the bundle, textures come from the bundle too.
+		// Returns false if the bundle has no meshes for fileName.
+		bool LoadModel(const gps::AssetBundle& bundle, std::string fileName);
+
+		// Maps the mesh cache or parses the .obj on the loader's workers and returns at once. The meshes are
+		// created by Update when the data is ready and drawn with placeholder textures until theirs are uploaded.
+		// The loader must be started.
+		void LoadModel(gps::AssetLoader& loader, std::string fileName);
+
+		// Picks up finished background loads, call once per frame on the GL thread
+		void Update();
+
+		// True until the meshes and every texture of a LoadModel(loader, ...) call are in video memory
+		bool IsLoading() const;
+
+		// Meshes created so far, 0 for a file that failed to load
+		size_t GetMeshCount() const;
+
+		// Follows textures that TextureManager::PackTextureArrays moved into arrays: the meshes bind the arrays,
+		// their materials carry the layers and the merged batches are regrouped by array
+		void UpdateTextureArrays();
+
+		void Draw(const gps::Shader& shaderProgram);
+
+		// Draws every mesh inside the frustum at the level of detail matching its projected size for these matrices
+		void Draw(const gps::Shader& shaderProgram, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+
+		// Adds every mesh inside the queue's frustum and not hidden in its occlusion buffer at the level of
+		// detail Draw would pick, keyed by view distance, and counts the culled ones in the queue. objectSlot is the ObjectBlock slot already
+		// holding this model's matrices.
+		void Submit(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader& shaderProgram, int objectSlot,
+			const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+
+		// Same, each mesh drawn with the variant for features, plus SHADER_FEATURE_SPECULAR_MAP for the meshes
+		// that have a specular texture, or with the fallback while that variant is still compiling
+		void Submit(gps::RenderQueue& queue, gps::RenderPass pass, gps::ShaderPermutations& shaders, uint32_t features,
+			int objectSlot, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+
+		// Draws one mesh queued by Submit
+		void DrawMesh(const gps::Shader& shaderProgram, size_t mesh, int lod);
+
+		// Draws one batch queued by Submit with merged geometry, every visible mesh of a material in one multi-draw
+		void DrawBatch(const gps::Shader& shaderProgram, int batch);
+
+		// Copies one world transform per instance into the instance buffer, with the normal matrices derived
+		// from them. The buffer is kept until the next call, static instances are set once.
+		void SetInstances(const glm::mat4* transforms, size_t count);
+		size_t GetInstanceCount() const;
+
+		// Draws every mesh once for all the instances set last, one instanced draw per mesh. Instances are
+		// neither culled nor given a level of detail of their own.
+		void DrawInstanced(const gps::Shader& shaderProgram);
+
+		// SetInstances then DrawInstanced, for transforms that change every frame
+		void DrawInstanced(const gps::Shader& shaderProgram, const glm::mat4* transforms, size_t count);
+
+		// Draws the meshes picked as occluders into the software depth buffer, before anything is submitted
+		void RasterizeOccluders(gps::OcclusionCuller& culler, const glm::mat4& model) const;
+		size_t GetOccluderTriangleCount() const;
+
+		// Hierarchy over the object space bounds of the meshes, primitive i is mesh i
+		const gps::Bvh& GetMeshBvh() const;
+
+		// Hierarchy over the triangles of the full mesh, empty unless triangle hierarchies are enabled
+		const gps::Bvh& GetTriangleBvh(size_t mesh) const;
+
+		// Parses the .obj file into CPU-side meshes, no GL calls are made
+		static bool ReadMeshData(std::string fileName, std::string basePath, std::vector<gps::MeshData>& meshData);
+
+		// Runs the optimizer, LOD generation and vertex compression on freshly parsed meshes, as enabled
+		static void ProcessMeshData(std::vector<gps::MeshData>& meshData);
+
+		// Fills mesh.triangleBvh from the triangles of the full mesh
+		static void BuildTriangleBvh(gps::MeshData& mesh, unsigned int threadCount);
+
+		// Flags describing how the meshes are processed, stored in the mesh cache
+		static uint32_t GetMeshCacheFlags();
+
+		// Enables reading/writing the binary mesh cache next to each .obj (on by default)
+		static void SetMeshCacheEnabled(bool enabled);
+
+		// Enables the vertex cache/overdraw/vertex fetch reordering of every mesh at load time (on by default)
+		static void SetMeshOptimizerEnabled(bool enabled);
+
+		// Uploads meshes as 16 byte CompactVertex instead of 32 byte Vertex (off by default)
+		static void SetCompactVerticesEnabled(bool enabled);
+
+		// Generates simplified levels of detail for every mesh at load time (on by default)
+		static void SetMeshLodEnabled(bool enabled);
+
+		// Relative margin around the LOD_SCREEN_SIZE thresholds before a mesh switches level (0.1 by default)
+		static void SetLodHysteresis(float hysteresis);
+
+		// Builds and caches a hierarchy over the triangles of every mesh at load time (off by default)
+		static void SetTriangleBvhEnabled(bool enabled);
+
+		// Skips meshes whose bounds are outside the view frustum (on by default)
+		static void SetFrustumCullingEnabled(bool enabled);
+
+		// Keeps occluder geometry on the CPU and skips meshes hidden behind it (on by default)
+		static void SetOcclusionCullingEnabled(bool enabled);
+
+		// Packs the meshes of every model loaded afterwards into one vertex buffer, one index buffer and one vertex
+		// array, and submits one multi-draw per material instead of a draw per mesh (off by default). Needs float
+		// vertices, models with compact ones are drawn mesh by mesh.
+		static void SetMergedGeometryEnabled(bool enabled);
+
+		// Issues the merged batches with glMultiDrawElementsIndirect where GL 4.3 or ARB_multi_draw_indirect is
+		// available (on by default), with glMultiDrawElementsBaseVertex otherwise
+		static void SetIndirectDrawsEnabled(bool enabled);
+
+		// Tints every mesh with the color of the level of detail it is drawn at
+		static void SetLodDebugEnabled(bool enabled);
+		static bool IsLodDebugEnabled();
+
+		// Times .obj parsing against mapping the mesh cache, CPU work only
+		static void BenchmarkMeshCache(std::string fileName, int runs);
+
+		// Culls the meshes of the .obj file from random cameras and compares with clipping every triangle,
+		// CPU work only. Returns false if a mesh with a visible triangle was culled or the mesh hierarchy
+		// disagrees with testing every mesh box.
+		static bool CheckFrustumCulling(std::string fileName, int cameraCount);
+
+		// Rasterizes the occluders of the .obj file from random cameras and times testing every mesh against
+		// them, CPU work only. The buffer of the camera hiding the most meshes is written to depthImageName.
+		static void BenchmarkOcclusionCulling(std::string fileName, int cameraCount, std::string depthImageName);
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
-		// Associated textures
+		// Associated textures, one TextureManager reference each
         std::vector<gps::Texture> loadedTextures;
 
+		static bool meshCacheEnabled;
+		static bool meshOptimizerEnabled;
+		static bool compactVerticesEnabled;
+		static bool meshLodEnabled;
+		static float lodHysteresis;
+		static bool lodDebugEnabled;
+		static bool frustumCullingEnabled;
+		static bool occlusionCullingEnabled;
+		static bool triangleBvhEnabled;
+		static bool mergedGeometryEnabled;
+		static bool indirectDrawsEnabled;
+
+		// Background load state, see LoadModel(loader, ...)
+		struct PendingModel;
+		gps::AssetLoader* loader;
+		std::shared_ptr<PendingModel> pendingModel;
+		std::future<void> pendingModelDone;
+		// textures still drawn with the placeholder, by the path the materials use
+		std::vector<std::pair<std::string, gps::TextureHandle> > pendingTextures;
+
+		// level of detail debug uniforms of the program drawn with last
+		GLuint uniformProgram;
+		gps::Uniform<bool> lodDebugUniform;
+		gps::Uniform<glm::vec3> lodColorUniform;
+
+		gps::Bvh meshBvh;
+		// one per mesh, empty ones when they are disabled
+		std::vector<gps::Bvh> triangleBvhs;
+
+		// object space triangles of the occluder meshes, full detail, merged into one list
+		std::vector<glm::vec3> occluderPositions;
+		std::vector<uint32_t> occluderIndices;
+
+		// hardware occlusion query of each mesh, -1 until it is first submitted with queries on
+		std::vector<int> occlusionQuerySlots;
+
+		// InstanceData of every instance, the vertex arrays of the first instancedMeshes meshes read from it
+		GLuint instanceBuffer;
+		GLsizeiptr instanceBufferSize;
+		std::vector<gps::InstanceData> instances;
+		size_t instancedMeshes;
+
+		// Layout of the commands glMultiDrawElementsIndirect reads
+		struct DrawElementsIndirectCommand
+		{
+			GLuint count;
+			GLuint instanceCount;
+			GLuint firstIndex;
+			GLint baseVertex;
+			// MaterialTable index of the mesh, read through the material index array of the merged vertex array
+			GLuint baseInstance;
+		};
+
+		// Visible meshes of one material this frame, drawn with the textures of its first mesh
+		struct MergedBatch
+		{
+			size_t firstMesh;
+			std::vector<DrawElementsIndirectCommand> commands;
+			float distance;
+			GLintptr indirectOffset;
+		};
+
+		// every mesh in one vertex and one index buffer behind one vertex array, all 0 unless geometry is merged
+		GLuint mergedVAO;
+		GLuint mergedVBO;
+		GLuint mergedEBO;
+		GLuint indirectBuffer;
+		bool indirectDraws;
+		// batch of each mesh, meshes with the same textures share one (and the same material without indirect draws)
+		std::vector<uint32_t> meshBatches;
+		std::vector<MergedBatch> mergedBatches;
+		// the commands of every batch back to back, uploaded by the first DrawBatch after a Submit
+		std::vector<DrawElementsIndirectCommand> indirectCommands;
+		bool indirectCommandsDirty;
+		// glMultiDrawElementsBaseVertex arguments of the last batch
+		std::vector<GLsizei> drawCounts;
+		std::vector<const GLvoid*> drawOffsets;
+		std::vector<GLint> drawBaseVertices;
+
+		// per mesh culling results of the last Draw or Submit, 1 if the mesh may be visible
+		std::vector<glm::vec4> cullSpheres;
+		std::vector<unsigned char> meshVisible;
+		std::vector<uint32_t> visibleMeshes;
+
+		void ResolveUniforms(const gps::Shader& shaderProgram);
+
+		// Submit with shaders[1] for the meshes with a specular texture and shaders[0] for the rest. A NULL entry
+		// is selected from permutations with features the first time a queued mesh needs it.
+		void SubmitMeshes(gps::RenderQueue& queue, gps::RenderPass pass, const gps::Shader* shaders[2],
+			gps::ShaderPermutations* permutations, uint32_t features, int objectSlot,
+			const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+
+		// Moves the meshes into the merged buffers and groups them by material, once they are created
+		void MergeMeshes();
+		// Groups the merged meshes into batches by the textures they bind
+		void BuildBatches();
+
+		// Fills meshVisible for a world space frustum, returns the number of visible meshes
+		unsigned int CullMeshes(const gps::Frustum& frustum, const glm::mat4& model, float scale);
+
+		// Clears meshVisible for the meshes hidden in the occlusion buffer, returns how many there were
+		unsigned int OccludeMeshes(const gps::OcclusionCuller& culler, const glm::mat4& model);
+
+		// Level of detail for a mesh, distance gets the view space distance to its bounding sphere center
+		int SelectMeshLod(size_t mesh, const glm::mat4& modelView, float scale, const glm::mat4& projection, float& distance);
+
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
-		// Retrieves a texture associated with the object - by its name and type
-		gps::Texture LoadTexture(std::string path, std::string type);
+		// Builds the meshes from a fresh binary cache, returns false if there is none
+		bool ReadMeshCache(std::string fileName, std::string basePath);
+
+		// Uploads every mesh of an opened cache, textures are looked up in bundle first when there is one
+		void CreateMeshes(const gps::MeshCache& cache, std::string basePath, const gps::AssetBundle* bundle);
+
+		// Uploads every mesh parsed from an .obj file
+		void CreateMeshes(const std::vector<gps::MeshData>& meshData, std::string basePath);
+
+		// Loads the textures named by a material
+		std::vector<gps::Texture> LoadMaterialTextures(std::string basePath, const std::string& ambientTexture,
+			const std::string& diffuseTexture, const std::string& specularTexture, const gps::AssetBundle* bundle = NULL);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Retrieves a texture associated with the object - by its name and type - from the TextureManager.
+		// With a loader the texture is decoded in the background and the placeholder is returned meanwhile.
+		gps::Texture LoadTexture(std::string path, std::string type, const gps::AssetBundle* bundle = NULL);
     };
 }
 
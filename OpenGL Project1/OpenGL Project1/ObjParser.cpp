@@ -0,0 +1,630 @@
+#include "ObjParser.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+
+namespace gps {
+
+    enum ObjStatementType { OBJ_USEMTL, OBJ_MTLLIB, OBJ_GROUP, OBJ_OBJECT };
+
+    // A statement that changes the shape/material state, replayed in file order after parsing
+    struct ObjStatement
+    {
+        ObjStatementType type;
+        // number of faces of the chunk that come before the statement
+        size_t faceIndex;
+        std::string name;
+    };
+
+    // A relative (negative) face index that needs the vertex count of the previous chunks
+    struct ObjFixup
+    {
+        size_t corner;
+        // 0 position, 1 normal, 2 texcoord
+        int component;
+    };
+
+    struct ObjChunk
+    {
+        const char* begin;
+        const char* end;
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+        std::vector<tinyobj::index_t> corners;
+        // first corner of every face, followed by corners.size()
+        std::vector<size_t> faceStarts;
+        std::vector<ObjFixup> fixups;
+        std::vector<ObjStatement> statements;
+    };
+
+    struct ObjFaceRange
+    {
+        const ObjChunk* chunk;
+        size_t begin;
+        size_t end;
+    };
+
+    static const size_t MIN_CHUNK_SIZE = 256 * 1024;
+
+    static inline bool IsSpace(char c)
+    {
+        return c == ' ' || c == '\t';
+    }
+
+    static inline bool IsDigit(char c)
+    {
+        return (unsigned int)(c - '0') < 10u;
+    }
+
+    static inline const char* SkipSpaces(const char* p, const char* end)
+    {
+        while (p < end && IsSpace(*p)) p++;
+        return p;
+    }
+
+    static inline const char* SkipToken(const char* p, const char* end)
+    {
+        while (p < end && !IsSpace(*p)) p++;
+        return p;
+    }
+
+    static inline const char* SkipIndex(const char* p, const char* end)
+    {
+        while (p < end && *p != '/' && !IsSpace(*p)) p++;
+        return p;
+    }
+
+    // Same arithmetic as tinyobj's tryParseDouble, so both parsers produce identical floats
+    static bool ParseDouble(const char* s, const char* end, double* result)
+    {
+        static const double powLut[] = { 1.0, 0.1, 0.01, 0.001, 0.0001, 0.00001, 0.000001, 0.0000001 };
+        const int lutEntries = sizeof(powLut) / sizeof(powLut[0]);
+
+        if (s >= end) {
+            return false;
+        }
+
+        double mantissa = 0.0;
+        int exponent = 0;
+        char sign = '+';
+        const char* p = s;
+
+        if (*p == '+' || *p == '-') {
+            sign = *p;
+            p++;
+        }
+        else if (!IsDigit(*p)) {
+            return false;
+        }
+
+        // integer part
+        int read = 0;
+        while (p < end && IsDigit(*p)) {
+            mantissa *= 10;
+            mantissa += (int)(*p - '0');
+            p++;
+            read++;
+        }
+        if (read == 0) {
+            return false;
+        }
+
+        // decimal part
+        if (p < end && *p == '.') {
+            p++;
+            read = 1;
+            while (p < end && IsDigit(*p)) {
+                mantissa += (int)(*p - '0') * (read < lutEntries ? powLut[read] : pow(10.0, -read));
+                read++;
+                p++;
+            }
+        }
+
+        // exponent part
+        if (p < end && (*p == 'e' || *p == 'E')) {
+            p++;
+            char expSign = '+';
+            if (p < end && (*p == '+' || *p == '-')) {
+                expSign = *p;
+                p++;
+            }
+            else if (p >= end || !IsDigit(*p)) {
+                return false;
+            }
+
+            read = 0;
+            while (p < end && IsDigit(*p)) {
+                exponent *= 10;
+                exponent += (int)(*p - '0');
+                p++;
+                read++;
+            }
+            exponent *= (expSign == '+' ? 1 : -1);
+            if (read == 0) {
+                return false;
+            }
+        }
+
+        *result = (sign == '+' ? 1 : -1) * (exponent ? ldexp(mantissa * pow(5.0, exponent), exponent) : mantissa);
+        return true;
+    }
+
+    static inline float ParseFloat(const char** token, const char* end)
+    {
+        const char* p = SkipSpaces(*token, end);
+        const char* tokenEnd = SkipToken(p, end);
+        double value = 0.0;
+        ParseDouble(p, tokenEnd, &value);
+        *token = tokenEnd;
+        return (float)value;
+    }
+
+    // atoi restricted to the current line
+    static inline int ParseInt(const char* p, const char* end)
+    {
+        while (p < end && (IsSpace(*p) || *p == '\v' || *p == '\f')) p++;
+
+        bool negative = false;
+        if (p < end && (*p == '+' || *p == '-')) {
+            negative = *p == '-';
+            p++;
+        }
+
+        int value = 0;
+        while (p < end && IsDigit(*p)) {
+            value = value * 10 + (*p - '0');
+            p++;
+        }
+        return negative ? -value : value;
+    }
+
+    // Resolves an .obj index like tinyobj's fixIndex. Relative indices are made relative to the
+    // chunk and patched once the counts of the previous chunks are known.
+    static inline int FixIndex(int index, size_t localCount, ObjChunk& chunk, int component)
+    {
+        if (index > 0) return index - 1;
+        if (index == 0) return 0;
+
+        ObjFixup fixup;
+        fixup.corner = chunk.corners.size();
+        fixup.component = component;
+        chunk.fixups.push_back(fixup);
+        return (int)localCount + index;
+    }
+
+    // Parses i, i/j/k, i//k and i/j
+    static void ParseTriple(const char** token, const char* end, ObjChunk& chunk)
+    {
+        tinyobj::index_t index;
+        index.vertex_index = -1;
+        index.normal_index = -1;
+        index.texcoord_index = -1;
+
+        const char* p = *token;
+        index.vertex_index = FixIndex(ParseInt(p, end), chunk.v.size() / 3, chunk, 0);
+        p = SkipIndex(p, end);
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p == '/') {
+                // i//k
+                p++;
+                index.normal_index = FixIndex(ParseInt(p, end), chunk.vn.size() / 3, chunk, 1);
+                p = SkipIndex(p, end);
+            }
+            else {
+                // i/j/k or i/j
+                index.texcoord_index = FixIndex(ParseInt(p, end), chunk.vt.size() / 2, chunk, 2);
+                p = SkipIndex(p, end);
+                if (p < end && *p == '/') {
+                    p++;
+                    index.normal_index = FixIndex(ParseInt(p, end), chunk.vn.size() / 3, chunk, 1);
+                    p = SkipIndex(p, end);
+                }
+            }
+        }
+
+        chunk.corners.push_back(index);
+        *token = p;
+    }
+
+    // First whitespace separated word, like sscanf("%s")
+    static std::string ParseName(const char* p, const char* end)
+    {
+        while (p < end && (IsSpace(*p) || *p == '\v' || *p == '\f')) p++;
+        const char* nameEnd = p;
+        while (nameEnd < end && !IsSpace(*nameEnd) && *nameEnd != '\v' && *nameEnd != '\f') nameEnd++;
+        return std::string(p, nameEnd);
+    }
+
+    static void AddStatement(ObjChunk& chunk, ObjStatementType type, const std::string& name)
+    {
+        ObjStatement statement;
+        statement.type = type;
+        statement.faceIndex = chunk.faceStarts.size();
+        statement.name = name;
+        chunk.statements.push_back(statement);
+    }
+
+    static void ParseLine(const char* token, const char* end, ObjChunk& chunk)
+    {
+        token = SkipSpaces(token, end);
+        if (token >= end || token[0] == '#') {
+            return;
+        }
+
+        char next = token + 1 < end ? token[1] : '\0';
+        char afterNext = token + 2 < end ? token[2] : '\0';
+
+        // vertex
+        if (token[0] == 'v' && IsSpace(next)) {
+            token += 2;
+            chunk.v.push_back(ParseFloat(&token, end));
+            chunk.v.push_back(ParseFloat(&token, end));
+            chunk.v.push_back(ParseFloat(&token, end));
+            return;
+        }
+
+        // normal
+        if (token[0] == 'v' && next == 'n' && IsSpace(afterNext)) {
+            token += 3;
+            chunk.vn.push_back(ParseFloat(&token, end));
+            chunk.vn.push_back(ParseFloat(&token, end));
+            chunk.vn.push_back(ParseFloat(&token, end));
+            return;
+        }
+
+        // texcoord
+        if (token[0] == 'v' && next == 't' && IsSpace(afterNext)) {
+            token += 3;
+            chunk.vt.push_back(ParseFloat(&token, end));
+            chunk.vt.push_back(ParseFloat(&token, end));
+            return;
+        }
+
+        // face
+        if (token[0] == 'f' && IsSpace(next)) {
+            token = SkipSpaces(token + 2, end);
+            size_t faceStart = chunk.corners.size();
+            while (token < end) {
+                ParseTriple(&token, end, chunk);
+                token = SkipSpaces(token, end);
+            }
+            if (chunk.corners.size() > faceStart) {
+                chunk.faceStarts.push_back(faceStart);
+            }
+            return;
+        }
+
+        if (end - token > 6 && IsSpace(token[6])) {
+            if (strncmp(token, "usemtl", 6) == 0) {
+                AddStatement(chunk, OBJ_USEMTL, ParseName(token + 7, end));
+                return;
+            }
+            if (strncmp(token, "mtllib", 6) == 0) {
+                AddStatement(chunk, OBJ_MTLLIB, ParseName(token + 7, end));
+                return;
+            }
+        }
+
+        // group name, the first word is 'g' itself
+        if (token[0] == 'g' && IsSpace(next)) {
+            std::vector<std::string> names;
+            while (token < end) {
+                token = SkipSpaces(token, end);
+                const char* nameEnd = SkipToken(token, end);
+                names.push_back(std::string(token, nameEnd));
+                token = SkipSpaces(nameEnd, end);
+            }
+            AddStatement(chunk, OBJ_GROUP, names.size() > 1 ? names[1] : std::string());
+            return;
+        }
+
+        // object name
+        if (token[0] == 'o' && IsSpace(next)) {
+            AddStatement(chunk, OBJ_OBJECT, ParseName(token + 2, end));
+            return;
+        }
+
+        // unknown commands are ignored
+    }
+
+    static void ParseChunk(ObjChunk* chunk)
+    {
+        const char* p = chunk->begin;
+        while (p < chunk->end) {
+            // lines end with \n, \r\n or \r, as in tinyobj's safeGetline
+            const char* lineEnd = p;
+            while (lineEnd < chunk->end && *lineEnd != '\n' && *lineEnd != '\r') lineEnd++;
+
+            ParseLine(p, lineEnd, *chunk);
+
+            p = lineEnd;
+            if (p < chunk->end) {
+                p += (*p == '\r' && p + 1 < chunk->end && p[1] == '\n') ? 2 : 1;
+            }
+        }
+        chunk->faceStarts.push_back(chunk->corners.size());
+    }
+
+    // Same flattening as tinyobj's exportFaceGroupToShape
+    static bool ExportFaceGroup(tinyobj::shape_t& shape, const std::vector<ObjFaceRange>& faceGroup,
+        int materialId, const std::string& name, bool triangulate)
+    {
+        if (faceGroup.empty()) {
+            return false;
+        }
+
+        for (size_t r = 0; r < faceGroup.size(); r++) {
+            const ObjChunk& chunk = *faceGroup[r].chunk;
+            for (size_t f = faceGroup[r].begin; f < faceGroup[r].end; f++) {
+                const tinyobj::index_t* face = &chunk.corners[chunk.faceStarts[f]];
+                size_t faceSize = chunk.faceStarts[f + 1] - chunk.faceStarts[f];
+
+                if (triangulate) {
+                    // polygon -> triangle fan
+                    for (size_t k = 2; k < faceSize; k++) {
+                        shape.mesh.indices.push_back(face[0]);
+                        shape.mesh.indices.push_back(face[k - 1]);
+                        shape.mesh.indices.push_back(face[k]);
+                        shape.mesh.num_face_vertices.push_back(3);
+                        shape.mesh.material_ids.push_back(materialId);
+                    }
+                }
+                else {
+                    shape.mesh.indices.insert(shape.mesh.indices.end(), face, face + faceSize);
+                    shape.mesh.num_face_vertices.push_back((unsigned char)faceSize);
+                    shape.mesh.material_ids.push_back(materialId);
+                }
+            }
+        }
+
+        shape.name = name;
+        shape.mesh.tags.clear();
+
+        return true;
+    }
+
+    static void AddFaces(std::vector<ObjFaceRange>& faceGroup, const ObjChunk* chunk, size_t begin, size_t end)
+    {
+        if (begin >= end) {
+            return;
+        }
+        if (!faceGroup.empty() && faceGroup.back().chunk == chunk && faceGroup.back().end == begin) {
+            faceGroup.back().end = end;
+            return;
+        }
+
+        ObjFaceRange range;
+        range.chunk = chunk;
+        range.begin = begin;
+        range.end = end;
+        faceGroup.push_back(range);
+    }
+
+    static void PushShape(std::vector<tinyobj::shape_t>* shapes, tinyobj::shape_t& shape)
+    {
+        shapes->push_back(tinyobj::shape_t());
+        std::swap(shapes->back(), shape);
+    }
+
+    bool ObjParser::LoadObj(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+        std::vector<tinyobj::material_t>* materials, std::string* err,
+        const char* fileName, const char* mtlBasePath, bool triangulate, unsigned int threadCount)
+    {
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+
+        MappedFile file;
+        if (!file.Open(fileName)) {
+            std::ifstream emptyCheck(fileName);
+            if (emptyCheck) {
+                // an existing but empty file parses to nothing
+                return true;
+            }
+            if (err) {
+                *err = std::string("Cannot open file [") + fileName + "]\n";
+            }
+            return false;
+        }
+
+        const char* data = (const char*)file.GetData();
+        size_t size = file.GetSize();
+
+        // split into newline aligned chunks
+        if (threadCount == 0) {
+            threadCount = std::thread::hardware_concurrency();
+        }
+        size_t chunkCount = std::max<size_t>(1, std::min<size_t>(threadCount, size / MIN_CHUNK_SIZE));
+
+        std::vector<ObjChunk> chunks(chunkCount);
+        const char* chunkBegin = data;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char* chunkEnd = data + size;
+            if (i + 1 < chunkCount) {
+                chunkEnd = std::max(chunkBegin, data + size * (i + 1) / chunkCount);
+                while (chunkEnd < data + size && *chunkEnd != '\n') chunkEnd++;
+                if (chunkEnd < data + size) chunkEnd++;
+            }
+            chunks[i].begin = chunkBegin;
+            chunks[i].end = chunkEnd;
+            chunkBegin = chunkEnd;
+        }
+
+        if (chunkCount == 1) {
+            ParseChunk(&chunks[0]);
+        }
+        else {
+            std::vector<std::thread> workers;
+            for (size_t i = 0; i < chunkCount; i++) {
+                workers.push_back(std::thread(ParseChunk, &chunks[i]));
+            }
+            for (size_t i = 0; i < workers.size(); i++) {
+                workers[i].join();
+            }
+        }
+
+        // patch relative indices and merge the vertex attributes
+        size_t vertexCount = 0;
+        size_t normalCount = 0;
+        size_t texcoordCount = 0;
+        for (size_t i = 0; i < chunkCount; i++) {
+            ObjChunk& chunk = chunks[i];
+            for (size_t f = 0; f < chunk.fixups.size(); f++) {
+                tinyobj::index_t& index = chunk.corners[chunk.fixups[f].corner];
+                if (chunk.fixups[f].component == 0) index.vertex_index += (int)(vertexCount / 3);
+                if (chunk.fixups[f].component == 1) index.normal_index += (int)(normalCount / 3);
+                if (chunk.fixups[f].component == 2) index.texcoord_index += (int)(texcoordCount / 2);
+            }
+            vertexCount += chunk.v.size();
+            normalCount += chunk.vn.size();
+            texcoordCount += chunk.vt.size();
+        }
+
+        attrib->vertices.reserve(vertexCount);
+        attrib->normals.reserve(normalCount);
+        attrib->texcoords.reserve(texcoordCount);
+        for (size_t i = 0; i < chunkCount; i++) {
+            attrib->vertices.insert(attrib->vertices.end(), chunks[i].v.begin(), chunks[i].v.end());
+            attrib->normals.insert(attrib->normals.end(), chunks[i].vn.begin(), chunks[i].vn.end());
+            attrib->texcoords.insert(attrib->texcoords.end(), chunks[i].vt.begin(), chunks[i].vt.end());
+        }
+
+        // replay the statements in file order, exactly as tinyobj groups faces into shapes
+        std::string basePath = mtlBasePath ? mtlBasePath : "";
+        tinyobj::MaterialFileReader materialReader(basePath);
+        std::map<std::string, int> materialMap;
+        int material = -1;
+        std::string name;
+        tinyobj::shape_t shape;
+        std::vector<ObjFaceRange> faceGroup;
+
+        for (size_t i = 0; i < chunkCount; i++) {
+            const ObjChunk& chunk = chunks[i];
+            size_t face = 0;
+
+            for (size_t s = 0; s < chunk.statements.size(); s++) {
+                const ObjStatement& statement = chunk.statements[s];
+                AddFaces(faceGroup, &chunk, face, statement.faceIndex);
+                face = statement.faceIndex;
+
+                if (statement.type == OBJ_USEMTL) {
+                    std::map<std::string, int>::iterator found = materialMap.find(statement.name);
+                    int newMaterial = found != materialMap.end() ? found->second : -1;
+                    if (newMaterial != material) {
+                        ExportFaceGroup(shape, faceGroup, material, name, triangulate);
+                        faceGroup.clear();
+                        material = newMaterial;
+                    }
+                }
+                else if (statement.type == OBJ_MTLLIB) {
+                    std::string mtlErr;
+                    bool ok = materialReader(statement.name, materials, &materialMap, &mtlErr);
+                    if (err) {
+                        *err += mtlErr;
+                    }
+                    if (!ok) {
+                        return false;
+                    }
+                }
+                else {
+                    if (ExportFaceGroup(shape, faceGroup, material, name, triangulate)) {
+                        PushShape(shapes, shape);
+                    }
+                    shape = tinyobj::shape_t();
+                    faceGroup.clear();
+                    name = statement.name;
+                }
+            }
+
+            AddFaces(faceGroup, &chunk, face, chunk.faceStarts.size() - 1);
+        }
+
+        bool exported = ExportFaceGroup(shape, faceGroup, material, name, triangulate);
+        if (exported || shape.mesh.indices.size()) {
+            PushShape(shapes, shape);
+        }
+
+        return true;
+    }
+
+    static bool SameObjOutput(const tinyobj::attrib_t& a, const std::vector<tinyobj::shape_t>& aShapes,
+        const tinyobj::attrib_t& b, const std::vector<tinyobj::shape_t>& bShapes)
+    {
+        if (a.vertices != b.vertices || a.normals != b.normals || a.texcoords != b.texcoords ||
+            aShapes.size() != bShapes.size()) {
+            return false;
+        }
+
+        for (size_t s = 0; s < aShapes.size(); s++) {
+            const tinyobj::mesh_t& aMesh = aShapes[s].mesh;
+            const tinyobj::mesh_t& bMesh = bShapes[s].mesh;
+            if (aShapes[s].name != bShapes[s].name || aMesh.indices.size() != bMesh.indices.size() ||
+                aMesh.num_face_vertices != bMesh.num_face_vertices || aMesh.material_ids != bMesh.material_ids) {
+                return false;
+            }
+            for (size_t i = 0; i < aMesh.indices.size(); i++) {
+                if (aMesh.indices[i].vertex_index != bMesh.indices[i].vertex_index ||
+                    aMesh.indices[i].normal_index != bMesh.indices[i].normal_index ||
+                    aMesh.indices[i].texcoord_index != bMesh.indices[i].texcoord_index) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void ObjParser::Benchmark(std::string fileName, int runs)
+    {
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+
+        MappedFile file;
+        if (!file.Open(fileName)) {
+            std::cerr << "ERROR: could not open " << fileName << std::endl;
+            return;
+        }
+        double megabytes = file.GetSize() / (1024.0 * 1024.0);
+        file.Close();
+
+        tinyobj::attrib_t tinyAttrib;
+        std::vector<tinyobj::shape_t> tinyShapes;
+        std::vector<tinyobj::material_t> tinyMaterials;
+        std::string err;
+
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++) {
+            tinyMaterials.clear();
+            tinyobj::LoadObj(&tinyAttrib, &tinyShapes, &tinyMaterials, &err, fileName.c_str(), basePath.c_str(), true);
+        }
+        double tinyTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+
+        tinyobj::attrib_t attrib;
+        std::vector<tinyobj::shape_t> shapes;
+        std::vector<tinyobj::material_t> materials;
+
+        start = std::chrono::steady_clock::now();
+        for (int run = 0; run < runs; run++) {
+            materials.clear();
+            LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), true);
+        }
+        double parallelTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / runs;
+
+        bool match = SameObjOutput(tinyAttrib, tinyShapes, attrib, shapes) && tinyMaterials.size() == materials.size();
+
+        std::cout << "OBJ parser benchmark: " << fileName << " (" << megabytes << " MB, " << runs << " runs, "
+            << std::thread::hardware_concurrency() << " threads)" << std::endl;
+        std::cout << "  tinyobj        : " << megabytes / tinyTime << " MB/s" << std::endl;
+        std::cout << "  gps::ObjParser : " << megabytes / parallelTime << " MB/s" << std::endl;
+        std::cout << "  outputs match  : " << (match ? "yes" : "NO") << std::endl;
+    }
+}
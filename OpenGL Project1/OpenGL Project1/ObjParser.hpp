@@ -0,0 +1,29 @@
+#ifndef ObjParser_hpp
+#define ObjParser_hpp
+
+#include "tiny_obj_loader.h"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Multi-threaded .obj parser producing the same attrib/shape/material data as tinyobj::LoadObj.
+    // The file is split into newline aligned chunks that are parsed concurrently, then the
+    // shape/material statements are replayed in file order. Materials go through tinyobj's
+    // .mtl reader, they are tiny next to the geometry. 't' (subdivision tag) lines are ignored.
+    class ObjParser
+    {
+    public:
+        // Same contract as tinyobj::LoadObj, threadCount 0 uses every hardware thread
+        static bool LoadObj(tinyobj::attrib_t* attrib, std::vector<tinyobj::shape_t>* shapes,
+            std::vector<tinyobj::material_t>* materials, std::string* err,
+            const char* fileName, const char* mtlBasePath = NULL,
+            bool triangulate = true, unsigned int threadCount = 0);
+
+        // Parses fileName with both parsers, prints their throughput in MB/s and checks the outputs match
+        static void Benchmark(std::string fileName, int runs);
+    };
+}
+
+#endif /* ObjParser_hpp */
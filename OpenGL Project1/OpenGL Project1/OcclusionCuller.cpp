@@ -0,0 +1,311 @@
+#include "OcclusionCuller.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define OCCLUSION_SSE 1
+#include <xmmintrin.h>
+#endif
+
+namespace gps {
+
+    const int TILE_WIDTH = 8;
+    const int TILE_HEIGHT = 4;
+    const uint32_t FULL_TILE_MASK = 0xffffffffu;
+
+    OcclusionCuller::OcclusionCuller()
+        : width(0), height(0), tilesX(0), tilesY(0), viewProjection(1.0f), rasterizedTriangles(0)
+    {
+        SetResolution(320, 192);
+    }
+
+    void OcclusionCuller::SetResolution(int width, int height)
+    {
+        this->tilesX = std::max((width + TILE_WIDTH - 1) / TILE_WIDTH, 1);
+        this->tilesY = std::max((height + TILE_HEIGHT - 1) / TILE_HEIGHT, 1);
+        this->width = tilesX * TILE_WIDTH;
+        this->height = tilesY * TILE_HEIGHT;
+        Begin(viewProjection);
+    }
+
+    int OcclusionCuller::GetWidth() const
+    {
+        return width;
+    }
+
+    int OcclusionCuller::GetHeight() const
+    {
+        return height;
+    }
+
+    void OcclusionCuller::Begin(const glm::mat4& viewProjection)
+    {
+        this->viewProjection = viewProjection;
+        size_t tileCount = (size_t)tilesX * tilesY;
+        zMax0.assign(tileCount, 1.0f);
+        zMax1.assign(tileCount, 0.0f);
+        masks.assign(tileCount, 0);
+        rasterizedTriangles = 0;
+    }
+
+    void OcclusionCuller::RasterizeOccluder(const glm::vec3* positions, size_t positionCount, const uint32_t* indices,
+        size_t indexCount, const glm::mat4& model)
+    {
+        glm::mat4 clipMatrix = viewProjection * model;
+        clipPositions.resize(positionCount);
+        for (size_t i = 0; i < positionCount; i++) {
+            clipPositions[i] = clipMatrix * glm::vec4(positions[i], 1.0f);
+        }
+
+        for (size_t i = 0; i + 2 < indexCount; i += 3) {
+            if (indices[i] >= positionCount || indices[i + 1] >= positionCount || indices[i + 2] >= positionCount) {
+                continue;
+            }
+            RasterizeTriangle(clipPositions[indices[i]], clipPositions[indices[i + 1]], clipPositions[indices[i + 2]]);
+            rasterizedTriangles++;
+        }
+    }
+
+    // Pixel coordinates in x and y, depth in [0, 1] in z
+    static glm::vec3 ToScreen(const glm::vec4& clip, int width, int height)
+    {
+        float inverseW = 1.0f / clip.w;
+        return glm::vec3((clip.x * inverseW * 0.5f + 0.5f) * width,
+            (clip.y * inverseW * 0.5f + 0.5f) * height,
+            std::min(std::max(clip.z * inverseW * 0.5f + 0.5f, 0.0f), 1.0f));
+    }
+
+    void OcclusionCuller::RasterizeTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+    {
+        // also rejects anything behind the camera, where w <= 0. Past the far plane the depth would be
+        // clamped nearer than it is, so those triangles are dropped as well.
+        if (a.z < -a.w || b.z < -b.w || c.z < -c.w || a.w <= 0.0f || b.w <= 0.0f || c.w <= 0.0f ||
+            a.z > a.w || b.z > b.w || c.z > c.w) {
+            return;
+        }
+
+        glm::vec3 v[3] = { ToScreen(a, width, height), ToScreen(b, width, height), ToScreen(c, width, height) };
+        float area = (v[1].x - v[0].x) * (v[2].y - v[0].y) - (v[1].y - v[0].y) * (v[2].x - v[0].x);
+        // degenerate, or NaN from a vertex at infinity
+        if (!(std::fabs(area) > 1e-6f)) {
+            return;
+        }
+        // both windings occlude, make it counter clockwise so inside is positive for every edge
+        if (area < 0.0f) {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        float minX = std::min(std::min(v[0].x, v[1].x), v[2].x);
+        float maxX = std::max(std::max(v[0].x, v[1].x), v[2].x);
+        float minY = std::min(std::min(v[0].y, v[1].y), v[2].y);
+        float maxY = std::max(std::max(v[0].y, v[1].y), v[2].y);
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height) {
+            return;
+        }
+        int firstTileX = std::max((int)minX, 0) / TILE_WIDTH;
+        int lastTileX = std::min((int)maxX, width - 1) / TILE_WIDTH;
+        int firstTileY = std::max((int)minY, 0) / TILE_HEIGHT;
+        int lastTileY = std::min((int)maxY, height - 1) / TILE_HEIGHT;
+
+        // edge i runs from v[i] to v[i + 1], edgeA * x + edgeB * y + edgeC is positive on its inner side
+        float edgeA[3];
+        float edgeB[3];
+        float edgeC[3];
+        for (int i = 0; i < 3; i++) {
+            const glm::vec3& from = v[i];
+            const glm::vec3& to = v[(i + 1) % 3];
+            edgeA[i] = from.y - to.y;
+            edgeB[i] = to.x - from.x;
+            edgeC[i] = -(edgeA[i] * from.x + edgeB[i] * from.y);
+        }
+
+        // depth is affine in screen space, z = depthA * x + depthB * y + depthC
+        float x1 = v[1].x - v[0].x;
+        float y1 = v[1].y - v[0].y;
+        float x2 = v[2].x - v[0].x;
+        float y2 = v[2].y - v[0].y;
+        float z1 = v[1].z - v[0].z;
+        float z2 = v[2].z - v[0].z;
+        float depthA = (z1 * y2 - z2 * y1) / area;
+        float depthB = (x1 * z2 - x2 * z1) / area;
+        float depthC = v[0].z - depthA * v[0].x - depthB * v[0].y;
+        float triangleMax = std::max(std::max(v[0].z, v[1].z), v[2].z);
+        // the plane is highest at one corner of every tile, picked by the signs of its slopes
+        float cornerX = depthA > 0.0f ? (float)TILE_WIDTH : 0.0f;
+        float cornerY = depthB > 0.0f ? (float)TILE_HEIGHT : 0.0f;
+
+#ifdef OCCLUSION_SSE
+        __m128 columnOffsets[2] = { _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f), _mm_setr_ps(4.5f, 5.5f, 6.5f, 7.5f) };
+        __m128 stepA[3];
+        for (int i = 0; i < 3; i++) {
+            stepA[i] = _mm_set1_ps(edgeA[i]);
+        }
+#endif
+
+        for (int tileY = firstTileY; tileY <= lastTileY; tileY++) {
+            for (int tileX = firstTileX; tileX <= lastTileX; tileX++) {
+                float tileLeft = (float)(tileX * TILE_WIDTH);
+                float tileBottom = (float)(tileY * TILE_HEIGHT);
+                float tileDepth = std::min(triangleMax,
+                    depthA * (tileLeft + cornerX) + depthB * (tileBottom + cornerY) + depthC);
+
+                // one bit per pixel, row r of the tile in bits [8r, 8r + 8)
+                uint32_t coverage = 0;
+                for (int row = 0; row < TILE_HEIGHT; row++) {
+                    float y = tileBottom + row + 0.5f;
+#ifdef OCCLUSION_SSE
+                    for (int half = 0; half < 2; half++) {
+                        __m128 x = _mm_add_ps(_mm_set1_ps(tileLeft), columnOffsets[half]);
+                        __m128 inside = _mm_cmpgt_ps(_mm_add_ps(_mm_mul_ps(stepA[0], x),
+                            _mm_set1_ps(edgeB[0] * y + edgeC[0])), _mm_setzero_ps());
+                        for (int i = 1; i < 3; i++) {
+                            __m128 edge = _mm_add_ps(_mm_mul_ps(stepA[i], x), _mm_set1_ps(edgeB[i] * y + edgeC[i]));
+                            inside = _mm_and_ps(inside, _mm_cmpgt_ps(edge, _mm_setzero_ps()));
+                        }
+                        coverage |= (uint32_t)_mm_movemask_ps(inside) << (row * TILE_WIDTH + half * 4);
+                    }
+#else
+                    for (int column = 0; column < TILE_WIDTH; column++) {
+                        float x = tileLeft + column + 0.5f;
+                        if (edgeA[0] * x + edgeB[0] * y + edgeC[0] > 0.0f &&
+                            edgeA[1] * x + edgeB[1] * y + edgeC[1] > 0.0f &&
+                            edgeA[2] * x + edgeB[2] * y + edgeC[2] > 0.0f) {
+                            coverage |= 1u << (row * TILE_WIDTH + column);
+                        }
+                    }
+#endif
+                }
+
+                UpdateTile(tileY * tilesX + tileX, coverage, tileDepth);
+            }
+        }
+    }
+
+    void OcclusionCuller::UpdateTile(int tile, uint32_t coverage, float depth)
+    {
+        if (coverage == 0 || depth >= zMax0[tile]) {
+            return;
+        }
+
+        // the triangle alone covers the tile, and the working layer survives only if it is still nearer
+        if (coverage == FULL_TILE_MASK) {
+            zMax0[tile] = depth;
+            if (zMax1[tile] >= depth) {
+                masks[tile] = 0;
+            }
+            return;
+        }
+
+        // merging a working layer far behind the triangle would push the triangle back to its depth,
+        // so that layer is dropped instead
+        if (masks[tile] != 0 && zMax1[tile] - depth > zMax0[tile] - zMax1[tile]) {
+            masks[tile] = 0;
+        }
+
+        zMax1[tile] = masks[tile] == 0 ? depth : std::max(zMax1[tile], depth);
+        masks[tile] |= coverage;
+        if (masks[tile] == FULL_TILE_MASK) {
+            zMax0[tile] = zMax1[tile];
+            masks[tile] = 0;
+        }
+    }
+
+    bool OcclusionCuller::IsBoxVisible(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& model) const
+    {
+        glm::mat4 clipMatrix = viewProjection * model;
+        float minX = (float)width;
+        float maxX = 0.0f;
+        float minY = (float)height;
+        float maxY = 0.0f;
+        float nearestDepth = 1.0f;
+        for (int corner = 0; corner < 8; corner++) {
+            glm::vec3 position(corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y, corner & 4 ? boxMax.z : boxMin.z);
+            glm::vec4 clip = clipMatrix * glm::vec4(position, 1.0f);
+            // a box reaching through the near plane covers the whole screen as far as we can tell
+            if (clip.z < -clip.w || clip.w <= 0.0f) {
+                return true;
+            }
+            glm::vec3 screen = ToScreen(clip, width, height);
+            minX = std::min(minX, screen.x);
+            maxX = std::max(maxX, screen.x);
+            minY = std::min(minY, screen.y);
+            maxY = std::max(maxY, screen.y);
+            nearestDepth = std::min(nearestDepth, screen.z);
+        }
+
+        // off screen boxes are left to the frustum test
+        if (maxX < 0.0f || maxY < 0.0f || minX >= (float)width || minY >= (float)height) {
+            return true;
+        }
+        int firstX = std::max((int)minX, 0);
+        int lastX = std::min((int)maxX, width - 1);
+        int firstY = std::max((int)minY, 0);
+        int lastY = std::min((int)maxY, height - 1);
+
+        for (int tileY = firstY / TILE_HEIGHT; tileY <= lastY / TILE_HEIGHT; tileY++) {
+            int firstRow = std::max(firstY - tileY * TILE_HEIGHT, 0);
+            int lastRow = std::min(lastY - tileY * TILE_HEIGHT, TILE_HEIGHT - 1);
+            for (int tileX = firstX / TILE_WIDTH; tileX <= lastX / TILE_WIDTH; tileX++) {
+                int firstColumn = std::max(firstX - tileX * TILE_WIDTH, 0);
+                int lastColumn = std::min(lastX - tileX * TILE_WIDTH, TILE_WIDTH - 1);
+                uint32_t columns = (2u << lastColumn) - (1u << firstColumn);
+                uint32_t rectangle = 0;
+                for (int row = firstRow; row <= lastRow; row++) {
+                    rectangle |= columns << (row * TILE_WIDTH);
+                }
+
+                int tile = tileY * tilesX + tileX;
+                // pixels outside the mask are bounded by zMax0, the ones in it by the nearer zMax1
+                float bound = (rectangle & ~masks[tile]) != 0 ? zMax0[tile] : zMax1[tile];
+                if (nearestDepth <= bound) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    size_t OcclusionCuller::GetRasterizedTriangleCount() const
+    {
+        return rasterizedTriangles;
+    }
+
+    float OcclusionCuller::GetPixelDepth(int x, int y) const
+    {
+        int tile = (y / TILE_HEIGHT) * tilesX + x / TILE_WIDTH;
+        uint32_t bit = 1u << ((y % TILE_HEIGHT) * TILE_WIDTH + x % TILE_WIDTH);
+        return (masks[tile] & bit) != 0 ? zMax1[tile] : zMax0[tile];
+    }
+
+    bool OcclusionCuller::WriteDepthImage(const std::string& fileName) const
+    {
+        // z/w crowds towards 1, so the nearest depth found is stretched to white
+        float nearest = 1.0f;
+        for (int y = 0; y < height; y++) {
+            for (int x = 0; x < width; x++) {
+                nearest = std::min(nearest, GetPixelDepth(x, y));
+            }
+        }
+        float range = std::max(1.0f - nearest, 1e-6f);
+
+        std::ofstream image(fileName.c_str(), std::ios::binary | std::ios::trunc);
+        if (!image) {
+            std::cerr << "Failed to write occlusion depth image " << fileName << std::endl;
+            return false;
+        }
+        image << "P5\n" << width << " " << height << "\n255\n";
+        std::vector<unsigned char> row(width);
+        // images start at the top row, the buffer at the bottom one
+        for (int y = height - 1; y >= 0; y--) {
+            for (int x = 0; x < width; x++) {
+                row[x] = (unsigned char)(255.0f * (1.0f - GetPixelDepth(x, y)) / range + 0.5f);
+            }
+            image.write((const char*)&row[0], row.size());
+        }
+        return (bool)image;
+    }
+}
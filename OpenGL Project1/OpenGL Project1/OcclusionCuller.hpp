@@ -0,0 +1,63 @@
+#ifndef OcclusionCuller_hpp
+#define OcclusionCuller_hpp
+
+#include "glm/glm.hpp"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Low resolution software depth buffer in the masked occlusion culling layout: the screen is split
+    // into 8x4 pixel tiles, each with a coverage mask and two conservative depths instead of one depth per
+    // pixel. zMax0 bounds every pixel of the tile, zMax1 the pixels in the mask. Occluder triangles are
+    // rasterized into it on the CPU, four pixels at a time with SSE where it is available, and boxes are
+    // then tested against it. Depth is z/w of the clip space in [0, 1], larger is farther.
+    class OcclusionCuller
+    {
+    public:
+        OcclusionCuller();
+
+        // The width is rounded up to whole tiles (8 pixels), the height too (4 pixels)
+        void SetResolution(int width, int height);
+        int GetWidth() const;
+        int GetHeight() const;
+
+        // Empties the buffer for a new view
+        void Begin(const glm::mat4& viewProjection);
+
+        // Rasterizes indexed triangles transformed by model as occluders. Triangles crossing the near or far
+        // plane are skipped, they only make the culling less effective.
+        void RasterizeOccluder(const glm::vec3* positions, size_t positionCount, const uint32_t* indices, size_t indexCount,
+            const glm::mat4& model);
+
+        // False only if the object space box is hidden behind the occluders everywhere it could cover
+        bool IsBoxVisible(const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::mat4& model) const;
+
+        size_t GetRasterizedTriangleCount() const;
+
+        // Writes the depth bound of every pixel as a binary PGM image, near is white
+        bool WriteDepthImage(const std::string& fileName) const;
+
+    private:
+        int width;
+        int height;
+        int tilesX;
+        int tilesY;
+        glm::mat4 viewProjection;
+        std::vector<float> zMax0;
+        std::vector<float> zMax1;
+        std::vector<uint32_t> masks;
+        // clip space positions of the occluder being rasterized
+        std::vector<glm::vec4> clipPositions;
+        size_t rasterizedTriangles;
+
+        void RasterizeTriangle(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c);
+        void UpdateTile(int tile, uint32_t coverage, float depth);
+        // Depth bound of one pixel, from the tile layers
+        float GetPixelDepth(int x, int y) const;
+    };
+}
+
+#endif /* OcclusionCuller_hpp */
@@ -0,0 +1,370 @@
+#include "OcclusionQueries.hpp"
+
+#include "Frustum.hpp"
+#include "GLStateCache.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    // frames a mesh found visible is drawn before its box is queried again
+    static const unsigned int VISIBLE_QUERY_INTERVAL = 4;
+    // boxes grow by this fraction of their diagonal, so a mesh never hides behind its own surface
+    static const float BOX_MARGIN = 0.01f;
+
+    // corner x | y << 1 | z << 2 of the unit cube, faces counter clockwise from outside
+    static const GLfloat CUBE_VERTICES[] = {
+        0.0f, 0.0f, 0.0f,  1.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f,  1.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 1.0f,  1.0f, 0.0f, 1.0f,  0.0f, 1.0f, 1.0f,  1.0f, 1.0f, 1.0f
+    };
+    static const GLubyte CUBE_INDICES[] = {
+        0, 2, 3,  0, 3, 1,
+        4, 5, 7,  4, 7, 6,
+        0, 4, 6,  0, 6, 2,
+        1, 3, 7,  1, 7, 5,
+        0, 1, 5,  0, 5, 4,
+        2, 6, 7,  2, 7, 3
+    };
+
+    static void ResetStats(OcclusionQueryStats& stats)
+    {
+        stats.issued = 0;
+        stats.available = 0;
+        stats.skipped = 0;
+        stats.conditional = 0;
+    }
+
+    OcclusionQueries::OcclusionQueries()
+        : target(GL_ANY_SAMPLES_PASSED), cubeVAO(0), cubeVBO(0), cubeEBO(0), frame(0), conditionalRender(false)
+    {
+        ResetStats(frameStats);
+        ResetStats(totalStats);
+    }
+
+    void OcclusionQueries::Create(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName)
+    {
+        // the conservative target may count samples that would not pass, never the other way around
+        target = GLEW_VERSION_4_3 || GLEW_ARB_ES3_compatibility ? GL_ANY_SAMPLES_PASSED_CONSERVATIVE : GL_ANY_SAMPLES_PASSED;
+
+        boxShader.loadShader(vertexShaderFileName, fragmentShaderFileName);
+        boxShader.bindUniformBlock("CameraBlock", UNIFORM_BINDING_CAMERA);
+        boxShader.bindUniformBlock("ObjectBlock", UNIFORM_BINDING_OBJECT);
+        boxMinUniform = boxShader.getUniform<glm::vec3>("boxMin");
+        boxSizeUniform = boxShader.getUniform<glm::vec3>("boxSize");
+
+        glGenVertexArrays(1, &cubeVAO);
+        glGenBuffers(1, &cubeVBO);
+        glGenBuffers(1, &cubeEBO);
+        GLStateCache::Get().BindVertexArray(cubeVAO);
+        glBindBuffer(GL_ARRAY_BUFFER, cubeVBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(CUBE_VERTICES), CUBE_VERTICES, GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, cubeEBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(CUBE_INDICES), CUBE_INDICES, GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
+        GLStateCache::Get().BindVertexArray(0);
+    }
+
+    void OcclusionQueries::Delete()
+    {
+        for (size_t i = 0; i < queries.size(); i++) {
+            glDeleteQueries(1, &queries[i].id);
+        }
+        queries.clear();
+        boxes.clear();
+
+        if (cubeVAO != 0) {
+            GLStateCache::Get().ForgetVertexArray(cubeVAO);
+            glDeleteVertexArrays(1, &cubeVAO);
+            glDeleteBuffers(1, &cubeVBO);
+            glDeleteBuffers(1, &cubeEBO);
+            glDeleteProgram(boxShader.shaderProgram);
+            cubeVAO = 0;
+            cubeVBO = 0;
+            cubeEBO = 0;
+        }
+    }
+
+    bool OcclusionQueries::IsCreated() const
+    {
+        return cubeVAO != 0;
+    }
+
+    int OcclusionQueries::Allocate()
+    {
+        Query query;
+        glGenQueries(1, &query.id);
+        query.pending = false;
+        query.hidden = false;
+        query.nearCamera = false;
+        // spreads the boxes of meshes loaded together over the query interval
+        query.queriedFrame = frame - VISIBLE_QUERY_INTERVAL + (unsigned int)queries.size() % VISIBLE_QUERY_INTERVAL;
+        queries.push_back(query);
+        return (int)queries.size() - 1;
+    }
+
+    void OcclusionQueries::BeginFrame()
+    {
+        frame++;
+        ResetStats(frameStats);
+
+        for (size_t i = 0; i < queries.size(); i++) {
+            Query& query = queries[i];
+            if (!query.pending) {
+                continue;
+            }
+            GLuint available = 0;
+            glGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) {
+                continue;
+            }
+            GLuint samplesPassed = 0;
+            glGetQueryObjectuiv(query.id, GL_QUERY_RESULT, &samplesPassed);
+            query.hidden = samplesPassed == 0;
+            query.pending = false;
+            frameStats.available++;
+            totalStats.available++;
+        }
+    }
+
+    void OcclusionQueries::AddBox(int query, int objectSlot, const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec4& nearPlane)
+    {
+        Query& current = queries[query];
+        float margin = glm::length(boxMax - boxMin) * BOX_MARGIN;
+        Box box = { query, objectSlot, boxMin - glm::vec3(margin), boxMax + glm::vec3(margin) };
+
+        // the corner farthest behind the near plane
+        glm::vec3 corner(nearPlane.x >= 0.0f ? box.boxMin.x : box.boxMax.x,
+            nearPlane.y >= 0.0f ? box.boxMin.y : box.boxMax.y,
+            nearPlane.z >= 0.0f ? box.boxMin.z : box.boxMax.z);
+        current.nearCamera = glm::dot(glm::vec3(nearPlane), corner) + nearPlane.w <= 0.0f;
+        if (current.nearCamera) {
+            current.hidden = false;
+            return;
+        }
+
+        if (current.pending || (!current.hidden && frame - current.queriedFrame < VISIBLE_QUERY_INTERVAL)) {
+            return;
+        }
+        boxes.push_back(box);
+    }
+
+    bool OcclusionQueries::BeginDraw(int query)
+    {
+        const Query& current = queries[query];
+        if (current.nearCamera) {
+            return true;
+        }
+        if (current.pending) {
+            // no result yet, the GPU draws unless it has one saying hidden by the time it gets here
+            glBeginConditionalRender(current.id, GL_QUERY_NO_WAIT);
+            conditionalRender = true;
+            frameStats.conditional++;
+            totalStats.conditional++;
+            return true;
+        }
+        if (current.hidden) {
+            frameStats.skipped++;
+            totalStats.skipped++;
+            return false;
+        }
+        return true;
+    }
+
+    void OcclusionQueries::EndDraw()
+    {
+        if (conditionalRender) {
+            glEndConditionalRender();
+            conditionalRender = false;
+        }
+    }
+
+    void OcclusionQueries::IssueQueries(const gps::UniformBuffer& objectBuffer)
+    {
+        if (boxes.empty()) {
+            return;
+        }
+
+        // back faces stay culled, the camera is outside every box queued
+        GLStateCache& state = GLStateCache::Get();
+        boxShader.useShaderProgram();
+        state.BindVertexArray(cubeVAO);
+        state.SetCapability(GL_DEPTH_TEST, true);
+        state.SetDepthMask(false);
+        glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+
+        int boundSlot = -1;
+        for (size_t i = 0; i < boxes.size(); i++) {
+            const Box& box = boxes[i];
+            if (box.objectSlot != boundSlot) {
+                objectBuffer.Bind(box.objectSlot);
+                boundSlot = box.objectSlot;
+            }
+            Query& query = queries[box.query];
+            glBeginQuery(target, query.id);
+            DrawBox(box.boxMin, box.boxMax);
+            glEndQuery(target);
+            query.pending = true;
+            query.queriedFrame = frame;
+        }
+        frameStats.issued += (unsigned int)boxes.size();
+        totalStats.issued += (unsigned int)boxes.size();
+        boxes.clear();
+
+        glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+        state.SetDepthMask(true);
+    }
+
+    bool OcclusionQueries::IsHidden(int query) const
+    {
+        return queries[query].hidden;
+    }
+
+    OcclusionQueryStats OcclusionQueries::GetFrameStats() const
+    {
+        return frameStats;
+    }
+
+    OcclusionQueryStats OcclusionQueries::GetTotalStats() const
+    {
+        return totalStats;
+    }
+
+    void OcclusionQueries::DrawBox(const glm::vec3& boxMin, const glm::vec3& boxMax)
+    {
+        boxMinUniform.set(boxMin);
+        boxSizeUniform.set(boxMax - boxMin);
+        glDrawElements(GL_TRIANGLES, sizeof(CUBE_INDICES), GL_UNSIGNED_BYTE, (GLvoid*)0);
+    }
+
+    bool OcclusionQueries::SelfTest(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName)
+    {
+        const int SIZE = 128;
+        const int FRAMES = 8;
+
+        // a hidden window may own none of its pixels, so everything goes to a framebuffer of our own
+        GLuint framebuffer;
+        GLuint renderbuffers[2];
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, SIZE, SIZE);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "ERROR: occlusion query test framebuffer is incomplete" << std::endl;
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+            glDeleteRenderbuffers(2, renderbuffers);
+            glDeleteFramebuffers(1, &framebuffer);
+            return false;
+        }
+        glViewport(0, 0, SIZE, SIZE);
+
+        OcclusionQueries occlusionQueries;
+        occlusionQueries.Create(vertexShaderFileName, fragmentShaderFileName);
+
+        UniformBuffer cameraBuffer;
+        UniformBuffer objectBuffer;
+        cameraBuffer.Create(UNIFORM_BINDING_CAMERA, sizeof(CameraUniforms));
+        objectBuffer.Create(UNIFORM_BINDING_OBJECT, sizeof(ObjectUniforms));
+        CameraUniforms camera;
+        camera.view = glm::lookAt(glm::vec3(0.0f, 0.0f, 5.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+        camera.projection = glm::perspective(glm::radians(45.0f), 1.0f, 0.1f, 100.0f);
+        cameraBuffer.Update(camera);
+        ObjectUniforms object = {};
+        object.model = glm::mat4(1.0f);
+        objectBuffer.Update(object);
+        Frustum frustum;
+        frustum.Extract(camera.projection * camera.view);
+        glm::vec4 nearPlane = frustum.GetPlane(FRUSTUM_PLANE_NEAR);
+
+        // a wall at z = 0 in front of the camera and meshes around it
+        struct TestMesh
+        {
+            const char* name;
+            glm::vec3 boxMin;
+            glm::vec3 boxMax;
+            bool hidden;
+            int query;
+        };
+        TestMesh meshes[] = {
+            { "behind the wall", glm::vec3(-0.5f, -0.5f, -3.0f), glm::vec3(0.5f, 0.5f, -2.0f), true, -1 },
+            { "in front of the wall", glm::vec3(-0.5f, -0.5f, 1.0f), glm::vec3(0.5f, 0.5f, 1.5f), false, -1 },
+            { "beside the wall", glm::vec3(2.2f, -0.5f, -2.0f), glm::vec3(2.7f, 0.5f, -1.5f), false, -1 },
+            { "around the camera", glm::vec3(-1.0f, -1.0f, 4.0f), glm::vec3(1.0f, 1.0f, 6.0f), false, -1 }
+        };
+        const int MESH_COUNT = sizeof(meshes) / sizeof(meshes[0]);
+        for (int i = 0; i < MESH_COUNT; i++) {
+            meshes[i].query = occlusionQueries.Allocate();
+        }
+
+        GLStateCache& state = GLStateCache::Get();
+        state.SetCapability(GL_DEPTH_TEST, true);
+        state.SetDepthFunc(GL_LESS);
+        state.SetCapability(GL_CULL_FACE, true);
+        unsigned int drawn = 0;
+        for (int frame = 0; frame <= FRAMES; frame++) {
+            occlusionQueries.BeginFrame();
+            if (frame == FRAMES) {
+                break;
+            }
+
+            state.SetDepthMask(true);
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            occlusionQueries.boxShader.useShaderProgram();
+            state.BindVertexArray(occlusionQueries.cubeVAO);
+            objectBuffer.Bind(0);
+            occlusionQueries.DrawBox(glm::vec3(-1.5f, -1.5f, -0.05f), glm::vec3(1.5f, 1.5f, 0.05f));
+
+            for (int i = 0; i < MESH_COUNT; i++) {
+                occlusionQueries.AddBox(meshes[i].query, 0, meshes[i].boxMin, meshes[i].boxMax, nearPlane);
+            }
+            for (int i = 0; i < MESH_COUNT; i++) {
+                if (occlusionQueries.BeginDraw(meshes[i].query)) {
+                    occlusionQueries.DrawBox(meshes[i].boxMin, meshes[i].boxMax);
+                    occlusionQueries.EndDraw();
+                    drawn++;
+                }
+            }
+            occlusionQueries.IssueQueries(objectBuffer);
+
+            // drawn again after the queries, as the transparent pass is, while their results are in flight
+            for (int i = 0; i < MESH_COUNT; i++) {
+                if (occlusionQueries.BeginDraw(meshes[i].query)) {
+                    occlusionQueries.DrawBox(meshes[i].boxMin, meshes[i].boxMax);
+                    occlusionQueries.EndDraw();
+                }
+            }
+            // every result is ready by the next frame, which keeps the outcome independent of GPU timing
+            glFinish();
+        }
+
+        bool passed = true;
+        std::cout << "Occlusion query check (" << FRAMES << " frames, "
+            << (occlusionQueries.target == GL_ANY_SAMPLES_PASSED_CONSERVATIVE ? "conservative" : "exact") << " queries)" << std::endl;
+        for (int i = 0; i < MESH_COUNT; i++) {
+            bool hidden = occlusionQueries.IsHidden(meshes[i].query);
+            std::cout << "  " << meshes[i].name << " : " << (hidden ? "hidden" : "visible")
+                << (hidden == meshes[i].hidden ? "" : " (WRONG)") << std::endl;
+            passed = passed && hidden == meshes[i].hidden;
+        }
+        OcclusionQueryStats stats = occlusionQueries.GetTotalStats();
+        std::cout << "  queries issued : " << stats.issued << ", results available " << stats.available << std::endl;
+        std::cout << "  draws          : " << drawn << " drawn, " << stats.skipped << " skipped, " << stats.conditional << " conditional" << std::endl;
+        // the hidden mesh is found on the first frame and skipped in the others
+        passed = passed && stats.issued > 0 && stats.available == stats.issued && stats.skipped >= FRAMES - 2 && stats.conditional > 0;
+
+        occlusionQueries.Delete();
+        GLuint uniformBuffers[] = { cameraBuffer.GetId(), objectBuffer.GetId() };
+        glDeleteBuffers(2, uniformBuffers);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(2, renderbuffers);
+        glDeleteFramebuffers(1, &framebuffer);
+        return passed;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef OcclusionQueries_hpp
+#define OcclusionQueries_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include "Shader.hpp"
+#include "UniformBuffer.hpp"
+
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Counted per frame: box queries sent, results read back, draws skipped on a hidden result and draws
+    // left to the GPU with conditional rendering because their result was still on its way
+    struct OcclusionQueryStats
+    {
+        unsigned int issued;
+        unsigned int available;
+        unsigned int skipped;
+        unsigned int conditional;
+    };
+
+    // Hardware occlusion culling with one query per mesh. The bounding boxes are drawn after the opaque
+    // pass with color and depth writes off, each inside a GL_ANY_SAMPLES_PASSED_CONSERVATIVE query
+    // (GL_ANY_SAMPLES_PASSED before GL 4.3). Results are only read once GL reports them available, a frame
+    // later in practice, so the CPU never waits: a mesh whose box was hidden is skipped, one whose result
+    // is still in flight is drawn inside glBeginConditionalRender and the GPU drops it if its box was
+    // hidden. Meshes found visible are trusted for a few frames before their box is queried again.
+    class OcclusionQueries
+    {
+    public:
+        OcclusionQueries();
+
+        // Needs a current GL context. Loads the box shader and the unit cube it draws.
+        void Create(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+        void Delete();
+        bool IsCreated() const;
+
+        // New query for one mesh, which starts out visible
+        int Allocate();
+
+        // Collects the results that arrived since the last frame, call before anything is submitted
+        void BeginFrame();
+
+        // Queues the box of the mesh behind query if it is due, in the object space of the ObjectBlock slot the
+        // mesh is drawn with. nearPlane is the near clip plane in the same space: a box reaching through it is
+        // drawn without any test this frame, since its faces may be clipped away while the mesh shows.
+        void AddBox(int query, int objectSlot, const glm::vec3& boxMin, const glm::vec3& boxMax, const glm::vec4& nearPlane);
+
+        // False if the mesh is known to be hidden. Otherwise draw it, then call EndDraw, which closes the
+        // conditional render BeginDraw may have opened.
+        bool BeginDraw(int query);
+        void EndDraw();
+
+        // Draws the queued boxes against the depth buffer the opaque pass left
+        void IssueQueries(const gps::UniformBuffer& objectBuffer);
+
+        // Last result read back for query
+        bool IsHidden(int query) const;
+
+        OcclusionQueryStats GetFrameStats() const;
+        OcclusionQueryStats GetTotalStats() const;
+
+        // Draws a wall and boxes around it into an offscreen framebuffer for a few frames and checks the
+        // results and counters. Needs a current context, a software GL is enough.
+        static bool SelfTest(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+
+    private:
+        struct Query
+        {
+            GLuint id;
+            // the last box drawn has no result yet
+            bool pending;
+            bool hidden;
+            // reaches through the near plane this frame
+            bool nearCamera;
+            unsigned int queriedFrame;
+        };
+
+        struct Box
+        {
+            int query;
+            int objectSlot;
+            glm::vec3 boxMin;
+            glm::vec3 boxMax;
+        };
+
+        GLenum target;
+        gps::Shader boxShader;
+        gps::Uniform<glm::vec3> boxMinUniform;
+        gps::Uniform<glm::vec3> boxSizeUniform;
+        GLuint cubeVAO;
+        GLuint cubeVBO;
+        GLuint cubeEBO;
+        std::vector<Query> queries;
+        std::vector<Box> boxes;
+        unsigned int frame;
+        bool conditionalRender;
+        OcclusionQueryStats frameStats;
+        OcclusionQueryStats totalStats;
+
+        OcclusionQueries(const OcclusionQueries&);
+        OcclusionQueries& operator=(const OcclusionQueries&);
+
+        // Unit cube stretched over the box, with the box shader and cube already bound
+        void DrawBox(const glm::vec3& boxMin, const glm::vec3& boxMax);
+    };
+}
+
+#endif /* OcclusionQueries_hpp */
@@ -0,0 +1,156 @@
+#include "ProgramBinaryCache.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+namespace gps {
+
+    static const char PROGRAM_BINARY_MAGIC[4] = { 'G', 'P', 'S', 'B' };
+
+    bool ProgramBinaryCache::enabled = true;
+    ProgramBinaryStats ProgramBinaryCache::stats = { 0, 0, 0 };
+
+    std::string ProgramBinaryCache::GetCachePath(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName,
+        const std::string& defines)
+    {
+        // one file per variant, named by what selects it; what it was built from is checked through the key
+        std::string name = vertexShaderFileName + "\n" + fragmentShaderFileName + "\n" + defines;
+        char suffix[32];
+        snprintf(suffix, sizeof(suffix), ".%016llx.programbinary", (unsigned long long)HashBytes(name.data(), name.size()));
+        return fragmentShaderFileName + suffix;
+    }
+
+    uint64_t ProgramBinaryCache::MakeKey(const std::string& vertexSource, const std::string& fragmentSource)
+    {
+        uint64_t key = HashBytes(vertexSource.data(), vertexSource.size());
+        // the separator keeps "ab" + "c" and "a" + "bc" apart
+        key = HashBytes("\n", 1, key);
+        key = HashBytes(fragmentSource.data(), fragmentSource.size(), key);
+
+        const GLenum driverStrings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+        for (size_t i = 0; i < sizeof(driverStrings) / sizeof(driverStrings[0]); i++) {
+            const char* value = (const char*)glGetString(driverStrings[i]);
+            key = HashBytes("\n", 1, key);
+            if (value) {
+                key = HashBytes(value, strlen(value), key);
+            }
+        }
+        return key;
+    }
+
+    bool ProgramBinaryCache::Load(GLuint program, const std::string& cachePath, uint64_t key)
+    {
+        MappedFile file;
+        if (!file.Open(cachePath) || file.GetSize() < sizeof(ProgramBinaryHeader)) {
+            return false;
+        }
+
+        ProgramBinaryHeader header;
+        memcpy(&header, file.GetData(), sizeof(header));
+        const unsigned char* binary = file.GetData() + sizeof(header);
+        if (memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != PROGRAM_BINARY_CACHE_VERSION || header.key != key ||
+            file.GetSize() - sizeof(header) != header.binarySize ||
+            HashBytes(binary, header.binarySize) != header.checksum) {
+            return false;
+        }
+
+        // a format the driver no longer offers would only raise GL_INVALID_ENUM
+        GLint formatCount = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+        std::vector<GLint> formats(std::max(formatCount, 1));
+        glGetIntegerv(GL_PROGRAM_BINARY_FORMATS, &formats[0]);
+        if (std::find(formats.begin(), formats.begin() + formatCount, (GLint)header.binaryFormat) == formats.begin() + formatCount) {
+            stats.rejected++;
+            return false;
+        }
+
+        glProgramBinary(program, (GLenum)header.binaryFormat, binary, (GLsizei)header.binarySize);
+        GLint linked = GL_FALSE;
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            stats.rejected++;
+            return false;
+        }
+        stats.loaded++;
+        return true;
+    }
+
+    bool ProgramBinaryCache::Store(GLuint program, const std::string& cachePath, uint64_t key)
+    {
+        GLint size = 0;
+        glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &size);
+        if (size <= 0) {
+            return false;
+        }
+
+        std::vector<unsigned char> buffer(sizeof(ProgramBinaryHeader) + size);
+        GLenum binaryFormat = 0;
+        GLsizei length = 0;
+        glGetProgramBinary(program, size, &length, &binaryFormat, &buffer[sizeof(ProgramBinaryHeader)]);
+        if (length <= 0) {
+            return false;
+        }
+        buffer.resize(sizeof(ProgramBinaryHeader) + length);
+
+        ProgramBinaryHeader header;
+        memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+        header.version = PROGRAM_BINARY_CACHE_VERSION;
+        header.key = key;
+        header.checksum = HashBytes(&buffer[sizeof(ProgramBinaryHeader)], length);
+        header.binaryFormat = binaryFormat;
+        header.binarySize = (uint32_t)length;
+        memcpy(&buffer[0], &header, sizeof(header));
+
+        // write to a temporary file first so an interrupted run never leaves a truncated binary
+        std::string tempPath = cachePath + ".tmp";
+        std::ofstream cacheFile(tempPath.c_str(), std::ios::binary | std::ios::trunc);
+        if (!cacheFile) {
+            return false;
+        }
+        cacheFile.write((const char*)&buffer[0], buffer.size());
+        cacheFile.close();
+        if (!cacheFile) {
+            std::remove(tempPath.c_str());
+            return false;
+        }
+
+        std::remove(cachePath.c_str());
+        return std::rename(tempPath.c_str(), cachePath.c_str()) == 0;
+    }
+
+    void ProgramBinaryCache::Remove(const std::string& cachePath)
+    {
+        std::remove(cachePath.c_str());
+    }
+
+    void ProgramBinaryCache::SetEnabled(bool enabled)
+    {
+        ProgramBinaryCache::enabled = enabled;
+    }
+
+    bool ProgramBinaryCache::IsEnabled()
+    {
+        if (!enabled) {
+            return false;
+        }
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        return formats > 0;
+    }
+
+    ProgramBinaryStats ProgramBinaryCache::GetStats()
+    {
+        return stats;
+    }
+
+    void ProgramBinaryCache::AddCompiled()
+    {
+        stats.compiled++;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef ProgramBinaryCache_hpp
+#define ProgramBinaryCache_hpp
+
+#include <GL/glew.h>
+
+#include <stdint.h>
+#include <string>
+
+namespace gps {
+
+    // Bump whenever the file layout below changes
+    const uint32_t PROGRAM_BINARY_CACHE_VERSION = 1;
+
+    struct ProgramBinaryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        // hash of both sources, defines included, and of the GL vendor, renderer and version strings
+        uint64_t key;
+        // hash of the binary that follows the header
+        uint64_t checksum;
+        uint32_t binaryFormat;
+        uint32_t binarySize;
+    };
+
+    // Counted since start-up
+    struct ProgramBinaryStats
+    {
+        // programs created from a cache file, and programs compiled because there was none or it was stale
+        unsigned int loaded;
+        unsigned int compiled;
+        // cache files with a matching key the driver refused, e.g. after an update that kept its version string
+        unsigned int rejected;
+    };
+
+    // Linked programs saved with glGetProgramBinary and restored with glProgramBinary on the next run,
+    // so start-up skips compiling and linking the GLSL. One file per shader pair and define set, stored
+    // next to the fragment shader. The key inside the file covers the sources and the driver, a file
+    // with another key is overwritten by the next compile.
+    class ProgramBinaryCache
+    {
+    public:
+        // Links program from the cache file, false if it is missing, stale or rejected by the driver
+        static bool Load(GLuint program, const std::string& cachePath, uint64_t key);
+        // Saves a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT, false if the driver gave no binary
+        static bool Store(GLuint program, const std::string& cachePath, uint64_t key);
+        // Deletes the cache file, the next load compiles
+        static void Remove(const std::string& cachePath);
+
+        static std::string GetCachePath(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName,
+            const std::string& defines);
+        // Needs a current context, the driver strings are part of it
+        static uint64_t MakeKey(const std::string& vertexSource, const std::string& fragmentSource);
+
+        // On by default, drivers without a binary format never use it
+        static void SetEnabled(bool enabled);
+        static bool IsEnabled();
+
+        static ProgramBinaryStats GetStats();
+        // Counts a program compiled while the cache was in use
+        static void AddCompiled();
+
+    private:
+        static bool enabled;
+        static ProgramBinaryStats stats;
+    };
+}
+
+#endif /* ProgramBinaryCache_hpp */
@@ -0,0 +1,273 @@
+#include "RenderQueue.hpp"
+#include "Model3D.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+
+namespace gps {
+
+    static const int PASS_BITS = 2;
+    static const int SHADER_BITS = 8;
+    static const int TEXTURE_BITS = 16;
+    static const int MATERIAL_BITS = 14;
+    static const int DEPTH_BITS = 24;
+
+    static uint64_t Field(uint64_t value, int bits)
+    {
+        return value & ((1ULL << bits) - 1);
+    }
+
+    RenderQueue::RenderQueue() : farPlane(1000.0f), occlusionCuller(NULL), occlusionQueries(NULL), drawCalls(0), totalDrawCalls(0)
+    {
+        cullStats.visible = 0;
+        cullStats.culled = 0;
+        cullStats.occluded = 0;
+        totalCullStats = cullStats;
+    }
+
+    void RenderQueue::Clear()
+    {
+        items.clear();
+        order.clear();
+        drawCalls = 0;
+        cullStats.visible = 0;
+        cullStats.culled = 0;
+        cullStats.occluded = 0;
+    }
+
+    void RenderQueue::Add(const DrawItem& item)
+    {
+        SortEntry entry = { item.key, (uint32_t)items.size() };
+        items.push_back(item);
+        order.push_back(entry);
+    }
+
+    void RenderQueue::Sort()
+    {
+        RadixSort(order, scratch);
+    }
+
+    void RenderQueue::Execute(RenderPass pass, gps::UniformBuffer& objectBuffer)
+    {
+        int boundSlot = -1;
+        for (size_t i = 0; i < order.size(); i++) {
+            const DrawItem& item = items[order[i].item];
+            int itemPass = (int)(item.key >> (64 - PASS_BITS));
+            if (itemPass < pass) {
+                continue;
+            }
+            if (itemPass > pass) {
+                break;
+            }
+            if (item.objectSlot != boundSlot) {
+                objectBuffer.Bind(item.objectSlot);
+                boundSlot = item.objectSlot;
+            }
+            if (item.batch >= 0) {
+                item.model->DrawBatch(*item.shader, item.batch);
+            }
+            else if (occlusionQueries && item.occlusionQuery >= 0) {
+                if (!occlusionQueries->BeginDraw(item.occlusionQuery)) {
+                    continue;
+                }
+                item.model->DrawMesh(*item.shader, item.mesh, item.lod);
+                occlusionQueries->EndDraw();
+            }
+            else {
+                item.model->DrawMesh(*item.shader, item.mesh, item.lod);
+            }
+            drawCalls++;
+            totalDrawCalls++;
+        }
+    }
+
+    void RenderQueue::SetDepthRange(float farPlane)
+    {
+        this->farPlane = farPlane;
+    }
+
+    void RenderQueue::SetFrustum(const gps::Frustum& frustum)
+    {
+        this->frustum = frustum;
+    }
+
+    const gps::Frustum& RenderQueue::GetFrustum() const
+    {
+        return frustum;
+    }
+
+    void RenderQueue::SetOcclusionCuller(const gps::OcclusionCuller* occlusionCuller)
+    {
+        this->occlusionCuller = occlusionCuller;
+    }
+
+    const gps::OcclusionCuller* RenderQueue::GetOcclusionCuller() const
+    {
+        return occlusionCuller;
+    }
+
+    void RenderQueue::SetOcclusionQueries(gps::OcclusionQueries* occlusionQueries)
+    {
+        this->occlusionQueries = occlusionQueries;
+    }
+
+    gps::OcclusionQueries* RenderQueue::GetOcclusionQueries() const
+    {
+        return occlusionQueries;
+    }
+
+    void RenderQueue::AddCullStats(const CullStats& stats)
+    {
+        cullStats.visible += stats.visible;
+        cullStats.culled += stats.culled;
+        cullStats.occluded += stats.occluded;
+        totalCullStats.visible += stats.visible;
+        totalCullStats.culled += stats.culled;
+        totalCullStats.occluded += stats.occluded;
+    }
+
+    CullStats RenderQueue::GetCullStats() const
+    {
+        return cullStats;
+    }
+
+    CullStats RenderQueue::GetTotalCullStats() const
+    {
+        return totalCullStats;
+    }
+
+    unsigned int RenderQueue::GetDrawCalls() const
+    {
+        return drawCalls;
+    }
+
+    unsigned int RenderQueue::GetTotalDrawCalls() const
+    {
+        return totalDrawCalls;
+    }
+
+    uint64_t RenderQueue::MakeKey(RenderPass pass, GLuint program, GLuint textureId, uint32_t materialHash, float depth) const
+    {
+        float normalized = std::min(std::max(depth / farPlane, 0.0f), 1.0f);
+        uint64_t depthBits = (uint64_t)(normalized * (float)((1 << DEPTH_BITS) - 1));
+        uint64_t state = Field(program, SHADER_BITS) << (TEXTURE_BITS + MATERIAL_BITS) |
+            Field(textureId, TEXTURE_BITS) << MATERIAL_BITS | Field(materialHash, MATERIAL_BITS);
+
+        uint64_t key = (uint64_t)pass << (64 - PASS_BITS);
+        if (pass == RENDER_PASS_TRANSPARENT) {
+            key |= Field(~depthBits, DEPTH_BITS) << (SHADER_BITS + TEXTURE_BITS + MATERIAL_BITS) | state;
+        }
+        else {
+            key |= state << DEPTH_BITS | depthBits;
+        }
+        return key;
+    }
+
+    size_t RenderQueue::GetItemCount() const
+    {
+        return items.size();
+    }
+
+    void RenderQueue::RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch)
+    {
+        size_t count = entries.size();
+        if (count < 2) {
+            return;
+        }
+        scratch.resize(count);
+
+        // 11 bit digits, 6 passes cover the key; every histogram is built in one read of the keys
+        const int DIGIT_BITS = 11;
+        const int DIGIT_COUNT = (64 + DIGIT_BITS - 1) / DIGIT_BITS;
+        const int BUCKETS = 1 << DIGIT_BITS;
+        std::vector<uint32_t> histograms(DIGIT_COUNT * BUCKETS, 0);
+        for (size_t i = 0; i < count; i++) {
+            uint64_t key = entries[i].key;
+            for (int digit = 0; digit < DIGIT_COUNT; digit++) {
+                histograms[digit * BUCKETS + ((key >> (digit * DIGIT_BITS)) & (BUCKETS - 1))]++;
+            }
+        }
+
+        SortEntry* source = &entries[0];
+        SortEntry* destination = &scratch[0];
+        for (int digit = 0; digit < DIGIT_COUNT; digit++) {
+            uint32_t* histogram = &histograms[digit * BUCKETS];
+            int shift = digit * DIGIT_BITS;
+            // a digit every key shares does not reorder anything
+            if (histogram[(source[0].key >> shift) & (BUCKETS - 1)] == count) {
+                continue;
+            }
+
+            uint32_t offset = 0;
+            for (int bucket = 0; bucket < BUCKETS; bucket++) {
+                uint32_t bucketCount = histogram[bucket];
+                histogram[bucket] = offset;
+                offset += bucketCount;
+            }
+            for (size_t i = 0; i < count; i++) {
+                destination[histogram[(source[i].key >> shift) & (BUCKETS - 1)]++] = source[i];
+            }
+            std::swap(source, destination);
+        }
+
+        if (source != &entries[0]) {
+            entries.swap(scratch);
+        }
+    }
+
+    void RenderQueue::Benchmark(int itemCount, int runs)
+    {
+        // a scene of a few shaders and materials spread over the depth range
+        std::mt19937 random(1234);
+        std::uniform_int_distribution<int> programs(1, 4);
+        std::uniform_int_distribution<int> textures(1, 300);
+        std::uniform_real_distribution<float> depths(0.0f, 1000.0f);
+
+        RenderQueue queue;
+        std::vector<GLuint> program(itemCount);
+        std::vector<GLuint> texture(itemCount);
+        std::vector<float> depth(itemCount);
+        for (int i = 0; i < itemCount; i++) {
+            program[i] = (GLuint)programs(random);
+            texture[i] = (GLuint)textures(random);
+            depth[i] = depths(random);
+        }
+
+        double buildTime = 0.0;
+        double sortTime = 0.0;
+        double stdSortTime = 0.0;
+        bool sorted = true;
+        for (int run = 0; run < runs; run++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            queue.Clear();
+            for (int i = 0; i < itemCount; i++) {
+                RenderPass pass = i % 10 == 0 ? RENDER_PASS_TRANSPARENT : RENDER_PASS_OPAQUE;
+                DrawItem item = { queue.MakeKey(pass, program[i], texture[i], texture[i] * 7, depth[i]), NULL, NULL, (uint32_t)i, 0, 0, -1, -1 };
+                queue.Add(item);
+            }
+            std::chrono::steady_clock::time_point built = std::chrono::steady_clock::now();
+
+            std::vector<SortEntry> reference = queue.order;
+            queue.Sort();
+            std::chrono::steady_clock::time_point radixDone = std::chrono::steady_clock::now();
+
+            std::sort(reference.begin(), reference.end(), [](const SortEntry& a, const SortEntry& b) { return a.key < b.key; });
+            std::chrono::steady_clock::time_point stdDone = std::chrono::steady_clock::now();
+
+            buildTime += std::chrono::duration<double, std::milli>(built - start).count();
+            sortTime += std::chrono::duration<double, std::milli>(radixDone - built).count();
+            stdSortTime += std::chrono::duration<double, std::milli>(stdDone - radixDone).count();
+            for (size_t i = 0; i < reference.size(); i++) {
+                sorted = sorted && reference[i].key == queue.order[i].key;
+            }
+        }
+
+        std::cout << "Render queue benchmark: " << itemCount << " items (" << runs << " runs)" << std::endl;
+        std::cout << "  build          : " << buildTime / runs << " ms" << std::endl;
+        std::cout << "  radix sort     : " << sortTime / runs << " ms" << std::endl;
+        std::cout << "  std::sort      : " << stdSortTime / runs << " ms" << std::endl;
+        std::cout << "  same order     : " << (sorted ? "yes" : "NO") << std::endl;
+    }
+}
@@ -0,0 +1,114 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include "Frustum.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
+#include "Shader.hpp"
+#include "UniformBuffer.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace gps {
+
+    class Model3D;
+
+    // Passes run in this order, the skybox is drawn between them
+    enum RenderPass
+    {
+        RENDER_PASS_OPAQUE = 0,
+        RENDER_PASS_TRANSPARENT = 1
+    };
+
+    // One mesh of a model at a level of detail, with the ObjectBlock slot holding its model matrix and
+    // the hardware occlusion query deciding whether it is drawn, -1 for none. With merged geometry an item
+    // is instead a batch of the model, every visible mesh sharing one material in a single multi-draw.
+    struct DrawItem
+    {
+        uint64_t key;
+        const gps::Shader* shader;
+        gps::Model3D* model;
+        uint32_t mesh;
+        int lod;
+        int objectSlot;
+        int occlusionQuery;
+        // -1 for a single mesh
+        int batch;
+    };
+
+    // Draw items collected from every model each frame and sorted by a 64 bit key. Opaque keys are
+    // pass | shader | texture | material | depth, so state changes are grouped and each group is drawn
+    // front to back. Transparent keys are pass | inverted depth | shader | texture | material, drawn
+    // back to front for blending.
+    class RenderQueue
+    {
+    public:
+        RenderQueue();
+
+        // Drops the items and cull counts of the previous frame, keeping the memory
+        void Clear();
+        void Add(const DrawItem& item);
+
+        // Orders the items by key with an LSD radix sort
+        void Sort();
+
+        // Draws the sorted items of one pass, binding objectBuffer slots as needed
+        void Execute(RenderPass pass, gps::UniformBuffer& objectBuffer);
+
+        // View space distance mapped to the depth bits, farther ones are clamped
+        void SetDepthRange(float farPlane);
+
+        // World space frustum the models cull their meshes against before adding them
+        void SetFrustum(const gps::Frustum& frustum);
+        const gps::Frustum& GetFrustum() const;
+
+        // Depth buffer the models test the meshes left by the frustum against, NULL to skip the test
+        void SetOcclusionCuller(const gps::OcclusionCuller* occlusionCuller);
+        const gps::OcclusionCuller* GetOcclusionCuller() const;
+
+        // Queries the models add their mesh boxes to and Execute draws through, NULL to draw every item
+        void SetOcclusionQueries(gps::OcclusionQueries* occlusionQueries);
+        gps::OcclusionQueries* GetOcclusionQueries() const;
+
+        // Meshes kept and rejected by culling this frame, and since the start
+        void AddCullStats(const CullStats& stats);
+        CullStats GetCullStats() const;
+        CullStats GetTotalCullStats() const;
+
+        // GL draw calls made by Execute this frame, and since the start. A batch is one call.
+        unsigned int GetDrawCalls() const;
+        unsigned int GetTotalDrawCalls() const;
+
+        // materialHash identifies the whole texture set, textureId the first texture
+        uint64_t MakeKey(RenderPass pass, GLuint program, GLuint textureId, uint32_t materialHash, float depth) const;
+
+        size_t GetItemCount() const;
+
+        // Times building and sorting itemCount random items against std::sort, CPU work only
+        static void Benchmark(int itemCount, int runs);
+
+    private:
+        struct SortEntry
+        {
+            uint64_t key;
+            uint32_t item;
+        };
+
+        std::vector<DrawItem> items;
+        std::vector<SortEntry> order;
+        std::vector<SortEntry> scratch;
+        float farPlane;
+        gps::Frustum frustum;
+        const gps::OcclusionCuller* occlusionCuller;
+        gps::OcclusionQueries* occlusionQueries;
+        CullStats cullStats;
+        CullStats totalCullStats;
+        unsigned int drawCalls;
+        unsigned int totalDrawCalls;
+
+        static void RadixSort(std::vector<SortEntry>& entries, std::vector<SortEntry>& scratch);
+    };
+}
+
+#endif /* RenderQueue_hpp */
@@ -1,6 +1,53 @@
 #include "Shader.hpp"
+#include "ProgramBinaryCache.hpp"
+
+#include "glm/gtc/type_ptr.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
 
 namespace gps {
+
+    template <> void Uniform<float>::set(const float& value) const
+    {
+        glUniform1f(location, value);
+    }
+
+    template <> void Uniform<GLint>::set(const GLint& value) const
+    {
+        glUniform1i(location, value);
+    }
+
+    template <> void Uniform<bool>::set(const bool& value) const
+    {
+        glUniform1i(location, value ? 1 : 0);
+    }
+
+    template <> void Uniform<glm::vec3>::set(const glm::vec3& value) const
+    {
+        glUniform3fv(location, 1, glm::value_ptr(value));
+    }
+
+    template <> void Uniform<glm::mat3>::set(const glm::mat3& value) const
+    {
+        glUniformMatrix3fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    template <> void Uniform<glm::mat4>::set(const glm::mat4& value) const
+    {
+        glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+
+    unsigned int Shader::uniformLocationCalls = 0;
+    double Shader::loadTime = 0.0;
+    bool Shader::parallelCompile = false;
+
+    Shader::Shader() : shaderProgram(0), pending(false), pendingVertexShader(0), pendingFragmentShader(0),
+        storeBinary(false), cacheKey(0)
+    {
+    }
+
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -49,42 +96,276 @@ namespace gps {
         }
     }
 
+    std::string Shader::injectDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty()) {
+            return source;
+        }
+        // #version has to stay the first statement, the defines go right below it
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos) {
+            return defines + source;
+        }
+        int nextLine = (int)std::count(source.begin(), source.begin() + lineEnd, '\n') + 2;
+        return source.substr(0, lineEnd + 1) + defines + "#line " + std::to_string(nextLine) + "\n" + source.substr(lineEnd + 1);
+    }
+
     void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName)
     {
-        //read, parse and compile the vertex shader
-        std::string v = readShaderFile(vertexShaderFileName);
+        loadShader(vertexShaderFileName, fragmentShaderFileName, std::string());
+    }
+
+    void Shader::loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::string& defines)
+    {
+        beginLoad(vertexShaderFileName, fragmentShaderFileName, defines);
+        finishLoad();
+    }
+
+    void Shader::beginLoad(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName, const std::string& defines)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::string v = injectDefines(readShaderFile(vertexShaderFileName), defines);
+        std::string f = injectDefines(readShaderFile(fragmentShaderFileName), defines);
+        this->shaderProgram = glCreateProgram();
+        this->pending = true;
+        this->pendingVertexShader = 0;
+        this->pendingFragmentShader = 0;
+
+        // a binary linked by an earlier run skips compiling and linking
+        this->storeBinary = ProgramBinaryCache::IsEnabled();
+        if (this->storeBinary) {
+            this->cachePath = ProgramBinaryCache::GetCachePath(vertexShaderFileName, fragmentShaderFileName, defines);
+            this->cacheKey = ProgramBinaryCache::MakeKey(v, f);
+            if (ProgramBinaryCache::Load(this->shaderProgram, this->cachePath, this->cacheKey)) {
+                this->storeBinary = false;
+                loadTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+                return;
+            }
+        }
+
+        //read, parse and compile the vertex shader, the status is only asked for in finishLoad
         const GLchar* vertexShaderString = v.c_str();
-        GLuint vertexShader;
-        vertexShader = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertexShader, 1, &vertexShaderString, NULL);
-        glCompileShader(vertexShader);
-        //check compilation status
-        shaderCompileLog(vertexShader);
-
-        //read, parse and compile the vertex shader
-        std::string f = readShaderFile(fragmentShaderFileName);
+        this->pendingVertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(this->pendingVertexShader, 1, &vertexShaderString, NULL);
+        glCompileShader(this->pendingVertexShader);
+
+        //read, parse and compile the fragment shader
         const GLchar* fragmentShaderString = f.c_str();
-        GLuint fragmentShader;
-        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragmentShader, 1, &fragmentShaderString, NULL);
-        glCompileShader(fragmentShader);
-        //check compilation status
-        shaderCompileLog(fragmentShader);
+        this->pendingFragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(this->pendingFragmentShader, 1, &fragmentShaderString, NULL);
+        glCompileShader(this->pendingFragmentShader);
 
         //attach and link the shader programs
-        this->shaderProgram = glCreateProgram();
-        glAttachShader(this->shaderProgram, vertexShader);
-        glAttachShader(this->shaderProgram, fragmentShader);
+        glAttachShader(this->shaderProgram, this->pendingVertexShader);
+        glAttachShader(this->shaderProgram, this->pendingFragmentShader);
+        if (this->storeBinary) {
+            glProgramParameteri(this->shaderProgram, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
         glLinkProgram(this->shaderProgram);
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
-        //check linking info
-        shaderLinkLog(this->shaderProgram);
+        loadTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool Shader::isReady() const
+    {
+        if (!this->pending || !parallelCompile) {
+            return true;
+        }
+        GLint completed = GL_TRUE;
+        glGetProgramiv(this->shaderProgram, GL_COMPLETION_STATUS_KHR, &completed);
+        return completed == GL_TRUE;
+    }
+
+    bool Shader::isPending() const
+    {
+        return this->pending;
+    }
+
+    void Shader::finishLoad()
+    {
+        if (!this->pending) {
+            return;
+        }
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        this->pending = false;
+
+        if (this->pendingVertexShader != 0) {
+            //check compilation status
+            shaderCompileLog(this->pendingVertexShader);
+            shaderCompileLog(this->pendingFragmentShader);
+            //check linking info
+            shaderLinkLog(this->shaderProgram);
+            glDetachShader(this->shaderProgram, this->pendingVertexShader);
+            glDetachShader(this->shaderProgram, this->pendingFragmentShader);
+            glDeleteShader(this->pendingVertexShader);
+            glDeleteShader(this->pendingFragmentShader);
+            this->pendingVertexShader = 0;
+            this->pendingFragmentShader = 0;
+        }
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &linked);
+        if (this->storeBinary && linked) {
+            ProgramBinaryCache::AddCompiled();
+            ProgramBinaryCache::Store(this->shaderProgram, this->cachePath, this->cacheKey);
+        }
+        reflectProgram();
+        loadTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    bool Shader::enableParallelCompile()
+    {
+        // as many driver threads as it wants
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+        else if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+            parallelCompile = true;
+        }
+        return parallelCompile;
+    }
+
+    double Shader::getLoadTime()
+    {
+        return loadTime;
+    }
+
+    void Shader::useShaderProgram() const
+    {
+        GLStateCache::Get().UseProgram(this->shaderProgram);
+    }
+
+    void Shader::reflectProgram()
+    {
+        uniforms.clear();
+        attributes.clear();
+        uniformBlocks.clear();
+
+        GLint linked = GL_FALSE;
+        glGetProgramiv(this->shaderProgram, GL_LINK_STATUS, &linked);
+        if (!linked) {
+            return;
+        }
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+        std::vector<GLchar> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            ShaderUniform uniform;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, &name[0]);
+            std::string uniformName(&name[0], length);
+
+            GLint blockIndex = -1;
+            GLuint index = (GLuint)i;
+            glGetActiveUniformsiv(this->shaderProgram, 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+            uniform.location = -1;
+            if (blockIndex < 0) {
+                uniform.location = glGetUniformLocation(this->shaderProgram, uniformName.c_str());
+                uniformLocationCalls++;
+            }
+
+            // arrays are reported as name[0], they are looked up by the plain name as well
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+                uniforms[uniformName.substr(0, uniformName.size() - 3)] = uniform;
+            }
+            uniforms[uniformName] = uniform;
+        }
+
+        count = 0;
+        maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_ATTRIBUTES, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_ATTRIBUTE_MAX_LENGTH, &maxLength);
+        name.resize(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            ShaderAttribute attribute;
+            glGetActiveAttrib(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &attribute.size, &attribute.type, &name[0]);
+            std::string attributeName(&name[0], length);
+            attribute.location = glGetAttribLocation(this->shaderProgram, attributeName.c_str());
+            attributes[attributeName] = attribute;
+        }
+
+        count = 0;
+        maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_BLOCKS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_BLOCK_MAX_NAME_LENGTH, &maxLength);
+        name.resize(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            ShaderUniformBlock block;
+            block.index = (GLuint)i;
+            glGetActiveUniformBlockName(this->shaderProgram, block.index, (GLsizei)name.size(), &length, &name[0]);
+            glGetActiveUniformBlockiv(this->shaderProgram, block.index, GL_UNIFORM_BLOCK_DATA_SIZE, &block.dataSize);
+            uniformBlocks[std::string(&name[0], length)] = block;
+        }
+    }
+
+    GLint Shader::getUniformLocation(const std::string& name, GLenum type) const
+    {
+        const ShaderUniform* uniform = findUniform(name);
+        if (!uniform) {
+            return -1;
+        }
+
+        bool sampler = uniform->type == GL_SAMPLER_2D || uniform->type == GL_SAMPLER_CUBE ||
+            uniform->type == GL_SAMPLER_2D_ARRAY || uniform->type == GL_SAMPLER_2D_SHADOW;
+        if (uniform->type != type && !(type == GL_INT && sampler)) {
+            std::cout << "Shader uniform " << name << " has type 0x" << std::hex << uniform->type
+                << ", not 0x" << type << std::dec << std::endl;
+            return -1;
+        }
+        return uniform->location;
+    }
+
+    void Shader::bindUniformBlock(const std::string& name, GLuint binding) const
+    {
+        const ShaderUniformBlock* block = findUniformBlock(name);
+        if (block) {
+            glUniformBlockBinding(this->shaderProgram, block->index, binding);
+        }
+    }
+
+    const ShaderUniform* Shader::findUniform(const std::string& name) const
+    {
+        std::unordered_map<std::string, ShaderUniform>::const_iterator found = uniforms.find(name);
+        return found != uniforms.end() ? &found->second : NULL;
+    }
+
+    const ShaderAttribute* Shader::findAttribute(const std::string& name) const
+    {
+        std::unordered_map<std::string, ShaderAttribute>::const_iterator found = attributes.find(name);
+        return found != attributes.end() ? &found->second : NULL;
+    }
+
+    const ShaderUniformBlock* Shader::findUniformBlock(const std::string& name) const
+    {
+        std::unordered_map<std::string, ShaderUniformBlock>::const_iterator found = uniformBlocks.find(name);
+        return found != uniformBlocks.end() ? &found->second : NULL;
+    }
+
+    size_t Shader::getUniformCount() const
+    {
+        return uniforms.size();
+    }
+
+    size_t Shader::getAttributeCount() const
+    {
+        return attributes.size();
+    }
+
+    size_t Shader::getUniformBlockCount() const
+    {
+        return uniformBlocks.size();
     }
 
-    void Shader::useShaderProgram()
+    unsigned int Shader::getUniformLocationCalls()
     {
-        glUseProgram(this->shaderProgram);
+        return uniformLocationCalls;
     }
 
 }
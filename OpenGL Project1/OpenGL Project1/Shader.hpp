@@ -2,26 +2,147 @@
 #define Shader_hpp
 
 #include <GL/glew.h>
+#include "glm/glm.hpp"
+#include "GLStateCache.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <unordered_map>
 
 namespace gps {
 
+// Active uniform found by reflection after link. Uniforms inside a uniform block have location -1.
+struct ShaderUniform
+{
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
+struct ShaderAttribute
+{
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
+struct ShaderUniformBlock
+{
+    GLuint index;
+    GLint dataSize;
+};
+
+// Pre-resolved uniform location of a given GLSL type. Like location -1 in GL, setting a handle
+// the program does not have does nothing, so optional uniforms need no checks at draw time.
+template <typename T>
+class Uniform
+{
+public:
+    GLint location;
+
+    Uniform() : location(-1) {}
+    explicit Uniform(GLint location) : location(location) {}
+
+    bool isValid() const { return location >= 0; }
+    // Sets the uniform of the program in use
+    void set(const T& value) const;
+
+    static GLenum getType();
+};
+
+template <> void Uniform<float>::set(const float& value) const;
+template <> void Uniform<GLint>::set(const GLint& value) const;
+template <> void Uniform<bool>::set(const bool& value) const;
+template <> void Uniform<glm::vec3>::set(const glm::vec3& value) const;
+template <> void Uniform<glm::mat3>::set(const glm::mat3& value) const;
+template <> void Uniform<glm::mat4>::set(const glm::mat4& value) const;
+
+template <> inline GLenum Uniform<float>::getType() { return GL_FLOAT; }
+template <> inline GLenum Uniform<GLint>::getType() { return GL_INT; }
+template <> inline GLenum Uniform<bool>::getType() { return GL_BOOL; }
+template <> inline GLenum Uniform<glm::vec3>::getType() { return GL_FLOAT_VEC3; }
+template <> inline GLenum Uniform<glm::mat3>::getType() { return GL_FLOAT_MAT3; }
+template <> inline GLenum Uniform<glm::mat4>::getType() { return GL_FLOAT_MAT4; }
+
 class Shader
 {
 public:
     GLuint shaderProgram;
+
+    Shader();
+
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
-    void useShaderProgram();
+    // Same, with defines ("#define NAME\n" lines) inserted after the #version line of both stages
+    void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName, const std::string& defines);
+    void useShaderProgram() const;
+
+    // loadShader in two halves. beginLoad submits the compile and link without asking GL for any status, so the
+    // driver works on it (on its own threads with parallel_shader_compile) while the caller goes on. finishLoad
+    // checks the logs and reflects the program, waiting for the driver if it is not done; the program and the
+    // uniform tables can only be used after it.
+    void beginLoad(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName, const std::string& defines);
+    void finishLoad();
+    // True if finishLoad would not wait. Without parallel_shader_compile there is no way to ask, always true.
+    bool isReady() const;
+    // Between beginLoad and finishLoad
+    bool isPending() const;
+
+    // Lets the driver compile on background threads if it supports KHR/ARB_parallel_shader_compile, false if not
+    static bool enableParallelCompile();
+
+    // Handle for the uniform called name, resolved from the reflected table without any GL call.
+    // Samplers resolve as GLint. Missing names give an invalid handle, a type mismatch is reported.
+    template <typename T>
+    Uniform<T> getUniform(const std::string& name) const
+    {
+        return Uniform<T>(getUniformLocation(name, Uniform<T>::getType()));
+    }
+
+    // Connects the uniform block called name to a uniform buffer binding point, if the program uses it
+    void bindUniformBlock(const std::string& name, GLuint binding) const;
+
+    // NULL if the program has no active variable with that name
+    const ShaderUniform* findUniform(const std::string& name) const;
+    const ShaderAttribute* findAttribute(const std::string& name) const;
+    const ShaderUniformBlock* findUniformBlock(const std::string& name) const;
+
+    size_t getUniformCount() const;
+    size_t getAttributeCount() const;
+    size_t getUniformBlockCount() const;
+
+    // glGetUniformLocation calls made by every shader so far, all of them during reflection
+    static unsigned int getUniformLocationCalls();
+    // Milliseconds spent in loadShader so far, compiling or restoring from the program binary cache
+    static double getLoadTime();
 
 private:
+    std::unordered_map<std::string, ShaderUniform> uniforms;
+    std::unordered_map<std::string, ShaderAttribute> attributes;
+    std::unordered_map<std::string, ShaderUniformBlock> uniformBlocks;
+
+    static unsigned int uniformLocationCalls;
+    static double loadTime;
+    static bool parallelCompile;
+
+    // state of a beginLoad until finishLoad, the shaders are 0 when the program came from the binary cache
+    bool pending;
+    GLuint pendingVertexShader;
+    GLuint pendingFragmentShader;
+    bool storeBinary;
+    std::string cachePath;
+    uint64_t cacheKey;
+
     std::string readShaderFile(std::string fileName);
+    // Puts defines after the #version line, followed by a #line so compile errors keep the file's line numbers
+    static std::string injectDefines(const std::string& source, const std::string& defines);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
+    // Fills the uniform, attribute and uniform block tables of the linked program
+    void reflectProgram();
+    GLint getUniformLocation(const std::string& name, GLenum type) const;
 };
 
 }
@@ -0,0 +1,164 @@
+#include "ShaderPermutations.hpp"
+#include "ProgramBinaryCache.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+namespace gps {
+
+    static const char* FEATURE_DEFINES[SHADER_FEATURE_COUNT] = {
+        "FOG", "LAMP", "PURPLE_LAMP", "SPECULAR_MAP", "ALPHA"
+    };
+
+    ShaderPermutations::ShaderPermutations() : fallback(NULL), substitutions(0)
+    {
+    }
+
+    void ShaderPermutations::Create(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName)
+    {
+        this->vertexShaderFileName = vertexShaderFileName;
+        this->fragmentShaderFileName = fragmentShaderFileName;
+    }
+
+    void ShaderPermutations::BindUniformBlock(const std::string& name, GLuint binding)
+    {
+        uniformBlocks.push_back(std::make_pair(name, binding));
+        for (std::map<uint32_t, gps::Shader>::iterator it = variants.begin(); it != variants.end(); ++it) {
+            if (!it->second.isPending()) {
+                it->second.bindUniformBlock(name, binding);
+            }
+        }
+    }
+
+    void ShaderPermutations::SetSampler(const std::string& name, GLint unit)
+    {
+        samplers.push_back(std::make_pair(name, unit));
+        for (std::map<uint32_t, gps::Shader>::iterator it = variants.begin(); it != variants.end(); ++it) {
+            if (!it->second.isPending()) {
+                it->second.useShaderProgram();
+                it->second.getUniform<GLint>(name).set(unit);
+            }
+        }
+    }
+
+    const gps::Shader& ShaderPermutations::Get(uint32_t features)
+    {
+        Prefetch(features);
+        gps::Shader& shader = variants[features];
+        if (shader.isPending()) {
+            Finish(shader);
+        }
+        return shader;
+    }
+
+    void ShaderPermutations::Prefetch(uint32_t features)
+    {
+        if (variants.find(features) == variants.end()) {
+            variants[features].beginLoad(vertexShaderFileName, fragmentShaderFileName, GetDefines(features));
+        }
+    }
+
+    void ShaderPermutations::SetFallback(uint32_t features)
+    {
+        fallback = &Get(features);
+    }
+
+    const gps::Shader& ShaderPermutations::Select(uint32_t features)
+    {
+        Prefetch(features);
+        gps::Shader& shader = variants[features];
+        if (!shader.isPending()) {
+            return shader;
+        }
+        if (fallback == NULL || shader.isReady()) {
+            Finish(shader);
+            return shader;
+        }
+        substitutions++;
+        return *fallback;
+    }
+
+    void ShaderPermutations::Finish(gps::Shader& shader)
+    {
+        shader.finishLoad();
+        for (size_t i = 0; i < uniformBlocks.size(); i++) {
+            shader.bindUniformBlock(uniformBlocks[i].first, uniformBlocks[i].second);
+        }
+        shader.useShaderProgram();
+        for (size_t i = 0; i < samplers.size(); i++) {
+            shader.getUniform<GLint>(samplers[i].first).set(samplers[i].second);
+        }
+    }
+
+    size_t ShaderPermutations::GetVariantCount() const
+    {
+        return variants.size();
+    }
+
+    unsigned int ShaderPermutations::GetSubstitutionCount() const
+    {
+        return substitutions;
+    }
+
+    void ShaderPermutations::Delete()
+    {
+        for (std::map<uint32_t, gps::Shader>::iterator it = variants.begin(); it != variants.end(); ++it) {
+            // releases the shader objects of a variant still compiling
+            it->second.finishLoad();
+            GLStateCache::Get().ForgetProgram(it->second.shaderProgram);
+            glDeleteProgram(it->second.shaderProgram);
+        }
+        variants.clear();
+        fallback = NULL;
+    }
+
+    std::string ShaderPermutations::GetDefines(uint32_t features)
+    {
+        std::string defines;
+        for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++) {
+            if (features & (1u << i)) {
+                defines += std::string("#define ") + FEATURE_DEFINES[i] + "\n";
+            }
+        }
+        return defines;
+    }
+
+    void ShaderPermutations::BenchmarkProgramBinaryCache(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName)
+    {
+        if (!ProgramBinaryCache::IsEnabled()) {
+            std::cout << "Program binary cache: disabled or no binary format from the driver" << std::endl;
+            return;
+        }
+        for (uint32_t features = 0; features <= SHADER_FEATURES_ALL; features++) {
+            ProgramBinaryCache::Remove(ProgramBinaryCache::GetCachePath(vertexShaderFileName, fragmentShaderFileName, GetDefines(features)));
+        }
+
+        // cold compiles and stores every variant, warm restores them from the files it left
+        double times[2];
+        ProgramBinaryStats before = ProgramBinaryCache::GetStats();
+        for (int warm = 0; warm < 2; warm++) {
+            ShaderPermutations permutations;
+            permutations.Create(vertexShaderFileName, fragmentShaderFileName);
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            // everything is submitted before the first status query, as at start-up
+            for (uint32_t features = 0; features <= SHADER_FEATURES_ALL; features++) {
+                permutations.Prefetch(features);
+            }
+            for (uint32_t features = 0; features <= SHADER_FEATURES_ALL; features++) {
+                permutations.Get(features);
+            }
+            // drivers may finish the work lazily, the wall clock time includes waiting for it
+            glFinish();
+            times[warm] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            permutations.Delete();
+        }
+        ProgramBinaryStats after = ProgramBinaryCache::GetStats();
+
+        std::cout << "Program binary cache: " << fragmentShaderFileName << " (" << SHADER_FEATURES_ALL + 1 << " variants)" << std::endl;
+        std::cout << "  cold        : " << times[0] << " ms (" << after.compiled - before.compiled << " compiled)" << std::endl;
+        std::cout << "  warm        : " << times[1] << " ms (" << after.loaded - before.loaded << " loaded, "
+            << after.rejected - before.rejected << " rejected by the driver)" << std::endl;
+        std::cout << "  speedup     : " << times[0] / std::max(times[1], 1e-6) << "x" << std::endl;
+    }
+}
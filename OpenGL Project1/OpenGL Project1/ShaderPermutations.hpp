@@ -0,0 +1,94 @@
+#ifndef ShaderPermutations_hpp
+#define ShaderPermutations_hpp
+
+#include <GL/glew.h>
+
+#include "Shader.hpp"
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gps {
+
+    // Optional parts of basic.frag, each compiled in with a #define of the same name
+    enum ShaderFeature
+    {
+        // FOG: distance fog, off while fogDensity is 0
+        SHADER_FEATURE_FOG = 1 << 0,
+        // LAMP, PURPLE_LAMP: the two point lights, off while their color is black
+        SHADER_FEATURE_LAMP = 1 << 1,
+        SHADER_FEATURE_PURPLE_LAMP = 1 << 2,
+        // SPECULAR_MAP: the specular color may come from a texture
+        SHADER_FEATURE_SPECULAR_MAP = 1 << 3,
+        // ALPHA: the ObjectBlock opacity is written out, else fragments are opaque
+        SHADER_FEATURE_ALPHA = 1 << 4
+    };
+
+    const uint32_t SHADER_FEATURE_COUNT = 5;
+    // every feature compiled in, the variant that matches any state
+    const uint32_t SHADER_FEATURES_ALL = (1u << SHADER_FEATURE_COUNT) - 1;
+
+    // Variants of one vertex and fragment shader pair, keyed by a ShaderFeature mask. A variant is compiled
+    // the first time it is asked for and kept, so a state that comes back costs nothing. Uniform block
+    // bindings and sampler units are recorded once and applied to every variant as it is created.
+    // Variants can be submitted ahead with Prefetch, and Select draws with the fallback while one is still
+    // compiling instead of waiting for it in the middle of a frame.
+    class ShaderPermutations
+    {
+    public:
+        ShaderPermutations();
+
+        // Only records the file names, nothing is compiled until Get
+        void Create(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+
+        void BindUniformBlock(const std::string& name, GLuint binding);
+        void SetSampler(const std::string& name, GLint unit);
+
+        // The variant with exactly features compiled in, compiled now if it is the first request
+        const gps::Shader& Get(uint32_t features);
+
+        // Starts compiling the variant without waiting for it, nothing if it is known already
+        void Prefetch(uint32_t features);
+        // The variant Select draws with while the right one is not ready, it must compile in a superset of
+        // the features it stands in for. Compiled now.
+        void SetFallback(uint32_t features);
+        // The variant if the driver has it ready, else it is prefetched and the fallback is returned. Without
+        // a fallback, or without parallel_shader_compile to ask the driver, this is Get.
+        const gps::Shader& Select(uint32_t features);
+
+        size_t GetVariantCount() const;
+        // Draws Select gave to the fallback since start-up
+        unsigned int GetSubstitutionCount() const;
+
+        // Deletes every variant compiled so far
+        void Delete();
+
+        // "#define FOG\n" ... for the features in the mask
+        static std::string GetDefines(uint32_t features);
+
+        // Loads every variant with the program binary cache cold (files removed first) and then warm and
+        // prints both times. Needs a current context.
+        static void BenchmarkProgramBinaryCache(const std::string& vertexShaderFileName, const std::string& fragmentShaderFileName);
+
+    private:
+        std::string vertexShaderFileName;
+        std::string fragmentShaderFileName;
+        // map nodes never move, draw items keep pointers to the variants
+        std::map<uint32_t, gps::Shader> variants;
+        std::vector<std::pair<std::string, GLuint> > uniformBlocks;
+        std::vector<std::pair<std::string, GLint> > samplers;
+        const gps::Shader* fallback;
+        unsigned int substitutions;
+
+        // finishLoad, then the recorded block bindings and samplers
+        void Finish(gps::Shader& shader);
+
+        ShaderPermutations(const ShaderPermutations&);
+        ShaderPermutations& operator=(const ShaderPermutations&);
+    };
+}
+
+#endif /* ShaderPermutations_hpp */
@@ -10,7 +10,7 @@
 
 namespace gps {
 
-    SkyBox::SkyBox()
+    SkyBox::SkyBox() : uniformProgram(0)
     {
 
     }
@@ -21,38 +21,58 @@ namespace gps {
         InitSkyBox();
     }
 
-    void SkyBox::Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix)
+    bool SkyBox::Load(const gps::AssetBundle& bundle, std::string name)
     {
-        shader.useShaderProgram();
+        cubemapTexture = LoadSkyBoxTextures(bundle, name);
+        if (cubemapTexture == 0) {
+            return false;
+        }
+        InitSkyBox();
+        return true;
+    }
+
+    void SkyBox::Load(gps::AssetLoader& loader, std::vector<const GLchar*> cubeMapFaces)
+    {
+        std::vector<std::string> faces(cubeMapFaces.begin(), cubeMapFaces.end());
+        cubemapLoad = loader.LoadCubeMap(faces);
+        cubemapTexture = cubemapLoad->id;
+        InitSkyBox();
+    }
 
-        //set the view and projection matrices
-        glm::mat4 transformedView = glm::mat4(glm::mat3(viewMatrix));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(transformedView));
-        glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projectionMatrix));
+    void SkyBox::Draw(const gps::Shader& shader)
+    {
+        if (cubemapLoad && cubemapLoad->ready) {
+            cubemapTexture = cubemapLoad->id;
+            cubemapLoad.reset();
+        }
+
+        shader.useShaderProgram();
+        if (uniformProgram != shader.shaderProgram) {
+            uniformProgram = shader.shaderProgram;
+            skyboxUniform = shader.getUniform<GLint>("skybox");
+        }
 
-        glDepthFunc(GL_LEQUAL);
+        GLStateCache& state = GLStateCache::Get();
+        state.SetDepthFunc(GL_LEQUAL);
 
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glUniform1i(glGetUniformLocation(shader.shaderProgram, "skybox"), 0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
+        state.BindVertexArray(skyboxVAO);
+        skyboxUniform.set(0);
+        state.BindTexture(0, GL_TEXTURE_CUBE_MAP, cubemapTexture);
         glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
 
-        glDepthFunc(GL_LESS);
+        state.SetDepthFunc(GL_LESS);
     }
 
     GLuint SkyBox::LoadSkyBoxTextures(std::vector<const GLchar*> skyBoxFaces)
     {
         GLuint textureID;
         glGenTextures(1, &textureID);
-        glActiveTexture(GL_TEXTURE0);
 
         int width, height, n;
         unsigned char* image;
         int force_channels = 3;
 
-        glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
         for (GLuint i = 0; i < skyBoxFaces.size(); i++)
         {
             image = stbi_load(skyBoxFaces[i], &width, &height, &n, force_channels);
@@ -70,7 +90,47 @@ namespace gps {
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
+
+        return textureID;
+    }
+
+    GLuint SkyBox::LoadSkyBoxTextures(const gps::AssetBundle& bundle, const std::string& name)
+    {
+        const AssetBundleEntry* entry = bundle.Find(name, ASSET_CUBE_MAP);
+        const TextureAssetHeader* texture = entry ? bundle.GetTexture(*entry) : NULL;
+        if (!texture || texture->faceCount != 6) {
+            return 0;
+        }
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+
+        GLenum format = texture->channels == 4 ? GL_RGBA : GL_RGB;
+
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, textureID);
+        // faces are tightly packed rows, stored as they are uploaded
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (GLuint i = 0; i < texture->faceCount; i++)
+        {
+            for (GLuint level = 0; level < texture->levelCount; level++)
+            {
+                GLsizei width = texture->width >> level ? texture->width >> level : 1;
+                GLsizei height = texture->height >> level ? texture->height >> level : 1;
+                glTexImage2D(
+                    GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, level,
+                    format, width, height, 0, format, GL_UNSIGNED_BYTE, bundle.GetTextureLevel(*texture, i, level)
+                );
+            }
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, texture->levelCount - 1);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, texture->levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_CUBE_MAP, 0);
 
         return textureID;
     }
@@ -124,14 +184,14 @@ namespace gps {
         glGenVertexArrays(1, &(this->skyboxVAO));
         glGenBuffers(1, &skyboxVBO);
 
-        glBindVertexArray(skyboxVAO);
+        GLStateCache::Get().BindVertexArray(skyboxVAO);
         glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
         glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
 
         glEnableVertexAttribArray(0);
         glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(GLfloat), (GLvoid*)0);
 
-        glBindVertexArray(0);
+        GLStateCache::Get().BindVertexArray(0);
     }
 
     GLuint SkyBox::GetTextureId()
@@ -11,6 +11,8 @@
 
 #include <stdio.h>
 #include "Shader.hpp"
+#include "AssetBundle.hpp"
+#include "AssetLoader.hpp"
 #include <vector>
 #include "stb_image.h"
 #include "glm/glm.hpp"
@@ -22,13 +24,23 @@ namespace gps {
     public:
         SkyBox();
         void Load(std::vector<const GLchar*> cubeMapFaces);
-        void Draw(gps::Shader shader, glm::mat4 viewMatrix, glm::mat4 projectionMatrix);
+        // Loads the cube map packed under name, returns false if the bundle does not have it
+        bool Load(const gps::AssetBundle& bundle, std::string name);
+        // Decodes the faces on the loader's workers, the sky stays black until they are uploaded
+        void Load(gps::AssetLoader& loader, std::vector<const GLchar*> cubeMapFaces);
+        // The camera comes from the CameraBlock uniform buffer
+        void Draw(const gps::Shader& shader);
         GLuint GetTextureId();
     private:
         GLuint skyboxVAO;
         GLuint skyboxVBO;
         GLuint cubemapTexture;
+        gps::TextureHandle cubemapLoad;
+        // uniforms of the program drawn with last
+        GLuint uniformProgram;
+        gps::Uniform<GLint> skyboxUniform;
         GLuint LoadSkyBoxTextures(std::vector<const GLchar*> cubeMapFaces);
+        GLuint LoadSkyBoxTextures(const gps::AssetBundle& bundle, const std::string& name);
         void InitSkyBox();
     };
 }
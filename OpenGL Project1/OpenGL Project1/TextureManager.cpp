@@ -0,0 +1,587 @@
+#include "TextureManager.hpp"
+#include "GLStateCache.hpp"
+#include "Hash.hpp"
+#include "MappedFile.hpp"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+namespace gps {
+
+    bool TextureManager::compressedTexturesEnabled = true;
+
+    TextureManager::TextureManager() :
+        requests(0), pathHits(0), contentHits(0), releasedBytesSaved(0)
+    {
+    }
+
+    TextureManager& TextureManager::Get()
+    {
+        // never destroyed, models are globals and release their textures during static destruction
+        static TextureManager* instance = new TextureManager();
+        return *instance;
+    }
+
+    TextureHandle TextureManager::Acquire(const std::string& path, const gps::AssetBundle* bundle, gps::AssetLoader* loader)
+    {
+        requests++;
+
+        std::unordered_map<std::string, std::shared_ptr<Entry> >::iterator found = byPath.find(path);
+        if (found != byPath.end()) {
+            Entry& entry = *found->second;
+            entry.refCount++;
+            entry.hits++;
+            pathHits++;
+            return entry.handle;
+        }
+
+        // same bytes under another path, e.g. a texture copied into every model folder. An image the loader
+        // decodes is hashed on its worker and matched in Update instead; only a .dds, which is uploaded from
+        // here anyway, is read on this thread then.
+        const AssetBundleEntry* bundleEntry = bundle ? bundle->Find(path, ASSET_TEXTURE) : NULL;
+        bool background = !bundleEntry && loader && loader->IsStarted();
+        uint64_t contentHash = 0;
+        if (bundleEntry) {
+            contentHash = HashContent(bundle->GetData(*bundleEntry), (size_t)bundleEntry->size);
+        }
+        else if (!background) {
+            contentHash = HashFile(path);
+        }
+        else if (compressedTexturesEnabled) {
+            contentHash = HashFile(DdsFile::GetCompressedPath(path));
+        }
+        std::unordered_map<uint64_t, std::shared_ptr<Entry> >::iterator sameContent = byContent.find(contentHash);
+        if (contentHash != 0 && sameContent != byContent.end()) {
+            std::shared_ptr<Entry> entry = sameContent->second;
+            entry->refCount++;
+            entry->hits++;
+            entry->paths.push_back(path);
+            byPath[path] = entry;
+            contentHits++;
+            return entry->handle;
+        }
+
+        std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+        entry->contentHash = contentHash;
+        entry->refCount = 1;
+        entry->hits = 0;
+        entry->paths.push_back(path);
+        entry->compressed = false;
+
+        size_t bytes = 0;
+        GLuint textureID = bundleEntry ? ReadTextureFromBundle(*bundle, *bundleEntry, bytes) : 0;
+        if (textureID == 0 && compressedTexturesEnabled) {
+            textureID = ReadTextureFromDds(path, bytes);
+            entry->compressed = textureID != 0;
+        }
+        if (textureID == 0 && background) {
+            entry->handle = loader->LoadTexture(path);
+            pendingLoads.push_back(entry);
+        }
+        else {
+            if (textureID == 0) {
+                textureID = ReadTextureFromFile(path.c_str(), bytes);
+            }
+            entry->handle = std::make_shared<TextureLoad>();
+            entry->handle->id = textureID;
+            entry->handle->ready = true;
+            entry->handle->path = path;
+            entry->handle->bytes = bytes;
+            entry->handle->layer = -1;
+            entry->handle->cancelled = false;
+            entry->handle->contentHash = contentHash;
+        }
+
+        byPath[path] = entry;
+        if (contentHash != 0) {
+            byContent[contentHash] = entry;
+        }
+        return entry->handle;
+    }
+
+    void TextureManager::Release(const std::string& path)
+    {
+        std::unordered_map<std::string, std::shared_ptr<Entry> >::iterator found = byPath.find(path);
+        if (found == byPath.end()) {
+            return;
+        }
+
+        std::shared_ptr<Entry> entry = found->second;
+        if (--entry->refCount > 0) {
+            return;
+        }
+
+        TextureLoad& texture = *entry->handle;
+        releasedBytesSaved += entry->hits * texture.bytes;
+        if (!texture.ready) {
+            texture.cancelled = true;
+        }
+        else if (texture.layer >= 0) {
+            if (--arrayLayers[texture.id] == 0) {
+                glDeleteTextures(1, &texture.id);
+                GLStateCache::Get().ForgetTexture(texture.id);
+                arrayLayers.erase(texture.id);
+            }
+            texture.id = 0;
+        }
+        else if (texture.id != 0) {
+            glDeleteTextures(1, &texture.id);
+            GLStateCache::Get().ForgetTexture(texture.id);
+            texture.id = 0;
+        }
+
+        for (size_t i = 0; i < entry->paths.size(); i++) {
+            byPath.erase(entry->paths[i]);
+        }
+        if (entry->contentHash != 0) {
+            byContent.erase(entry->contentHash);
+        }
+    }
+
+    TextureHandle TextureManager::Find(const std::string& path) const
+    {
+        std::unordered_map<std::string, std::shared_ptr<Entry> >::const_iterator found = byPath.find(path);
+        return found != byPath.end() ? found->second->handle : TextureHandle();
+    }
+
+    void TextureManager::Update()
+    {
+        size_t kept = 0;
+        for (size_t i = 0; i < pendingLoads.size(); i++) {
+            std::shared_ptr<Entry> entry = pendingLoads[i];
+            TextureLoad& texture = *entry->handle;
+            if (!texture.ready) {
+                pendingLoads[kept++] = entry;
+                continue;
+            }
+            // released before the upload, unreadable, or already known by the hash of its .dds
+            if (entry->refCount == 0 || texture.contentHash == 0 || entry->contentHash != 0) {
+                continue;
+            }
+
+            std::unordered_map<uint64_t, std::shared_ptr<Entry> >::iterator sameContent = byContent.find(texture.contentHash);
+            if (sameContent == byContent.end()) {
+                entry->contentHash = texture.contentHash;
+                byContent[entry->contentHash] = entry;
+                continue;
+            }
+
+            // the first Acquire of the copy counts as a content hit, the later ones already were path hits
+            std::shared_ptr<Entry> original = sameContent->second;
+            original->refCount += entry->refCount;
+            original->hits += entry->hits + 1;
+            contentHits++;
+            for (size_t p = 0; p < entry->paths.size(); p++) {
+                original->paths.push_back(entry->paths[p]);
+                byPath[entry->paths[p]] = original;
+            }
+            if (texture.id != 0) {
+                glDeleteTextures(1, &texture.id);
+                GLStateCache::Get().ForgetTexture(texture.id);
+            }
+            // models still holding the copy's handle pick the original up from it
+            texture.id = original->handle->id;
+        }
+        pendingLoads.resize(kept);
+    }
+
+    void TextureManager::PackTextureArrays(bool resample)
+    {
+        struct Candidate
+        {
+            std::shared_ptr<Entry> entry;
+            GLint width;
+            GLint height;
+            // set when the texture joins an array of another size
+            bool resampled;
+        };
+
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+        // by path so the layers come out the same every run
+        std::vector<std::string> paths;
+        for (std::unordered_map<std::string, std::shared_ptr<Entry> >::const_iterator it = byPath.begin(); it != byPath.end(); ++it) {
+            const TextureLoad& texture = *it->second->handle;
+            if (it->second->paths[0] == it->first && texture.ready && texture.id != 0 && texture.layer < 0) {
+                paths.push_back(it->first);
+            }
+        }
+        std::sort(paths.begin(), paths.end());
+
+        // uncompressed arrays get a new mip chain, so the level count only splits compressed ones
+        GLStateCache& state = GLStateCache::Get();
+        std::map<std::string, std::vector<Candidate> > groups;
+        std::map<std::string, GLint> groupFormats;
+        std::map<std::string, GLint> groupLevels;
+        for (size_t p = 0; p < paths.size(); p++) {
+            Candidate candidate;
+            candidate.entry = byPath[paths[p]];
+            candidate.resampled = false;
+            state.BindTexture(0, GL_TEXTURE_2D, candidate.entry->handle->id);
+            GLint format = 0;
+            GLint maxLevel = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &candidate.width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &candidate.height);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &format);
+            glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+            GLint levels = 0;
+            if (candidate.entry->compressed) {
+                for (GLint size = std::max(candidate.width, candidate.height); size > 0 && levels <= maxLevel; size >>= 1) {
+                    levels++;
+                }
+            }
+            std::string key = std::to_string(format) + " " + std::to_string(candidate.width) + "x" +
+                std::to_string(candidate.height) + " " + std::to_string(levels);
+            groups[key].push_back(candidate);
+            groupFormats[key] = format;
+            groupLevels[key] = levels;
+        }
+        state.BindTexture(0, GL_TEXTURE_2D, 0);
+
+        size_t resampledCount = 0;
+        if (resample) {
+            for (std::map<std::string, std::vector<Candidate> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+                if (it->second.size() != 1 || groupLevels[it->first] != 0) {
+                    continue;
+                }
+                std::string target;
+                for (std::map<std::string, std::vector<Candidate> >::iterator other = groups.begin(); other != groups.end(); ++other) {
+                    if (other->second.size() > 1 && groupFormats[other->first] == groupFormats[it->first] &&
+                        (target.empty() || other->second.size() > groups[target].size())) {
+                        target = other->first;
+                    }
+                }
+                if (!target.empty()) {
+                    it->second[0].resampled = true;
+                    groups[target].push_back(it->second[0]);
+                    it->second.clear();
+                    resampledCount++;
+                }
+            }
+        }
+
+        size_t arrayCount = 0;
+        size_t layerCount = 0;
+        size_t bytesBefore = 0;
+        size_t bytesAfter = 0;
+        std::vector<unsigned char> pixels;
+        std::vector<unsigned char> scaled;
+        for (std::map<std::string, std::vector<Candidate> >::iterator it = groups.begin(); it != groups.end(); ++it) {
+            // the first texture sets the size, layers past the driver limit stay 2D textures
+            std::vector<Candidate>& layers = it->second;
+            if (layers.size() < 2) {
+                continue;
+            }
+            layers.resize(std::min(layers.size(), (size_t)maxLayers));
+            GLint format = groupFormats[it->first];
+            GLint levels = groupLevels[it->first];
+            GLsizei width = layers[0].width;
+            GLsizei height = layers[0].height;
+            GLsizei layerTotal = (GLsizei)layers.size();
+
+            GLuint arrayID;
+            glGenTextures(1, &arrayID);
+            state.BindTexture(0, GL_TEXTURE_2D_ARRAY, arrayID);
+            size_t arrayBytes = 0;
+            if (levels == 0) {
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, format, width, height, layerTotal, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+                pixels.resize((size_t)width * height * 4);
+                for (GLsizei layer = 0; layer < layerTotal; layer++) {
+                    const Candidate& candidate = layers[layer];
+                    state.BindTexture(0, GL_TEXTURE_2D, candidate.entry->handle->id);
+                    if (candidate.resampled) {
+                        scaled.resize((size_t)candidate.width * candidate.height * 4);
+                        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &scaled[0]);
+                        ResampleImage(&scaled[0], candidate.width, candidate.height, &pixels[0], width, height);
+                    }
+                    else {
+                        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+                    }
+                    glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, width, height, 1, GL_RGBA, GL_UNSIGNED_BYTE, &pixels[0]);
+                }
+                glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+                // the mip chain adds a third
+                arrayBytes = (size_t)width * height * 4 * 4 / 3 * layerTotal;
+            }
+            else {
+                // block compressed levels are copied as they are, they cannot be rendered to or resampled
+                for (GLint level = 0; level < levels; level++) {
+                    GLsizei levelWidth = std::max(width >> level, 1);
+                    GLsizei levelHeight = std::max(height >> level, 1);
+                    state.BindTexture(0, GL_TEXTURE_2D, layers[0].entry->handle->id);
+                    GLint levelSize = 0;
+                    glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &levelSize);
+                    glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, format, levelWidth, levelHeight, layerTotal, 0,
+                        levelSize * layerTotal, NULL);
+                    pixels.resize(levelSize);
+                    for (GLsizei layer = 0; layer < layerTotal; layer++) {
+                        state.BindTexture(0, GL_TEXTURE_2D, layers[layer].entry->handle->id);
+                        glGetCompressedTexImage(GL_TEXTURE_2D, level, &pixels[0]);
+                        glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer, levelWidth, levelHeight, 1,
+                            format, levelSize, &pixels[0]);
+                    }
+                    arrayBytes += (size_t)levelSize * layerTotal;
+                }
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levels - 1);
+                glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+            }
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            state.BindTexture(0, GL_TEXTURE_2D, 0);
+            state.BindTexture(0, GL_TEXTURE_2D_ARRAY, 0);
+
+            for (GLsizei layer = 0; layer < layerTotal; layer++) {
+                TextureLoad& texture = *layers[layer].entry->handle;
+                bytesBefore += texture.bytes;
+                glDeleteTextures(1, &texture.id);
+                state.ForgetTexture(texture.id);
+                texture.id = arrayID;
+                texture.layer = layer;
+                // the stats add up the entries, each carries its share of the array
+                texture.bytes = arrayBytes / layerTotal;
+            }
+            arrayLayers[arrayID] = layerTotal;
+            arrayCount++;
+            layerCount += layerTotal;
+            bytesAfter += arrayBytes;
+        }
+
+        std::cout << "Texture arrays : " << arrayCount << " arrays, " << layerCount << " layers from " << paths.size()
+            << " textures, " << resampledCount << " resampled, " << bytesBefore / 1024 << " KB -> " << bytesAfter / 1024 << " KB" << std::endl;
+    }
+
+    void TextureManager::ResampleImage(const unsigned char* source, int sourceWidth, int sourceHeight,
+        unsigned char* destination, int width, int height)
+    {
+        for (int y = 0; y < height; y++) {
+            float sy = std::min(std::max((y + 0.5f) * sourceHeight / height - 0.5f, 0.0f), (float)(sourceHeight - 1));
+            int y0 = (int)sy;
+            int y1 = std::min(y0 + 1, sourceHeight - 1);
+            float fy = sy - y0;
+            for (int x = 0; x < width; x++) {
+                float sx = std::min(std::max((x + 0.5f) * sourceWidth / width - 0.5f, 0.0f), (float)(sourceWidth - 1));
+                int x0 = (int)sx;
+                int x1 = std::min(x0 + 1, sourceWidth - 1);
+                float fx = sx - x0;
+                for (int c = 0; c < 4; c++) {
+                    float top = source[(y0 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y0 * sourceWidth + x1) * 4 + c] * fx;
+                    float bottom = source[(y1 * sourceWidth + x0) * 4 + c] * (1.0f - fx) + source[(y1 * sourceWidth + x1) * 4 + c] * fx;
+                    destination[(y * width + x) * 4 + c] = (unsigned char)(top * (1.0f - fy) + bottom * fy + 0.5f);
+                }
+            }
+        }
+    }
+
+    TextureStats TextureManager::GetStats() const
+    {
+        TextureStats stats;
+        stats.uniqueTextures = 0;
+        stats.requests = requests;
+        stats.pathHits = pathHits;
+        stats.contentHits = contentHits;
+        stats.bytesSaved = releasedBytesSaved;
+        stats.bytesResident = 0;
+        stats.compressedTextures = 0;
+
+        for (std::unordered_map<std::string, std::shared_ptr<Entry> >::const_iterator it = byPath.begin(); it != byPath.end(); ++it) {
+            const Entry& entry = *it->second;
+            // count every entry once, under the path it was loaded from
+            if (entry.paths[0] == it->first) {
+                stats.uniqueTextures++;
+                stats.bytesSaved += entry.hits * entry.handle->bytes;
+                stats.bytesResident += entry.handle->bytes;
+                stats.compressedTextures += entry.compressed ? 1 : 0;
+            }
+        }
+        return stats;
+    }
+
+    void TextureManager::PrintStats() const
+    {
+        TextureStats stats = GetStats();
+        std::cout << "Textures       : " << stats.uniqueTextures << " unique for " << stats.requests << " requests, "
+            << stats.pathHits << " path hits, " << stats.contentHits << " content hits, "
+            << stats.bytesSaved / 1024 << " KB saved" << std::endl;
+        std::cout << "Texture VRAM   : " << stats.bytesResident / 1024 << " KB, "
+            << stats.compressedTextures << " block compressed" << std::endl;
+    }
+
+    void TextureManager::SetCompressedTexturesEnabled(bool enabled)
+    {
+        compressedTexturesEnabled = enabled;
+    }
+
+    uint64_t TextureManager::HashContent(const unsigned char* data, size_t size)
+    {
+        // seeded with the size, 0 is kept for files that could not be read
+        uint64_t hash = HashBytes(data, size, HASH_SEED ^ size);
+        return hash != 0 ? hash : 1;
+    }
+
+    uint64_t TextureManager::HashFile(const std::string& path)
+    {
+        MappedFile file;
+        if (!file.Open(path)) {
+            return 0;
+        }
+        return HashContent(file.GetData(), file.GetSize());
+    }
+
+    // Reads the pixel data from an image file and loads it into the video memory
+    GLuint TextureManager::ReadTextureFromFile(const char* file_name, size_t& bytes) {
+        int x, y, n;
+        int force_channels = 4;
+        unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
+        if (!image_data) {
+            fprintf(stderr, "ERROR: could not load %s\n", file_name);
+            return false;
+        }
+        // NPOT check
+        if ((x & (x - 1)) != 0 || (y & (y - 1)) != 0) {
+            fprintf(
+                stderr, "WARNING: texture %s is not power-of-2 dimensions\n", file_name
+            );
+        }
+
+        int width_in_bytes = x * 4;
+        unsigned char *top = NULL;
+        unsigned char *bottom = NULL;
+        unsigned char temp = 0;
+        int half_height = y / 2;
+
+        for (int row = 0; row < half_height; row++) {
+            top = image_data + row * width_in_bytes;
+            bottom = image_data + (y - row - 1) * width_in_bytes;
+            for (int col = 0; col < width_in_bytes; col++) {
+                temp = *top;
+                *top = *bottom;
+                *bottom = temp;
+                top++;
+                bottom++;
+            }
+        }
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, textureID);
+        glTexImage2D(
+            GL_TEXTURE_2D,
+            0,
+            GL_SRGB, //GL_SRGB,//GL_RGBA,
+            x,
+            y,
+            0,
+            GL_RGBA,
+            GL_UNSIGNED_BYTE,
+            image_data
+        );
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+
+        stbi_image_free(image_data);
+
+        // the mip chain adds a third
+        bytes = (size_t)x * y * 4 * 4 / 3;
+        return textureID;
+    }
+
+    GLuint TextureManager::ReadTextureFromDds(const std::string& path, size_t& bytes) {
+        DdsFile dds;
+        if (!dds.Open(DdsFile::GetCompressedPath(path))) {
+            return 0;
+        }
+
+        GLenum internalFormat;
+        bool supported;
+        switch (dds.GetFormat()) {
+        // the sRGB S3TC formats come from EXT_texture_sRGB, s3tc alone only has the linear ones
+        case BLOCK_FORMAT_BC1:
+            internalFormat = GL_COMPRESSED_SRGB_S3TC_DXT1_EXT;
+            supported = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+            break;
+        case BLOCK_FORMAT_BC3:
+            internalFormat = GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT;
+            supported = GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+            break;
+        default:
+            internalFormat = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM;
+            supported = GLEW_ARB_texture_compression_bptc;
+            break;
+        }
+        if (!supported) {
+            static bool warned[3] = {};
+            if (!warned[dds.GetFormat()]) {
+                fprintf(stderr, "WARNING: %s textures are not supported, using RGBA8\n", BlockCompressor::GetFormatName(dds.GetFormat()));
+                warned[dds.GetFormat()] = true;
+            }
+            return 0;
+        }
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, textureID);
+        bytes = 0;
+        for (int level = 0; level < dds.GetLevelCount(); level++) {
+            GLsizei width = std::max(dds.GetWidth() >> level, 1);
+            GLsizei height = std::max(dds.GetHeight() >> level, 1);
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, internalFormat, width, height, 0,
+                (GLsizei)dds.GetLevelSize(level), dds.GetLevelData(level));
+            bytes += dds.GetLevelSize(level);
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, dds.GetLevelCount() - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, dds.GetLevelCount() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+
+        return textureID;
+    }
+
+    GLuint TextureManager::ReadTextureFromBundle(const gps::AssetBundle& bundle, const gps::AssetBundleEntry& entry, size_t& bytes) {
+        const TextureAssetHeader* texture = bundle.GetTexture(entry);
+        if (!texture) {
+            return 0;
+        }
+
+        GLenum format = texture->channels == 4 ? GL_RGBA : GL_RGB;
+
+        GLuint textureID;
+        glGenTextures(1, &textureID);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, textureID);
+        // levels are tightly packed rows
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (uint32_t level = 0; level < texture->levelCount; level++) {
+            GLsizei width = std::max((GLsizei)(texture->width >> level), 1);
+            GLsizei height = std::max((GLsizei)(texture->height >> level), 1);
+            glTexImage2D(GL_TEXTURE_2D, level, GL_SRGB, width, height, 0, format, GL_UNSIGNED_BYTE,
+                bundle.GetTextureLevel(*texture, 0, level));
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture->levelCount - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, texture->levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        GLStateCache::Get().BindTexture(0, GL_TEXTURE_2D, 0);
+
+        bytes = AssetBundle::GetTexturePayloadSize(*texture) - sizeof(TextureAssetHeader);
+        return textureID;
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef TextureManager_hpp
+#define TextureManager_hpp
+
+#include <GL/glew.h>
+
+#include "AssetBundle.hpp"
+#include "AssetLoader.hpp"
+#include "DdsFile.hpp"
+
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace gps {
+
+    struct TextureStats
+    {
+        // distinct textures in video memory
+        size_t uniqueTextures;
+        // Acquire calls, and those served by an existing texture with the same path or the same file content
+        size_t requests;
+        size_t pathHits;
+        size_t contentHits;
+        // video memory the hits would have taken as separate copies
+        size_t bytesSaved;
+        // video memory taken by the unique textures, and how many of them are block compressed
+        size_t bytesResident;
+        size_t compressedTextures;
+    };
+
+    // Process-wide owner of the material textures. Textures are shared by path and by file content,
+    // so identical images in different model folders are decoded and uploaded once.
+    // Only used from the GL thread.
+    class TextureManager
+    {
+    public:
+        static TextureManager& Get();
+
+        // Takes a reference to the texture at path, loading it on first use: from bundle when it has it,
+        // else from the .dds next to the image, else decoded in the background by loader when it is
+        // started, else right away.
+        TextureHandle Acquire(const std::string& path, const gps::AssetBundle* bundle, gps::AssetLoader* loader);
+        // Drops a reference taken by Acquire, the texture is deleted with the last one
+        void Release(const std::string& path);
+        // The texture loaded for path, NULL if there is none
+        TextureHandle Find(const std::string& path) const;
+
+        // Images decoded by the loader are hashed on its workers, so they are only matched by content once
+        // uploaded: a copy of a texture already resident is deleted and its paths move to the original. Call
+        // once per frame after AssetLoader::ProcessUploads and before Model3D::Update.
+        void Update();
+
+        // Key textures are shared by, never 0. Safe from any thread.
+        static uint64_t HashContent(const unsigned char* data, size_t size);
+
+        // Moves the ready textures that share a format and a size into GL_TEXTURE_2D_ARRAY objects, one layer
+        // each, so the meshes drawing them bind one texture between them. With resample, uncompressed textures
+        // alone in their size are scaled to the most common size of their format to join that array. Call once
+        // the textures are loaded, then Model3D::UpdateTextureArrays on every model.
+        void PackTextureArrays(bool resample);
+
+        TextureStats GetStats() const;
+        void PrintStats() const;
+
+        // Uploads the block compressed .dds next to an image instead of decoding it (on by default).
+        // Formats the driver does not support fall back to the RGBA8 image.
+        static void SetCompressedTexturesEnabled(bool enabled);
+
+    private:
+        struct Entry
+        {
+            TextureHandle handle;
+            uint64_t contentHash;
+            int refCount;
+            // Acquire calls served by this entry without loading anything
+            int hits;
+            // every path resolving to this entry
+            std::vector<std::string> paths;
+            bool compressed;
+        };
+
+        std::unordered_map<std::string, std::shared_ptr<Entry> > byPath;
+        std::unordered_map<uint64_t, std::shared_ptr<Entry> > byContent;
+        size_t requests;
+        size_t pathHits;
+        size_t contentHits;
+        // bytes saved by entries that have been released since
+        size_t releasedBytesSaved;
+        // layers of each texture array still owned by an entry, the array is deleted with the last one
+        std::unordered_map<GLuint, int> arrayLayers;
+        // entries given to the loader, until Update has matched them by content
+        std::vector<std::shared_ptr<Entry> > pendingLoads;
+
+        static bool compressedTexturesEnabled;
+
+        TextureManager();
+
+        // 0 if the file cannot be read
+        static uint64_t HashFile(const std::string& path);
+
+        // Reads the pixel data from an image file and loads it into the video memory
+        static GLuint ReadTextureFromFile(const char* file_name, size_t& bytes);
+
+        // Uploads the .dds next to the image with glCompressedTexImage2D; 0 if there is none or the
+        // driver lacks the format
+        static GLuint ReadTextureFromDds(const std::string& path, size_t& bytes);
+
+        // Uploads a packed texture and its mip chain as is, no decoding; 0 if the entry is not a valid texture
+        static GLuint ReadTextureFromBundle(const gps::AssetBundle& bundle, const gps::AssetBundleEntry& entry, size_t& bytes);
+
+        // Bilinear scaling of an RGBA8 image, texel centers of both images line up
+        static void ResampleImage(const unsigned char* source, int sourceWidth, int sourceHeight,
+            unsigned char* destination, int width, int height);
+
+        TextureManager(const TextureManager&);
+        TextureManager& operator=(const TextureManager&);
+    };
+}
+
+#endif /* TextureManager_hpp */
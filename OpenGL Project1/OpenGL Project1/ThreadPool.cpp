@@ -0,0 +1,61 @@
+#include "ThreadPool.hpp"
+
+namespace gps {
+
+    ThreadPool::ThreadPool(unsigned int threadCount) : stopping(false)
+    {
+        if (threadCount == 0) {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+
+        for (unsigned int i = 0; i < threadCount; i++) {
+            workers.push_back(std::thread(&ThreadPool::WorkerLoop, this));
+        }
+    }
+
+    ThreadPool::~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            jobs.clear();
+        }
+        jobAvailable.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    unsigned int ThreadPool::GetThreadCount() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    void ThreadPool::Enqueue(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back(job);
+        }
+        jobAvailable.notify_one();
+    }
+
+    void ThreadPool::WorkerLoop()
+    {
+        for (;;) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                jobAvailable.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping) {
+                    return;
+                }
+                job = jobs.front();
+                jobs.pop_front();
+            }
+            job();
+        }
+    }
+}
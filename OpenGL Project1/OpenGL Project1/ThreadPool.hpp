@@ -0,0 +1,54 @@
+#ifndef ThreadPool_hpp
+#define ThreadPool_hpp
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace gps {
+
+    // Fixed set of worker threads running jobs in submission order. No GL calls may be made from a job,
+    // the context belongs to the main thread.
+    class ThreadPool
+    {
+    public:
+        // threadCount 0 keeps one hardware thread free for the GL thread
+        explicit ThreadPool(unsigned int threadCount = 0);
+        // Jobs that have not started yet are dropped (their futures report broken_promise), running ones finish
+        ~ThreadPool();
+
+        template <typename Job>
+        std::future<typename std::result_of<Job()>::type> Submit(Job job)
+        {
+            typedef typename std::result_of<Job()>::type Result;
+            // std::function needs a copyable target, the task itself is move only
+            std::shared_ptr<std::packaged_task<Result()> > task = std::make_shared<std::packaged_task<Result()> >(job);
+            std::future<Result> result = task->get_future();
+            Enqueue([task]() { (*task)(); });
+            return result;
+        }
+
+        unsigned int GetThreadCount() const;
+
+    private:
+        std::vector<std::thread> workers;
+        std::deque<std::function<void()> > jobs;
+        std::mutex mutex;
+        std::condition_variable jobAvailable;
+        bool stopping;
+
+        void Enqueue(std::function<void()> job);
+        void WorkerLoop();
+
+        ThreadPool(const ThreadPool&);
+        ThreadPool& operator=(const ThreadPool&);
+    };
+}
+
+#endif /* ThreadPool_hpp */
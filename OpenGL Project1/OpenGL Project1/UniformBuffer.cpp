@@ -0,0 +1,71 @@
+#include "UniformBuffer.hpp"
+
+#include <algorithm>
+
+namespace gps {
+
+    unsigned int UniformBuffer::uploadCount = 0;
+    size_t UniformBuffer::uploadBytes = 0;
+
+    UniformBuffer::UniformBuffer() : buffer(0), binding(0), blockSize(0), slotStride(0), slotCount(0)
+    {
+    }
+
+    void UniformBuffer::Create(GLuint binding, GLsizeiptr blockSize, int slotCount)
+    {
+        GLint alignment = 256;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        alignment = std::max(alignment, 1);
+
+        this->binding = binding;
+        this->blockSize = blockSize;
+        this->slotCount = std::max(slotCount, 1);
+        this->slotStride = (blockSize + alignment - 1) / alignment * alignment;
+
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, slotStride * this->slotCount, NULL, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, 0, blockSize);
+    }
+
+    void UniformBuffer::Update(const void* data, int slot)
+    {
+        slot = std::min(std::max(slot, 0), slotCount - 1);
+        GLintptr offset = slot * slotStride;
+
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, offset, blockSize, data);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, offset, blockSize);
+
+        uploadCount++;
+        uploadBytes += (size_t)blockSize;
+    }
+
+    void UniformBuffer::Bind(int slot) const
+    {
+        slot = std::min(std::max(slot, 0), slotCount - 1);
+        glBindBufferRange(GL_UNIFORM_BUFFER, binding, buffer, slot * slotStride, blockSize);
+    }
+
+    GLuint UniformBuffer::GetId() const
+    {
+        return buffer;
+    }
+
+    int UniformBuffer::GetSlotCount() const
+    {
+        return slotCount;
+    }
+
+    unsigned int UniformBuffer::GetUploadCount()
+    {
+        return uploadCount;
+    }
+
+    size_t UniformBuffer::GetUploadBytes()
+    {
+        return uploadBytes;
+    }
+}
@@ -0,0 +1,112 @@
+#ifndef UniformBuffer_hpp
+#define UniformBuffer_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Binding points of the std140 uniform blocks shared by every shader
+    enum UniformBinding
+    {
+        UNIFORM_BINDING_CAMERA = 0,
+        UNIFORM_BINDING_LIGHTS = 1,
+        UNIFORM_BINDING_OBJECT = 2,
+        UNIFORM_BINDING_MATERIALS = 3
+    };
+
+    // CameraBlock, uploaded once per frame
+    struct CameraUniforms
+    {
+        glm::mat4 view;
+        glm::mat4 projection;
+    };
+
+    // LightsBlock, uploaded in the frames it changes. std140 aligns every vec3 to 16 bytes, a float
+    // right after one fills the rest of its slot.
+    struct LightUniforms
+    {
+        glm::vec3 lightDir;
+        float padding0;
+        glm::vec3 lightColor;
+        float padding1;
+        glm::vec3 lampLightPosition;
+        float padding2;
+        glm::vec3 lampLightColor;
+        float padding3;
+        glm::vec3 purpleLampLightPosition;
+        float padding4;
+        glm::vec3 purpleLampLightColor;
+        float fogDensity;
+    };
+
+    // ObjectBlock, one slot per object drawn in a frame. The normal matrix is a mat4 because a std140
+    // mat3 has vec4 columns, shaders take its mat3.
+    struct ObjectUniforms
+    {
+        glm::mat4 model;
+        glm::mat4 normalMatrix;
+        float opacity;
+        float padding[3];
+    };
+
+    // One element of the MaterialBlock array. The w of diffuse and specular is 1 when the mesh samples its
+    // texture for that color, 0 when the color itself is used. textureLayers.x and .y are the layers of the
+    // diffuse and specular texture arrays, -1 for textures that are not in an array.
+    struct MaterialUniforms
+    {
+        glm::vec4 ambient;
+        glm::vec4 diffuse;
+        glm::vec4 specular;
+        glm::vec4 textureLayers;
+    };
+
+    static_assert(sizeof(CameraUniforms) == 128, "CameraUniforms must match the std140 CameraBlock");
+    static_assert(sizeof(LightUniforms) == 96, "LightUniforms must match the std140 LightsBlock");
+    static_assert(sizeof(ObjectUniforms) == 144, "ObjectUniforms must match the std140 ObjectBlock");
+    static_assert(sizeof(MaterialUniforms) == 64, "MaterialUniforms must match the std140 MaterialBlock element");
+
+    // Uniform buffer holding slotCount copies of one std140 block, each at an offset aligned for
+    // glBindBufferRange. Writing a slot binds it to the block's binding point.
+    class UniformBuffer
+    {
+    public:
+        UniformBuffer();
+
+        void Create(GLuint binding, GLsizeiptr blockSize, int slotCount = 1);
+
+        // Copies blockSize bytes into slot and binds that slot
+        void Update(const void* data, int slot = 0);
+
+        template <typename T>
+        void Update(const T& block, int slot = 0)
+        {
+            Update((const void*)&block, slot);
+        }
+
+        // Binds a slot written earlier in the frame
+        void Bind(int slot) const;
+
+        GLuint GetId() const;
+        int GetSlotCount() const;
+
+        // Update calls and bytes copied by every uniform buffer so far
+        static unsigned int GetUploadCount();
+        static size_t GetUploadBytes();
+
+    private:
+        GLuint buffer;
+        GLuint binding;
+        GLsizeiptr blockSize;
+        GLsizeiptr slotStride;
+        int slotCount;
+
+        static unsigned int uploadCount;
+        static size_t uploadBytes;
+
+        UniformBuffer(const UniformBuffer&);
+        UniformBuffer& operator=(const UniformBuffer&);
+    };
+}
+
+#endif /* UniformBuffer_hpp */
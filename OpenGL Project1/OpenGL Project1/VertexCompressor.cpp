@@ -0,0 +1,178 @@
+#include "VertexCompressor.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace gps {
+
+    VertexCompressionError VertexCompressor::Compress(MeshData& mesh)
+    {
+        VertexCompressionError error;
+        error.position = 0.0f;
+        error.normal = 0.0f;
+        error.texCoords = 0.0f;
+
+        glm::vec3 boundsMin(0.0f);
+        glm::vec3 boundsMax(0.0f);
+        if (!mesh.vertices.empty()) {
+            boundsMin = mesh.vertices[0].Position;
+            boundsMax = mesh.vertices[0].Position;
+        }
+        for (size_t i = 1; i < mesh.vertices.size(); i++) {
+            boundsMin = glm::min(boundsMin, mesh.vertices[i].Position);
+            boundsMax = glm::max(boundsMax, mesh.vertices[i].Position);
+        }
+        mesh.quantization.positionOffset = boundsMin;
+        mesh.quantization.positionScale = boundsMax - boundsMin;
+
+        mesh.compactVertices.resize(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            const Vertex& vertex = mesh.vertices[i];
+            CompactVertex& compact = mesh.compactVertices[i];
+
+            // positions: 16 bit unorm inside the bounds, flat axes store 0
+            glm::vec3 decodedPosition;
+            for (int c = 0; c < 3; c++) {
+                float extent = mesh.quantization.positionScale[c];
+                float normalized = extent > 0.0f ? (vertex.Position[c] - boundsMin[c]) / extent : 0.0f;
+                normalized = std::min(std::max(normalized, 0.0f), 1.0f);
+                compact.Position[c] = (GLushort)(normalized * 65535.0f + 0.5f);
+                decodedPosition[c] = boundsMin[c] + compact.Position[c] / 65535.0f * extent;
+            }
+            compact.Position[3] = 0;
+            error.position = std::max(error.position, glm::length(decodedPosition - vertex.Position));
+
+            EncodeOctahedral(vertex.Normal, compact.Normal);
+            float normalLength = glm::length(vertex.Normal);
+            if (normalLength > 0.0f) {
+                float cosine = glm::dot(vertex.Normal / normalLength, DecodeOctahedral(compact.Normal));
+                float angle = glm::degrees(std::acos(std::min(std::max(cosine, -1.0f), 1.0f)));
+                error.normal = std::max(error.normal, angle);
+            }
+
+            for (int c = 0; c < 2; c++) {
+                compact.TexCoords[c] = FloatToHalf(vertex.TexCoords[c]);
+                error.texCoords = std::max(error.texCoords, std::fabs(HalfToFloat(compact.TexCoords[c]) - vertex.TexCoords[c]));
+            }
+        }
+
+        return error;
+    }
+
+    // Round to nearest even, overflow goes to infinity and tiny values to half subnormals
+    uint16_t VertexCompressor::FloatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+
+        uint16_t sign = (uint16_t)((bits >> 16) & 0x8000);
+        int exponent = (int)((bits >> 23) & 0xff);
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (exponent == 255) {
+            return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+        }
+
+        int halfExponent = exponent - 127 + 15;
+        if (halfExponent >= 31) {
+            return sign | 0x7c00;
+        }
+
+        if (halfExponent <= 0) {
+            if (halfExponent < -10) {
+                return sign;
+            }
+            mantissa |= 0x800000;
+            int shift = 14 - halfExponent;
+            uint32_t half = mantissa >> shift;
+            uint32_t remainder = mantissa & ((1u << shift) - 1);
+            uint32_t halfway = 1u << (shift - 1);
+            if (remainder > halfway || (remainder == halfway && (half & 1))) {
+                half++;
+            }
+            return sign | (uint16_t)half;
+        }
+
+        uint32_t half = ((uint32_t)halfExponent << 10) | (mantissa >> 13);
+        uint32_t remainder = mantissa & 0x1fff;
+        if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+            // a carry into the exponent is still the correctly rounded value
+            half++;
+        }
+        return sign | (uint16_t)half;
+    }
+
+    float VertexCompressor::HalfToFloat(uint16_t value)
+    {
+        uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+        uint32_t exponent = (value >> 10) & 0x1f;
+        uint32_t mantissa = value & 0x3ff;
+        uint32_t bits;
+
+        if (exponent == 0) {
+            if (mantissa == 0) {
+                bits = sign;
+            }
+            else {
+                // subnormal half, renormalize
+                exponent = 127 - 15 + 1;
+                while ((mantissa & 0x400) == 0) {
+                    mantissa <<= 1;
+                    exponent--;
+                }
+                mantissa &= 0x3ff;
+                bits = sign | (exponent << 23) | (mantissa << 13);
+            }
+        }
+        else if (exponent == 31) {
+            bits = sign | 0x7f800000 | (mantissa << 13);
+        }
+        else {
+            bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+        }
+
+        float result;
+        memcpy(&result, &bits, sizeof(result));
+        return result;
+    }
+
+    static inline float SignNotZero(float value)
+    {
+        return value >= 0.0f ? 1.0f : -1.0f;
+    }
+
+    // Projects the unit sphere on an octahedron and unfolds it into the [-1, 1] square
+    void VertexCompressor::EncodeOctahedral(const glm::vec3& normal, GLshort encoded[2])
+    {
+        float sum = std::fabs(normal.x) + std::fabs(normal.y) + std::fabs(normal.z);
+        float x = 0.0f;
+        float y = 0.0f;
+        if (sum > 0.0f) {
+            x = normal.x / sum;
+            y = normal.y / sum;
+            if (normal.z < 0.0f) {
+                float foldedX = (1.0f - std::fabs(y)) * SignNotZero(x);
+                float foldedY = (1.0f - std::fabs(x)) * SignNotZero(y);
+                x = foldedX;
+                y = foldedY;
+            }
+        }
+
+        encoded[0] = (GLshort)std::floor(std::min(std::max(x, -1.0f), 1.0f) * 32767.0f + 0.5f);
+        encoded[1] = (GLshort)std::floor(std::min(std::max(y, -1.0f), 1.0f) * 32767.0f + 0.5f);
+    }
+
+    // Same math as decodeOctahedral in basic.vert, after the GL snorm conversion
+    glm::vec3 VertexCompressor::DecodeOctahedral(const GLshort encoded[2])
+    {
+        float x = std::max(encoded[0] / 32767.0f, -1.0f);
+        float y = std::max(encoded[1] / 32767.0f, -1.0f);
+        glm::vec3 normal(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+        if (normal.z < 0.0f) {
+            normal.x = (1.0f - std::fabs(y)) * SignNotZero(x);
+            normal.y = (1.0f - std::fabs(x)) * SignNotZero(y);
+        }
+        return glm::normalize(normal);
+    }
+}
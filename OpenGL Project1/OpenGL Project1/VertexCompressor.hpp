@@ -0,0 +1,36 @@
+#ifndef VertexCompressor_hpp
+#define VertexCompressor_hpp
+
+#include "Mesh.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+namespace gps {
+
+    // Largest deviation between the float vertices and their compact encoding, after decoding
+    struct VertexCompressionError
+    {
+        // object space units
+        float position;
+        // degrees
+        float normal;
+        float texCoords;
+    };
+
+    // Encodes gps::Vertex into the 16 byte CompactVertex layout decoded by basic.vert
+    class VertexCompressor
+    {
+    public:
+        // Quantizes positions against the bounds of the mesh, fills mesh.compactVertices and mesh.quantization
+        static VertexCompressionError Compress(MeshData& mesh);
+
+        static uint16_t FloatToHalf(float value);
+        static float HalfToFloat(uint16_t value);
+
+        static void EncodeOctahedral(const glm::vec3& normal, GLshort encoded[2]);
+        static glm::vec3 DecodeOctahedral(const GLshort encoded[2]);
+    };
+}
+
+#endif /* VertexCompressor_hpp */
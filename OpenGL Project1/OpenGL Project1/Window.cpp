@@ -2,7 +2,7 @@
 
 namespace gps {
 
-    void Window::Create(int width, int height, const char *title) {
+    void Window::Create(int width, int height, const char *title, bool visible) {
         if (!glfwInit()) {
             throw std::runtime_error("Could not start GLFW3!");
         }
@@ -19,6 +19,8 @@ namespace gps {
         // for multisampling/antialising
         glfwWindowHint(GLFW_SAMPLES, 4);
 
+        glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+
         this->window = glfwCreateWindow(width, height, title, NULL, NULL);
         if (!this->window) {
             throw std::runtime_error("Could not create GLFW3 window!");
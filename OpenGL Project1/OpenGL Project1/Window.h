@@ -16,7 +16,8 @@ namespace gps {
     class Window {
 
     public:
-        void Create(int width=800, int height=600, const char *title="OpenGL Project");
+        // A hidden window still gives a context for offscreen work, such as checks run without a display
+        void Create(int width=800, int height=600, const char *title="OpenGL Project", bool visible=true);
         void Delete();
 
         GLFWwindow* getWindow();
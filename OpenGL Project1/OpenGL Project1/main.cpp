@@ -3,6 +3,9 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
 
 #include "glm/glm.hpp"//core glm functionality
 #include "glm/gtc/matrix_transform.hpp" //glm extension for generating common transformation matrices
@@ -14,6 +17,12 @@
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
+#include "UniformBuffer.hpp"
+#include "RenderQueue.hpp"
+#include "OcclusionCuller.hpp"
+#include "OcclusionQueries.hpp"
+#include "ShaderPermutations.hpp"
+#include "ProgramBinaryCache.hpp"
 
 
 // window
@@ -34,19 +43,27 @@ glm::vec3 ghostCenterAnimation(-213.0f, 11.0f, -2.0f);
 glm::vec3 lightDir;
 glm::vec3 lightColor;
 
-// shader uniform locations
-GLuint modelLoc;
-GLuint viewLoc;
-GLuint projectionLoc;
-GLuint normalMatrixLoc;
-GLuint lightDirLoc;
-GLuint lightColorLoc;
-GLuint lapmLightPositionLoc;
-GLuint lampLightColorLoc;
-GLuint purpleLampLightPositionLoc;
-GLuint purpleLampLightColorLoc;
-GLuint opacityLoc;
-GLuint fogDensityLoc;
+// std140 uniform buffers bound to every shader: camera once per frame, lights when they change,
+// one object slot per draw
+const int MAX_OBJECTS_PER_FRAME = 16;
+gps::UniformBuffer cameraBuffer;
+gps::UniformBuffer lightBuffer;
+gps::UniformBuffer objectBuffer;
+bool lightsChanged = true;
+int objectSlot = 0;
+
+// draw items of every model, sorted by state and depth each frame
+gps::RenderQueue renderQueue;
+// CPU time from the first Submit to the last Execute, every frame so far
+double submitTimeMs = 0.0;
+
+// software depth buffer of the base scene's walls, meshes hidden behind them are not queued
+gps::OcclusionCuller occlusionCuller;
+bool occlusionCullingEnabled = true;
+
+// optional hardware occlusion queries on the mesh boxes, results used a frame late
+gps::OcclusionQueries occlusionQueries;
+bool occlusionQueriesEnabled = false;
 
 float fogDensity = 0.0f;
 float opacity = 1.0f;
@@ -67,18 +84,47 @@ GLboolean pressedKeys[1024];
 // models
 gps::Model3D baseScene;
 gps::Model3D ghost;
+
+// stress scene: a ring of asteroids around the base scene, one instanced draw per mesh
+const unsigned int DEFAULT_ASTEROID_COUNT = 100000;
+const glm::vec3 ASTEROID_BELT_CENTER(-200.0f, 40.0f, 0.0f);
+const float ASTEROID_BELT_RADIUS = 250.0f;
+const float ASTEROID_BELT_WIDTH = 60.0f;
+const float ASTEROID_BELT_HEIGHT = 15.0f;
+gps::Model3D asteroid;
+std::vector<glm::mat4> asteroidTransforms;
+unsigned int asteroidCount = 0;
+int instancingBenchmarkFrames = 0;
+bool programBinaryCacheBenchmark = false;
 GLfloat angle;
 
 float ghoastAngle = 0.0f;
 
 // shaders
-gps::Shader myBasicShader;
+// basic.vert/basic.frag variants, compiled for the fog and lamp states as they come up
+gps::ShaderPermutations basicShaders;
+bool shaderPermutationsEnabled = true;
 gps::Shader skyboxShader;
 
 // skybox
 std::vector<const GLchar*> faces;
 gps::SkyBox mySkyBox;
 
+// packed scene, see the AssetPacker tool
+std::string bundleFileName;
+gps::AssetBundle assetBundle;
+
+// background loading, textures are uploaded a few per frame
+gps::AssetLoader assetLoader;
+bool asyncLoadingEnabled = true;
+unsigned int loaderThreadCount = 0;
+double uploadBudgetMs = 2.0;
+bool assetsResident = false;
+// same sized textures packed into arrays once loaded, optionally with odd sizes resampled to join them
+bool textureArraysEnabled = false;
+bool textureArrayResampleEnabled = false;
+std::chrono::steady_clock::time_point startTime;
+
 bool mousePause = false;
 bool presentationPressed = true;
 
@@ -132,9 +178,6 @@ void windowResizeCallback(GLFWwindow* window, int width, int height) {
         0.1f, 
         RENDER_DISTANCE);
 
-    myBasicShader.useShaderProgram();
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
     glViewport(0, 0, window_width, window_height);
 }
 
@@ -143,6 +186,16 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
         glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS) { // level of detail colors
+        gps::Model3D::SetLodDebugEnabled(!gps::Model3D::IsLodDebugEnabled());
+    }
+
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS) { // occlusion buffer of the last frame
+        if (occlusionCuller.WriteDepthImage("occlusion_depth.pgm")) {
+            std::cout << "Wrote occlusion_depth.pgm" << std::endl;
+        }
+    }
+
     if (key >= 0 && key < 1024) {
         if (action == GLFW_PRESS) {
             pressedKeys[key] = true;
@@ -188,8 +241,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 
     myCamera.rotate(pitch, yaw);
     view = myCamera.getViewMatrix();
-    myBasicShader.useShaderProgram();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 }
 
@@ -198,8 +249,6 @@ void processMovement() {
         myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_W);
@@ -208,8 +257,6 @@ void processMovement() {
         myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_S);
@@ -218,8 +265,6 @@ void processMovement() {
         myCamera.move(gps::MOVE_LEFT, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_A);
@@ -228,8 +273,6 @@ void processMovement() {
         myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_D);
@@ -238,8 +281,6 @@ void processMovement() {
         myCamera.move(gps::MOVE_UP, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for teapot
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
@@ -247,8 +288,6 @@ void processMovement() {
         myCamera.move(gps::MOVE_DOWN, cameraSpeed);
         //update view matrix
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         // compute normal matrix for baseScene
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     }
@@ -257,8 +296,6 @@ void processMovement() {
         // update model matrix for teapot
         myCamera.rotate(pitch, yaw);
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_Q);
     }
@@ -267,8 +304,6 @@ void processMovement() {
         // update model matrix for teapot
         myCamera.rotate(pitch, yaw);
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_E);
     }
@@ -277,8 +312,6 @@ void processMovement() {
         // update model matrix for teapot
         myCamera.rotate(pitch, yaw);
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_T);
     }
@@ -287,8 +320,6 @@ void processMovement() {
         // update model matrix for teapot
         myCamera.rotate(pitch, yaw);
         view = myCamera.getViewMatrix();
-        myBasicShader.useShaderProgram();
-        glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
         normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
         //fprintf(file, "%d\n", GLFW_KEY_G);
     }
@@ -305,54 +336,48 @@ void processMovement() {
         //fprintf(file, "%d\n", GLFW_KEY_P);
     }
     if (pressedKeys[GLFW_KEY_L]) { // turn on the lamp light
-        myBasicShader.useShaderProgram();
         lampLightColor = glm::vec3(1, 0, 0); 
-        glUniform3fv(lampLightColorLoc, 1, glm::value_ptr(lampLightColor));
+        lightsChanged = true;
         //fprintf(file, "%d\n", GLFW_KEY_L);
     }
     if (pressedKeys[GLFW_KEY_O]) { // turn off the lamp light
-        myBasicShader.useShaderProgram();
         lampLightColor = glm::vec3(0, 0, 0); // 0 0 0 for turn off
-        glUniform3fv(lampLightColorLoc, 1, glm::value_ptr(lampLightColor));
+        lightsChanged = true;
         //fprintf(file, "%d\n", GLFW_KEY_O);
     }
     if (pressedKeys[GLFW_KEY_1]) { // turn on second lamp 
-        myBasicShader.useShaderProgram();
         purpleLampLightColor = glm::vec3(0.4, 0.1, 0.8); 
-        glUniform3fv(purpleLampLightColorLoc, 1, glm::value_ptr(purpleLampLightColor));
+        lightsChanged = true;
         //fprintf(file, "%d\n", GLFW_KEY_1);
     }
     if (pressedKeys[GLFW_KEY_2]) { // turn off second lamp 
-        myBasicShader.useShaderProgram();
         purpleLampLightColor = glm::vec3(0, 0, 0);
-        glUniform3fv(purpleLampLightColorLoc, 1, glm::value_ptr(purpleLampLightColor));
+        lightsChanged = true;
         //fprintf(file, "%d\n", GLFW_KEY_2);
     }
     //polygonal
     if (pressedKeys[GLFW_KEY_Z]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
+        gps::GLStateCache::Get().SetPolygonMode(GL_POINT);
         //fprintf(file, "%d\n", GLFW_KEY_Z);
     }
 
     if (pressedKeys[GLFW_KEY_X]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+        gps::GLStateCache::Get().SetPolygonMode(GL_FILL);
         //fprintf(file, "%d\n", GLFW_KEY_X);
     }
     //wireframe
     if (pressedKeys[GLFW_KEY_Y]) {
-        glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
+        gps::GLStateCache::Get().SetPolygonMode(GL_LINE);
         //fprintf(file, "%d\n", GLFW_KEY_Y);
     }
     if (pressedKeys[GLFW_KEY_F]) { /// fog ON
         fogDensity = 0.0069;
-        myBasicShader.useShaderProgram();
-        glUniform1f(fogDensityLoc, fogDensity);
+        lightsChanged = true;
         //fprintf(file, "%d\n", GLFW_KEY_F);
     }
     if (pressedKeys[GLFW_KEY_H]) { // fog OFF
         fogDensity = 0.0;
-        myBasicShader.useShaderProgram();
-        glUniform1f(fogDensityLoc, fogDensity);
+        lightsChanged = true;
         //fprintf(file, "%d\n", GLFW_KEY_H);
     }
 }
@@ -371,96 +396,253 @@ void setWindowCallbacks() {
 void initOpenGLState() {
     glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
     glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
-    glEnable(GL_FRAMEBUFFER_SRGB);
-    glEnable(GL_DEPTH_TEST); // enable depth-testing
-    glDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
+    gps::GLStateCache& state = gps::GLStateCache::Get();
+    state.SetCapability(GL_FRAMEBUFFER_SRGB, true);
+    state.SetCapability(GL_DEPTH_TEST, true); // enable depth-testing
+    state.SetDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
     glCullFace(GL_BACK); // cull back face
     glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
-    glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    state.SetCapability(GL_BLEND, true);
+    state.SetBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+double millisecondsSinceStart() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+// bundle first, then the loose files in the background or right away
+void loadModel(gps::Model3D& model, const std::string& fileName) {
+    if (assetBundle.IsOpen() && model.LoadModel(assetBundle, fileName)) {
+        return;
+    }
+    if (asyncLoadingEnabled) {
+        model.LoadModel(assetLoader, fileName);
+    }
+    else {
+        model.LoadModel(fileName);
+    }
+}
+
+// Random position, orientation and size for every asteroid, the same belt on every run
+void createAsteroidBelt(unsigned int count) {
+    std::mt19937 random(19);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    asteroidTransforms.resize(count);
+    for (unsigned int i = 0; i < count; i++) {
+        float beltAngle = unit(random) * glm::radians(360.0f);
+        float radius = ASTEROID_BELT_RADIUS + (unit(random) - 0.5f) * ASTEROID_BELT_WIDTH;
+        float height = (unit(random) - 0.5f) * ASTEROID_BELT_HEIGHT;
+        glm::vec3 axis = glm::normalize(glm::vec3(unit(random), unit(random), unit(random)) + glm::vec3(0.1f));
+        float spin = unit(random) * glm::radians(360.0f);
+        float size = 0.2f + unit(random) * 0.8f;
+
+        glm::mat4 transform = glm::translate(glm::mat4(1.0f),
+            ASTEROID_BELT_CENTER + glm::vec3(std::cos(beltAngle) * radius, height, std::sin(beltAngle) * radius));
+        transform = glm::rotate(transform, spin, axis);
+        asteroidTransforms[i] = glm::scale(transform, glm::vec3(size));
+    }
 }
 
 void initModels() {
-    baseScene.LoadModel("models/base-scene/base_scene.obj");
-    ghost.LoadModel("models/ghost/ghost.obj");
+    if (!bundleFileName.empty() && !assetBundle.Open(bundleFileName)) {
+        std::cerr << "WARNING: could not open asset bundle " << bundleFileName << std::endl;
+    }
+    if (asyncLoadingEnabled) {
+        assetLoader.Start(loaderThreadCount);
+    }
+
+    loadModel(baseScene, "models/base-scene/base_scene.obj");
+    loadModel(ghost, "models/ghost/ghost.obj");
+    if (asteroidCount > 0) {
+        createAsteroidBelt(asteroidCount);
+        loadModel(asteroid, "models/asteroid/asteroid.obj");
+        asteroid.SetInstances(&asteroidTransforms[0], asteroidTransforms.size());
+    }
 }
 
+void updateLoading() {
+    if (assetsResident) {
+        return;
+    }
+
+    if (assetLoader.IsStarted()) {
+        assetLoader.ProcessUploads(uploadBudgetMs);
+        gps::TextureManager::Get().Update();
+    }
+    baseScene.Update();
+    ghost.Update();
+    asteroid.Update();
+
+    if (!baseScene.IsLoading() && !ghost.IsLoading() && !asteroid.IsLoading() && assetLoader.GetPendingCount() == 0) {
+        assetsResident = true;
+        std::cout << "Assets resident: " << millisecondsSinceStart() << " ms";
+        if (assetLoader.IsStarted()) {
+            std::cout << " (" << assetLoader.GetUploadCount() << " textures uploaded in " << assetLoader.GetUploadTime()
+                << " ms, at most " << assetLoader.GetMaxFrameUploadTime() << " ms per frame)";
+        }
+        std::cout << std::endl;
+        gps::TextureManager::Get().PrintStats();
+
+        // an empty belt would draw nothing and make the instancing numbers meaningless
+        if (asteroidCount > 0 && asteroid.GetMeshCount() == 0) {
+            std::cerr << "ERROR: no meshes in models/asteroid/asteroid.obj, the asteroid belt cannot be drawn" << std::endl;
+            glfwSetWindowShouldClose(myWindow.getWindow(), GL_TRUE);
+        }
+
+        if (textureArraysEnabled) {
+            gps::TextureManager::Get().PackTextureArrays(textureArrayResampleEnabled);
+            baseScene.UpdateTextureArrays();
+            ghost.UpdateTextureArrays();
+            asteroid.UpdateTextureArrays();
+        }
+    }
+}
+
+// Parts of basic.frag the current lights and fog need, every part when permutations are off
+uint32_t getShaderFeatures() {
+    if (!shaderPermutationsEnabled) {
+        return gps::SHADER_FEATURES_ALL;
+    }
+    uint32_t features = 0;
+    if (fogDensity > 0.0f) {
+        features |= gps::SHADER_FEATURE_FOG;
+    }
+    if (lampLightColor != glm::vec3(0.0f)) {
+        features |= gps::SHADER_FEATURE_LAMP;
+    }
+    if (purpleLampLightColor != glm::vec3(0.0f)) {
+        features |= gps::SHADER_FEATURE_PURPLE_LAMP;
+    }
+    return features;
+}
+
+// Submits every program start-up needs without waiting on any of them, finishShaders collects them once
+// the models and textures have been set going
 void initShaders() {
-    myBasicShader.loadShader(
+    bool parallelCompile = gps::Shader::enableParallelCompile();
+    basicShaders.Create(
         "shaders/basic.vert",
         "shaders/basic.frag");
-    skyboxShader.loadShader(
+    skyboxShader.beginLoad(
         "shaders/skyboxShader.vert",
-        "shaders/skyboxShader.frag");
+        "shaders/skyboxShader.frag",
+        "");
+
+    // the fallback, then what the first frame draws with; the driver threads can take every other variant
+    // in the background, without them a variant is only compiled once a state asks for it
+    basicShaders.Prefetch(gps::SHADER_FEATURES_ALL);
+    uint32_t features = getShaderFeatures();
+    basicShaders.Prefetch(features);
+    basicShaders.Prefetch(features | gps::SHADER_FEATURE_SPECULAR_MAP);
+    basicShaders.Prefetch(features | gps::SHADER_FEATURE_ALPHA);
+    basicShaders.Prefetch(features | gps::SHADER_FEATURE_ALPHA | gps::SHADER_FEATURE_SPECULAR_MAP);
+    if (parallelCompile && shaderPermutationsEnabled) {
+        for (uint32_t variant = 0; variant <= gps::SHADER_FEATURES_ALL; variant++) {
+            basicShaders.Prefetch(variant);
+        }
+    }
+
+    if (occlusionQueriesEnabled) {
+        occlusionQueries.Create("shaders/occlusionBox.vert", "shaders/occlusionBox.frag");
+        renderQueue.SetOcclusionQueries(&occlusionQueries);
+    }
+
+    basicShaders.BindUniformBlock("CameraBlock", gps::UNIFORM_BINDING_CAMERA);
+    basicShaders.BindUniformBlock("LightsBlock", gps::UNIFORM_BINDING_LIGHTS);
+    basicShaders.BindUniformBlock("ObjectBlock", gps::UNIFORM_BINDING_OBJECT);
+    basicShaders.BindUniformBlock("MaterialBlock", gps::UNIFORM_BINDING_MATERIALS);
+
+    // meshes point the samplers at their units when they draw, until then the array samplers must not share
+    // a unit with the 2D ones
+    basicShaders.SetSampler("diffuseTextureArray", gps::TEXTURE_ARRAY_UNIT + 1);
+    basicShaders.SetSampler("specularTextureArray", gps::TEXTURE_ARRAY_UNIT + 2);
 }
 
-void initUniforms() {
-    myBasicShader.useShaderProgram();
+// Waits for the skybox shader and the fallback variant, the first frame cannot draw without them. The other
+// variants stay in flight, Select substitutes the fallback until they are ready.
+void finishShaders() {
+    skyboxShader.finishLoad();
+    skyboxShader.bindUniformBlock("CameraBlock", gps::UNIFORM_BINDING_CAMERA);
+    skyboxShader.bindUniformBlock("LightsBlock", gps::UNIFORM_BINDING_LIGHTS);
+    skyboxShader.bindUniformBlock("ObjectBlock", gps::UNIFORM_BINDING_OBJECT);
+    skyboxShader.bindUniformBlock("MaterialBlock", gps::UNIFORM_BINDING_MATERIALS);
+    basicShaders.SetFallback(gps::SHADER_FEATURES_ALL);
+}
 
+void initUniforms() {
     // create model matrix for baseScene
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-    modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
 
     // get view matrix for current camera
     myCamera.rotate(pitch, yaw);
     view = myCamera.getViewMatrix();
-    viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-    // send view matrix to shader
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
 
     // compute normal matrix for baseScene
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
     // create projection matrix
     projection = glm::perspective(glm::radians(45.0f),
         (float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
         0.1f, 20.0f);
-    projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-    // send projection matrix to shader
-    glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
 
     //set the light direction (direction towards the light)
     lightDir = glm::vec3(0.0f, 1.0f, 1.0f);
-    lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-    // send light dir to shader
-    glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
 
     //set light color
     lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-    lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-    // send light color to shader
-    glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
-    //lamp 
-    lampLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lampLightColor");
-    lapmLightPositionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lampLightPosition");
+    // camera, lights and fog go to the shaders through the uniform buffers
+    cameraBuffer.Create(gps::UNIFORM_BINDING_CAMERA, sizeof(gps::CameraUniforms));
+    lightBuffer.Create(gps::UNIFORM_BINDING_LIGHTS, sizeof(gps::LightUniforms));
+    objectBuffer.Create(gps::UNIFORM_BINDING_OBJECT, sizeof(gps::ObjectUniforms), MAX_OBJECTS_PER_FRAME);
+    lightsChanged = true;
+    renderQueue.SetDepthRange(RENDER_DISTANCE);
 
-    glUniform3fv(lampLightColorLoc, 1, glm::value_ptr(lampLightColor));
-    glUniform3fv(lapmLightPositionLoc, 1, glm::value_ptr(lampLightPosition));
-
-    //purpel light
-    purpleLampLightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "purpleLampLightColor");
-    purpleLampLightPositionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "purpleLampLightPosition");
-
-    glUniform3fv(purpleLampLightColorLoc, 1, glm::value_ptr(purpleLampLightColor));
-    glUniform3fv(purpleLampLightPositionLoc, 1, glm::value_ptr(purpleLampLightPosition));
+    bool skyBoxFromBundle = assetBundle.IsOpen() && mySkyBox.Load(assetBundle, "models/skybox/nightsky");
+    if (!skyBoxFromBundle && asyncLoadingEnabled) {
+        mySkyBox.Load(assetLoader, faces);
+    }
+    else if (!skyBoxFromBundle) {
+        mySkyBox.Load(faces);
+    }
+    assetBundle.Close();
+}
 
-    // fog location uniform
-    fogDensityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "fogDensity");
-    glUniform1f(fogDensityLoc, fogDensity);
+void uploadFrameUniforms() {
+    gps::CameraUniforms camera;
+    camera.view = view;
+    camera.projection = projection;
+    cameraBuffer.Update(camera);
+
+    if (lightsChanged) {
+        gps::LightUniforms lights = {};
+        lights.lightDir = lightDir;
+        lights.lightColor = lightColor;
+        lights.lampLightPosition = lampLightPosition;
+        lights.lampLightColor = lampLightColor;
+        lights.purpleLampLightPosition = purpleLampLightPosition;
+        lights.purpleLampLightColor = purpleLampLightColor;
+        lights.fogDensity = fogDensity;
+        lightBuffer.Update(lights);
+        lightsChanged = false;
+    }
 
-    opacityLoc = glGetUniformLocation(myBasicShader.shaderProgram, "opacity");
-    glUniform1f(opacityLoc, opacity);
+    objectSlot = 0;
+}
 
-    mySkyBox.Load(faces);
-    skyboxShader.useShaderProgram();
-    glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "view"), 1, GL_FALSE, glm::value_ptr(view));
-    glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE, glm::value_ptr(projection));
-    glUniform1f(glGetUniformLocation(skyboxShader.shaderProgram, "ambientStrength"), 1.0f);
+// Writes the next object slot, returns it for the draw items of the object
+int uploadObjectUniforms() {
+    gps::ObjectUniforms object = {};
+    object.model = model;
+    object.normalMatrix = glm::mat4(normalMatrix);
+    object.opacity = opacity;
+    int slot = objectSlot % MAX_OBJECTS_PER_FRAME;
+    objectBuffer.Update(object, slot);
+    objectSlot++;
+    return slot;
 }
 
-void renderGhost(gps::Shader shader) {
+void renderGhost(uint32_t shaderFeatures) {
     ghoastAngle += 0.01f;
     glm::mat4 ghostModel(1);
     ghostModel = glm::translate(ghostModel, ghostCenterAnimation);
@@ -475,40 +657,117 @@ void renderGhost(gps::Shader shader) {
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f)) * ghostModel;
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
     opacity = 0.2f;
-    shader.useShaderProgram();
-    glUniform1f(opacityLoc, opacity);
-
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    ghost.Draw(shader);
+    int slot = uploadObjectUniforms();
+    ghost.Submit(renderQueue, gps::RENDER_PASS_TRANSPARENT, basicShaders, shaderFeatures | gps::SHADER_FEATURE_ALPHA, slot,
+        model, view, projection);
     opacity = 1.0;
-    shader.useShaderProgram();
-    glUniform1f(opacityLoc, opacity);
 }
 
-void renderBaseScene(gps::Shader shader) {
-    shader.useShaderProgram();
+void renderBaseScene(uint32_t shaderFeatures) {
     model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
     normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-    glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-    glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-    baseScene.Draw(shader);
+    int slot = uploadObjectUniforms();
+    baseScene.RasterizeOccluders(occlusionCuller, model);
+    baseScene.Submit(renderQueue, gps::RENDER_PASS_OPAQUE, basicShaders, shaderFeatures, slot, model, view, projection);
+}
+
+void renderAsteroids(const gps::Shader& shader) {
+    // the instances carry their own matrices, the object slot only gives the opacity
+    model = glm::mat4(1.0f);
+    normalMatrix = glm::mat3(view);
+    uploadObjectUniforms();
+    asteroid.DrawInstanced(shader);
+}
+
+// The same belt with one object slot upload and one draw per asteroid and mesh, the way renderGhost draws
+void renderAsteroidsSeparately(const gps::Shader& shader) {
+    for (size_t i = 0; i < asteroidTransforms.size(); i++) {
+        model = asteroidTransforms[i];
+        normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+        uploadObjectUniforms();
+        asteroid.Draw(shader);
+    }
 }
 
 void renderScene() {
-    myBasicShader.useShaderProgram();
     view = myCamera.getViewMatrix();
-    glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
+    uploadFrameUniforms();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-    renderBaseScene(myBasicShader);
-    renderGhost(myBasicShader);
 
-    skyboxShader.useShaderProgram();
-    glUniform1f(glGetUniformLocation(skyboxShader.shaderProgram, "ambientStrength"), 1.0f);
-    mySkyBox.Draw(skyboxShader, view, projection);
+    std::chrono::steady_clock::time_point submitStart = std::chrono::steady_clock::now();
+    renderQueue.Clear();
+    renderQueue.SetFrustum(myCamera.getFrustum(projection));
+    // filled by the models drawn first, the ghost is transparent and hides nothing
+    occlusionCuller.Begin(projection * view);
+    renderQueue.SetOcclusionCuller(occlusionCullingEnabled ? &occlusionCuller : NULL);
+    if (occlusionQueries.IsCreated()) {
+        occlusionQueries.BeginFrame();
+    }
+    uint32_t shaderFeatures = getShaderFeatures();
+    renderBaseScene(shaderFeatures);
+    renderGhost(shaderFeatures);
+    renderQueue.Sort();
+
+    // the sky fills what the opaque meshes left, transparent ones blend over both
+    renderQueue.Execute(gps::RENDER_PASS_OPAQUE, objectBuffer);
+    if (asteroidCount > 0) {
+        renderAsteroids(basicShaders.Select(shaderFeatures | gps::SHADER_FEATURE_SPECULAR_MAP));
+    }
+    // tested against the finished opaque depth, read back next frame
+    if (occlusionQueries.IsCreated()) {
+        occlusionQueries.IssueQueries(objectBuffer);
+    }
+    mySkyBox.Draw(skyboxShader);
+    renderQueue.Execute(gps::RENDER_PASS_TRANSPARENT, objectBuffer);
+    submitTimeMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitStart).count();
+}
+
+// Frame time of the belt drawn instanced against one draw per asteroid, seen from above its rim. Each
+// frame is finished with glFinish so the GPU time is counted, not just the submission. False if the
+// asteroid model could not be loaded.
+bool benchmarkInstancing(int frames) {
+    while (!assetsResident) {
+        updateLoading();
+        glfwPollEvents();
+    }
+    if (asteroid.GetMeshCount() == 0) {
+        return false;
+    }
+    view = glm::lookAt(ASTEROID_BELT_CENTER + glm::vec3(0.0f, 150.0f, -1.6f * ASTEROID_BELT_RADIUS),
+        ASTEROID_BELT_CENTER, glm::vec3(0.0f, 1.0f, 0.0f));
+    uploadFrameUniforms();
+    const gps::Shader& shader = basicShaders.Get(getShaderFeatures() | gps::SHADER_FEATURE_SPECULAR_MAP);
+
+    double frameTimes[2];
+    for (int instanced = 1; instanced >= 0; instanced--) {
+        double total = 0.0;
+        for (int frame = 0; frame < frames; frame++) {
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            objectSlot = 0;
+            if (instanced) {
+                renderAsteroids(shader);
+            }
+            else {
+                renderAsteroidsSeparately(shader);
+            }
+            glFinish();
+            total += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            glfwSwapBuffers(myWindow.getWindow());
+            glfwPollEvents();
+        }
+        frameTimes[instanced] = total / frames;
+    }
+    glCheckError();
+
+    std::cout << "Instancing     : " << asteroidTransforms.size() << " asteroids, " << frameTimes[1] << " ms per frame instanced, "
+        << frameTimes[0] << " ms with a draw each (" << frameTimes[0] / std::max(frameTimes[1], 1e-6) << "x)" << std::endl;
+    return true;
 }
 
 void cleanup() {
+    assetLoader.Stop();
+    occlusionQueries.Delete();
     myWindow.Delete();
     //cleanup code for your own data
 }
@@ -548,6 +807,144 @@ void presentationAnimation() {
 
 int main(int argc, const char* argv[]) {
 
+    startTime = std::chrono::steady_clock::now();
+
+    for (int i = 1; i < argc; i++) {
+        std::string option = argv[i];
+        if (option == "--no-mesh-cache") {
+            gps::Model3D::SetMeshCacheEnabled(false);
+        }
+        else if (option == "--no-mesh-optimizer") {
+            gps::Model3D::SetMeshOptimizerEnabled(false);
+        }
+        else if (option == "--compact-vertices") {
+            gps::Model3D::SetCompactVerticesEnabled(true);
+        }
+        else if (option == "--bundle" && i + 1 < argc) {
+            bundleFileName = argv[++i];
+        }
+        else if (option == "--no-compressed-textures") {
+            gps::TextureManager::SetCompressedTexturesEnabled(false);
+        }
+        else if (option == "--no-state-cache") {
+            gps::GLStateCache::SetEnabled(false);
+        }
+        else if (option == "--sync-loading") {
+            asyncLoadingEnabled = false;
+        }
+        else if (option == "--loader-threads" && i + 1 < argc) {
+            loaderThreadCount = (unsigned int)atoi(argv[++i]);
+        }
+        else if (option == "--upload-budget" && i + 1 < argc) {
+            uploadBudgetMs = atof(argv[++i]);
+        }
+        else if (option == "--no-mesh-lod") {
+            gps::Model3D::SetMeshLodEnabled(false);
+        }
+        else if (option == "--lod-hysteresis" && i + 1 < argc) {
+            gps::Model3D::SetLodHysteresis((float)atof(argv[++i]));
+        }
+        else if (option == "--no-frustum-culling") {
+            gps::Model3D::SetFrustumCullingEnabled(false);
+        }
+        else if (option == "--no-occlusion-culling") {
+            gps::Model3D::SetOcclusionCullingEnabled(false);
+            occlusionCullingEnabled = false;
+        }
+        else if (option == "--occlusion-queries") {
+            occlusionQueriesEnabled = true;
+        }
+        else if (option == "--asteroids" && i + 1 < argc) {
+            asteroidCount = (unsigned int)atoi(argv[++i]);
+        }
+        else if (option == "--bench-instancing") {
+            instancingBenchmarkFrames = 20;
+        }
+        else if (option == "--merged-geometry") {
+            gps::Model3D::SetMergedGeometryEnabled(true);
+        }
+        else if (option == "--no-indirect-draws") {
+            gps::Model3D::SetIndirectDrawsEnabled(false);
+        }
+        else if (option == "--no-program-binary-cache") {
+            gps::ProgramBinaryCache::SetEnabled(false);
+        }
+        else if (option == "--bench-program-binary-cache") {
+            programBinaryCacheBenchmark = true;
+        }
+        else if (option == "--no-shader-permutations") {
+            shaderPermutationsEnabled = false;
+        }
+        else if (option == "--texture-arrays") {
+            textureArraysEnabled = true;
+        }
+        else if (option == "--texture-array-resample") {
+            textureArraysEnabled = true;
+            textureArrayResampleEnabled = true;
+        }
+        else if (option == "--triangle-bvh") {
+            gps::Model3D::SetTriangleBvhEnabled(true);
+        }
+        else if (option == "--bench-mesh-lod") {
+            gps::MeshSimplifier::Benchmark("models/base-scene/base_scene.obj", 3);
+            gps::MeshSimplifier::Benchmark("models/ghost/ghost.obj", 3);
+            return EXIT_SUCCESS;
+        }
+        else if (option == "--check-mesh-lod") {
+            bool passed = gps::MeshSimplifier::Check("models/base-scene/base_scene.obj");
+            passed = gps::MeshSimplifier::Check("models/ghost/ghost.obj") && passed;
+            passed = gps::MeshSimplifier::Check("models/asteroid/asteroid.obj") && passed;
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (option == "--bench-mesh-cache") {
+            gps::Model3D::BenchmarkMeshCache("models/base-scene/base_scene.obj", 5);
+            gps::Model3D::BenchmarkMeshCache("models/ghost/ghost.obj", 5);
+            return EXIT_SUCCESS;
+        }
+        else if (option == "--bench-render-queue") {
+            gps::RenderQueue::Benchmark(10000, 20);
+            gps::RenderQueue::Benchmark(100000, 10);
+            gps::RenderQueue::Benchmark(1000000, 5);
+            return EXIT_SUCCESS;
+        }
+        else if (option == "--bench-bvh") {
+            gps::Bvh::Benchmark("models/base-scene/base_scene.obj", 3);
+            gps::Bvh::Benchmark("models/ghost/ghost.obj", 3);
+            return EXIT_SUCCESS;
+        }
+        else if (option == "--check-frustum-culling") {
+            bool passed = gps::Model3D::CheckFrustumCulling("models/base-scene/base_scene.obj", 50);
+            passed = gps::Model3D::CheckFrustumCulling("models/ghost/ghost.obj", 50) && passed;
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (option == "--bench-occlusion") {
+            gps::Model3D::BenchmarkOcclusionCulling("models/base-scene/base_scene.obj", 50, "occlusion_depth.pgm");
+            return EXIT_SUCCESS;
+        }
+        else if (option == "--check-occlusion-queries") {
+            // needs no display beyond what GLFW wants, e.g. LIBGL_ALWAYS_SOFTWARE=1 under xvfb-run
+            try {
+                myWindow.Create(128, 128, "Occlusion query check", false);
+            }
+            catch (const std::exception& e) {
+                std::cerr << e.what() << std::endl;
+                return EXIT_FAILURE;
+            }
+            bool passed = gps::OcclusionQueries::SelfTest("shaders/occlusionBox.vert", "shaders/occlusionBox.frag");
+            myWindow.Delete();
+            return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        else if (option == "--bench-obj-parser") {
+            gps::ObjParser::Benchmark("models/base-scene/base_scene.obj", 5);
+            gps::ObjParser::Benchmark("models/ghost/ghost.obj", 5);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    if (instancingBenchmarkFrames > 0 && asteroidCount == 0) {
+        asteroidCount = DEFAULT_ASTEROID_COUNT;
+    }
+
     try {
         initOpenGLWindow();
     }
@@ -557,17 +954,42 @@ int main(int argc, const char* argv[]) {
     }
 
     initOpenGLState();
-    initModels();
     initShaders();
+    initModels();
     initSkyBox();
     initUniforms();
+    finishShaders();
     setWindowCallbacks();
 
     glCheckError();
+    if (programBinaryCacheBenchmark) {
+        gps::ShaderPermutations::BenchmarkProgramBinaryCache("shaders/basic.vert", "shaders/basic.frag");
+        cleanup();
+        return EXIT_SUCCESS;
+    }
+    if (instancingBenchmarkFrames > 0) {
+        bool benchmarked = benchmarkInstancing(instancingBenchmarkFrames);
+        cleanup();
+        return benchmarked ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    if (asyncLoadingEnabled) {
+        std::cout << "Start-up       : " << millisecondsSinceStart() << " ms (background loading, "
+            << assetLoader.GetThreadCount() << " threads)" << std::endl;
+    }
+    else {
+        std::cout << "Start-up       : " << millisecondsSinceStart() << " ms (synchronous loading)" << std::endl;
+    }
+
+    // every uniform is resolved once when a shader variant is compiled, glGetUniformLocation only runs there
+    unsigned int loadUniformLookups = gps::Shader::getUniformLocationCalls();
+    unsigned int frameCount = 0;
+
     // application loop
     file = fopen("presentation.in", "r");
     mousePause = true;
+    bool firstFrame = true;
     while (!glfwWindowShouldClose(myWindow.getWindow())) {
+        updateLoading();
         processMovement();
         presentationAnimation();
         renderScene();
@@ -575,9 +997,51 @@ int main(int argc, const char* argv[]) {
         glfwPollEvents();
         glfwSwapBuffers(myWindow.getWindow());
 
+        gps::GLStateCache::Get().EndFrame();
+        if (firstFrame) {
+            std::cout << "First frame    : " << millisecondsSinceStart() << " ms" << std::endl;
+            firstFrame = false;
+        }
+
+        frameCount++;
         glCheckError();
     }
 
+    std::cout << "Uniform lookups: " << loadUniformLookups << " at load, "
+        << gps::Shader::getUniformLocationCalls() - loadUniformLookups << " in " << frameCount << " frames" << std::endl;
+    gps::ProgramBinaryStats programBinaries = gps::ProgramBinaryCache::GetStats();
+    std::cout << "Shader variants: " << basicShaders.GetVariantCount() << " in use, " << gps::Shader::getLoadTime()
+        << " ms loading every shader, " << programBinaries.loaded << " from the binary cache, " << programBinaries.compiled
+        << " compiled, " << programBinaries.rejected << " rejected, " << basicShaders.GetSubstitutionCount()
+        << " draws on the fallback while compiling" << std::endl;
+    std::cout << "Uniform buffers: " << gps::UniformBuffer::GetUploadCount() / std::max(frameCount, 1u) << " updates, "
+        << gps::UniformBuffer::GetUploadBytes() / std::max(frameCount, 1u) << " bytes per frame on average" << std::endl;
+    gps::GLStateStats frameState = gps::GLStateCache::Get().GetFrameStats();
+    gps::GLStateStats totalState = gps::GLStateCache::Get().GetTotalStats();
+    std::cout << "GL state calls : " << frameState.issued << " issued, " << frameState.elided << " elided last frame, "
+        << totalState.issued / std::max(frameCount, 1u) << " / " << totalState.elided / std::max(frameCount, 1u)
+        << " per frame on average" << std::endl;
+    std::cout << "Texture binds  : " << frameState.textureBinds << " last frame, "
+        << totalState.textureBinds / std::max(frameCount, 1u) << " per frame on average" << std::endl;
+    gps::CullStats frameCull = renderQueue.GetCullStats();
+    gps::CullStats totalCull = renderQueue.GetTotalCullStats();
+    std::cout << "Culling        : " << frameCull.visible << " visible, " << frameCull.culled << " outside the frustum, "
+        << frameCull.occluded << " occluded last frame, " << totalCull.visible / std::max(frameCount, 1u) << " / "
+        << totalCull.culled / std::max(frameCount, 1u) << " / " << totalCull.occluded / std::max(frameCount, 1u)
+        << " per frame on average" << std::endl;
+    std::cout << "Draw calls     : " << renderQueue.GetDrawCalls() << " last frame, "
+        << renderQueue.GetTotalDrawCalls() / std::max(frameCount, 1u) << " per frame on average, "
+        << submitTimeMs / std::max(frameCount, 1u) << " ms CPU submit per frame" << std::endl;
+    if (occlusionQueries.IsCreated()) {
+        gps::OcclusionQueryStats frameQueries = occlusionQueries.GetFrameStats();
+        gps::OcclusionQueryStats totalQueries = occlusionQueries.GetTotalStats();
+        unsigned int frames = std::max(frameCount, 1u);
+        std::cout << "GPU occlusion  : " << frameQueries.issued << " queries, " << frameQueries.available << " results, "
+            << frameQueries.skipped << " skipped, " << frameQueries.conditional << " conditional draws last frame, "
+            << totalQueries.issued / frames << " / " << totalQueries.available / frames << " / " << totalQueries.skipped / frames
+            << " / " << totalQueries.conditional / frames << " per frame on average" << std::endl;
+    }
+
     fclose(file);
     cleanup();
 
@@ -1,30 +1,58 @@
 #version 410 core
+//compiled with FOG, LAMP, PURPLE_LAMP, SPECULAR_MAP and ALPHA defined as needed, see ShaderPermutations
 
-in vec3 fPosition;
-in vec3 fNormal;
+in vec4 fPosEye;
+in vec3 fNormalEye;
 in vec2 fTexCoords;
+flat in uint fMaterialIndex;
 
 out vec4 fColor;
 
-//matrices
-uniform mat4 model;
-uniform mat4 view;
-uniform mat3 normalMatrix;
-//lighting
-uniform vec3 lightDir;
-uniform vec3 lightColor;
-//lamp
-uniform vec3 lampLightColor;
-uniform vec3 lampLightPosition;
+//matrices, shared with every shader and updated once per frame
+layout(std140) uniform CameraBlock
+{
+    mat4 view;
+    mat4 projection;
+};
+//lighting, lamps and fog
+layout(std140) uniform LightsBlock
+{
+    vec3 lightDir;
+    vec3 lightColor;
+    vec3 lampLightPosition;
+    vec3 lampLightColor;
+    vec3 purpleLampLightPosition;
+    vec3 purpleLampLightColor;
+    float fogDensity;
+};
+//per object matrices and transparency
+layout(std140) uniform ObjectBlock
+{
+    mat4 model;
+    mat4 normalMatrix;
+    float opacity;
+};
+//colors of every .mtl material in the scene, w is 1 where the texture is sampled instead of the color.
+//textureLayers holds the diffuse and specular layers when the textures were packed into arrays, else -1
+struct Material
+{
+    vec4 ambient;
+    vec4 diffuse;
+    vec4 specular;
+    vec4 textureLayers;
+};
+layout(std140) uniform MaterialBlock
+{
+    Material materials[256];
+};
 // textures
 uniform sampler2D diffuseTexture;
 uniform sampler2D specularTexture;
-//purple lamp
-uniform vec3 purpleLampLightColor;
-uniform vec3 purpleLampLightPosition;
-// transparency and fog
-uniform float fogDensity;
-uniform float opacity;
+uniform sampler2DArray diffuseTextureArray;
+uniform sampler2DArray specularTextureArray;
+// level of detail debug view
+uniform bool lodDebug;
+uniform vec3 lodColor;
 //components
 vec3 ambient;
 float ambientStrength = 0.2f;
@@ -32,16 +60,16 @@ vec3 diffuse;
 vec3 specular;
 float specularStrength = 0.5f;
 
-//components
-vec3 lampAmbient;
-vec3 lampDiffuse;
-vec3 lampSpecular;
+//components, black unless the lamp is compiled in
+vec3 lampAmbient = vec3(0.0f);
+vec3 lampDiffuse = vec3(0.0f);
+vec3 lampSpecular = vec3(0.0f);
 float lampSpecularStrength = 0.5;
 
 //components
-vec3 purpleLampAmbient;
-vec3 purpleLampDiffuse;
-vec3 purpleLampSpecular;
+vec3 purpleLampAmbient = vec3(0.0f);
+vec3 purpleLampDiffuse = vec3(0.0f);
+vec3 purpleLampSpecular = vec3(0.0f);
 float purpleLampSpecularStrength = 0.2;
 
 //constants for computing light
@@ -53,9 +81,8 @@ vec4 fogColor = vec4(0.5, 0.5, 0.5, 1);
 
 void computeDirLight()
 {
-    //compute eye space coordinates
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
-    vec3 normalEye = normalize(normalMatrix * fNormal);
+    //eye space coordinates come from the vertex shader
+    vec3 normalEye = normalize(fNormalEye);
 
     //normalize light direction
     vec3 lightDirN = vec3(normalize(view * vec4(lightDir, 0.0f)));
@@ -75,12 +102,14 @@ void computeDirLight()
     specular = specularStrength * specCoeff * lightColor;
 }
 
+//the lamps are placed in world space, the math is done in eye space like the directional light so the
+//model matrix (per object or per instance) is already applied to the fragment position
 void computePointLight() {
-    vec3 normalEye = normalize(normalMatrix * fNormal);	
-    vec3 lightDirN = normalize(lampLightPosition - fPosition.xyz);    
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
+    vec3 normalEye = normalize(fNormalEye);
+    vec3 lightPosEye = vec3(view * vec4(lampLightPosition, 1.0f));
+    vec3 lightDirN = normalize(lightPosEye - fPosEye.xyz);
 
-    float distanceToLight = length(lampLightPosition - fPosition.xyz);
+    float distanceToLight = length(lightPosEye - fPosEye.xyz);
     vec3 viewDir = normalize (-fPosEye.xyz);
 
     float atenuation = cnst + linear * distanceToLight + quad * distanceToLight * distanceToLight;
@@ -94,11 +123,11 @@ void computePointLight() {
 }
 
 void computePurplePointLight() {
-    vec3 normalEye = normalize(normalMatrix * fNormal);	
-    vec3 lightDirN = normalize(purpleLampLightPosition - fPosition.xyz);    
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
+    vec3 normalEye = normalize(fNormalEye);
+    vec3 lightPosEye = vec3(view * vec4(purpleLampLightPosition, 1.0f));
+    vec3 lightDirN = normalize(lightPosEye - fPosEye.xyz);
 
-    float distanceToLight = length(purpleLampLightPosition - fPosition.xyz);
+    float distanceToLight = length(lightPosEye - fPosEye.xyz);
     vec3 viewDir = normalize (-fPosEye.xyz);
 
     float atenuation = cnst + linear * distanceToLight + quad * distanceToLight * distanceToLight;
@@ -112,7 +141,6 @@ void computePurplePointLight() {
 }
 
 float computeFog(){
-    vec4 fPosEye = view * model * vec4(fPosition, 1.0f);
     float dist = length(fPosEye);
     float fogFactor = exp(-pow(dist * fogDensity, 2));
     return clamp(fogFactor, 0.0f, 1.0f);
@@ -120,12 +148,39 @@ float computeFog(){
 
 void main() {
     computeDirLight();
+#ifdef LAMP
     computePointLight();
+#endif
+#ifdef PURPLE_LAMP
 	computePurplePointLight();
-	float fogFactor = computeFog();
+#endif
+    //surface colors, from the textures or the material when it has none
+    Material material = materials[fMaterialIndex];
+    vec3 diffuseColor = material.diffuse.rgb;
+    if (material.diffuse.w > 0.0f) {
+        diffuseColor = material.textureLayers.x >= 0.0f ? texture(diffuseTextureArray, vec3(fTexCoords, material.textureLayers.x)).rgb
+            : texture(diffuseTexture, fTexCoords).rgb;
+    }
+    vec3 ambientColor = material.diffuse.w > 0.0f ? diffuseColor : material.ambient.rgb;
+    vec3 specularColor = material.specular.rgb;
+#ifdef SPECULAR_MAP
+    if (material.specular.w > 0.0f) {
+        specularColor = material.textureLayers.y >= 0.0f ? texture(specularTextureArray, vec3(fTexCoords, material.textureLayers.y)).rgb
+            : texture(specularTexture, fTexCoords).rgb;
+    }
+#endif
     //compute final vertex color
-    vec3 color = min((ambient + diffuse + lampAmbient + lampDiffuse + purpleLampAmbient + purpleLampDiffuse) * texture(diffuseTexture, fTexCoords).rgb + (lampSpecular + specular + purpleLampSpecular) * texture(specularTexture, fTexCoords).rgb, 1.0f);
+    vec3 color = min((ambient + lampAmbient + purpleLampAmbient) * ambientColor + (diffuse + lampDiffuse + purpleLampDiffuse) * diffuseColor + (lampSpecular + specular + purpleLampSpecular) * specularColor, 1.0f);
+    if (lodDebug) {
+        color = mix(color, lodColor, 0.6f);
+    }
     fColor = vec4(color, 1.0f);
-	fColor = mix(fogColor, fColor, fogFactor);
+#ifdef FOG
+	fColor = mix(fogColor, fColor, computeFog());
+#endif
+#ifdef ALPHA
 	fColor.w = opacity;
+#else
+	fColor.w = 1.0f;
+#endif
 }
@@ -3,19 +3,58 @@
 layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
+// per instance, only read when instanced is set
+layout(location=3) in mat4 instanceModel;
+layout(location=7) in mat3 instanceNormalMatrix;
+// entry of the MaterialBlock, per draw
+layout(location=10) in uint vMaterialIndex;
 
-out vec3 fPosition;
-out vec3 fNormal;
+out vec4 fPosEye;
+out vec3 fNormalEye;
 out vec2 fTexCoords;
+flat out uint fMaterialIndex;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+layout(std140) uniform CameraBlock
+{
+	mat4 view;
+	mat4 projection;
+};
+
+layout(std140) uniform ObjectBlock
+{
+	mat4 model;
+	mat4 normalMatrix;
+	float opacity;
+};
+
+// compact vertex format, identity for float vertices
+uniform vec3 positionOffset;
+uniform vec3 positionScale;
+uniform bool octahedralNormals;
+// the matrices come from the instance attributes instead of the ObjectBlock
+uniform bool instanced;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	if (n.z < 0.0f) {
+		n.xy = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return normalize(n);
+}
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
+	vec3 position = positionOffset + vPosition * positionScale;
+	vec3 normal = octahedralNormals ? decodeOctahedral(vNormal.xy) : vNormal;
+
+	// the instance normal matrix is in world space, the view only rotates so its 3x3 carries it to eye space
+	mat4 modelMatrix = instanced ? instanceModel : model;
+	mat3 normalEye = instanced ? mat3(view) * instanceNormalMatrix : mat3(normalMatrix);
+
+	fPosEye = view * modelMatrix * vec4(position, 1.0f);
+	gl_Position = projection * fPosEye;
+	fNormalEye = normalEye * normal;
 	fTexCoords = vTexCoords;
+	fMaterialIndex = vMaterialIndex;
 }
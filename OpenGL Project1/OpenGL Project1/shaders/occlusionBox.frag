@@ -0,0 +1,6 @@
+#version 410 core
+
+// only depth is tested, color writes are off while the boxes are drawn
+void main()
+{
+}
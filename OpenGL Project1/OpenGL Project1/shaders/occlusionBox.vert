@@ -0,0 +1,25 @@
+#version 410 core
+
+layout(location=0) in vec3 vPosition;
+
+layout(std140) uniform CameraBlock
+{
+	mat4 view;
+	mat4 projection;
+};
+
+layout(std140) uniform ObjectBlock
+{
+	mat4 model;
+	mat4 normalMatrix;
+	float opacity;
+};
+
+// the unit cube stretched over a mesh's bounding box
+uniform vec3 boxMin;
+uniform vec3 boxSize;
+
+void main()
+{
+	gl_Position = projection * view * model * vec4(boxMin + vPosition * boxSize, 1.0f);
+}
@@ -4,13 +4,16 @@ layout (location = 0) in vec3 vertexPosition;
 
 out vec3 textureCoordinates;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+layout(std140) uniform CameraBlock
+{
+    mat4 view;
+    mat4 projection;
+};
 
 void main()
 {
-    vec4 tempPos = projection * view * vec4(vertexPosition, 1.0);
+    // rotation only, the sky stays around the camera
+    vec4 tempPos = projection * mat4(mat3(view)) * vec4(vertexPosition, 1.0);
     gl_Position = tempPos.xyww;
     textureCoordinates = vertexPosition;
 }
\ No newline at end of file